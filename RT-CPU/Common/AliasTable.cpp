@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "AliasTable.h"
+
+using namespace std;
+
+AliasTable::AliasTable()
+{
+}
+
+AliasTable::~AliasTable()
+{
+}
+
+bool AliasTable::Init(const float* pWeights, uint32_t count)
+{
+    auto sum = 0.0;
+    for (auto i = 0u; i < count; ++i) sum += pWeights[i];
+    if (!(sum > 0.0)) return false;
+
+    // Buckets scaled to an average of 1, split into those under and over it
+    m_entries.resize(count);
+    vector<double> scaled(count);
+    vector<uint32_t> small, large;
+    small.reserve(count);
+    large.reserve(count);
+    for (auto i = 0u; i < count; ++i)
+    {
+        m_entries[i].Probability = static_cast<float>(pWeights[i] / sum);
+        m_entries[i].Alias = i;
+        scaled[i] = pWeights[i] / sum * count;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    // Each small bucket is topped up by a large one, which may then become small
+    while (!small.empty() && !large.empty())
+    {
+        const auto s = small.back();
+        const auto l = large.back();
+        small.pop_back();
+        m_entries[s].Threshold = static_cast<float>(scaled[s]);
+        m_entries[s].Alias = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // What is left is 1 up to rounding
+    for (const auto i : small) m_entries[i].Threshold = 1.0f;
+    for (const auto i : large) m_entries[i].Threshold = 1.0f;
+
+    return true;
+}
+
+void AliasTable::Init(const Entry* pEntries, uint32_t count)
+{
+    m_entries.assign(pEntries, pEntries + count);
+}
+
+uint32_t AliasTable::Sample(float u, float& v) const
+{
+    const auto count = static_cast<uint32_t>(m_entries.size());
+    const auto i = (min)(static_cast<uint32_t>(u * count), count - 1);
+    const auto& entry = m_entries[i];
+    if (v < entry.Threshold)
+    {
+        v = (min)(v / entry.Threshold, 0.99999994f);
+
+        return i;
+    }
+
+    v = (min)((v - entry.Threshold) / (1.0f - entry.Threshold), 0.99999994f);
+
+    return entry.Alias;
+}
+
+float AliasTable::GetProbability(uint32_t i) const
+{
+    return m_entries[i].Probability;
+}
+
+const AliasTable::Entry* AliasTable::GetEntries() const
+{
+    return m_entries.data();
+}
+
+uint32_t AliasTable::GetCount() const
+{
+    return static_cast<uint32_t>(m_entries.size());
+}
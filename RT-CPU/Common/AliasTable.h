@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Discrete distribution sampled in O(1) by Walker's alias method: a bucket is picked
+// uniformly, then a coin chooses between it and its alias. Built by Vose's method.
+class AliasTable
+{
+public:
+    struct Entry
+    {
+        float       Threshold;      // Chance to keep the bucket rather than its alias
+        uint32_t    Alias;
+        float       Probability;    // Of the bucket itself, for the PDFs
+    };
+
+    AliasTable();
+    virtual ~AliasTable();
+
+    // Weights are non-negative, not all 0
+    bool Init(const float* pWeights, uint32_t count);
+    void Init(const Entry* pEntries, uint32_t count);
+
+    // u picks the bucket and v flips its coin; v is then rescaled to [0, 1) for reuse
+    uint32_t Sample(float u, float& v) const;
+    float GetProbability(uint32_t i) const;
+
+    const Entry* GetEntries() const;
+    uint32_t GetCount() const;
+
+protected:
+    std::vector<Entry> m_entries;
+};
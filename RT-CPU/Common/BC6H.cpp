@@ -0,0 +1,677 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "BC6H.h"
+#include "PackedColor.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Endpoint fields of the block headers: W and X are the endpoints of region 0,
+// and Y and Z those of region 1; D is the partition
+enum Field : uint8_t
+{
+    RW, RX, RY, RZ,
+    GW, GX, GY, GZ,
+    BW, BX, BY, BZ,
+    D,
+
+    NUM_FIELD
+};
+
+// Bits From to To of a field, in the order they are stored
+struct BitRun
+{
+    uint8_t Field;
+    uint8_t From;
+    uint8_t To;
+};
+
+struct ModeInfo
+{
+    uint8_t NumRegions;
+    bool    IsTransformed;  // Endpoints past the first as deltas from it
+    uint8_t EndpointBits;
+    uint8_t DeltaBits[3];
+    BitRun  Runs[24];
+};
+
+static const ModeInfo g_modes[] =
+{
+    { 2, true, 10, { 5, 5, 5 },
+    {
+        { GY, 4, 4 }, { BY, 4, 4 }, { BZ, 4, 4 }, { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 4 }, { GZ, 4, 4 },
+        { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 },
+        { BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 7, { 6, 6, 6 },
+    {
+        { GY, 5, 5 }, { GZ, 4, 5 }, { RW, 0, 6 }, { BZ, 0, 1 }, { BY, 4, 4 }, { GW, 0, 6 }, { BY, 5, 5 }, { BZ, 2, 2 },
+        { GY, 4, 4 }, { BW, 0, 6 }, { BZ, 3, 3 }, { BZ, 5, 5 }, { BZ, 4, 4 }, { RX, 0, 5 }, { GY, 0, 3 }, { GX, 0, 5 },
+        { GZ, 0, 3 }, { BX, 0, 5 }, { BY, 0, 3 }, { RY, 0, 5 }, { RZ, 0, 5 }, { D, 0, 4 }
+    } },
+    { 2, true, 11, { 5, 4, 4 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 4 }, { RW, 10, 10 }, { GY, 0, 3 }, { GX, 0, 3 }, { GW, 10, 10 },
+        { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 3 }, { BW, 10, 10 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 },
+        { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 11, { 4, 5, 4 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 10, 10 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 4 },
+        { GW, 10, 10 }, { GZ, 0, 3 }, { BX, 0, 3 }, { BW, 10, 10 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 3 }, { BZ, 0, 0 },
+        { BZ, 2, 2 }, { RZ, 0, 3 }, { GY, 4, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 11, { 4, 4, 5 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 10, 10 }, { BY, 4, 4 }, { GY, 0, 3 }, { GX, 0, 3 },
+        { GW, 10, 10 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BW, 10, 10 }, { BY, 0, 3 }, { RY, 0, 3 }, { BZ, 1, 2 },
+        { RZ, 0, 3 }, { BZ, 4, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 9, { 5, 5, 5 },
+    {
+        { RW, 0, 8 }, { BY, 4, 4 }, { GW, 0, 8 }, { GY, 4, 4 }, { BW, 0, 8 }, { BZ, 4, 4 }, { RX, 0, 4 }, { GZ, 4, 4 },
+        { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 }, { RY, 0, 4 },
+        { BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 8, { 6, 5, 5 },
+    {
+        { RW, 0, 7 }, { GZ, 4, 4 }, { BY, 4, 4 }, { GW, 0, 7 }, { BZ, 2, 2 }, { GY, 4, 4 }, { BW, 0, 7 }, { BZ, 3, 4 },
+        { RX, 0, 5 }, { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 }, { BY, 0, 3 },
+        { RY, 0, 5 }, { RZ, 0, 5 }, { D, 0, 4 }
+    } },
+    { 2, true, 8, { 5, 6, 5 },
+    {
+        { RW, 0, 7 }, { BZ, 0, 0 }, { BY, 4, 4 }, { GW, 0, 7 }, { GY, 5, 5 }, { GY, 4, 4 }, { BW, 0, 7 }, { GZ, 5, 5 },
+        { BZ, 4, 4 }, { RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 5 }, { GZ, 0, 3 }, { BX, 0, 4 }, { BZ, 1, 1 },
+        { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, true, 8, { 5, 5, 6 },
+    {
+        { RW, 0, 7 }, { BZ, 1, 1 }, { BY, 4, 4 }, { GW, 0, 7 }, { BY, 5, 5 }, { GY, 4, 4 }, { BW, 0, 7 }, { BZ, 5, 5 },
+        { BZ, 4, 4 }, { RX, 0, 4 }, { GZ, 4, 4 }, { GY, 0, 3 }, { GX, 0, 4 }, { BZ, 0, 0 }, { GZ, 0, 3 }, { BX, 0, 5 },
+        { BY, 0, 3 }, { RY, 0, 4 }, { BZ, 2, 2 }, { RZ, 0, 4 }, { BZ, 3, 3 }, { D, 0, 4 }
+    } },
+    { 2, false, 6, { 6, 6, 6 },
+    {
+        { RW, 0, 5 }, { GZ, 4, 4 }, { BZ, 0, 1 }, { BY, 4, 4 }, { GW, 0, 5 }, { GY, 5, 5 }, { BY, 5, 5 }, { BZ, 2, 2 },
+        { GY, 4, 4 }, { BW, 0, 5 }, { GZ, 5, 5 }, { BZ, 3, 3 }, { BZ, 5, 5 }, { BZ, 4, 4 }, { RX, 0, 5 }, { GY, 0, 3 },
+        { GX, 0, 5 }, { GZ, 0, 3 }, { BX, 0, 5 }, { BY, 0, 3 }, { RY, 0, 5 }, { RZ, 0, 5 }, { D, 0, 4 }
+    } },
+    { 1, false, 10, { 10, 10, 10 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 9 }, { GX, 0, 9 }, { BX, 0, 9 }
+    } },
+    { 1, true, 11, { 9, 9, 9 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 8 }, { RW, 10, 10 }, { GX, 0, 8 }, { GW, 10, 10 },
+        { BX, 0, 8 }, { BW, 10, 10 }
+    } },
+    { 1, true, 12, { 8, 8, 8 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 7 }, { RW, 11, 10 }, { GX, 0, 7 }, { GW, 11, 10 },
+        { BX, 0, 7 }, { BW, 11, 10 }
+    } },
+    { 1, true, 16, { 4, 4, 4 },
+    {
+        { RW, 0, 9 }, { GW, 0, 9 }, { BW, 0, 9 }, { RX, 0, 3 }, { RW, 15, 10 }, { GX, 0, 3 }, { GW, 15, 10 },
+        { BX, 0, 3 }, { BW, 15, 10 }
+    } }
+};
+
+// The first 32 two-subset partitions of BC7, one bit per texel for the region
+static const uint16_t g_partitions[] =
+{
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c
+};
+
+// Texels of region 1 whose index drops its implicit top bit
+static const uint8_t g_anchors[] =
+{
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15,
+    2, 8, 2, 2, 8, 8, 2, 2
+};
+
+static const int g_weights3[] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const int g_weights4[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static uint32_t readBits(const uint8_t* pBlock, uint32_t& pos, uint32_t numBits)
+{
+    auto bits = 0u;
+    for (auto i = 0u; i < numBits; ++i, ++pos)
+        bits |= ((pBlock[pos >> 3] >> (pos & 7)) & 1u) << i;
+
+    return bits;
+}
+
+static void writeBits(uint8_t* pBlock, uint32_t& pos, uint32_t bits, uint32_t numBits)
+{
+    for (auto i = 0u; i < numBits; ++i, ++pos)
+        pBlock[pos >> 3] |= ((bits >> i) & 1u) << (pos & 7);
+}
+
+static int signExtend(int value, uint32_t numBits)
+{
+    const auto signBit = 1 << (numBits - 1);
+
+    return (value & (signBit - 1)) - (value & signBit);
+}
+
+static int unquantize(int value, uint32_t numBits, bool isSigned)
+{
+    if (!isSigned)
+    {
+        if (numBits >= 15 || value == 0) return value;
+        if (value == (1 << numBits) - 1) return 0xffff;
+
+        return ((value << 16) + 0x8000) >> numBits;
+    }
+
+    if (numBits >= 16) return value;
+
+    const auto magnitude = abs(value);
+    auto result = 0;
+    if (magnitude >= (1 << (numBits - 1)) - 1) result = 0x7fff;
+    else if (magnitude) result = ((magnitude << 15) + 0x4000) >> (numBits - 1);
+
+    return value < 0 ? -result : result;
+}
+
+// Scales the interpolated value to the half range, keeping the sign for SF16
+static float finishUnquantize(int value, bool isSigned)
+{
+    if (!isSigned) return HalfToFloat(static_cast<uint16_t>((value * 31) >> 6));
+
+    const auto half = value < 0 ? 0x8000 | ((-value * 31) >> 5) : (value * 31) >> 5;
+
+    return HalfToFloat(static_cast<uint16_t>(half));
+}
+
+void DecodeBC6H(const uint8_t* pBlock, float3* pTexels, bool isSigned)
+{
+    // 2-bit modes 0 and 1, then the 5-bit ones with the low bits 10 or 11
+    uint32_t pos = 0;
+    auto modeIdx = readBits(pBlock, pos, 2);
+    if (modeIdx > 1)
+    {
+        const auto mode = modeIdx | (readBits(pBlock, pos, 3) << 2);
+        modeIdx = (mode >> 2) + ((mode & 1) ? 10 : 2);
+    }
+
+    if (modeIdx >= size(g_modes))
+    {
+        fill(pTexels, pTexels + 16, 0.0f);
+
+        return;
+    }
+
+    const auto& info = g_modes[modeIdx];
+    const auto headerBits = info.NumRegions > 1 ? 82u : 65u;
+    int fields[NUM_FIELD] = {};
+    for (auto run = info.Runs; pos < headerBits; ++run)
+    {
+        const auto step = run->From <= run->To ? 1 : -1;
+        for (int bit = run->From; ; bit += step)
+        {
+            fields[run->Field] |= readBits(pBlock, pos, 1) << bit;
+            if (bit == run->To) break;
+        }
+    }
+
+    // Endpoints W, X, Y and Z as integers of the endpoint precision
+    const auto numEndpoints = info.NumRegions * 2u;
+    const auto wrapMask = (1 << info.EndpointBits) - 1;
+    int endpoints[4][3];
+    for (auto c = 0u; c < 3; ++c)
+    {
+        auto& first = endpoints[0][c];
+        first = fields[4 * c];
+        if (isSigned) first = signExtend(first, info.EndpointBits);
+
+        for (auto e = 1u; e < numEndpoints; ++e)
+        {
+            auto& endpoint = endpoints[e][c];
+            endpoint = fields[4 * c + e];
+            if (isSigned || info.IsTransformed) endpoint = signExtend(endpoint, info.DeltaBits[c]);
+            if (info.IsTransformed)
+            {
+                endpoint = (endpoint + first) & wrapMask;
+                if (isSigned) endpoint = signExtend(endpoint, info.EndpointBits);
+            }
+        }
+
+        for (auto e = 0u; e < numEndpoints; ++e)
+            endpoints[e][c] = unquantize(endpoints[e][c], info.EndpointBits, isSigned);
+    }
+
+    // Indices, with the top bit of the anchors implicitly 0
+    const auto partition = info.NumRegions > 1 ? g_partitions[fields[D]] : 0;
+    const auto anchor = info.NumRegions > 1 ? g_anchors[fields[D]] : 0u;
+    const auto indexBits = info.NumRegions > 1 ? 3u : 4u;
+    const auto pWeights = info.NumRegions > 1 ? g_weights3 : g_weights4;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        const auto isAnchor = i == 0 || (info.NumRegions > 1 && i == anchor);
+        const auto weight = pWeights[readBits(pBlock, pos, isAnchor ? indexBits - 1 : indexBits)];
+        const auto region = (partition >> i) & 1;
+        const auto& e0 = endpoints[2 * region];
+        const auto& e1 = endpoints[2 * region + 1];
+
+        auto& texel = pTexels[i];
+        for (auto c = 0u; c < 3; ++c)
+            texel[c] = finishUnquantize((e0[c] * (64 - weight) + e1[c] * weight + 32) >> 6, isSigned);
+    }
+}
+
+void DecodeBC6H(const uint8_t* pBlocks, uint32_t rowPitch, uint32_t width, uint32_t height,
+    bool isSigned, float3* pImage)
+{
+    const auto numBlocksX = DIV_UP(width, 4);
+    ThreadPool::GetDefault().ParallelFor(DIV_UP(height, 4), 4, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        float3 texels[16];
+        for (auto by = begin; by < end; ++by)
+        {
+            for (auto bx = 0u; bx < numBlocksX; ++bx)
+            {
+                DecodeBC6H(pBlocks + static_cast<size_t>(rowPitch) * by + 16 * bx, texels, isSigned);
+
+                // Clip the blocks past the edges of the image
+                for (auto y = 0u; y < 4 && 4 * by + y < height; ++y)
+                    for (auto x = 0u; x < 4 && 4 * bx + x < width; ++x)
+                        pImage[static_cast<size_t>(width) * (4 * by + y) + 4 * bx + x] = texels[4 * y + x];
+            }
+        }
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Encoder
+//--------------------------------------------------------------------------------------
+
+// Texels in the 16-bit domain of the unquantized endpoints, where v * 31 >> 6 is the half,
+// as 3 channels of 16 texels
+struct EncodeBlock
+{
+    alignas(32) float Channels[3][16];
+};
+
+// Endpoints W, X of region 0 and Y, Z of region 1
+using Endpoints = float[4][3];
+
+// Interpolated colors of each region, in the same domain
+using Palettes = float[2][16][3];
+
+// Nearest palette entries of the texels and the total squared error
+static float assignIndices(const EncodeBlock& block, const Palettes& palettes, uint16_t partition,
+    uint32_t numIndices, uint8_t indices[16])
+{
+    auto error = 0.0f;
+#if defined(__AVX2__)
+    const auto bitMasks = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (auto half = 0u; half < 2; ++half)
+    {
+        __m256 channels[3];
+        for (auto c = 0u; c < 3; ++c) channels[c] = _mm256_load_ps(&block.Channels[c][8 * half]);
+        const auto regionBits = _mm256_and_si256(_mm256_set1_epi32(partition >> (8 * half)), bitMasks);
+        const auto isRegion1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(regionBits, bitMasks));
+
+        auto bestError = _mm256_set1_ps(FLT_MAX);
+        auto bestIndex = _mm256_setzero_ps();
+        for (auto k = 0u; k < numIndices; ++k)
+        {
+            auto texelError = _mm256_setzero_ps();
+            for (auto c = 0u; c < 3; ++c)
+            {
+                const auto color = _mm256_blendv_ps(_mm256_set1_ps(palettes[0][k][c]),
+                    _mm256_set1_ps(palettes[1][k][c]), isRegion1);
+                const auto diff = _mm256_sub_ps(channels[c], color);
+                texelError = _mm256_fmadd_ps(diff, diff, texelError);
+            }
+            const auto isBetter = _mm256_cmp_ps(texelError, bestError, _CMP_LT_OQ);
+            bestError = _mm256_min_ps(texelError, bestError);
+            bestIndex = _mm256_blendv_ps(bestIndex, _mm256_castsi256_ps(_mm256_set1_epi32(k)), isBetter);
+        }
+
+        alignas(32) float errors[8];
+        alignas(32) uint32_t bestIndices[8];
+        _mm256_store_ps(errors, bestError);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bestIndices), _mm256_castps_si256(bestIndex));
+        for (auto i = 0u; i < 8; ++i)
+        {
+            indices[8 * half + i] = static_cast<uint8_t>(bestIndices[i]);
+            error += errors[i];
+        }
+    }
+#else
+    for (auto i = 0u; i < 16; ++i)
+    {
+        const auto& palette = palettes[(partition >> i) & 1];
+        auto bestError = FLT_MAX;
+        for (auto k = 0u; k < numIndices; ++k)
+        {
+            auto texelError = 0.0f;
+            for (auto c = 0u; c < 3; ++c)
+            {
+                const auto diff = block.Channels[c][i] - palette[k][c];
+                texelError += diff * diff;
+            }
+            if (texelError < bestError)
+            {
+                bestError = texelError;
+                indices[i] = static_cast<uint8_t>(k);
+            }
+        }
+        error += bestError;
+    }
+#endif
+
+    return error;
+}
+
+// Line through the texels of a region along their principal axis, clipped to their extent
+static void fitEndpoints(const EncodeBlock& block, uint16_t partition, uint32_t region, float* pE0, float* pE1)
+{
+    float mean[3] = {};
+    auto count = 0u;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        if (((partition >> i) & 1) != region) continue;
+        for (auto c = 0u; c < 3; ++c) mean[c] += block.Channels[c][i];
+        ++count;
+    }
+    for (auto& m : mean) m /= count;
+
+    float covariance[6] = {};
+    for (auto i = 0u; i < 16; ++i)
+    {
+        if (((partition >> i) & 1) != region) continue;
+        const float d[] = { block.Channels[0][i] - mean[0], block.Channels[1][i] - mean[1], block.Channels[2][i] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // Power iterations from the diagonal
+    float axis[] = { 1.0f, 1.0f, 1.0f };
+    for (auto iter = 0u; iter < 4; ++iter)
+    {
+        const float next[] =
+        {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        const auto norm = (max)((max)(fabs(next[0]), fabs(next[1])), fabs(next[2]));
+        if (norm <= 0.0f) break;
+        for (auto c = 0u; c < 3; ++c) axis[c] = next[c] / norm;
+    }
+    const auto lengthSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    auto tMin = FLT_MAX, tMax = -FLT_MAX;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        if (((partition >> i) & 1) != region) continue;
+        auto t = 0.0f;
+        for (auto c = 0u; c < 3; ++c) t += (block.Channels[c][i] - mean[c]) * axis[c];
+        tMin = (min)(tMin, t);
+        tMax = (max)(tMax, t);
+    }
+
+    for (auto c = 0u; c < 3; ++c)
+    {
+        pE0[c] = (min)((max)(mean[c] + axis[c] * tMin / lengthSq, 0.0f), 65535.0f);
+        pE1[c] = (min)((max)(mean[c] + axis[c] * tMax / lengthSq, 0.0f), 65535.0f);
+    }
+}
+
+// Least-squares endpoints of each region for the weights of the indices
+static void refineEndpoints(const EncodeBlock& block, uint16_t partition, uint32_t numRegions,
+    const uint8_t indices[16], const int* pWeights, Endpoints& endpoints)
+{
+    for (auto r = 0u; r < numRegions; ++r)
+    {
+        auto aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ap[3] = {}, bp[3] = {};
+        for (auto i = 0u; i < 16; ++i)
+        {
+            if (((partition >> i) & 1) != r) continue;
+            const auto b = pWeights[indices[i]] / 64.0f;
+            const auto a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (auto c = 0u; c < 3; ++c)
+            {
+                ap[c] += a * block.Channels[c][i];
+                bp[c] += b * block.Channels[c][i];
+            }
+        }
+
+        const auto det = aa * bb - ab * ab;
+        if (fabs(det) < 1e-6f) continue;
+        for (auto c = 0u; c < 3; ++c)
+        {
+            endpoints[2 * r][c] = (min)((max)((ap[c] * bb - bp[c] * ab) / det, 0.0f), 65535.0f);
+            endpoints[2 * r + 1][c] = (min)((max)((bp[c] * aa - ap[c] * ab) / det, 0.0f), 65535.0f);
+        }
+    }
+}
+
+// Squared error of the endpoints in a mode, written to pBlock; FLT_MAX if the deltas do not fit
+static float encodeMode(const EncodeBlock& block, uint32_t modeIdx, uint32_t partitionIdx,
+    const Endpoints& endpoints, uint8_t* pBlock)
+{
+    const auto& info = g_modes[modeIdx];
+    const auto numEndpoints = info.NumRegions * 2u;
+    const auto partition = info.NumRegions > 1 ? g_partitions[partitionIdx] : 0;
+    const auto numIndices = info.NumRegions > 1 ? 8u : 16u;
+    const auto pWeights = info.NumRegions > 1 ? g_weights3 : g_weights4;
+
+    // Bucket of each endpoint, then the colors the decoder interpolates
+    const auto maxValue = (1 << info.EndpointBits) - 1;
+    int quantized[4][3];
+    Palettes palettes;
+    for (auto r = 0u; r < info.NumRegions; ++r)
+    {
+        int unquantized[2][3];
+        for (auto e = 0u; e < 2; ++e)
+        {
+            for (auto c = 0u; c < 3; ++c)
+            {
+                auto& q = quantized[2 * r + e][c];
+                q = (min)(static_cast<int>(endpoints[2 * r + e][c] * (1 << info.EndpointBits) / 65536.0f), maxValue);
+                unquantized[e][c] = unquantize(q, info.EndpointBits, false);
+            }
+        }
+
+        for (auto k = 0u; k < numIndices; ++k)
+            for (auto c = 0u; c < 3; ++c)
+                palettes[r][k][c] = static_cast<float>((unquantized[0][c] * (64 - pWeights[k]) +
+                    unquantized[1][c] * pWeights[k] + 32) >> 6);
+    }
+    if (info.NumRegions == 1) memcpy(palettes[1], palettes[0], sizeof(palettes[0]));
+
+    uint8_t indices[16];
+    const auto error = assignIndices(block, palettes, partition, numIndices, indices);
+
+    // The top bits of the anchors are implicitly 0, so the endpoints swap if they are set
+    const uint32_t anchors[] = { 0, info.NumRegions > 1 ? g_anchors[partitionIdx] : 0u };
+    for (auto r = 0u; r < info.NumRegions; ++r)
+    {
+        if (indices[anchors[r]] < numIndices / 2) continue;
+        for (auto c = 0u; c < 3; ++c) swap(quantized[2 * r][c], quantized[2 * r + 1][c]);
+        for (auto i = 0u; i < 16; ++i)
+            if (((partition >> i) & 1) == r) indices[i] = static_cast<uint8_t>(numIndices - 1 - indices[i]);
+    }
+
+    int fields[NUM_FIELD] = {};
+    for (auto c = 0u; c < 3; ++c)
+    {
+        fields[4 * c] = quantized[0][c];
+        const auto deltaMin = -(1 << (info.DeltaBits[c] - 1)), deltaMax = (1 << (info.DeltaBits[c] - 1)) - 1;
+        for (auto e = 1u; e < numEndpoints; ++e)
+        {
+            auto value = quantized[e][c];
+            if (info.IsTransformed)
+            {
+                value -= quantized[0][c];
+                if (value < deltaMin || value > deltaMax) return FLT_MAX;
+            }
+            fields[4 * c + e] = value & ((1 << info.DeltaBits[c]) - 1);
+        }
+    }
+    fields[D] = partitionIdx;
+
+    // 2-bit modes 0 and 1, then the 5-bit ones
+    memset(pBlock, 0, 16);
+    uint32_t pos = 0;
+    if (modeIdx < 2) writeBits(pBlock, pos, modeIdx, 2);
+    else writeBits(pBlock, pos, modeIdx < 10 ? 2 | ((modeIdx - 2) << 2) : 3 | ((modeIdx - 10) << 2), 5);
+
+    const auto headerBits = info.NumRegions > 1 ? 82u : 65u;
+    for (auto run = info.Runs; pos < headerBits; ++run)
+    {
+        const auto step = run->From <= run->To ? 1 : -1;
+        for (int bit = run->From; ; bit += step)
+        {
+            writeBits(pBlock, pos, (fields[run->Field] >> bit) & 1, 1);
+            if (bit == run->To) break;
+        }
+    }
+
+    const auto indexBits = info.NumRegions > 1 ? 3u : 4u;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        const auto isAnchor = i == 0 || (info.NumRegions > 1 && i == anchors[1]);
+        writeBits(pBlock, pos, indices[i], isAnchor ? indexBits - 1 : indexBits);
+    }
+
+    return error;
+}
+
+// Encodes the endpoints in the mode, then again with those refined for its indices
+static void tryMode(const EncodeBlock& block, uint32_t modeIdx, uint32_t partitionIdx, Endpoints& endpoints,
+    bool refine, float& bestError, uint8_t* pBestBlock)
+{
+    uint8_t candidate[16];
+    auto error = encodeMode(block, modeIdx, partitionIdx, endpoints, candidate);
+    if (error < bestError)
+    {
+        bestError = error;
+        memcpy(pBestBlock, candidate, sizeof(candidate));
+    }
+    if (!refine || error == FLT_MAX) return;
+
+    // Indices back from the block, as its endpoints may have swapped
+    const auto& info = g_modes[modeIdx];
+    const auto partition = info.NumRegions > 1 ? g_partitions[partitionIdx] : 0;
+    const auto numIndices = info.NumRegions > 1 ? 8u : 16u;
+    const auto pWeights = info.NumRegions > 1 ? g_weights3 : g_weights4;
+    Palettes palettes;
+    for (auto r = 0u; r < info.NumRegions; ++r)
+        for (auto k = 0u; k < numIndices; ++k)
+            for (auto c = 0u; c < 3; ++c)
+                palettes[r][k][c] = endpoints[2 * r][c] + (endpoints[2 * r + 1][c] - endpoints[2 * r][c]) * pWeights[k] / 64.0f;
+    if (info.NumRegions == 1) memcpy(palettes[1], palettes[0], sizeof(palettes[0]));
+
+    uint8_t indices[16];
+    assignIndices(block, palettes, partition, numIndices, indices);
+    refineEndpoints(block, partition, info.NumRegions, indices, pWeights, endpoints);
+
+    error = encodeMode(block, modeIdx, partitionIdx, endpoints, candidate);
+    if (error < bestError)
+    {
+        bestError = error;
+        memcpy(pBestBlock, candidate, sizeof(candidate));
+    }
+}
+
+void EncodeBC6H(const float3* pTexels, uint8_t* pBlock, uint32_t quality)
+{
+    EncodeBlock block;
+    for (auto i = 0u; i < 16; ++i)
+        for (auto c = 0u; c < 3; ++c)
+            block.Channels[c][i] = (min)(FloatToHalf((max)(pTexels[i][c], 0.0f)), uint16_t(0x7bff)) * (64.0f / 31.0f);
+
+    // 1 region: mode 11 of 10-bit endpoints, and the modes of 11, 12 and 16-bit bases with deltas
+    auto bestError = FLT_MAX;
+    Endpoints endpoints;
+    fitEndpoints(block, 0, 0, endpoints[0], endpoints[1]);
+    for (auto modeIdx = 10u; modeIdx < (quality > 0 ? 14u : 11u); ++modeIdx)
+    {
+        Endpoints modeEndpoints;
+        memcpy(modeEndpoints, endpoints, sizeof(Endpoints));
+        tryMode(block, modeIdx, 0, modeEndpoints, quality > 0, bestError, pBlock);
+    }
+    if (quality < 2) return;
+
+    // 2 regions: the partitions ranked by the error of their unquantized fits
+    const auto numPartitions = static_cast<uint32_t>(size(g_partitions));
+    float partitionErrors[size(g_partitions)];
+    Endpoints partitionEndpoints[size(g_partitions)];
+    for (auto p = 0u; p < numPartitions; ++p)
+    {
+        auto& e = partitionEndpoints[p];
+        fitEndpoints(block, g_partitions[p], 0, e[0], e[1]);
+        fitEndpoints(block, g_partitions[p], 1, e[2], e[3]);
+
+        Palettes palettes;
+        for (auto r = 0u; r < 2; ++r)
+            for (auto k = 0u; k < 8; ++k)
+                for (auto c = 0u; c < 3; ++c)
+                    palettes[r][k][c] = e[2 * r][c] + (e[2 * r + 1][c] - e[2 * r][c]) * g_weights3[k] / 64.0f;
+
+        uint8_t indices[16];
+        partitionErrors[p] = assignIndices(block, palettes, g_partitions[p], 8, indices);
+    }
+
+    const auto numCandidates = 2u;
+    uint32_t candidates[numCandidates];
+    for (auto i = 0u; i < numCandidates; ++i)
+    {
+        candidates[i] = static_cast<uint32_t>(min_element(partitionErrors, partitionErrors + numPartitions) - partitionErrors);
+        if (partitionErrors[candidates[i]] >= bestError) return;
+        partitionErrors[candidates[i]] = FLT_MAX;
+
+        for (auto modeIdx = 0u; modeIdx < 10; ++modeIdx)
+        {
+            Endpoints modeEndpoints;
+            memcpy(modeEndpoints, partitionEndpoints[candidates[i]], sizeof(Endpoints));
+            tryMode(block, modeIdx, candidates[i], modeEndpoints, true, bestError, pBlock);
+        }
+    }
+}
+
+void EncodeBC6H(const float3* pImage, uint32_t width, uint32_t height, uint32_t quality,
+    uint8_t* pBlocks, uint32_t rowPitch)
+{
+    const auto numBlocksX = DIV_UP(width, 4);
+    ThreadPool::GetDefault().ParallelFor(DIV_UP(height, 4), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        float3 texels[16];
+        for (auto by = begin; by < end; ++by)
+        {
+            for (auto bx = 0u; bx < numBlocksX; ++bx)
+            {
+                for (auto y = 0u; y < 4; ++y)
+                {
+                    const auto srcY = (min)(4 * by + y, height - 1);
+                    for (auto x = 0u; x < 4; ++x)
+                        texels[4 * y + x] = pImage[static_cast<size_t>(width) * srcY + (min)(4 * bx + x, width - 1)];
+                }
+                EncodeBC6H(texels, pBlocks + static_cast<size_t>(rowPitch) * by + 16 * bx, quality);
+            }
+        }
+    });
+}
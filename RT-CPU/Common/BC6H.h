@@ -0,0 +1,24 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// BC6H blocks of HDR RGB texels, as in the D3D11 functional spec: 4x4 texels in 16 bytes,
+// with 1 or 2 regions of interpolated endpoints in 14 modes. The reserved modes decode to 0.
+void DecodeBC6H(const uint8_t* pBlock, float3* pTexels, bool isSigned);
+
+// A whole image of width x height texels from rows of blocks, in parallel
+void DecodeBC6H(const uint8_t* pBlocks, uint32_t rowPitch, uint32_t width, uint32_t height,
+    bool isSigned, float3* pImage);
+
+// UF16 blocks from 4x4 texels, with negative values as 0. Quality 0 fits mode 11 only,
+// 1 all the 1-region modes with a refinement of the endpoints, and 2 also the 2-region
+// modes on the most promising partitions.
+void EncodeBC6H(const float3* pTexels, uint8_t* pBlock, uint32_t quality = 1);
+
+// Rows of blocks from a whole image, in parallel, repeating the last texels past the edges
+void EncodeBC6H(const float3* pImage, uint32_t width, uint32_t height, uint32_t quality,
+    uint8_t* pBlocks, uint32_t rowPitch);
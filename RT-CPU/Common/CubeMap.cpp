@@ -0,0 +1,377 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CubeMap.h"
+#include "BC6H.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const float Pi = 3.141592654f;
+
+CubeMap::CubeMap() :
+    m_gridWidth(0)
+{
+}
+
+CubeMap::~CubeMap()
+{
+}
+
+bool CubeMap::Init(const DDSReader& reader)
+{
+    if (!reader.IsCube()) return false;
+
+    Init(reader.GetWidth(), reader.GetNumMips());
+
+    const auto format = reader.GetFormat();
+    const auto isBlockCompressed = DDSReader::IsBlockCompressed(format);
+    vector<float3> image;
+    for (auto i = 0u; i < reader.GetNumMips(); ++i)
+    {
+        const auto n = m_mips[i].Size;
+        for (auto face = 0u; face < NUM_FACE; ++face)
+        {
+            const auto& subresource = reader.GetSubresource(face, i);
+            if (isBlockCompressed)
+            {
+                image.resize(static_cast<size_t>(n) * n);
+                DecodeBC6H(subresource.pData, subresource.RowPitch, n, n, format == DDSReader::FORMAT_BC6H_SF16, image.data());
+            }
+
+            for (auto y = 0u; y < n; ++y)
+                for (auto x = 0u; x < n; ++x)
+                    m_texels[getTexelIndex(i, static_cast<Face>(face), x, y)] = isBlockCompressed ?
+                        image[static_cast<size_t>(n) * y + x] : reader.LoadTexel(subresource, x, y);
+        }
+
+        UpdateBorders(i);
+    }
+
+    return true;
+}
+
+void CubeMap::Init(uint32_t size, uint32_t numMips)
+{
+    m_mips.resize(numMips);
+    size_t numTexels = 0;
+    for (auto i = 0u; i < numMips; ++i)
+    {
+        auto& mip = m_mips[i];
+        mip.Size = (max)(size >> i, 1u);
+        mip.Offset = numTexels;
+        numTexels += NUM_FACE * static_cast<size_t>(mip.Size + 2) * (mip.Size + 2);
+    }
+    m_texels.assign(numTexels, 0.0f);
+    m_lookupGrid.clear();
+    m_gridWidth = 0;
+}
+
+const float3& CubeMap::GetTexel(uint32_t mip, Face face, uint32_t x, uint32_t y) const
+{
+    return m_texels[getTexelIndex(mip, face, x, y)];
+}
+
+void CubeMap::SetTexel(uint32_t mip, Face face, uint32_t x, uint32_t y, const float3& texel)
+{
+    m_texels[getTexelIndex(mip, face, x, y)] = texel;
+}
+
+void CubeMap::BuildLookupGrid(uint32_t resolution)
+{
+    // Uniform in longitude and in height is uniform in solid angle
+    m_gridWidth = resolution ? resolution : 4 * m_mips[0].Size;
+    const auto gridHeight = m_gridWidth / 2;
+    m_lookupGrid.resize(static_cast<size_t>(m_gridWidth) * gridHeight);
+
+    const auto n = m_mips[0].Size;
+    ThreadPool::GetDefault().ParallelFor(gridHeight, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto j = begin; j < end; ++j)
+        {
+            const auto h = 1.0f - 2.0f * (j + 0.5f) / gridHeight;
+            const auto r = sqrt((max)(1.0f - h * h, 0.0f));
+            for (auto i = 0u; i < m_gridWidth; ++i)
+            {
+                const auto phi = 2.0f * Pi * (i + 0.5f) / m_gridWidth - Pi;
+                float2 uv;
+                const auto face = SelectFace(float3(r * cos(phi), h, r * sin(phi)), uv);
+                const auto x = (min)(static_cast<uint32_t>(uv.x * n), n - 1);
+                const auto y = (min)(static_cast<uint32_t>(uv.y * n), n - 1);
+                m_lookupGrid[static_cast<size_t>(m_gridWidth) * j + i] = static_cast<uint32_t>(getTexelIndex(0, face, x, y));
+            }
+        }
+    });
+}
+
+float3 CubeMap::SampleLevel(const float3& dir, float level) const
+{
+    const auto lod = (min)((max)(level, 0.0f), static_cast<float>(m_mips.size() - 1));
+    const auto mip = static_cast<uint32_t>(lod);
+    const auto weight = lod - mip;
+
+    float2 uv;
+    const auto face = SelectFace(dir, uv);
+    const auto color = sampleBilinear(mip, face, uv);
+
+    return weight > 0.0f ? color + (sampleBilinear(mip + 1, face, uv) - color) * weight : color;
+}
+
+void CubeMap::SampleLevel(const float3* pDirs, float3* pColors, uint32_t count, float level) const
+{
+    const auto lod = (min)((max)(level, 0.0f), static_cast<float>(m_mips.size() - 1));
+    const auto mip = static_cast<uint32_t>(lod);
+    const auto weight = lod - mip;
+
+    sampleBilinear(mip, pDirs, pColors, count);
+    if (weight > 0.0f)
+    {
+        vector<float3> colors(count);
+        sampleBilinear(mip + 1, pDirs, colors.data(), count);
+        for (auto i = 0u; i < count; ++i) pColors[i] = pColors[i] + (colors[i] - pColors[i]) * weight;
+    }
+}
+
+float3 CubeMap::SampleNearest(const float3& dir) const
+{
+    if (!m_lookupGrid.empty())
+    {
+        const auto gridHeight = m_gridWidth / 2;
+        const auto h = dir.y / sqrt(dot(dir, dir));
+        const auto phi = atan2(dir.z, dir.x);
+        const auto i = (min)(static_cast<uint32_t>((phi + Pi) * (m_gridWidth / (2.0f * Pi))), m_gridWidth - 1);
+        const auto j = (min)(static_cast<uint32_t>((1.0f - h) * 0.5f * gridHeight), gridHeight - 1);
+
+        return m_texels[m_lookupGrid[static_cast<size_t>(m_gridWidth) * j + i]];
+    }
+
+    float2 uv;
+    const auto face = SelectFace(dir, uv);
+    const auto n = m_mips[0].Size;
+    const auto x = (min)(static_cast<uint32_t>(uv.x * n), n - 1);
+    const auto y = (min)(static_cast<uint32_t>(uv.y * n), n - 1);
+
+    return m_texels[getTexelIndex(0, face, x, y)];
+}
+
+uint32_t CubeMap::GetSize() const
+{
+    return m_mips.empty() ? 0 : m_mips[0].Size;
+}
+
+uint32_t CubeMap::GetSize(uint32_t mip) const
+{
+    return m_mips[mip].Size;
+}
+
+uint32_t CubeMap::GetNumMips() const
+{
+    return static_cast<uint32_t>(m_mips.size());
+}
+
+size_t CubeMap::GetMemorySize() const
+{
+    return sizeof(float3) * m_texels.capacity() + sizeof(uint32_t) * m_lookupGrid.capacity();
+}
+
+CubeMap::Face CubeMap::SelectFace(const float3& dir, float2& uv)
+{
+    const auto ax = fabs(dir.x);
+    const auto ay = fabs(dir.y);
+    const auto az = fabs(dir.z);
+
+    Face face;
+    float ma, sc, tc;
+    if (az >= ax && az >= ay)
+    {
+        face = dir.z < 0.0f ? NEG_Z : POS_Z;
+        ma = az;
+        sc = dir.z < 0.0f ? -dir.x : dir.x;
+        tc = -dir.y;
+    }
+    else if (ay >= ax)
+    {
+        face = dir.y < 0.0f ? NEG_Y : POS_Y;
+        ma = ay;
+        sc = dir.x;
+        tc = dir.y < 0.0f ? -dir.z : dir.z;
+    }
+    else
+    {
+        face = dir.x < 0.0f ? NEG_X : POS_X;
+        ma = ax;
+        sc = dir.x < 0.0f ? dir.z : -dir.z;
+        tc = -dir.y;
+    }
+
+    uv = float2(0.5f * (sc / ma) + 0.5f, 0.5f * (tc / ma) + 0.5f);
+
+    return face;
+}
+
+float3 CubeMap::GetDirection(Face face, const float2& uv)
+{
+    const auto s = 2.0f * uv.x - 1.0f;
+    const auto t = 2.0f * uv.y - 1.0f;
+    switch (face)
+    {
+    case POS_X:
+        return float3(1.0f, -t, -s);
+    case NEG_X:
+        return float3(-1.0f, -t, s);
+    case POS_Y:
+        return float3(s, 1.0f, t);
+    case NEG_Y:
+        return float3(s, -1.0f, -t);
+    case POS_Z:
+        return float3(s, -t, 1.0f);
+    default:
+        return float3(-s, -t, -1.0f);
+    }
+}
+
+float3 CubeMap::sampleBilinear(uint32_t mip, Face face, const float2& uv) const
+{
+    // In the texels of the bordered face, so that the taps go at most 1 texel into the border
+    const auto n = m_mips[mip].Size;
+    const auto pitch = n + 2;
+    const auto x = (min)((max)(uv.x * n + 0.5f, 0.5f), n + 0.5f);
+    const auto y = (min)((max)(uv.y * n + 0.5f, 0.5f), n + 0.5f);
+    const auto x0 = static_cast<uint32_t>(x);
+    const auto y0 = static_cast<uint32_t>(y);
+    const auto wx = x - x0;
+    const auto wy = y - y0;
+
+    const auto pTexel = &m_texels[m_mips[mip].Offset + (static_cast<size_t>(pitch) * face + y0) * pitch + x0];
+    const auto top = pTexel[0] + (pTexel[1] - pTexel[0]) * wx;
+    const auto bottom = pTexel[pitch] + (pTexel[pitch + 1] - pTexel[pitch]) * wx;
+
+    return top + (bottom - top) * wy;
+}
+
+void CubeMap::sampleBilinear(uint32_t mip, const float3* pDirs, float3* pColors, uint32_t count) const
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    // Same as the scalar version for 8 directions at a time, with the taps gathered
+    const auto n = m_mips[mip].Size;
+    const auto pitch = static_cast<int>(n + 2);
+    const auto pTexels = reinterpret_cast<const float*>(m_texels.data());
+    const auto signMask = _mm256_set1_ps(-0.0f);
+    const auto zero = _mm256_setzero_ps();
+    const auto half = _mm256_set1_ps(0.5f);
+    const auto size = _mm256_set1_ps(static_cast<float>(n));
+    const auto maxCoord = _mm256_set1_ps(n + 0.5f);
+    const auto dirOffsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const auto offset = _mm256_set1_epi32(static_cast<int>(m_mips[mip].Offset));
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto pDir = reinterpret_cast<const float*>(pDirs + i);
+        const auto x = _mm256_i32gather_ps(pDir, dirOffsets, 4);
+        const auto y = _mm256_i32gather_ps(pDir + 1, dirOffsets, 4);
+        const auto z = _mm256_i32gather_ps(pDir + 2, dirOffsets, 4);
+        const auto ax = _mm256_andnot_ps(signMask, x);
+        const auto ay = _mm256_andnot_ps(signMask, y);
+        const auto az = _mm256_andnot_ps(signMask, z);
+
+        const auto isZ = _mm256_and_ps(_mm256_cmp_ps(az, ax, _CMP_GE_OQ), _mm256_cmp_ps(az, ay, _CMP_GE_OQ));
+        const auto isY = _mm256_andnot_ps(isZ, _mm256_cmp_ps(ay, ax, _CMP_GE_OQ));
+        const auto ma = _mm256_blendv_ps(_mm256_blendv_ps(ax, ay, isY), az, isZ);
+        const auto major = _mm256_blendv_ps(_mm256_blendv_ps(x, y, isY), z, isZ);
+
+        const auto scX = _mm256_xor_ps(z, _mm256_xor_ps(signMask, _mm256_and_ps(x, signMask)));
+        const auto scZ = _mm256_xor_ps(x, _mm256_and_ps(z, signMask));
+        const auto sc = _mm256_blendv_ps(_mm256_blendv_ps(scX, x, isY), scZ, isZ);
+        const auto tc = _mm256_blendv_ps(_mm256_xor_ps(y, signMask), _mm256_xor_ps(z, _mm256_and_ps(y, signMask)), isY);
+
+        auto face = _mm256_or_si256(_mm256_and_si256(_mm256_castps_si256(isY), _mm256_set1_epi32(POS_Y)),
+            _mm256_and_si256(_mm256_castps_si256(isZ), _mm256_set1_epi32(POS_Z)));
+        face = _mm256_sub_epi32(face, _mm256_castps_si256(_mm256_cmp_ps(major, zero, _CMP_LT_OQ)));
+
+        const auto u = _mm256_add_ps(_mm256_mul_ps(half, _mm256_div_ps(sc, ma)), half);
+        const auto v = _mm256_add_ps(_mm256_mul_ps(half, _mm256_div_ps(tc, ma)), half);
+        const auto fx = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(u, size), half), half), maxCoord);
+        const auto fy = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(v, size), half), half), maxCoord);
+        const auto x0 = _mm256_cvttps_epi32(fx);
+        const auto y0 = _mm256_cvttps_epi32(fy);
+        const auto wx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(x0));
+        const auto wy = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(y0));
+
+        const auto row = _mm256_add_epi32(_mm256_mullo_epi32(face, _mm256_set1_epi32(pitch)), y0);
+        const auto idx = _mm256_add_epi32(offset, _mm256_add_epi32(_mm256_mullo_epi32(row, _mm256_set1_epi32(pitch)), x0));
+        const auto idx00 = _mm256_mullo_epi32(idx, _mm256_set1_epi32(3));
+        const auto idx01 = _mm256_add_epi32(idx00, _mm256_set1_epi32(3));
+        const auto idx10 = _mm256_add_epi32(idx00, _mm256_set1_epi32(3 * pitch));
+        const auto idx11 = _mm256_add_epi32(idx10, _mm256_set1_epi32(3));
+
+        alignas(32) float colors[3][8];
+        for (auto c = 0u; c < 3; ++c)
+        {
+            const auto c00 = _mm256_i32gather_ps(pTexels + c, idx00, 4);
+            const auto c01 = _mm256_i32gather_ps(pTexels + c, idx01, 4);
+            const auto c10 = _mm256_i32gather_ps(pTexels + c, idx10, 4);
+            const auto c11 = _mm256_i32gather_ps(pTexels + c, idx11, 4);
+            const auto top = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c01, c00), wx));
+            const auto bottom = _mm256_add_ps(c10, _mm256_mul_ps(_mm256_sub_ps(c11, c10), wx));
+            _mm256_store_ps(colors[c], _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), wy)));
+        }
+
+        for (auto j = 0u; j < 8; ++j) pColors[i + j] = float3(colors[0][j], colors[1][j], colors[2][j]);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float2 uv;
+        const auto face = SelectFace(pDirs[i], uv);
+        pColors[i] = sampleBilinear(mip, face, uv);
+    }
+}
+
+void CubeMap::UpdateBorders(uint32_t mip)
+{
+    // Edges from the nearest texels of the adjacent faces
+    const auto n = static_cast<int32_t>(m_mips[mip].Size);
+    const auto copyTexel = [&](Face face, int32_t x, int32_t y)
+    {
+        float2 uv;
+        const auto dir = GetDirection(face, float2((x + 0.5f) / n, (y + 0.5f) / n));
+        const auto adjFace = SelectFace(dir, uv);
+        const auto adjX = (min)((max)(static_cast<int32_t>(uv.x * n), 0), n - 1);
+        const auto adjY = (min)((max)(static_cast<int32_t>(uv.y * n), 0), n - 1);
+        m_texels[getTexelIndex(mip, face, x, y)] = m_texels[getTexelIndex(mip, adjFace, adjX, adjY)];
+    };
+
+    // Corners from the 3 texels around them
+    const auto averageCorner = [&](Face face, int32_t x, int32_t y, int32_t innerX, int32_t innerY)
+    {
+        m_texels[getTexelIndex(mip, face, x, y)] = (m_texels[getTexelIndex(mip, face, innerX, innerY)] +
+            m_texels[getTexelIndex(mip, face, x, innerY)] + m_texels[getTexelIndex(mip, face, innerX, y)]) / 3.0f;
+    };
+
+    for (auto i = 0u; i < NUM_FACE; ++i)
+    {
+        const auto face = static_cast<Face>(i);
+        for (auto j = 0; j < n; ++j)
+        {
+            copyTexel(face, -1, j);
+            copyTexel(face, n, j);
+            copyTexel(face, j, -1);
+            copyTexel(face, j, n);
+        }
+
+        averageCorner(face, -1, -1, 0, 0);
+        averageCorner(face, n, -1, n - 1, 0);
+        averageCorner(face, -1, n, 0, n - 1);
+        averageCorner(face, n, n, n - 1, n - 1);
+    }
+}
+
+size_t CubeMap::getTexelIndex(uint32_t mip, Face face, int32_t x, int32_t y) const
+{
+    const auto pitch = static_cast<size_t>(m_mips[mip].Size + 2);
+
+    return m_mips[mip].Offset + (pitch * face + static_cast<size_t>(y + 1)) * pitch + static_cast<size_t>(x + 1);
+}
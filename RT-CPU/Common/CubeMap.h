@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DDSReader.h"
+
+// CPU counterpart of TextureCube::SampleLevel with a linear filter, as environment() of
+// RTCommon.hlsli: the faces are selected as in D3D, and each face is stored with a
+// border of 1 texel from its neighbors, so that the bilinear taps never branch on the
+// seams. The missing corner texels are the averages of the 3 around them.
+class CubeMap
+{
+public:
+    enum Face : uint8_t
+    {
+        POS_X,
+        NEG_X,
+        POS_Y,
+        NEG_Y,
+        POS_Z,
+        NEG_Z,
+
+        NUM_FACE
+    };
+
+    CubeMap();
+    virtual ~CubeMap();
+
+    // Decodes all the mips of the first cube in the file
+    bool Init(const DDSReader& reader);
+    void Init(uint32_t size, uint32_t numMips);
+
+    // Texels of the faces; the borders of a mip are refreshed by UpdateBorders
+    const float3& GetTexel(uint32_t mip, Face face, uint32_t x, uint32_t y) const;
+    void SetTexel(uint32_t mip, Face face, uint32_t x, uint32_t y, const float3& texel);
+    void UpdateBorders(uint32_t mip);
+
+    // Equal-area grid of the nearest texels, resolution x resolution / 2 cells over
+    // longitude and height; 0 for as many cells as texels around the equator
+    void BuildLookupGrid(uint32_t resolution = 0);
+
+    float3 SampleLevel(const float3& dir, float level = 0.0f) const;
+    void SampleLevel(const float3* pDirs, float3* pColors, uint32_t count, float level = 0.0f) const;
+    float3 SampleNearest(const float3& dir) const;  // Through the lookup grid if built
+
+    uint32_t GetSize() const;
+    uint32_t GetSize(uint32_t mip) const;
+    uint32_t GetNumMips() const;
+    size_t GetMemorySize() const;
+
+    // The face of the major axis of dir, ties going to Z then Y, and the uv on it
+    static Face SelectFace(const float3& dir, float2& uv);
+    static float3 GetDirection(Face face, const float2& uv);
+
+protected:
+    struct MipLevel
+    {
+        uint32_t    Size;
+        size_t      Offset;
+    };
+
+    float3 sampleBilinear(uint32_t mip, Face face, const float2& uv) const;
+    void sampleBilinear(uint32_t mip, const float3* pDirs, float3* pColors, uint32_t count) const;
+    size_t getTexelIndex(uint32_t mip, Face face, int32_t x, int32_t y) const;
+
+    std::vector<float3>     m_texels;       // All the mips of the faces, with their borders
+    std::vector<MipLevel>   m_mips;
+
+    std::vector<uint32_t>   m_lookupGrid;   // Texel indices at mip 0
+    uint32_t                m_gridWidth;
+};
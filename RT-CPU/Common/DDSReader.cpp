@@ -0,0 +1,496 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "DDSReader.h"
+#include "PackedColor.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Layouts of the DDS headers, as in DDS.h of DirectXTex
+struct DDSPixelFormat
+{
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t FourCC;
+    uint32_t RGBBitCount;
+    uint32_t RBitMask;
+    uint32_t GBitMask;
+    uint32_t BBitMask;
+    uint32_t ABitMask;
+};
+
+struct DDSHeader
+{
+    uint32_t        Size;
+    uint32_t        Flags;
+    uint32_t        Height;
+    uint32_t        Width;
+    uint32_t        PitchOrLinearSize;
+    uint32_t        Depth;
+    uint32_t        MipMapCount;
+    uint32_t        Reserved1[11];
+    DDSPixelFormat  PixelFormat;
+    uint32_t        Caps;
+    uint32_t        Caps2;
+    uint32_t        Caps3;
+    uint32_t        Caps4;
+    uint32_t        Reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    uint32_t Format;
+    uint32_t ResourceDimension;
+    uint32_t MiscFlag;
+    uint32_t ArraySize;
+    uint32_t MiscFlags2;
+};
+
+static const uint32_t DDSMagic = 0x20534444;            // "DDS "
+static const uint32_t FourCCDX10 = 0x30315844;          // "DX10"
+static const uint32_t SourceHashTag = 0x48535452;       // "RTSH", in Reserved1[0] before the hash
+static const uint32_t PixelFormatFourCC = 0x4;
+static const uint32_t HeaderFlagsVolume = 0x800000;
+static const uint32_t Caps2Cubemap = 0x200;
+static const uint32_t Caps2CubemapAllFaces = 0xfc00;
+static const uint32_t Caps2Volume = 0x200000;
+static const uint32_t ResourceDimensionTexture2D = 3;
+static const uint32_t ResourceMiscTextureCube = 0x4;
+
+// Limits of D3D12 textures
+static const uint32_t MaxTextureSize = 16384;
+static const uint32_t MaxArraySize = 2048;
+
+DDSReader::DDSReader() :
+    m_pFile(nullptr),
+    m_fileSize(0),
+    m_sourceHash(0),
+    m_numBytesTouched(0),
+    m_loadTime(0.0),
+    m_format(FORMAT_UNKNOWN),
+    m_width(0),
+    m_height(0),
+    m_numMips(0),
+    m_numFaces(0),
+    m_isCube(false)
+{
+}
+
+DDSReader::~DDSReader()
+{
+    Close();
+}
+
+bool DDSReader::Load(const char* fileName)
+{
+    Close();
+
+    const auto start = chrono::high_resolution_clock::now();
+#if defined(_WIN32)
+    const auto hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    // The view keeps the mapping alive after the handles are closed
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0)
+    {
+        const auto hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMapping)
+        {
+            m_pFile = static_cast<const uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+            m_fileSize = m_pFile ? static_cast<size_t>(fileSize.QuadPart) : 0;
+            CloseHandle(hMapping);
+        }
+    }
+    CloseHandle(hFile);
+#else
+    const auto fd = open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        const auto pMapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pMapping != MAP_FAILED)
+        {
+            m_pFile = static_cast<const uint8_t*>(pMapping);
+            m_fileSize = fileStat.st_size;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!m_pFile || !parseHeaders())
+    {
+        Close();
+
+        return false;
+    }
+
+    m_loadTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+    return true;
+}
+
+void DDSReader::Close()
+{
+    if (m_pFile)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_pFile);
+#else
+        munmap(const_cast<uint8_t*>(m_pFile), m_fileSize);
+#endif
+    }
+
+    m_pFile = nullptr;
+    m_fileSize = 0;
+    m_sourceHash = 0;
+    m_numBytesTouched = 0;
+    m_loadTime = 0.0;
+    m_format = FORMAT_UNKNOWN;
+    m_width = m_height = m_numMips = m_numFaces = 0;
+    m_isCube = false;
+    m_subresources.clear();
+}
+
+const DDSReader::Subresource& DDSReader::GetSubresource(uint32_t face, uint32_t mip) const
+{
+    return m_subresources[m_numMips * face + mip];
+}
+
+float3 DDSReader::LoadTexel(const Subresource& subresource, uint32_t x, uint32_t y) const
+{
+    const auto pTexel = subresource.pData + static_cast<size_t>(subresource.RowPitch) * y +
+        static_cast<size_t>(GetBitsPerTexel(m_format) / 8) * x;
+
+    float texel[3] = {};
+    uint16_t halves[3] = {};
+    uint32_t packed;
+    switch (m_format)
+    {
+    case FORMAT_R32G32B32A32_FLOAT:
+    case FORMAT_R32G32B32_FLOAT:
+        memcpy(texel, pTexel, sizeof(float) * 3);
+        break;
+    case FORMAT_R32G32_FLOAT:
+        memcpy(texel, pTexel, sizeof(float) * 2);
+        break;
+    case FORMAT_R32_FLOAT:
+        memcpy(texel, pTexel, sizeof(float));
+        break;
+    case FORMAT_R16G16B16A16_FLOAT:
+        memcpy(halves, pTexel, sizeof(uint16_t) * 3);
+        break;
+    case FORMAT_R16G16_FLOAT:
+        memcpy(halves, pTexel, sizeof(uint16_t) * 2);
+        break;
+    case FORMAT_R16_FLOAT:
+        memcpy(halves, pTexel, sizeof(uint16_t));
+        break;
+    case FORMAT_R11G11B10_FLOAT:
+        memcpy(&packed, pTexel, sizeof(packed));
+        return UnpackR11G11B10(packed);
+    case FORMAT_R9G9B9E5_SHAREDEXP:
+    {
+        memcpy(&packed, pTexel, sizeof(packed));
+        const auto scale = ldexp(1.0f, static_cast<int>(packed >> 27) - 24);
+        return float3(static_cast<float>(packed & 0x1ff), static_cast<float>((packed >> 9) & 0x1ff),
+            static_cast<float>((packed >> 18) & 0x1ff)) * scale;
+    }
+    default:
+        break;
+    }
+
+    if (m_format == FORMAT_R16G16B16A16_FLOAT || m_format == FORMAT_R16G16_FLOAT || m_format == FORMAT_R16_FLOAT)
+        return float3(HalfToFloat(halves[0]), HalfToFloat(halves[1]), HalfToFloat(halves[2]));
+
+    return float3(texel[0], texel[1], texel[2]);
+}
+
+DDSReader::Format DDSReader::GetFormat() const
+{
+    return m_format;
+}
+
+uint32_t DDSReader::GetWidth() const
+{
+    return m_width;
+}
+
+uint32_t DDSReader::GetHeight() const
+{
+    return m_height;
+}
+
+uint32_t DDSReader::GetNumMips() const
+{
+    return m_numMips;
+}
+
+uint32_t DDSReader::GetNumFaces() const
+{
+    return m_numFaces;
+}
+
+bool DDSReader::IsCube() const
+{
+    return m_isCube;
+}
+
+double DDSReader::GetLoadTime() const
+{
+    return m_loadTime;
+}
+
+size_t DDSReader::GetNumBytesTouched() const
+{
+    return m_numBytesTouched;
+}
+
+size_t DDSReader::GetFileSize() const
+{
+    return m_fileSize;
+}
+
+uint64_t DDSReader::GetHash() const
+{
+    auto hash = 14695981039346656037ull;
+    const auto hashBytes = [&hash](const uint8_t* pData, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ pData[i]) * 1099511628211ull;
+    };
+
+    const uint32_t desc[] = { m_format, m_width, m_height, m_numMips, m_numFaces };
+    hashBytes(reinterpret_cast<const uint8_t*>(desc), sizeof(desc));
+    for (const auto& subresource : m_subresources)
+        hashBytes(subresource.pData, static_cast<size_t>(subresource.RowPitch) * subresource.NumRows);
+
+    return hash;
+}
+
+uint64_t DDSReader::GetSourceHash() const
+{
+    return m_sourceHash;
+}
+
+bool DDSReader::SaveCube(const char* fileName, Format format, uint32_t size, uint32_t numMips,
+    const uint8_t* pData, size_t dataSize, uint64_t sourceHash)
+{
+    const auto bitsPerTexel = GetBitsPerTexel(format);
+    if (!bitsPerTexel) return false;
+
+    DDSHeader header = {};
+    header.Size = sizeof(DDSHeader);
+    header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;     // Caps, height, width, pixel format, mip count
+    header.Height = size;
+    header.Width = size;
+    header.PitchOrLinearSize = IsBlockCompressed(format) ? DIV_UP(size, 4) * bitsPerTexel * 2 : DIV_UP(size * bitsPerTexel, 8);
+    header.MipMapCount = numMips;
+    if (sourceHash)
+    {
+        header.Reserved1[0] = SourceHashTag;
+        header.Reserved1[1] = static_cast<uint32_t>(sourceHash);
+        header.Reserved1[2] = static_cast<uint32_t>(sourceHash >> 32);
+    }
+    header.PixelFormat.Size = sizeof(DDSPixelFormat);
+    header.PixelFormat.Flags = PixelFormatFourCC;
+    header.PixelFormat.FourCC = FourCCDX10;
+    header.Caps = 0x1000 | 0x8 | 0x400000;                  // Texture, complex, mipmap
+    header.Caps2 = Caps2Cubemap | Caps2CubemapAllFaces;
+
+    DDSHeaderDX10 headerDX10 = {};
+    headerDX10.Format = format;
+    headerDX10.ResourceDimension = ResourceDimensionTexture2D;
+    headerDX10.MiscFlag = ResourceMiscTextureCube;
+    headerDX10.ArraySize = 1;
+
+    ofstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    file.write(reinterpret_cast<const char*>(&DDSMagic), sizeof(DDSMagic));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&headerDX10), sizeof(headerDX10));
+    file.write(reinterpret_cast<const char*>(pData), dataSize);
+
+    return static_cast<bool>(file);
+}
+
+uint32_t DDSReader::GetBitsPerTexel(Format format)
+{
+    switch (format)
+    {
+    case FORMAT_R32G32B32A32_FLOAT:
+        return 128;
+    case FORMAT_R32G32B32_FLOAT:
+        return 96;
+    case FORMAT_R16G16B16A16_FLOAT:
+    case FORMAT_R32G32_FLOAT:
+        return 64;
+    case FORMAT_R11G11B10_FLOAT:
+    case FORMAT_R16G16_FLOAT:
+    case FORMAT_R32_FLOAT:
+    case FORMAT_R9G9B9E5_SHAREDEXP:
+        return 32;
+    case FORMAT_R16_FLOAT:
+        return 16;
+    case FORMAT_BC6H_UF16:
+    case FORMAT_BC6H_SF16:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+bool DDSReader::IsBlockCompressed(Format format)
+{
+    return format == FORMAT_BC6H_UF16 || format == FORMAT_BC6H_SF16;
+}
+
+const char* DDSReader::GetFormatName(Format format)
+{
+    switch (format)
+    {
+    case FORMAT_R32G32B32A32_FLOAT:
+        return "R32G32B32A32_FLOAT";
+    case FORMAT_R32G32B32_FLOAT:
+        return "R32G32B32_FLOAT";
+    case FORMAT_R16G16B16A16_FLOAT:
+        return "R16G16B16A16_FLOAT";
+    case FORMAT_R32G32_FLOAT:
+        return "R32G32_FLOAT";
+    case FORMAT_R11G11B10_FLOAT:
+        return "R11G11B10_FLOAT";
+    case FORMAT_R16G16_FLOAT:
+        return "R16G16_FLOAT";
+    case FORMAT_R32_FLOAT:
+        return "R32_FLOAT";
+    case FORMAT_R16_FLOAT:
+        return "R16_FLOAT";
+    case FORMAT_R9G9B9E5_SHAREDEXP:
+        return "R9G9B9E5_SHAREDEXP";
+    case FORMAT_BC6H_UF16:
+        return "BC6H_UF16";
+    case FORMAT_BC6H_SF16:
+        return "BC6H_SF16";
+    default:
+        return "Unknown";
+    }
+}
+
+bool DDSReader::parseHeaders()
+{
+    uint32_t magic;
+    DDSHeader header;
+    auto offset = sizeof(magic) + sizeof(header);
+    if (m_fileSize < offset) return false;
+
+    memcpy(&magic, m_pFile, sizeof(magic));
+    memcpy(&header, m_pFile + sizeof(magic), sizeof(header));
+    if (magic != DDSMagic || header.Size != sizeof(DDSHeader) || header.PixelFormat.Size != sizeof(DDSPixelFormat))
+        return false;
+
+    if (header.Reserved1[0] == SourceHashTag)
+        m_sourceHash = header.Reserved1[1] | static_cast<uint64_t>(header.Reserved1[2]) << 32;
+
+    // Only 2D textures and cube maps
+    if ((header.Flags & HeaderFlagsVolume) || (header.Caps2 & Caps2Volume)) return false;
+
+    auto arraySize = 1u;
+    if ((header.PixelFormat.Flags & PixelFormatFourCC) && header.PixelFormat.FourCC == FourCCDX10)
+    {
+        DDSHeaderDX10 headerDX10;
+        if (m_fileSize < offset + sizeof(headerDX10)) return false;
+        memcpy(&headerDX10, m_pFile + offset, sizeof(headerDX10));
+        offset += sizeof(headerDX10);
+
+        if (headerDX10.ResourceDimension != ResourceDimensionTexture2D) return false;
+        m_format = static_cast<Format>(headerDX10.Format);
+        m_isCube = (headerDX10.MiscFlag & ResourceMiscTextureCube) != 0;
+        arraySize = headerDX10.ArraySize;
+    }
+    else
+    {
+        // The D3DFMT codes of the float formats in the legacy header
+        if (!(header.PixelFormat.Flags & PixelFormatFourCC)) return false;
+        switch (header.PixelFormat.FourCC)
+        {
+        case 111:
+            m_format = FORMAT_R16_FLOAT;
+            break;
+        case 112:
+            m_format = FORMAT_R16G16_FLOAT;
+            break;
+        case 113:
+            m_format = FORMAT_R16G16B16A16_FLOAT;
+            break;
+        case 114:
+            m_format = FORMAT_R32_FLOAT;
+            break;
+        case 115:
+            m_format = FORMAT_R32G32_FLOAT;
+            break;
+        case 116:
+            m_format = FORMAT_R32G32B32A32_FLOAT;
+            break;
+        default:
+            return false;
+        }
+
+        m_isCube = (header.Caps2 & Caps2Cubemap) != 0;
+        if (m_isCube && (header.Caps2 & Caps2CubemapAllFaces) != Caps2CubemapAllFaces) return false;
+    }
+    m_numBytesTouched = offset;
+
+    const auto bitsPerTexel = GetBitsPerTexel(m_format);
+    if (!bitsPerTexel) return false;
+
+    m_width = header.Width;
+    m_height = header.Height;
+    if (!m_width || !m_height || m_width > MaxTextureSize || m_height > MaxTextureSize) return false;
+    if (m_isCube && m_width != m_height) return false;
+    if (!arraySize || arraySize > MaxArraySize) return false;
+
+    auto maxNumMips = 1u;
+    while ((max)(m_width, m_height) >> maxNumMips) ++maxNumMips;
+    m_numMips = (max)(header.MipMapCount, 1u);
+    if (m_numMips > maxNumMips) return false;
+    m_numFaces = m_isCube ? arraySize * 6 : arraySize;
+
+    // Faces are stored one after another, each with all its mips
+    const auto isBlockCompressed = IsBlockCompressed(m_format);
+    m_subresources.resize(static_cast<size_t>(m_numFaces) * m_numMips);
+    for (auto face = 0u; face < m_numFaces; ++face)
+    {
+        for (auto mip = 0u; mip < m_numMips; ++mip)
+        {
+            auto& subresource = m_subresources[m_numMips * face + mip];
+            subresource.Width = (max)(m_width >> mip, 1u);
+            subresource.Height = (max)(m_height >> mip, 1u);
+            subresource.RowPitch = isBlockCompressed ? DIV_UP(subresource.Width, 4) * bitsPerTexel * 2 :
+                DIV_UP(subresource.Width * bitsPerTexel, 8);
+            subresource.NumRows = isBlockCompressed ? DIV_UP(subresource.Height, 4) : subresource.Height;
+
+            const auto size = static_cast<size_t>(subresource.RowPitch) * subresource.NumRows;
+            if (size > m_fileSize - offset) return false;
+            subresource.pData = m_pFile + offset;
+            offset += size;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Read-only DDS texture, memory-mapped instead of uploaded as DDS::Loader does: the
+// headers are validated on load, and the faces and mip levels are views into the
+// mapping, so their pages are only read in when the texels are.
+class DDSReader
+{
+public:
+    // The DXGI_FORMAT values of the HDR formats
+    enum Format : uint32_t
+    {
+        FORMAT_UNKNOWN = 0,
+        FORMAT_R32G32B32A32_FLOAT = 2,
+        FORMAT_R32G32B32_FLOAT = 6,
+        FORMAT_R16G16B16A16_FLOAT = 10,
+        FORMAT_R32G32_FLOAT = 16,
+        FORMAT_R11G11B10_FLOAT = 26,
+        FORMAT_R16G16_FLOAT = 34,
+        FORMAT_R32_FLOAT = 41,
+        FORMAT_R16_FLOAT = 54,
+        FORMAT_R9G9B9E5_SHAREDEXP = 67,
+        FORMAT_BC6H_UF16 = 95,
+        FORMAT_BC6H_SF16 = 96
+    };
+
+    // Rows of texels, or of 4x4 blocks for BC6H
+    struct Subresource
+    {
+        const uint8_t*  pData;
+        uint32_t        Width;
+        uint32_t        Height;
+        uint32_t        RowPitch;
+        uint32_t        NumRows;
+    };
+
+    DDSReader();
+    virtual ~DDSReader();
+
+    bool Load(const char* fileName);
+    void Close();
+
+    // Faces are the 6 of each cube in the array, in the order +X, -X, +Y, -Y, +Z, -Z
+    const Subresource& GetSubresource(uint32_t face, uint32_t mip) const;
+
+    // Texels of the uncompressed formats, with the missing channels as 0; 0 for BC6H
+    float3 LoadTexel(const Subresource& subresource, uint32_t x, uint32_t y) const;
+
+    Format GetFormat() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint32_t GetNumMips() const;
+    uint32_t GetNumFaces() const;
+    bool IsCube() const;
+
+    // Time to map and validate the file, and bytes read to do so
+    double GetLoadTime() const;
+    size_t GetNumBytesTouched() const;
+    size_t GetFileSize() const;
+
+    // FNV-1a of the format, the dimensions and all the texels, and that of the file a
+    // cube written by SaveCube was made from, 0 if none
+    uint64_t GetHash() const;
+    uint64_t GetSourceHash() const;
+
+    // Cube of the faces one after another, each with all its mips, as they are read
+    static bool SaveCube(const char* fileName, Format format, uint32_t size, uint32_t numMips,
+        const uint8_t* pData, size_t dataSize, uint64_t sourceHash = 0);
+
+    static uint32_t GetBitsPerTexel(Format format);
+    static bool IsBlockCompressed(Format format);
+    static const char* GetFormatName(Format format);
+
+protected:
+    bool parseHeaders();
+
+    const uint8_t*  m_pFile;
+    size_t          m_fileSize;
+    uint64_t        m_sourceHash;
+    size_t          m_numBytesTouched;
+    double          m_loadTime;
+
+    Format          m_format;
+    uint32_t        m_width;
+    uint32_t        m_height;
+    uint32_t        m_numMips;
+    uint32_t        m_numFaces;
+    bool            m_isCube;
+
+    std::vector<Subresource> m_subresources;
+};
@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "FrameCapture.h"
+#include "ImageIO.h"
+#include "ToneMap.h"
+
+using namespace std;
+
+FrameCapture::FrameCapture() :
+    m_format(PNG),
+    m_policy(DROP),
+    m_ringHead(0),
+    m_queueDepth(0),
+    m_nextFrame(0),
+    m_stats(),
+    m_queueDepthSum(0),
+    m_isQuitting(false)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+bool FrameCapture::Init(const char* prefix, Format format, Policy policy, uint32_t numSlots, uint32_t numWorkers)
+{
+    if (numSlots == 0 || numWorkers == 0) return false;
+    stop();
+
+    m_prefix = prefix;
+    m_format = format;
+    m_policy = policy;
+
+    m_slots.assign(numSlots, Slot());
+    m_freeSlots.clear();
+    for (auto& slot : m_slots) m_freeSlots.push_back(&slot);
+    m_ring.assign(numSlots, nullptr);
+    m_ringHead = 0;
+    m_queueDepth = 0;
+    m_nextFrame = 0;
+    m_stats = {};
+    m_queueDepthSum = 0;
+    m_isQuitting = false;
+
+    m_workers.reserve(numWorkers);
+    for (auto i = 0u; i < numWorkers; ++i) m_workers.emplace_back(&FrameCapture::workerMain, this);
+
+    return true;
+}
+
+bool FrameCapture::Submit(const float3* pImage, uint32_t width, uint32_t height)
+{
+    const auto pSlot = acquireSlot();
+    if (!pSlot) return false;
+
+    // Copied outside the lock; the slot belongs to this thread until it is queued
+    pSlot->HDR.assign(pImage, pImage + static_cast<size_t>(width) * height);
+    pSlot->Width = width;
+    pSlot->Height = height;
+    pSlot->IsHDR = true;
+    queueSlot(pSlot);
+
+    return true;
+}
+
+bool FrameCapture::Submit(const uint32_t* pImage, uint32_t width, uint32_t height)
+{
+    const auto pSlot = acquireSlot();
+    if (!pSlot) return false;
+
+    pSlot->RGBA8.assign(pImage, pImage + static_cast<size_t>(width) * height);
+    pSlot->Width = width;
+    pSlot->Height = height;
+    pSlot->IsHDR = false;
+    queueSlot(pSlot);
+
+    return true;
+}
+
+void FrameCapture::Flush()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_slotCond.wait(lock, [this] { return m_freeSlots.size() == m_slots.size(); });
+    if (m_stats.NumSubmitted > 0)
+        m_stats.WallTime = chrono::duration<double>(chrono::high_resolution_clock::now() - m_startTime).count();
+}
+
+FrameCapture::Stats FrameCapture::GetStats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    auto stats = m_stats;
+    const auto numQueued = stats.NumSubmitted - stats.NumDropped;
+    stats.MeanQueueDepth = numQueued > 0 ? static_cast<double>(m_queueDepthSum) / numQueued : 0.0;
+
+    return stats;
+}
+
+const char* FrameCapture::GetExtension(Format format)
+{
+    static const char* extensions[] = { ".png", ".pfm", ".exr" };
+
+    return extensions[format];
+}
+
+FrameCapture::Slot* FrameCapture::acquireSlot()
+{
+    unique_lock<mutex> lock(m_mutex);
+    if (m_stats.NumSubmitted++ == 0) m_startTime = chrono::high_resolution_clock::now();
+    const auto frame = m_nextFrame++;
+
+    if (m_freeSlots.empty())
+    {
+        if (m_policy == DROP)
+        {
+            ++m_stats.NumDropped;
+
+            return nullptr;
+        }
+
+        const auto start = chrono::high_resolution_clock::now();
+        m_slotCond.wait(lock, [this] { return !m_freeSlots.empty(); });
+        m_stats.BlockTime += chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const auto pSlot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    pSlot->Frame = frame;
+
+    return pSlot;
+}
+
+void FrameCapture::queueSlot(Slot* pSlot)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        const auto numSlots = static_cast<uint32_t>(m_ring.size());
+        m_ring[(m_ringHead + m_queueDepth) % numSlots] = pSlot;
+        ++m_queueDepth;
+
+        // Frames waiting or being encoded
+        const auto depth = numSlots - static_cast<uint32_t>(m_freeSlots.size());
+        m_stats.MaxQueueDepth = (max)(m_stats.MaxQueueDepth, depth);
+        m_queueDepthSum += depth;
+    }
+    m_workCond.notify_one();
+}
+
+void FrameCapture::workerMain()
+{
+    while (true)
+    {
+        Slot* pSlot;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_workCond.wait(lock, [this] { return m_isQuitting || m_queueDepth > 0; });
+            if (m_queueDepth == 0) return; // Quitting once the ring is drained
+
+            pSlot = m_ring[m_ringHead];
+            m_ringHead = (m_ringHead + 1) % static_cast<uint32_t>(m_ring.size());
+            --m_queueDepth;
+        }
+
+        const auto start = chrono::high_resolution_clock::now();
+        const auto isWritten = encode(*pSlot);
+        const auto encodeTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            ++(isWritten ? m_stats.NumWritten : m_stats.NumFailed);
+            m_stats.EncodeTime += encodeTime;
+            m_stats.NumPixels += static_cast<uint64_t>(pSlot->Width) * pSlot->Height;
+            m_freeSlots.push_back(pSlot);
+        }
+        m_slotCond.notify_all();
+    }
+}
+
+bool FrameCapture::encode(Slot& slot) const
+{
+    stringstream fileName;
+    fileName << m_prefix << "_" << setw(5) << setfill('0') << slot.Frame << GetExtension(m_format);
+
+    const auto numPixels = static_cast<size_t>(slot.Width) * slot.Height;
+    if (m_format == PNG)
+    {
+        // The reference tone mapping, single-threaded: the default pool runs one loop at a
+        // time, and it is the render thread's
+        if (slot.IsHDR)
+        {
+            vector<float3> toneMapped(numPixels);
+            ToneMap(slot.HDR.data(), toneMapped.data(), slot.Width, slot.Height);
+            slot.RGBA8.resize(numPixels);
+            for (size_t i = 0; i < numPixels; ++i) slot.RGBA8[i] = ToRGBA8(toneMapped[i]);
+        }
+
+        return WritePNG(fileName.str().c_str(), slot.RGBA8.data(), slot.Width, slot.Height);
+    }
+
+    if (!slot.IsHDR)
+    {
+        slot.HDR.resize(numPixels);
+        for (size_t i = 0; i < numPixels; ++i)
+        {
+            const auto pixel = slot.RGBA8[i];
+            slot.HDR[i] = float3(static_cast<float>(pixel & 0xff), static_cast<float>((pixel >> 8) & 0xff),
+                static_cast<float>((pixel >> 16) & 0xff)) * (1.0f / 255.0f);
+        }
+    }
+
+    return m_format == PFM ? WritePFM(fileName.str().c_str(), slot.HDR.data(), slot.Width, slot.Height) :
+        WriteEXR(fileName.str().c_str(), slot.HDR.data(), slot.Width, slot.Height);
+}
+
+void FrameCapture::stop()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_isQuitting = true;
+    }
+    m_workCond.notify_all();
+
+    for (auto& worker : m_workers) worker.join();
+    m_workers.clear();
+}
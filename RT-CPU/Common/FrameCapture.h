@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Writes frames to image files off the render thread. Submit copies a frame into one of
+// a fixed number of slots and queues it in a ring; the worker threads encode the queued
+// frames into prefix_NNNNN.png, .pfm or .exr. When all the slots are taken, Submit either
+// drops the frame or blocks until a worker frees one. HDR frames are tone-mapped for PNG;
+// 8-bit frames, as the back buffers, are written as they are, or as [0, 1] floats.
+class FrameCapture
+{
+public:
+    enum Format : uint8_t
+    {
+        PNG,
+        PFM,
+        EXR
+    };
+
+    enum Policy : uint8_t
+    {
+        DROP,
+        BLOCK
+    };
+
+    struct Stats
+    {
+        uint32_t    NumSubmitted;
+        uint32_t    NumWritten;
+        uint32_t    NumDropped;
+        uint32_t    NumFailed;
+        uint32_t    MaxQueueDepth;
+        double      MeanQueueDepth;     // Seen by Submit, after queuing
+        double      EncodeTime;         // Summed over the workers
+        double      BlockTime;          // Of Submit, waiting for a slot
+        double      WallTime;           // From the first Submit to the end of Flush
+        uint64_t    NumPixels;
+    };
+
+    FrameCapture();
+    virtual ~FrameCapture();
+
+    bool Init(const char* prefix, Format format, Policy policy, uint32_t numSlots = 4, uint32_t numWorkers = 1);
+
+    // False if the frame is dropped
+    bool Submit(const float3* pImage, uint32_t width, uint32_t height);
+    bool Submit(const uint32_t* pImage, uint32_t width, uint32_t height);
+
+    // Waits for the queued frames to be written
+    void Flush();
+
+    Stats GetStats() const;
+
+    static const char* GetExtension(Format format);
+
+protected:
+    struct Slot
+    {
+        std::vector<float3>     HDR;
+        std::vector<uint32_t>   RGBA8;
+        uint32_t                Width;
+        uint32_t                Height;
+        uint32_t                Frame;
+        bool                    IsHDR;
+    };
+
+    Slot* acquireSlot();
+    void queueSlot(Slot* pSlot);
+    void workerMain();
+    bool encode(Slot& slot) const;
+    void stop();
+
+    std::string                 m_prefix;
+    Format                      m_format;
+    Policy                      m_policy;
+
+    std::vector<Slot>           m_slots;
+    std::vector<Slot*>          m_freeSlots;
+    std::vector<Slot*>          m_ring;         // Queued slots, oldest at m_ringHead
+    uint32_t                    m_ringHead;
+    uint32_t                    m_queueDepth;
+    uint32_t                    m_nextFrame;
+
+    std::vector<std::thread>    m_workers;
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_workCond;     // A slot is queued, or quitting
+    std::condition_variable     m_slotCond;     // A slot is freed
+
+    Stats                       m_stats;
+    uint64_t                    m_queueDepthSum;
+    std::chrono::high_resolution_clock::time_point m_startTime;
+    bool                        m_isQuitting;
+};
@@ -0,0 +1,347 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ImageIO.h"
+#include "PackedColor.h"
+
+using namespace std;
+
+bool WritePFM(const char* fileName, const float3* pImage, uint32_t width, uint32_t height)
+{
+    ofstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    // Negative scale for little endian; rows are stored bottom to top
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    for (auto y = height; y-- > 0;)
+        file.write(reinterpret_cast<const char*>(&pImage[static_cast<size_t>(width) * y]), sizeof(float3) * width);
+
+    return file.good();
+}
+
+// Deflate stream of the fixed Huffman codes, written from the least significant bit
+class BitWriter
+{
+public:
+    BitWriter(vector<uint8_t>& data) : m_data(data), m_bits(0), m_numBits(0) {}
+
+    void Write(uint32_t bits, uint32_t numBits)
+    {
+        m_bits |= static_cast<uint64_t>(bits) << m_numBits;
+        m_numBits += numBits;
+        while (m_numBits >= 8)
+        {
+            m_data.push_back(static_cast<uint8_t>(m_bits));
+            m_bits >>= 8;
+            m_numBits -= 8;
+        }
+    }
+
+    // Huffman codes go most significant bit first
+    void WriteCode(uint32_t code, uint32_t numBits)
+    {
+        auto reversed = 0u;
+        for (auto i = 0u; i < numBits; ++i) reversed |= ((code >> i) & 1) << (numBits - 1 - i);
+        Write(reversed, numBits);
+    }
+
+    void Flush()
+    {
+        if (m_numBits > 0) m_data.push_back(static_cast<uint8_t>(m_bits));
+        m_bits = 0;
+        m_numBits = 0;
+    }
+
+protected:
+    vector<uint8_t>& m_data;
+    uint64_t m_bits;
+    uint32_t m_numBits;
+};
+
+static void writeLiteral(BitWriter& writer, uint32_t symbol)
+{
+    if (symbol < 144) writer.WriteCode(0x30 + symbol, 8);
+    else if (symbol < 256) writer.WriteCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) writer.WriteCode(symbol - 256, 7);
+    else writer.WriteCode(0xc0 + symbol - 280, 8);
+}
+
+static void writeMatch(BitWriter& writer, uint32_t length, uint32_t distance)
+{
+    static const uint16_t lengthBases[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lengthExtras[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distBases[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t distExtras[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    auto i = static_cast<uint32_t>(upper_bound(lengthBases, lengthBases + 29, length) - lengthBases) - 1;
+    writeLiteral(writer, 257 + i);
+    writer.Write(length - lengthBases[i], lengthExtras[i]);
+
+    i = static_cast<uint32_t>(upper_bound(distBases, distBases + 30, distance) - distBases) - 1;
+    writer.WriteCode(i, 5);
+    writer.Write(distance - distBases[i], distExtras[i]);
+}
+
+// Zlib stream of a single fixed-code block, with LZ77 matches from hash chains over the 32K window
+static void deflate(const uint8_t* pSrc, size_t size, vector<uint8_t>& data)
+{
+    static const uint32_t windowSize = 1 << 15;
+    static const uint32_t hashBits = 15;
+    static const uint32_t maxChain = 16;
+    static const uint32_t minMatch = 3, maxMatch = 258;
+
+    data.push_back(0x78);
+    data.push_back(0x01);
+
+    BitWriter writer(data);
+    writer.Write(1, 1); // Final block
+    writer.Write(1, 2); // Fixed Huffman codes
+
+    vector<int64_t> heads(1 << hashBits, -1);
+    vector<int64_t> prevs(windowSize, -1);
+    const auto hash = [pSrc](size_t i)
+    {
+        const auto key = pSrc[i] | (pSrc[i + 1] << 8) | (pSrc[i + 2] << 16);
+
+        return (key * 2654435761u) >> (32 - hashBits);
+    };
+    const auto insert = [&](size_t i)
+    {
+        const auto h = hash(i);
+        prevs[i & (windowSize - 1)] = heads[h];
+        heads[h] = static_cast<int64_t>(i);
+    };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        auto bestLength = 0u, bestDist = 0u;
+        if (i + minMatch <= size)
+        {
+            const auto maxLength = static_cast<uint32_t>((min<size_t>)(maxMatch, size - i));
+            auto candidate = heads[hash(i)];
+            for (auto j = 0u; j < maxChain && candidate >= 0 && i - candidate <= windowSize - 1; ++j)
+            {
+                auto length = 0u;
+                while (length < maxLength && pSrc[candidate + length] == pSrc[i + length]) ++length;
+                if (length > bestLength)
+                {
+                    bestLength = length;
+                    bestDist = static_cast<uint32_t>(i - candidate);
+                    if (length == maxLength) break;
+                }
+                candidate = prevs[candidate & (windowSize - 1)];
+            }
+        }
+
+        if (bestLength >= minMatch)
+        {
+            writeMatch(writer, bestLength, bestDist);
+            const auto end = i + bestLength;
+            for (; i < end; ++i) if (i + minMatch <= size) insert(i);
+        }
+        else
+        {
+            writeLiteral(writer, pSrc[i]);
+            if (i + minMatch <= size) insert(i);
+            ++i;
+        }
+    }
+    writeLiteral(writer, 256);
+    writer.Flush();
+
+    auto a = 1u, b = 0u;
+    for (size_t j = 0; j < size; ++j)
+    {
+        a = (a + pSrc[j]) % 65521;
+        b = (b + a) % 65521;
+    }
+    const auto adler = (b << 16) | a;
+    for (auto shift = 24; shift >= 0; shift -= 8) data.push_back(static_cast<uint8_t>(adler >> shift));
+}
+
+static uint32_t crc32(const uint8_t* pData, size_t size, uint32_t crc = 0)
+{
+    static const auto table = []
+    {
+        vector<uint32_t> table(256);
+        for (auto i = 0u; i < 256; ++i)
+        {
+            auto c = i;
+            for (auto k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ pData[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static void writeChunk(ofstream& file, const char* type, const vector<uint8_t>& data)
+{
+    vector<uint8_t> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    const auto size = static_cast<uint32_t>(data.size());
+    const auto crc = crc32(chunk.data(), chunk.size());
+    const uint8_t header[] = { uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size) };
+    const uint8_t footer[] = { uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+    file.write(reinterpret_cast<const char*>(header), 4);
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    file.write(reinterpret_cast<const char*>(footer), 4);
+}
+
+bool WritePNG(const char* fileName, const uint32_t* pImage, uint32_t width, uint32_t height)
+{
+    ofstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    // Each row is filtered as none, sub, up or Paeth, whichever leaves the smallest residuals
+    const auto rowSize = static_cast<size_t>(width) * 3;
+    vector<uint8_t> filtered((rowSize + 1) * height);
+    vector<uint8_t> rows[2] = { vector<uint8_t>(rowSize), vector<uint8_t>(rowSize) };
+    vector<uint8_t> residuals(rowSize);
+    for (auto y = 0u; y < height; ++y)
+    {
+        auto& row = rows[y & 1];
+        const auto& above = rows[(y + 1) & 1];
+        for (auto x = 0u; x < width; ++x)
+        {
+            const auto pixel = pImage[static_cast<size_t>(width) * y + x];
+            for (auto c = 0u; c < 3; ++c) row[x * 3 + c] = static_cast<uint8_t>(pixel >> (8 * c));
+        }
+
+        auto pFiltered = &filtered[(rowSize + 1) * y];
+        auto bestSum = UINT64_MAX;
+        for (uint8_t filter = 0; filter < 5; ++filter)
+        {
+            if (filter == 3) continue; // Average is rarely chosen
+            uint64_t sum = 0;
+            for (size_t i = 0; i < rowSize; ++i)
+            {
+                const int a = i >= 3 ? row[i - 3] : 0;
+                const int b = y > 0 ? above[i] : 0;
+                const int c = i >= 3 && y > 0 ? above[i - 3] : 0;
+                int predictor = 0;
+                if (filter == 1) predictor = a;
+                else if (filter == 2) predictor = b;
+                else if (filter == 4)
+                {
+                    const auto p = a + b - c;
+                    const auto pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                    predictor = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+                }
+                residuals[i] = static_cast<uint8_t>(row[i] - predictor);
+                sum += abs(static_cast<int8_t>(residuals[i]));
+            }
+
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                pFiltered[0] = filter;
+                memcpy(pFiltered + 1, residuals.data(), rowSize);
+            }
+        }
+    }
+
+    static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    // 8-bit RGB, not interlaced
+    const vector<uint8_t> header = { uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+        uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height), 8, 2, 0, 0, 0 };
+    writeChunk(file, "IHDR", header);
+
+    vector<uint8_t> data;
+    data.reserve(filtered.size() / 2);
+    deflate(filtered.data(), filtered.size(), data);
+    writeChunk(file, "IDAT", data);
+    writeChunk(file, "IEND", {});
+
+    return file.good();
+}
+
+template<typename T>
+static void writeValue(ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void writeAttribute(ofstream& file, const char* name, const char* type, uint32_t size)
+{
+    file.write(name, strlen(name) + 1);
+    file.write(type, strlen(type) + 1);
+    writeValue(file, size);
+}
+
+bool WriteEXR(const char* fileName, const float3* pImage, uint32_t width, uint32_t height)
+{
+    ofstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    // Magic number, then version 2, single-part scanlines
+    writeValue(file, 20000630u);
+    writeValue(file, 2u);
+
+    // Channels in alphabetical order, as half floats
+    static const char channels[] = { 'B', 'G', 'R' };
+    writeAttribute(file, "channels", "chlist", 3 * 18 + 1);
+    for (const auto channel : channels)
+    {
+        const char name[] = { channel, '\0' };
+        file.write(name, 2);
+        writeValue(file, 1);        // HALF
+        writeValue(file, 0u);       // Not perceptually linear, and reserved
+        writeValue(file, 1);        // x sampling
+        writeValue(file, 1);        // y sampling
+    }
+    file.put('\0');
+
+    const int32_t window[] = { 0, 0, static_cast<int32_t>(width) - 1, static_cast<int32_t>(height) - 1 };
+    writeAttribute(file, "compression", "compression", 1);
+    file.put(0);                    // None
+    writeAttribute(file, "dataWindow", "box2i", sizeof(window));
+    writeValue(file, window);
+    writeAttribute(file, "displayWindow", "box2i", sizeof(window));
+    writeValue(file, window);
+    writeAttribute(file, "lineOrder", "lineOrder", 1);
+    file.put(0);                    // Increasing y
+    writeAttribute(file, "pixelAspectRatio", "float", 4);
+    writeValue(file, 1.0f);
+    writeAttribute(file, "screenWindowCenter", "v2f", 8);
+    writeValue(file, float2(0.0f, 0.0f));
+    writeAttribute(file, "screenWindowWidth", "float", 4);
+    writeValue(file, 1.0f);
+    file.put('\0');
+
+    // One row per chunk without compression, each after its y and its size
+    const auto rowSize = static_cast<uint32_t>(width * sizeof(uint16_t) * 3);
+    auto offset = static_cast<uint64_t>(file.tellp()) + sizeof(uint64_t) * height;
+    for (auto y = 0u; y < height; ++y, offset += rowSize + 8) writeValue(file, offset);
+
+    vector<uint16_t> row(width * 3);
+    for (auto y = 0u; y < height; ++y)
+    {
+        const auto pRow = &pImage[static_cast<size_t>(width) * y];
+        for (auto x = 0u; x < width; ++x)
+        {
+            row[x] = FloatToHalf(pRow[x].z);
+            row[width + x] = FloatToHalf(pRow[x].y);
+            row[width * 2 + x] = FloatToHalf(pRow[x].x);
+        }
+        writeValue(file, y);
+        writeValue(file, rowSize);
+        file.write(reinterpret_cast<const char*>(row.data()), rowSize);
+    }
+
+    return file.good();
+}
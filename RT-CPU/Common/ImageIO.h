@@ -0,0 +1,17 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Writes a linear HDR image as a portable float map (PFM), top row first in memory
+bool WritePFM(const char* fileName, const float3* pImage, uint32_t width, uint32_t height);
+
+// Writes 8-bit RGBA pixels, as R8G8B8A8_UNORM stores them, as an RGB PNG, deflated with
+// the fixed Huffman codes after the per-row filter with the smallest residuals
+bool WritePNG(const char* fileName, const uint32_t* pImage, uint32_t width, uint32_t height);
+
+// Writes a linear HDR image as an uncompressed OpenEXR scanline image of half floats
+bool WriteEXR(const char* fileName, const float3* pImage, uint32_t width, uint32_t height);
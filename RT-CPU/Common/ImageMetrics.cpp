@@ -0,0 +1,342 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ImageMetrics.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const float Pi = 3.141592654f;
+
+// Separable convolution with clamped borders; the kernel is centered
+static void convolve(const float* pSrc, float* pDst, uint32_t width, uint32_t height,
+    const vector<float>& kernelX, const vector<float>& kernelY)
+{
+    vector<float> temp(static_cast<size_t>(width) * height);
+    const auto radiusX = static_cast<int32_t>(kernelX.size() / 2);
+    const auto radiusY = static_cast<int32_t>(kernelY.size() / 2);
+    const auto w = static_cast<int32_t>(width);
+    const auto h = static_cast<int32_t>(height);
+
+    auto& threadPool = ThreadPool::GetDefault();
+    threadPool.ParallelFor(height, 8, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+        {
+            const auto pRow = &pSrc[static_cast<size_t>(w) * y];
+            for (auto x = 0; x < w; ++x)
+            {
+                auto sum = 0.0f;
+                for (auto i = -radiusX; i <= radiusX; ++i)
+                    sum += kernelX[i + radiusX] * pRow[(min)((max)(x + i, 0), w - 1)];
+                temp[static_cast<size_t>(w) * y + x] = sum;
+            }
+        }
+    });
+
+    threadPool.ParallelFor(height, 8, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+        {
+            for (auto x = 0; x < w; ++x)
+            {
+                auto sum = 0.0f;
+                for (auto i = -radiusY; i <= radiusY; ++i)
+                    sum += kernelY[i + radiusY] * temp[static_cast<size_t>(w) * (min)((max)(y + i, 0), h - 1) + x];
+                pDst[static_cast<size_t>(w) * y + x] = sum;
+            }
+        }
+    });
+}
+
+static vector<float> gaussianKernel(float sigma, int32_t radius)
+{
+    vector<float> kernel(2 * radius + 1);
+    auto sum = 0.0f;
+    for (auto i = -radius; i <= radius; ++i)
+        sum += kernel[i + radius] = exp(-0.5f * i * i / (sigma * sigma));
+    for (auto& k : kernel) k /= sum;
+
+    return kernel;
+}
+
+static double mean(const vector<float>& values)
+{
+    auto sum = 0.0;
+    for (const auto& value : values) sum += value;
+
+    return sum / values.size();
+}
+
+double ImageMetrics::PSNR(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height)
+{
+    const auto numPixels = static_cast<size_t>(width) * height;
+    auto sse = 0.0;
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        const auto diff = pTest[i] - pReference[i];
+        sse += dot(diff, diff);
+    }
+
+    const auto mse = sse / (3.0 * numPixels);
+
+    return mse > 0.0 ? 10.0 * log10(1.0 / mse) : INFINITY;
+}
+
+double ImageMetrics::SSIM(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height)
+{
+    const auto numPixels = static_cast<size_t>(width) * height;
+    const auto luma = float3(0.299f, 0.587f, 0.114f);
+
+    // Local means, variances and covariance
+    vector<float> moments[5], filtered[5];
+    for (auto& moment : moments) moment.resize(numPixels);
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        const auto x = dot(pReference[i], luma);
+        const auto y = dot(pTest[i], luma);
+        moments[0][i] = x;
+        moments[1][i] = y;
+        moments[2][i] = x * x;
+        moments[3][i] = y * y;
+        moments[4][i] = x * y;
+    }
+
+    const auto kernel = gaussianKernel(1.5f, 5);
+    for (auto i = 0; i < 5; ++i)
+    {
+        filtered[i].resize(numPixels);
+        convolve(moments[i].data(), filtered[i].data(), width, height, kernel, kernel);
+    }
+
+    const auto c1 = 0.01f * 0.01f;
+    const auto c2 = 0.03f * 0.03f;
+    auto& ssim = moments[0];
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        const auto muX = filtered[0][i];
+        const auto muY = filtered[1][i];
+        const auto sigmaX2 = filtered[2][i] - muX * muX;
+        const auto sigmaY2 = filtered[3][i] - muY * muY;
+        const auto sigmaXY = filtered[4][i] - muX * muY;
+        ssim[i] = (2.0f * muX * muY + c1) * (2.0f * sigmaXY + c2) /
+            ((muX * muX + muY * muY + c1) * (sigmaX2 + sigmaY2 + c2));
+    }
+
+    return mean(ssim);
+}
+
+//--------------------------------------------------------------------------------------
+// FLIP
+//--------------------------------------------------------------------------------------
+
+static float sRGBToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float3 linearRGBToXYZ(const float3& c)
+{
+    return float3(
+        0.4124564f * c.x + 0.3575761f * c.y + 0.1804375f * c.z,
+        0.2126729f * c.x + 0.7151522f * c.y + 0.0721750f * c.z,
+        0.0193339f * c.x + 0.1191920f * c.y + 0.9503041f * c.z);
+}
+
+static float3 XYZToLinearRGB(const float3& c)
+{
+    return float3(
+        3.2404542f * c.x - 1.5371385f * c.y - 0.4985314f * c.z,
+        -0.9692660f * c.x + 1.8760108f * c.y + 0.0415560f * c.z,
+        0.0556434f * c.x - 0.2040259f * c.y + 1.0572252f * c.z);
+}
+
+// Opponent space, relative to the D65 white point of the linear RGB
+static const float3 WhiteD65(0.950428545f, 1.0f, 1.088900371f);
+
+static float3 XYZToYCxCz(const float3& c)
+{
+    const auto x = c.x / WhiteD65.x;
+    const auto y = c.y / WhiteD65.y;
+    const auto z = c.z / WhiteD65.z;
+
+    return float3(116.0f * y - 16.0f, 500.0f * (x - y), 200.0f * (y - z));
+}
+
+static float3 YCxCzToXYZ(const float3& c)
+{
+    const auto y = (c.x + 16.0f) / 116.0f;
+
+    return float3((y + c.y / 500.0f) * WhiteD65.x, y * WhiteD65.y, (y - c.z / 200.0f) * WhiteD65.z);
+}
+
+// Hunt-adjusted CIELab
+static float3 XYZToHuntLab(const float3& c)
+{
+    const auto f = [](float t)
+    {
+        const auto delta = 6.0f / 29.0f;
+
+        return t > delta * delta * delta ? cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+    };
+
+    const auto fx = f(c.x / WhiteD65.x);
+    const auto fy = f(c.y / WhiteD65.y);
+    const auto fz = f(c.z / WhiteD65.z);
+    const auto l = 116.0f * fy - 16.0f;
+
+    return float3(l, 0.01f * l * 500.0f * (fx - fy), 0.01f * l * 200.0f * (fy - fz));
+}
+
+static float hyAB(const float3& a, const float3& b)
+{
+    const auto da = a.y - b.y;
+    const auto db = a.z - b.z;
+
+    return abs(a.x - b.x) + sqrt(da * da + db * db);
+}
+
+// Contrast sensitivity of an opponent channel, a1 and b1 for the first Gaussian and a2 and b2
+// for the second one, if any, in the spatial domain. The sum of two 2D Gaussians is not
+// separable, so each one is filtered separately and weighted by its share of the kernel.
+static void filterCSF(const float* pSrc, float* pDst, uint32_t width, uint32_t height,
+    float a1, float b1, float a2, float b2, float pixelsPerDegree)
+{
+    const auto radius = static_cast<int32_t>(ceil(3.0f * sqrt(0.04f / (2.0f * Pi * Pi)) * pixelsPerDegree));
+    const float a[] = { a1, a2 };
+    const float b[] = { b1, b2 };
+
+    vector<float> kernels[2];
+    float weights[2] = {};
+    for (auto j = 0; j < 2; ++j)
+    {
+        if (a[j] <= 0.0f) continue;
+
+        kernels[j].resize(2 * radius + 1);
+        auto sum = 0.0f;
+        for (auto i = -radius; i <= radius; ++i)
+        {
+            const auto x = i / pixelsPerDegree;
+            sum += kernels[j][i + radius] = exp(-Pi * Pi * x * x / b[j]);
+        }
+        for (auto& k : kernels[j]) k /= sum;
+        weights[j] = a[j] * sqrt(Pi / b[j]) * sum * sum;
+    }
+
+    const auto numPixels = static_cast<size_t>(width) * height;
+    convolve(pSrc, pDst, width, height, kernels[0], kernels[0]);
+    if (weights[1] > 0.0f)
+    {
+        vector<float> temp(numPixels);
+        convolve(pSrc, temp.data(), width, height, kernels[1], kernels[1]);
+        const auto w = weights[0] / (weights[0] + weights[1]);
+        for (size_t i = 0; i < numPixels; ++i) pDst[i] = w * pDst[i] + (1.0f - w) * temp[i];
+    }
+}
+
+// Edge (first derivative) and point (second derivative) detectors of Gaussians, with the
+// positive and negative lobes normalized separately
+static void featureKernels(float pixelsPerDegree, vector<float>& gaussian, vector<float>& edge, vector<float>& point)
+{
+    const auto sigma = 0.5f * 0.082f * pixelsPerDegree;
+    const auto radius = static_cast<int32_t>(ceil(3.0f * sigma));
+    gaussian = gaussianKernel(sigma, radius);
+    edge.resize(gaussian.size());
+    point.resize(gaussian.size());
+
+    auto edgeSum = 0.0f, pointPos = 0.0f, pointNeg = 0.0f;
+    for (auto i = -radius; i <= radius; ++i)
+    {
+        const auto g = gaussian[i + radius];
+        edge[i + radius] = -i * g;
+        point[i + radius] = (i * i / (sigma * sigma) - 1.0f) * g;
+        if (i > 0) edgeSum += i * g;
+        (point[i + radius] > 0.0f ? pointPos : pointNeg) += point[i + radius];
+    }
+
+    for (auto& k : edge) k /= edgeSum;
+    for (auto& k : point) k /= k > 0.0f ? pointPos : -pointNeg;
+}
+
+double ImageMetrics::FLIP(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height,
+    float pixelsPerDegree)
+{
+    const auto numPixels = static_cast<size_t>(width) * height;
+    const float3* pImages[] = { pReference, pTest };
+
+    // CSF parameters of the achromatic, red-green and blue-yellow channels
+    const float csfParams[][4] =
+    {
+        { 1.0f, 0.0047f, 0.0f, 1e-5f },
+        { 1.0f, 0.0053f, 0.0f, 1e-5f },
+        { 34.1f, 0.04f, 13.5f, 0.025f }
+    };
+
+    vector<float> gaussian, edge, point;
+    featureKernels(pixelsPerDegree, gaussian, edge, point);
+
+    vector<float3> labs[2];
+    vector<float> edges[2], points[2];
+    vector<float> channels[3], temp(numPixels), gradX(numPixels), gradY(numPixels);
+    for (auto& channel : channels) channel.resize(numPixels);
+    for (auto k = 0u; k < 2; ++k)
+    {
+        // Opponent channels, and the normalized achromatic channel for the features
+        vector<float> achromatic(numPixels);
+        for (size_t i = 0; i < numPixels; ++i)
+        {
+            const auto& c = pImages[k][i];
+            const auto ycxcz = XYZToYCxCz(linearRGBToXYZ(float3(sRGBToLinear(c.x), sRGBToLinear(c.y), sRGBToLinear(c.z))));
+            channels[0][i] = ycxcz.x;
+            channels[1][i] = ycxcz.y;
+            channels[2][i] = ycxcz.z;
+            achromatic[i] = (ycxcz.x + 16.0f) / 116.0f;
+        }
+
+        // Spatial filtering, then back to the Hunt-adjusted Lab of the clamped RGB
+        for (auto j = 0u; j < 3; ++j)
+        {
+            const auto& p = csfParams[j];
+            filterCSF(channels[j].data(), temp.data(), width, height, p[0], p[1], p[2], p[3], pixelsPerDegree);
+            channels[j].swap(temp);
+        }
+
+        labs[k].resize(numPixels);
+        for (size_t i = 0; i < numPixels; ++i)
+        {
+            auto rgb = XYZToLinearRGB(YCxCzToXYZ(float3(channels[0][i], channels[1][i], channels[2][i])));
+            rgb = float3(saturate(rgb.x), saturate(rgb.y), saturate(rgb.z));
+            labs[k][i] = XYZToHuntLab(linearRGBToXYZ(rgb));
+        }
+
+        // Feature magnitudes
+        edges[k].resize(numPixels);
+        points[k].resize(numPixels);
+        convolve(achromatic.data(), gradX.data(), width, height, edge, gaussian);
+        convolve(achromatic.data(), gradY.data(), width, height, gaussian, edge);
+        for (size_t i = 0; i < numPixels; ++i) edges[k][i] = sqrt(gradX[i] * gradX[i] + gradY[i] * gradY[i]);
+        convolve(achromatic.data(), gradX.data(), width, height, point, gaussian);
+        convolve(achromatic.data(), gradY.data(), width, height, gaussian, point);
+        for (size_t i = 0; i < numPixels; ++i) points[k][i] = sqrt(gradX[i] * gradX[i] + gradY[i] * gradY[i]);
+    }
+
+    // Color difference, remapped with the largest difference of the gamut, between green and blue
+    const auto qc = 0.7f, pc = 0.4f, pt = 0.95f;
+    const auto cmax = pow(hyAB(XYZToHuntLab(linearRGBToXYZ(float3(0.0f, 1.0f, 0.0f))),
+        XYZToHuntLab(linearRGBToXYZ(float3(0.0f, 0.0f, 1.0f)))), qc);
+
+    auto& flip = temp;
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        const auto deltaE = pow(hyAB(labs[0][i], labs[1][i]), qc);
+        const auto colorDiff = deltaE < pc * cmax ? pt / (pc * cmax) * deltaE :
+            pt + (deltaE - pc * cmax) / (cmax - pc * cmax) * (1.0f - pt);
+
+        const auto featureDiff = sqrt((max)(abs(edges[0][i] - edges[1][i]), abs(points[0][i] - points[1][i])) / sqrt(2.0f));
+        flip[i] = pow(colorDiff, 1.0f - featureDiff);
+    }
+
+    return mean(flip);
+}
@@ -0,0 +1,22 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Full-reference image quality metrics on display (sRGB-encoded) images in [0, 1]
+namespace ImageMetrics
+{
+    // Peak signal-to-noise ratio over all channels, in dB
+    double PSNR(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height);
+
+    // Mean structural similarity of the luma, with the 11x11 Gaussian window (sigma 1.5) of Wang et al. 2004
+    double SSIM(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height);
+
+    // Mean LDR-FLIP error [Andersson et al. 2020], in [0, 1], for the default
+    // viewing conditions of 0.7 m to a 0.7 m wide monitor of 3840 pixels
+    double FLIP(const float3* pReference, const float3* pTest, uint32_t width, uint32_t height,
+        float pixelsPerDegree = 67.0206f);
+}
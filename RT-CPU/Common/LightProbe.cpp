@@ -0,0 +1,502 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "LightProbe.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const float Pi = 3.141592654f;
+static const uint32_t NumGGXSamples = 64;
+
+// Layout of the .probe file; the SH, mips 1 and up, face by face without the borders, and
+// the entries of the alias table follow
+struct ProbeCacheHeader
+{
+    char        Magic[4];
+    uint32_t    Version;
+    uint64_t    SourceHash;
+    uint32_t    Filter;
+    uint32_t    NumSamples;
+    uint32_t    Size;
+    uint32_t    NumMips;
+};
+
+static const char ProbeCacheMagic[4] = { 'R', 'T', 'L', 'P' };
+static const uint32_t ProbeCacheVersion = 2;
+
+// Solid angle of the texel (x, y) of a face of n x n texels
+static float texelSolidAngle(uint32_t x, uint32_t y, uint32_t n)
+{
+    const auto areaElement = [](float s, float t) { return atan2(s * t, sqrt(s * s + t * t + 1.0f)); };
+    const auto s0 = 2.0f * x / n - 1.0f, s1 = 2.0f * (x + 1) / n - 1.0f;
+    const auto t0 = 2.0f * y / n - 1.0f, t1 = 2.0f * (y + 1) / n - 1.0f;
+
+    return areaElement(s0, t0) - areaElement(s0, t1) - areaElement(s1, t0) + areaElement(s1, t1);
+}
+
+// The same for all the faces, so computed for one
+static vector<float> getTexelSolidAngles(uint32_t n, ThreadPool& threadPool)
+{
+    vector<float> solidAngles(static_cast<size_t>(n) * n);
+    threadPool.ParallelFor(n, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = begin; y < end; ++y)
+            for (auto x = 0u; x < n; ++x) solidAngles[static_cast<size_t>(n) * y + x] = texelSolidAngle(x, y, n);
+    });
+
+    return solidAngles;
+}
+
+// Real SH basis of bands 0 to 2
+static void evaluateSHBasis(const float3& dir, float basis[9])
+{
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * dir.y;
+    basis[2] = 0.488603f * dir.z;
+    basis[3] = 0.488603f * dir.x;
+    basis[4] = 1.092548f * dir.x * dir.y;
+    basis[5] = 1.092548f * dir.y * dir.z;
+    basis[6] = 0.315392f * (3.0f * dir.z * dir.z - 1.0f);
+    basis[7] = 1.092548f * dir.x * dir.z;
+    basis[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+}
+
+static float getLuminance(const float3& color)
+{
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+static float3 getTexelDirection(CubeMap::Face face, uint32_t x, uint32_t y, uint32_t n)
+{
+    return normalize(CubeMap::GetDirection(face, float2((x + 0.5f) / n, (y + 0.5f) / n)));
+}
+
+LightProbe::LightProbe() :
+    m_irradianceSH(),
+    m_filter(BOX),
+    m_decodeTime(0.0),
+    m_prefilterTime(0.0),
+    m_tableTime(0.0),
+    m_cacheTime(0.0),
+    m_isFromCache(false)
+{
+}
+
+LightProbe::~LightProbe()
+{
+}
+
+bool LightProbe::Init(const char* fileName, Filter filter, bool useCache, ThreadPool* pThreadPool)
+{
+    using Clock = chrono::high_resolution_clock;
+    const auto getSeconds = [](const Clock::time_point& start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    auto& threadPool = pThreadPool ? *pThreadPool : ThreadPool::GetDefault();
+    m_filter = filter;
+    m_prefilterTime = 0.0;
+    m_tableTime = 0.0;
+    m_cacheTime = 0.0;
+    m_isFromCache = false;
+
+    DDSReader reader;
+    if (!reader.Load(fileName)) return false;
+
+    // Mip 0 from the DDS; the mips of the file are replaced by the filtered ones
+    auto start = Clock::now();
+    CubeMap source;
+    if (!source.Init(reader)) return false;
+    const auto size = source.GetSize();
+    auto numMips = 1u;
+    while ((size >> numMips) > 0) ++numMips;
+
+    m_cubeMap.Init(size, numMips);
+    for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        for (auto y = 0u; y < size; ++y)
+            for (auto x = 0u; x < size; ++x)
+                m_cubeMap.SetTexel(0, CubeMap::Face(face), x, y, source.GetTexel(0, CubeMap::Face(face), x, y));
+    m_cubeMap.UpdateBorders(0);
+    m_decodeTime = getSeconds(start);
+
+    start = Clock::now();
+    const auto cacheFileName = GetCacheFileName(fileName);
+    const auto sourceHash = reader.GetHash();
+    m_isFromCache = useCache && loadCache(cacheFileName, sourceHash);
+    m_cacheTime = getSeconds(start);
+    if (m_isFromCache) return true;
+
+    start = Clock::now();
+    buildBoxChain(threadPool);
+    if (filter == GGX)
+    {
+        // Filtered importance sampling reads the box-filtered chain
+        source = m_cubeMap;
+        prefilterGGX(source, threadPool);
+    }
+    projectIrradiance(threadPool);
+    m_prefilterTime = getSeconds(start);
+
+    start = Clock::now();
+    if (!buildAliasTable(threadPool)) return false;
+    m_tableTime = getSeconds(start);
+
+    if (useCache)
+    {
+        start = Clock::now();
+        if (!saveCache(cacheFileName, sourceHash)) cerr << "Failed to write " << cacheFileName << endl;
+        m_cacheTime += getSeconds(start);
+    }
+
+    return true;
+}
+
+float3 LightProbe::SampleLevel(const float3& dir, float level) const
+{
+    return m_cubeMap.SampleLevel(dir, level);
+}
+
+float3 LightProbe::SampleRoughness(const float3& dir, float roughness) const
+{
+    return m_cubeMap.SampleLevel(dir, saturate(roughness) * (m_cubeMap.GetNumMips() - 1));
+}
+
+float3 LightProbe::EvaluateIrradiance(const float3& normal) const
+{
+    float basis[9];
+    evaluateSHBasis(normal, basis);
+
+    float3 irradiance = 0.0f;
+    for (auto i = 0u; i < 9; ++i) irradiance += m_irradianceSH[i] * basis[i];
+
+    return max3(irradiance, 0.0f);
+}
+
+float3 LightProbe::Sample(const float3& u, float& pdf) const
+{
+    const auto n = m_cubeMap.GetSize();
+    auto s = u.y;
+    const auto i = m_aliasTable.Sample(u.x, s);
+    const auto face = CubeMap::Face(i / (n * n));
+    const auto x = i % n, y = i / n % n;
+
+    // Uniform over the texel on the face, so the PDF over solid angle grows with r^3
+    const auto dir = CubeMap::GetDirection(face, float2((x + s) / n, (y + u.z) / n));
+    const auto r2 = dot(dir, dir);
+    pdf = m_aliasTable.GetProbability(i) * (n * n * 0.25f) * r2 * sqrt(r2);
+
+    return dir / sqrt(r2);
+}
+
+float LightProbe::GetPdf(const float3& dir) const
+{
+    const auto n = m_cubeMap.GetSize();
+    float2 uv;
+    const auto face = CubeMap::SelectFace(dir, uv);
+    const auto x = (min)(static_cast<uint32_t>((max)(uv.x, 0.0f) * n), n - 1);
+    const auto y = (min)(static_cast<uint32_t>((max)(uv.y, 0.0f) * n), n - 1);
+    const auto r2 = dot(CubeMap::GetDirection(face, uv), CubeMap::GetDirection(face, uv));
+
+    return m_aliasTable.GetProbability((face * n + y) * n + x) * (n * n * 0.25f) * r2 * sqrt(r2);
+}
+
+const CubeMap& LightProbe::GetCubeMap() const
+{
+    return m_cubeMap;
+}
+
+const float3* LightProbe::GetIrradianceSH() const
+{
+    return m_irradianceSH;
+}
+
+const AliasTable& LightProbe::GetAliasTable() const
+{
+    return m_aliasTable;
+}
+
+LightProbe::Filter LightProbe::GetFilter() const
+{
+    return m_filter;
+}
+
+double LightProbe::GetDecodeTime() const
+{
+    return m_decodeTime;
+}
+
+double LightProbe::GetPrefilterTime() const
+{
+    return m_prefilterTime;
+}
+
+double LightProbe::GetTableTime() const
+{
+    return m_tableTime;
+}
+
+double LightProbe::GetCacheTime() const
+{
+    return m_cacheTime;
+}
+
+bool LightProbe::IsFromCache() const
+{
+    return m_isFromCache;
+}
+
+string LightProbe::GetCacheFileName(const char* fileName)
+{
+    string cacheFileName = fileName;
+    const auto dot = cacheFileName.find_last_of('.');
+    const auto slash = cacheFileName.find_last_of("/\\");
+    if (dot != string::npos && (slash == string::npos || dot > slash)) cacheFileName.resize(dot);
+
+    return cacheFileName + ".probe";
+}
+
+// Each texel is the average of its 2 x 2 children, in parallel over the rows of all the faces
+void LightProbe::buildBoxChain(ThreadPool& threadPool)
+{
+    for (auto mip = 1u; mip < m_cubeMap.GetNumMips(); ++mip)
+    {
+        const auto n = m_cubeMap.GetSize(mip);
+        const auto childSize = m_cubeMap.GetSize(mip - 1);
+        threadPool.ParallelFor(CubeMap::NUM_FACE * n, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto face = CubeMap::Face(i / n);
+                const auto y = i % n;
+                const auto y0 = (min)(2 * y, childSize - 1), y1 = (min)(2 * y + 1, childSize - 1);
+                for (auto x = 0u; x < n; ++x)
+                {
+                    const auto x0 = (min)(2 * x, childSize - 1), x1 = (min)(2 * x + 1, childSize - 1);
+                    m_cubeMap.SetTexel(mip, face, x, y, (m_cubeMap.GetTexel(mip - 1, face, x0, y0) +
+                        m_cubeMap.GetTexel(mip - 1, face, x1, y0) + m_cubeMap.GetTexel(mip - 1, face, x0, y1) +
+                        m_cubeMap.GetTexel(mip - 1, face, x1, y1)) * 0.25f);
+                }
+            }
+        });
+        m_cubeMap.UpdateBorders(mip);
+    }
+}
+
+// Split-sum prefiltering with N = V = R: GGX samples weighted by NdotL, each read from the
+// box-filtered mip whose texels cover the solid angle of its PDF, so that few samples suffice.
+void LightProbe::prefilterGGX(const CubeMap& source, ThreadPool& threadPool)
+{
+    struct Sample
+    {
+        float3  H;      // Tangent space
+        float   NdotL;
+        float   Level;
+    };
+
+    const auto numMips = m_cubeMap.GetNumMips();
+    const auto texelSolidAngle0 = 4.0f * Pi / (CubeMap::NUM_FACE * static_cast<float>(source.GetSize()) * source.GetSize());
+    vector<Sample> samples;
+    for (auto mip = 1u; mip < numMips; ++mip)
+    {
+        // The samples of a mip are the same for all its texels, up to the tangent frame
+        const auto roughness = static_cast<float>(mip) / (numMips - 1);
+        const auto a = roughness * roughness;
+        const auto a2 = a * a;
+        samples.clear();
+        for (auto i = 0u; i < NumGGXSamples; ++i)
+        {
+            auto bits = i;
+            bits = (bits << 16) | (bits >> 16);
+            bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+            bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+            bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+            bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+            const auto u = (i + 0.5f) / NumGGXSamples;
+            const auto v = bits * 2.3283064365386963e-10f;
+
+            const auto phi = 2.0f * Pi * u;
+            const auto cosTheta = sqrt((1.0f - v) / (1.0f + (a2 - 1.0f) * v));
+            const auto sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+            const auto NdotL = 2.0f * cosTheta * cosTheta - 1.0f;
+            if (NdotL <= 0.0f) continue;
+
+            const auto d = cosTheta * cosTheta * (a2 - 1.0f) + 1.0f;
+            const auto pdf = a2 / (Pi * d * d) * 0.25f;
+            const auto sampleSolidAngle = 1.0f / (NumGGXSamples * pdf);
+            const auto level = 0.5f * log2((max)(sampleSolidAngle / texelSolidAngle0, 1.0f)) + 1.0f;
+            samples.push_back({ float3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta), NdotL,
+                (min)(level, static_cast<float>(numMips - 1)) });
+        }
+
+        const auto n = m_cubeMap.GetSize(mip);
+        threadPool.ParallelFor(CubeMap::NUM_FACE * n, 4, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto face = CubeMap::Face(i / n);
+                const auto y = i % n;
+                for (auto x = 0u; x < n; ++x)
+                {
+                    const auto N = getTexelDirection(face, x, y, n);
+                    const auto up = fabs(N.z) < 0.999f ? float3(0.0f, 0.0f, 1.0f) : float3(1.0f, 0.0f, 0.0f);
+                    const auto T = normalize(cross(up, N));
+                    const auto B = cross(N, T);
+
+                    float3 color = 0.0f;
+                    auto weight = 0.0f;
+                    for (const auto& sample : samples)
+                    {
+                        const auto H = T * sample.H.x + B * sample.H.y + N * sample.H.z;
+                        const auto L = 2.0f * sample.H.z * H - N;
+                        color += source.SampleLevel(L, sample.Level) * sample.NdotL;
+                        weight += sample.NdotL;
+                    }
+                    m_cubeMap.SetTexel(mip, face, x, y, color / weight);
+                }
+            }
+        });
+        m_cubeMap.UpdateBorders(mip);
+    }
+}
+
+// Projection of mip 0 weighted by the solid angles of its texels, with partial sums per
+// thread, then the convolution with the clamped cosine (Ramamoorthi and Hanrahan 2001)
+void LightProbe::projectIrradiance(ThreadPool& threadPool)
+{
+    const auto n = m_cubeMap.GetSize();
+    const auto solidAngles = getTexelSolidAngles(n, threadPool);
+    vector<float3> partialSums(9 * (threadPool.GetNumThreads() + 1), 0.0f);
+
+    threadPool.ParallelFor(CubeMap::NUM_FACE * n, 16, [&](uint32_t begin, uint32_t end, uint32_t threadIdx)
+    {
+        const auto sums = &partialSums[9 * threadIdx];
+        float basis[9];
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto face = CubeMap::Face(i / n);
+            const auto y = i % n;
+            for (auto x = 0u; x < n; ++x)
+            {
+                evaluateSHBasis(getTexelDirection(face, x, y, n), basis);
+                const auto radiance = m_cubeMap.GetTexel(0, face, x, y) * solidAngles[static_cast<size_t>(n) * y + x];
+                for (auto j = 0u; j < 9; ++j) sums[j] += radiance * basis[j];
+            }
+        }
+    });
+
+    static const float bandScales[] =
+    {
+        Pi,
+        2.0f * Pi / 3.0f, 2.0f * Pi / 3.0f, 2.0f * Pi / 3.0f,
+        Pi / 4.0f, Pi / 4.0f, Pi / 4.0f, Pi / 4.0f, Pi / 4.0f
+    };
+
+    for (auto j = 0u; j < 9; ++j)
+    {
+        m_irradianceSH[j] = 0.0f;
+        for (auto i = j; i < partialSums.size(); i += 9) m_irradianceSH[j] += partialSums[i];
+        m_irradianceSH[j] *= bandScales[j];
+    }
+}
+
+// Weights of the texels by luminance times solid angle, in parallel over the rows of all
+// the faces; the pairing of the buckets is sequential.
+bool LightProbe::buildAliasTable(ThreadPool& threadPool)
+{
+    const auto n = m_cubeMap.GetSize();
+    const auto solidAngles = getTexelSolidAngles(n, threadPool);
+    vector<float> weights(CubeMap::NUM_FACE * static_cast<size_t>(n) * n);
+    threadPool.ParallelFor(CubeMap::NUM_FACE * n, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto face = CubeMap::Face(i / n);
+            const auto y = i % n;
+            for (auto x = 0u; x < n; ++x)
+            {
+                const auto luminance = (max)(getLuminance(m_cubeMap.GetTexel(0, face, x, y)), 0.0f);
+                weights[static_cast<size_t>(i) * n + x] = luminance * solidAngles[static_cast<size_t>(n) * y + x];
+            }
+        }
+    });
+
+    return m_aliasTable.Init(weights.data(), static_cast<uint32_t>(weights.size()));
+}
+
+bool LightProbe::loadCache(const string& fileName, uint64_t sourceHash)
+{
+    ifstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    ProbeCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (memcmp(header.Magic, ProbeCacheMagic, sizeof(ProbeCacheMagic)) != 0 || header.Version != ProbeCacheVersion ||
+        header.SourceHash != sourceHash || header.Filter != m_filter || header.NumSamples != NumGGXSamples ||
+        header.Size != m_cubeMap.GetSize() || header.NumMips != m_cubeMap.GetNumMips())
+        return false;
+
+    float3 irradianceSH[9];
+    if (!file.read(reinterpret_cast<char*>(irradianceSH), sizeof(irradianceSH))) return false;
+
+    vector<float3> row;
+    for (auto mip = 1u; mip < header.NumMips; ++mip)
+    {
+        const auto n = m_cubeMap.GetSize(mip);
+        row.resize(n);
+        for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        {
+            for (auto y = 0u; y < n; ++y)
+            {
+                if (!file.read(reinterpret_cast<char*>(row.data()), sizeof(float3) * n)) return false;
+                for (auto x = 0u; x < n; ++x) m_cubeMap.SetTexel(mip, CubeMap::Face(face), x, y, row[x]);
+            }
+        }
+        m_cubeMap.UpdateBorders(mip);
+    }
+
+    vector<AliasTable::Entry> entries(CubeMap::NUM_FACE * static_cast<size_t>(header.Size) * header.Size);
+    if (!file.read(reinterpret_cast<char*>(entries.data()), sizeof(AliasTable::Entry) * entries.size())) return false;
+    m_aliasTable.Init(entries.data(), static_cast<uint32_t>(entries.size()));
+    copy(irradianceSH, irradianceSH + 9, m_irradianceSH);
+
+    return true;
+}
+
+bool LightProbe::saveCache(const string& fileName, uint64_t sourceHash) const
+{
+    ofstream file(fileName, ios::binary);
+    if (!file) return false;
+
+    ProbeCacheHeader header = {};
+    memcpy(header.Magic, ProbeCacheMagic, sizeof(ProbeCacheMagic));
+    header.Version = ProbeCacheVersion;
+    header.SourceHash = sourceHash;
+    header.Filter = m_filter;
+    header.NumSamples = NumGGXSamples;
+    header.Size = m_cubeMap.GetSize();
+    header.NumMips = m_cubeMap.GetNumMips();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_irradianceSH), sizeof(m_irradianceSH));
+
+    vector<float3> row;
+    for (auto mip = 1u; mip < header.NumMips; ++mip)
+    {
+        const auto n = m_cubeMap.GetSize(mip);
+        row.resize(n);
+        for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        {
+            for (auto y = 0u; y < n; ++y)
+            {
+                for (auto x = 0u; x < n; ++x) row[x] = m_cubeMap.GetTexel(mip, CubeMap::Face(face), x, y);
+                file.write(reinterpret_cast<const char*>(row.data()), sizeof(float3) * n);
+            }
+        }
+    }
+    file.write(reinterpret_cast<const char*>(m_aliasTable.GetEntries()), sizeof(AliasTable::Entry) * m_aliasTable.GetCount());
+
+    return static_cast<bool>(file);
+}
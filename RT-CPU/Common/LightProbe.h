@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AliasTable.h"
+#include "CubeMap.h"
+
+class ThreadPool;
+
+// Preprocessed light probe: a full mip chain of the cube map, box-filtered or prefiltered
+// for GGX with the roughness of mip i at i / (numMips - 1), and the 9 SH coefficients of
+// the irradiance, and an alias table over the texels of mip 0 for importance sampling.
+// The results are cached next to the DDS, as name.probe, and rebuilt when the texels
+// of the DDS or the filter change.
+class LightProbe
+{
+public:
+    enum Filter : uint8_t
+    {
+        BOX,
+        GGX
+    };
+
+    LightProbe();
+    virtual ~LightProbe();
+
+    // On the default thread pool if none is given
+    bool Init(const char* fileName, Filter filter, bool useCache = true, ThreadPool* pThreadPool = nullptr);
+
+    float3 SampleLevel(const float3& dir, float level = 0.0f) const;
+    float3 SampleRoughness(const float3& dir, float roughness) const;   // GGX only
+    float3 EvaluateIrradiance(const float3& normal) const;              // Not divided by Pi
+
+    // Directions in proportion to the luminance of mip 0, with their PDFs over solid angle;
+    // u.x picks the texel, u.y and u.z place the direction in it
+    float3 Sample(const float3& u, float& pdf) const;
+    float GetPdf(const float3& dir) const;
+
+    const CubeMap& GetCubeMap() const;
+    const float3* GetIrradianceSH() const;
+    const AliasTable& GetAliasTable() const;
+    Filter GetFilter() const;
+
+    // Times to decode the DDS and to prefilter, 0 if loaded from the cache
+    double GetDecodeTime() const;
+    double GetPrefilterTime() const;
+    double GetTableTime() const;
+    double GetCacheTime() const;
+    bool IsFromCache() const;
+
+    static std::string GetCacheFileName(const char* fileName);
+
+protected:
+    void buildBoxChain(ThreadPool& threadPool);
+    void prefilterGGX(const CubeMap& source, ThreadPool& threadPool);
+    void projectIrradiance(ThreadPool& threadPool);
+    bool buildAliasTable(ThreadPool& threadPool);
+
+    bool loadCache(const std::string& fileName, uint64_t sourceHash);
+    bool saveCache(const std::string& fileName, uint64_t sourceHash) const;
+
+    CubeMap     m_cubeMap;
+    float3      m_irradianceSH[9];
+    AliasTable  m_aliasTable;       // Over (face * size + y) * size + x
+    Filter      m_filter;
+
+    double      m_decodeTime;
+    double      m_prefilterTime;
+    double      m_tableTime;
+    double      m_cacheTime;
+    bool        m_isFromCache;
+};
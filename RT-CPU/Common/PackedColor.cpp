@@ -0,0 +1,320 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "PackedColor.h"
+
+using namespace std;
+
+// Thresholds on the bits of a float: the normal range of the small floats starts at 2^-14,
+// and the smallest denormal, 2^-14 / 2^M, is the smallest value not flushed to 0.
+static const uint32_t InfBits = 0x7f800000;
+static const uint32_t NormalBits = 113 << 23;
+
+template<uint32_t M>
+struct ChannelFormat
+{
+    static const uint32_t Shift = 23 - M;
+    static const uint32_t Mask = (1u << (M + 5)) - 1;
+    static const uint32_t Inf = 31u << M;
+    static const uint32_t MaxFinite = (30u << M) | ((1u << M) - 1);
+    static const uint32_t ZeroBits = (113 - M) << 23;
+    static const uint32_t MaxFiniteBits = (142u << 23) | (((1u << M) - 1) << Shift);
+};
+
+template<uint32_t M>
+static uint32_t packChannel(float value)
+{
+    using Format = ChannelFormat<M>;
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const auto absBits = bits & 0x7fffffff;
+    if (absBits > InfBits) return Format::Mask;         // NaN
+    if (bits & 0x80000000) return 0;                    // Negative, including -INF
+    if (absBits == InfBits) return Format::Inf;
+    if (absBits > Format::MaxFiniteBits) return Format::MaxFinite;
+    if (absBits < Format::ZeroBits) return 0;
+
+    // Rebias the exponent from 127 to 15, or align the mantissa of a denormal,
+    // then round to the nearest even
+    const auto aligned = absBits < NormalBits ?
+        (0x800000 | (absBits & 0x7fffff)) >> (113 - (absBits >> 23)) : absBits + 0xc8000000;
+
+    return ((aligned + (1u << (Format::Shift - 1)) - 1 + ((aligned >> Format::Shift) & 1)) >> Format::Shift) & Format::Mask;
+}
+
+template<uint32_t M>
+static float unpackChannel(uint32_t packed)
+{
+    using Format = ChannelFormat<M>;
+
+    const auto mantissa = packed & ((1u << M) - 1);
+    const auto exponent = (packed >> M) & 0x1f;
+    if (exponent == 0) return static_cast<float>(mantissa) * (1.0f / (1u << (14 + M)));
+
+    const auto bits = (exponent == 31 ? InfBits : (exponent + 112) << 23) | (mantissa << Format::Shift);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+#if defined(__AVX2__)
+template<uint32_t M>
+static __m256i packChannel(__m256 value)
+{
+    using Format = ChannelFormat<M>;
+
+    const auto bits = _mm256_castps_si256(value);
+    const auto absBits = _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffffff));
+
+    const auto isDenormal = _mm256_cmpgt_epi32(_mm256_set1_epi32(NormalBits), absBits);
+    const auto denormal = _mm256_srlv_epi32(
+        _mm256_or_si256(_mm256_and_si256(absBits, _mm256_set1_epi32(0x7fffff)), _mm256_set1_epi32(0x800000)),
+        _mm256_sub_epi32(_mm256_set1_epi32(113), _mm256_srli_epi32(absBits, 23)));
+    const auto normal = _mm256_add_epi32(absBits, _mm256_set1_epi32(static_cast<int>(0xc8000000)));
+    const auto aligned = _mm256_blendv_epi8(normal, denormal, isDenormal);
+
+    const auto lsb = _mm256_and_si256(_mm256_srli_epi32(aligned, Format::Shift), _mm256_set1_epi32(1));
+    auto result = _mm256_add_epi32(aligned, _mm256_add_epi32(_mm256_set1_epi32((1u << (Format::Shift - 1)) - 1), lsb));
+    result = _mm256_and_si256(_mm256_srli_epi32(result, Format::Shift), _mm256_set1_epi32(Format::Mask));
+
+    // The special cases, in increasing priority as in the scalar version
+    const auto zero = _mm256_setzero_si256();
+    result = _mm256_blendv_epi8(result, zero, _mm256_cmpgt_epi32(_mm256_set1_epi32(Format::ZeroBits), absBits));
+    result = _mm256_blendv_epi8(result, _mm256_set1_epi32(Format::MaxFinite),
+        _mm256_cmpgt_epi32(absBits, _mm256_set1_epi32(Format::MaxFiniteBits)));
+    result = _mm256_blendv_epi8(result, _mm256_set1_epi32(Format::Inf), _mm256_cmpeq_epi32(absBits, _mm256_set1_epi32(InfBits)));
+    result = _mm256_blendv_epi8(result, zero, _mm256_srai_epi32(bits, 31));
+    result = _mm256_blendv_epi8(result, _mm256_set1_epi32(Format::Mask), _mm256_cmpgt_epi32(absBits, _mm256_set1_epi32(InfBits)));
+
+    return result;
+}
+
+template<uint32_t M>
+static __m256 unpackChannel(__m256i packed)
+{
+    using Format = ChannelFormat<M>;
+
+    const auto mantissa = _mm256_and_si256(packed, _mm256_set1_epi32((1u << M) - 1));
+    const auto exponent = _mm256_and_si256(_mm256_srli_epi32(packed, M), _mm256_set1_epi32(0x1f));
+    const auto mantissaBits = _mm256_slli_epi32(mantissa, Format::Shift);
+
+    const auto normal = _mm256_or_si256(_mm256_slli_epi32(_mm256_add_epi32(exponent, _mm256_set1_epi32(112)), 23), mantissaBits);
+    const auto special = _mm256_or_si256(_mm256_set1_epi32(InfBits), mantissaBits);
+    const auto denormal = _mm256_castps_si256(_mm256_mul_ps(_mm256_cvtepi32_ps(mantissa),
+        _mm256_set1_ps(1.0f / (1u << (14 + M)))));
+
+    auto result = _mm256_blendv_epi8(normal, special, _mm256_cmpeq_epi32(exponent, _mm256_set1_epi32(31)));
+    result = _mm256_blendv_epi8(result, denormal, _mm256_cmpeq_epi32(exponent, _mm256_setzero_si256()));
+
+    return _mm256_castsi256_ps(result);
+}
+
+// 4 colors from x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 to the x, y and z vectors, and back
+static void loadSoA(const float* pSrc, __m128& x, __m128& y, __m128& z)
+{
+    const auto a = _mm_loadu_ps(pSrc);
+    const auto b = _mm_loadu_ps(pSrc + 4);
+    const auto c = _mm_loadu_ps(pSrc + 8);
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+        _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+        _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static void storeAoS(float* pDst, const __m128& x, const __m128& y, const __m128& z)
+{
+    const auto a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    const auto b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)),
+        _MM_SHUFFLE(2, 0, 2, 0));
+    const auto c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storeu_ps(pDst, a);
+    _mm_storeu_ps(pDst + 4, b);
+    _mm_storeu_ps(pDst + 8, c);
+}
+
+static __m256 combine(const __m128& lo, const __m128& hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+#endif
+
+uint32_t PackR11G11B10(const float3& color)
+{
+    return packChannel<6>(color.x) | (packChannel<6>(color.y) << 11) | (packChannel<5>(color.z) << 22);
+}
+
+float3 UnpackR11G11B10(uint32_t packed)
+{
+    return float3(unpackChannel<6>(packed), unpackChannel<6>(packed >> 11), unpackChannel<5>(packed >> 22));
+}
+
+void PackR11G11B10(const float3* pSrc, uint32_t* pDst, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const auto pFloats = reinterpret_cast<const float*>(pSrc);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 x[2], y[2], z[2];
+        loadSoA(pFloats + 3 * i, x[0], y[0], z[0]);
+        loadSoA(pFloats + 3 * i + 12, x[1], y[1], z[1]);
+
+        const auto r = packChannel<6>(combine(x[0], x[1]));
+        const auto g = packChannel<6>(combine(y[0], y[1]));
+        const auto b = packChannel<5>(combine(z[0], z[1]));
+        const auto packed = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 11), _mm256_slli_epi32(b, 22)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), packed);
+    }
+#endif
+
+    for (; i < count; ++i) pDst[i] = PackR11G11B10(pSrc[i]);
+}
+
+void UnpackR11G11B10(const uint32_t* pSrc, float3* pDst, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const auto pFloats = reinterpret_cast<float*>(pDst);
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+        const auto r = unpackChannel<6>(packed);
+        const auto g = unpackChannel<6>(_mm256_srli_epi32(packed, 11));
+        const auto b = unpackChannel<5>(_mm256_srli_epi32(packed, 22));
+
+        storeAoS(pFloats + 3 * i, _mm256_castps256_ps128(r), _mm256_castps256_ps128(g), _mm256_castps256_ps128(b));
+        storeAoS(pFloats + 3 * i + 12, _mm256_extractf128_ps(r, 1), _mm256_extractf128_ps(g, 1), _mm256_extractf128_ps(b, 1));
+    }
+#endif
+
+    for (; i < count; ++i) pDst[i] = UnpackR11G11B10(pSrc[i]);
+}
+
+float HalfToFloat(uint16_t half)
+{
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+    auto bits = static_cast<uint32_t>(half & 0x8000) << 16;
+
+    float value;
+    if (exponent == 0)
+    {
+        value = static_cast<float>(mantissa) * (1.0f / (1 << 24));
+
+        return bits ? -value : value;
+    }
+
+    bits |= (exponent == 31 ? InfBits : (exponent + 112) << 23) | (mantissa << 13);
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const auto absBits = bits & 0x7fffffff;
+
+    if (absBits > InfBits) return sign | 0x7e00;                // NaN
+    if (absBits >= 0x477ff000) return sign | 0x7c00;            // Rounds past 65504
+    if (absBits < 0x38800000)                                   // Denormal
+        return sign | static_cast<uint16_t>(lrintf(fabs(value) * (1 << 24)));
+
+    const auto rebiased = absBits - (112u << 23);
+
+    return sign | static_cast<uint16_t>((rebiased + 0xfff + ((rebiased >> 13) & 1)) >> 13);
+}
+
+float3 GetR11G11B10ErrorBound(const float3& color)
+{
+    return float3((max)(color.x / 128.0f, 1.0f / (1u << 20)), (max)(color.y / 128.0f, 1.0f / (1u << 20)),
+        (max)(color.z / 64.0f, 1.0f / (1u << 19)));
+}
+
+static bool isSameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+bool VerifyR11G11B10()
+{
+    // Values around all the powers of two from below the denormals to past the
+    // largest finite values, including the rounding ties, in all the channels
+    vector<float> values;
+    const float mantissas[] = { 1.0f, 1.0f + 1.0f / 128.0f, 1.0f + 1.0f / 64.0f, 1.0f + 3.0f / 128.0f,
+        1.5f, 1.0f + 127.0f / 128.0f, 1.0f + 255.0f / 256.0f, 1.9999999f };
+    for (auto e = -24; e <= 17; ++e)
+        for (const auto& mantissa : mantissas) values.emplace_back(ldexp(mantissa, e));
+
+    // Pseudo-random values of the light probes, log-uniform from 2^-24 to 2^16
+    auto seed = 1u;
+    for (auto i = 0u; i < 4096; ++i)
+    {
+        seed = 1664525u * seed + 1013904223u;
+        values.emplace_back(exp2(-24.0f + 40.0f * (seed >> 8) / 16777216.0f));
+    }
+
+    const auto nan = numeric_limits<float>::quiet_NaN();
+    const auto inf = numeric_limits<float>::infinity();
+    const float specials[] = { 0.0f, -0.0f, -1.0f, -65536.0f, -inf, inf, nan, -nan, FLT_MIN,
+        FLT_MIN / 4.0f, FLT_MAX, 65024.0f, 65025.0f, 65535.0f, 65536.0f, 64512.0f, 64513.0f, 1e30f };
+    values.insert(values.end(), begin(specials), end(specials));
+
+    // Each value in each channel, next to the others
+    vector<float3> colors;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const auto& prev = values[i ? i - 1 : values.size() - 1];
+        colors.emplace_back(values[i], prev, values[i]);
+        colors.emplace_back(prev, values[i], values[i]);
+    }
+
+    for (const auto& color : colors)
+    {
+        const auto roundTrip = UnpackR11G11B10(PackR11G11B10(color));
+        const auto bound = GetR11G11B10ErrorBound(color);
+        for (auto c = 0u; c < 3; ++c)
+        {
+            const auto value = color[c];
+            const auto result = roundTrip[c];
+            if (isnan(value)) { if (!isnan(result)) return false; }
+            else if (value <= 0.0f) { if (result != 0.0f) return false; }
+            else if (isinf(value)) { if (result != inf) return false; }
+            else if (value > R11G11B10Max[c]) { if (result != R11G11B10Max[c]) return false; }
+            else if (fabs(result - value) > bound[c]) return false;
+        }
+    }
+
+    // Every packed value of each channel is kept by a round trip
+    for (auto p = 0u; p < 0x800; ++p)
+    {
+        const auto packed = p | (p << 11) | ((p >> 1) << 22);
+        const auto roundTrip = PackR11G11B10(UnpackR11G11B10(packed));
+        const auto isNaN = (p & 0x7c0) == 0x7c0 && (p & 0x3f);
+        if (!isNaN && roundTrip != packed) return false;
+    }
+
+    // The batch versions are bit-exact, with a partial batch at the end
+    vector<uint32_t> packed(colors.size());
+    vector<float3> unpacked(colors.size());
+    PackR11G11B10(colors.data(), packed.data(), colors.size() - 3);
+    UnpackR11G11B10(packed.data(), unpacked.data(), colors.size() - 3);
+    for (size_t i = 0; i + 3 < colors.size(); ++i)
+    {
+        if (packed[i] != PackR11G11B10(colors[i])) return false;
+
+        const auto result = UnpackR11G11B10(packed[i]);
+        for (auto c = 0u; c < 3; ++c)
+            if (!isSameBits(unpacked[i][c], result[c])) return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// R11G11B10_FLOAT packing of the intermediate colors, with the semantics of XMFLOAT3PK
+// in DirectXPackedVector: 6-bit mantissas for red and green and 5-bit for blue, 5-bit
+// exponents biased by 15, and no sign. Mantissas are rounded to the nearest even;
+// negative values pack to 0, values past the largest finite one to it, except for INF,
+// and NaNs stay NaNs. For a value v in [0, R11G11B10Max], the round-trip error is at
+// most GetR11G11B10ErrorBound(v): a relative 2^-7 for red and green and 2^-6 for blue,
+// or, below the normal range, the smallest denormal, 2^-20 and 2^-19.
+uint32_t PackR11G11B10(const float3& color);
+float3 UnpackR11G11B10(uint32_t packed);
+
+// Batch versions, 8 colors at a time with AVX2 if enabled
+void PackR11G11B10(const float3* pSrc, uint32_t* pDst, size_t count);
+void UnpackR11G11B10(const uint32_t* pSrc, float3* pDst, size_t count);
+
+// Half floats, as XMConvertHalfToFloat and XMConvertFloatToHalf, rounding to the nearest even
+float HalfToFloat(uint16_t half);
+uint16_t FloatToHalf(float value);
+
+float3 GetR11G11B10ErrorBound(const float3& color);
+
+// Round trips of the extreme HDR values within the error bound, and the batch
+// versions bit-exact against the scalar ones
+bool VerifyR11G11B10();
+
+static const float3 R11G11B10Max = float3(65024.0f, 65024.0f, 64512.0f);
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(uint32_t numThreads) :
+    m_pTask(nullptr),
+    m_count(0),
+    m_grainSize(1),
+    m_nextChunk(0),
+    m_numBusy(0),
+    m_generation(0),
+    m_isQuitting(false)
+{
+    if (numThreads == 0)
+    {
+        const auto numCores = thread::hardware_concurrency();
+        numThreads = numCores > 1 ? numCores - 1 : 0;
+    }
+
+    m_workers.reserve(numThreads);
+    for (auto i = 0u; i < numThreads; ++i)
+        m_workers.emplace_back(&ThreadPool::workerMain, this, i + 1);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_isQuitting = true;
+    }
+    m_wakeCond.notify_all();
+
+    for (auto& worker : m_workers) worker.join();
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grainSize, const Task& task)
+{
+    if (count == 0) return;
+    grainSize = (max)(grainSize, 1u);
+
+    // Not worth waking up the workers
+    if (m_workers.empty() || count <= grainSize)
+    {
+        task(0, count, 0);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_pTask = &task;
+        m_count = count;
+        m_grainSize = grainSize;
+        m_nextChunk = 0;
+        m_numBusy = static_cast<uint32_t>(m_workers.size());
+        ++m_generation;
+    }
+    m_wakeCond.notify_all();
+
+    runChunks(0);
+
+    // Wait for the workers to drain their last chunks
+    unique_lock<mutex> lock(m_mutex);
+    m_doneCond.wait(lock, [this] { return m_numBusy == 0; });
+    m_pTask = nullptr;
+}
+
+uint32_t ThreadPool::GetNumThreads() const
+{
+    return static_cast<uint32_t>(m_workers.size()) + 1;
+}
+
+ThreadPool& ThreadPool::GetDefault()
+{
+    static ThreadPool threadPool;
+
+    return threadPool;
+}
+
+void ThreadPool::workerMain(uint32_t threadIdx)
+{
+    auto generation = 0ull;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wakeCond.wait(lock, [&] { return m_isQuitting || m_generation != generation; });
+            if (m_isQuitting) return;
+            generation = m_generation;
+        }
+
+        runChunks(threadIdx);
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            --m_numBusy;
+        }
+        m_doneCond.notify_one();
+    }
+}
+
+void ThreadPool::runChunks(uint32_t threadIdx)
+{
+    while (true)
+    {
+        const auto begin = m_nextChunk.fetch_add(m_grainSize, memory_order_relaxed);
+        if (begin >= m_count) break;
+
+        const auto end = (min)(begin + m_grainSize, m_count);
+        (*m_pTask)(begin, end, threadIdx);
+    }
+}
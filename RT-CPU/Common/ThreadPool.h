@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Persistent worker threads for data-parallel loops.
+// The calling thread takes part in every loop, so a pool of N threads
+// keeps N + 1 cores busy.
+class ThreadPool
+{
+public:
+    using Task = std::function<void(uint32_t begin, uint32_t end, uint32_t threadIdx)>;
+
+    ThreadPool(uint32_t numThreads = 0);
+    virtual ~ThreadPool();
+
+    // Splits [0, count) into chunks of grainSize and runs task on them in parallel
+    void ParallelFor(uint32_t count, uint32_t grainSize, const Task& task);
+
+    uint32_t GetNumThreads() const;
+
+    static ThreadPool& GetDefault();
+
+protected:
+    void workerMain(uint32_t threadIdx);
+    void runChunks(uint32_t threadIdx);
+
+    std::vector<std::thread>    m_workers;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wakeCond;
+    std::condition_variable     m_doneCond;
+
+    const Task*                 m_pTask;
+    uint32_t                    m_count;
+    uint32_t                    m_grainSize;
+    std::atomic_uint32_t        m_nextChunk;
+    uint32_t                    m_numBusy;
+    uint64_t                    m_generation;
+    bool                        m_isQuitting;
+};
@@ -0,0 +1,292 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ToneMap.h"
+#include "PackedColor.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const uint32_t TileWidth = 256;     // 3 rows of 3 channels stay in L1
+static const uint32_t StripHeight = 32;
+
+static float3 toneMap(const float3* pSrc, uint32_t width, uint32_t height, int32_t x, int32_t y)
+{
+    if (x < 0 || y < 0 || x >= static_cast<int32_t>(width) || y >= static_cast<int32_t>(height))
+        return float3(0.0f);
+
+    const auto& color = pSrc[static_cast<size_t>(width) * y + x];
+
+    return float3(color.x / (color.x + 0.5f), color.y / (color.y + 0.5f), color.z / (color.z + 0.5f));
+}
+
+void ToneMap(const float3* pSrc, float3* pDst, uint32_t width, uint32_t height)
+{
+    ThreadPool::GetDefault().ParallelFor(height, 8, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = static_cast<int32_t>(begin); y < static_cast<int32_t>(end); ++y)
+        {
+            for (auto x = 0; x < static_cast<int32_t>(width); ++x)
+            {
+                const auto center = toneMap(pSrc, width, height, x, y);
+                const auto laplace = toneMap(pSrc, width, height, x - 1, y) + toneMap(pSrc, width, height, x + 1, y) +
+                    toneMap(pSrc, width, height, x, y - 1) + toneMap(pSrc, width, height, x, y + 1) - 4.0f * center;
+
+                // Unsharp, then the saturation of the UNORM render target
+                const auto color = center - 0.2f * laplace;
+                pDst[static_cast<size_t>(width) * y + x] = float3(saturate(color.x), saturate(color.y), saturate(color.z));
+            }
+        }
+    });
+}
+
+uint32_t ToRGBA8(const float3& color)
+{
+    const auto toUNORM8 = [](float value) { return static_cast<uint32_t>(saturate(value) * 255.0f + 0.5f); };
+
+    return toUNORM8(color.x) | (toUNORM8(color.y) << 8) | (toUNORM8(color.z) << 16) | 0xff000000;
+}
+
+// Rows of a tile as planes of channels, with 1 pixel on either side
+struct ToneMapRow
+{
+    alignas(32) float Channels[3][TileWidth + 16];
+};
+
+static const float3* loadRow(const float3* pSrc, size_t offset, uint32_t, float3*)
+{
+    return pSrc + offset;
+}
+
+static const float3* loadRow(const uint32_t* pSrc, size_t offset, uint32_t count, float3* pScratch)
+{
+    UnpackR11G11B10(pSrc + offset, pScratch, count);
+
+    return pScratch;
+}
+
+// Row y of the source over [x0 - 1, x0 + count + 1), tone-mapped, with 0 outside the image
+template<typename T>
+static void toneMapRow(const T* pSrc, uint32_t width, uint32_t height, int32_t y, int32_t x0, uint32_t count,
+    float3* pScratch, ToneMapRow& row)
+{
+    const auto numPixels = count + 2;
+    for (auto& channel : row.Channels) fill(channel, channel + numPixels, 0.0f);
+    if (y < 0 || y >= static_cast<int32_t>(height)) return;
+
+    const auto begin = (max)(x0 - 1, 0);
+    const auto end = (min)(x0 + static_cast<int32_t>(count) + 1, static_cast<int32_t>(width));
+    const auto pColors = loadRow(pSrc, static_cast<size_t>(width) * y + begin, end - begin, pScratch);
+    const auto offset = begin - (x0 - 1);
+    const auto n = static_cast<uint32_t>(end - begin);
+
+    auto i = 0u;
+#if defined(__AVX2__)
+    const auto indices = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const auto half = _mm256_set1_ps(0.5f);
+    const auto pFloats = reinterpret_cast<const float*>(pColors);
+    for (; i + 8 <= n; i += 8)
+    {
+        for (auto c = 0u; c < 3; ++c)
+        {
+            const auto color = _mm256_i32gather_ps(pFloats + 3 * i + c, indices, 4);
+            _mm256_storeu_ps(&row.Channels[c][offset + i], _mm256_div_ps(color, _mm256_add_ps(color, half)));
+        }
+    }
+#endif
+
+    for (; i < n; ++i)
+        for (auto c = 0u; c < 3; ++c) row.Channels[c][offset + i] = pColors[i][c] / (pColors[i][c] + 0.5f);
+}
+
+static void storeRow(float3* pDst, const float (*colors)[8], uint32_t count)
+{
+    for (auto i = 0u; i < count; ++i) pDst[i] = float3(colors[0][i], colors[1][i], colors[2][i]);
+}
+
+static void storeRow(uint32_t* pDst, const float (*colors)[8], uint32_t count)
+{
+    for (auto i = 0u; i < count; ++i) pDst[i] = ToRGBA8(float3(colors[0][i], colors[1][i], colors[2][i]));
+}
+
+#if defined(__AVX2__)
+static void storeRow(float3* pDst, const __m256 colors[3])
+{
+    alignas(32) float values[3][8];
+    for (auto c = 0u; c < 3; ++c) _mm256_store_ps(values[c], colors[c]);
+    storeRow(pDst, values, 8);
+}
+
+static void storeRow(uint32_t* pDst, const __m256 colors[3])
+{
+    auto rgba = _mm256_set1_epi32(0xff000000);
+    const auto scale = _mm256_set1_ps(255.0f);
+    for (auto c = 0u; c < 3; ++c)
+    {
+        const auto value = _mm256_cvttps_epi32(_mm256_fmadd_ps(colors[c], scale, _mm256_set1_ps(0.5f)));
+        rgba = _mm256_or_si256(rgba, _mm256_slli_epi32(value, 8 * c));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst), rgba);
+}
+#endif
+
+template<typename T, typename U>
+static void toneMapTiled(const T* pSrc, U* pDst, uint32_t width, uint32_t height)
+{
+    const auto numTilesX = DIV_UP(width, TileWidth);
+    const auto numStrips = DIV_UP(height, StripHeight);
+    ThreadPool::GetDefault().ParallelFor(numTilesX * numStrips, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        ToneMapRow rows[3];
+        vector<float3> scratch(TileWidth + 2);
+        for (auto tile = begin; tile < end; ++tile)
+        {
+            const auto x0 = static_cast<int32_t>(TileWidth * (tile % numTilesX));
+            const auto y0 = static_cast<int32_t>(StripHeight * (tile / numTilesX));
+            const auto count = (min)(TileWidth, width - x0);
+            const auto y1 = (min)(y0 + static_cast<int32_t>(StripHeight), static_cast<int32_t>(height));
+
+            // Rows y - 1, y and y + 1 in the ring at (y + 3) % 3 and so on
+            toneMapRow(pSrc, width, height, y0 - 1, x0, count, scratch.data(), rows[(y0 + 2) % 3]);
+            toneMapRow(pSrc, width, height, y0, x0, count, scratch.data(), rows[y0 % 3]);
+            for (auto y = y0; y < y1; ++y)
+            {
+                toneMapRow(pSrc, width, height, y + 1, x0, count, scratch.data(), rows[(y + 1) % 3]);
+                const auto& up = rows[(y + 2) % 3].Channels;
+                const auto& mid = rows[y % 3].Channels;
+                const auto& down = rows[(y + 1) % 3].Channels;
+                const auto pDstRow = pDst + static_cast<size_t>(width) * y + x0;
+
+                auto x = 0u;
+#if defined(__AVX2__)
+                const auto four = _mm256_set1_ps(4.0f);
+                const auto amount = _mm256_set1_ps(0.2f);
+                const auto zero = _mm256_setzero_ps();
+                const auto one = _mm256_set1_ps(1.0f);
+                for (; x + 8 <= count; x += 8)
+                {
+                    __m256 colors[3];
+                    for (auto c = 0u; c < 3; ++c)
+                    {
+                        const auto center = _mm256_loadu_ps(&mid[c][x + 1]);
+                        auto laplace = _mm256_add_ps(_mm256_loadu_ps(&mid[c][x]), _mm256_loadu_ps(&mid[c][x + 2]));
+                        laplace = _mm256_add_ps(laplace, _mm256_loadu_ps(&up[c][x + 1]));
+                        laplace = _mm256_add_ps(laplace, _mm256_loadu_ps(&down[c][x + 1]));
+                        laplace = _mm256_sub_ps(laplace, _mm256_mul_ps(four, center));
+                        const auto color = _mm256_sub_ps(center, _mm256_mul_ps(amount, laplace));
+                        colors[c] = _mm256_min_ps(_mm256_max_ps(color, zero), one);
+                    }
+                    storeRow(pDstRow + x, colors);
+                }
+#endif
+
+                // Unsharp, then the saturation of the UNORM render target
+                float colors[3][8];
+                while (x < count)
+                {
+                    const auto n = (min)(count - x, 8u);
+                    for (auto c = 0u; c < 3; ++c)
+                    {
+                        for (auto i = 0u; i < n; ++i)
+                        {
+                            const auto center = mid[c][x + i + 1];
+                            const auto laplace = mid[c][x + i] + mid[c][x + i + 2] + up[c][x + i + 1] +
+                                down[c][x + i + 1] - 4.0f * center;
+                            colors[c][i] = saturate(center - 0.2f * laplace);
+                        }
+                    }
+                    storeRow(pDstRow + x, colors, n);
+                    x += n;
+                }
+            }
+        }
+    });
+}
+
+void ToneMapTiled(const float3* pSrc, float3* pDst, uint32_t width, uint32_t height)
+{
+    toneMapTiled(pSrc, pDst, width, height);
+}
+
+void ToneMapTiled(const float3* pSrc, uint32_t* pDst, uint32_t width, uint32_t height)
+{
+    toneMapTiled(pSrc, pDst, width, height);
+}
+
+void ToneMapTiled(const uint32_t* pSrc, float3* pDst, uint32_t width, uint32_t height)
+{
+    toneMapTiled(pSrc, pDst, width, height);
+}
+
+void ToneMapTiled(const uint32_t* pSrc, uint32_t* pDst, uint32_t width, uint32_t height)
+{
+    toneMapTiled(pSrc, pDst, width, height);
+}
+
+bool VerifyToneMap()
+{
+    const uint32_t sizes[][2] =
+    {
+        { 1, 1 }, { 7, 3 }, { 8, 8 }, { 9, 33 }, { TileWidth - 1, StripHeight + 1 },
+        { TileWidth + 1, 2 * StripHeight - 1 }, { 2 * TileWidth + 13, 3 * StripHeight + 5 }
+    };
+
+    auto seed = 1u;
+    auto isPassed = true;
+    for (const auto& size : sizes)
+    {
+        const auto width = size[0], height = size[1];
+        const auto numPixels = static_cast<size_t>(width) * height;
+
+        // HDR values over several magnitudes, through R11G11B10 so both sources agree
+        vector<float3> src(numPixels), ref(numPixels), result(numPixels);
+        vector<uint32_t> packed(numPixels), refRGBA(numPixels), resultRGBA(numPixels);
+        for (auto& color : src)
+        {
+            for (auto c = 0u; c < 3; ++c)
+            {
+                seed = 1664525u * seed + 1013904223u;
+                color[c] = ldexp((seed >> 8) / 16777216.0f, static_cast<int>(seed % 16) - 8);
+            }
+        }
+        PackR11G11B10(src.data(), packed.data(), numPixels);
+        UnpackR11G11B10(packed.data(), src.data(), numPixels);
+
+        ToneMap(src.data(), ref.data(), width, height);
+        for (size_t i = 0; i < numPixels; ++i) refRGBA[i] = ToRGBA8(ref[i]);
+
+        // Within the rounding of a contracted multiply-add, and 1 step of UNORM8 at the ties
+        const auto compare = [&](bool isFloat)
+        {
+            for (size_t i = 0; i < numPixels; ++i)
+            {
+                if (isFloat)
+                {
+                    for (auto c = 0u; c < 3; ++c)
+                        if (fabs(result[i][c] - ref[i][c]) > 1e-6f) return false;
+                }
+                else for (auto c = 0u; c < 3; ++c)
+                {
+                    const auto a = static_cast<int>((resultRGBA[i] >> (8 * c)) & 0xff);
+                    const auto b = static_cast<int>((refRGBA[i] >> (8 * c)) & 0xff);
+                    if (abs(a - b) > 1 || (a != b && fabs(ref[i][c] * 255.0f + 0.5f - (max)(a, b)) > 1e-4f)) return false;
+                }
+            }
+
+            return true;
+        };
+
+        ToneMapTiled(src.data(), result.data(), width, height);
+        isPassed = compare(true) && isPassed;
+        ToneMapTiled(packed.data(), result.data(), width, height);
+        isPassed = compare(true) && isPassed;
+        ToneMapTiled(src.data(), resultRGBA.data(), width, height);
+        isPassed = compare(false) && isPassed;
+        ToneMapTiled(packed.data(), resultRGBA.data(), width, height);
+        isPassed = compare(false) && isPassed;
+    }
+
+    return isPassed;
+}
@@ -0,0 +1,27 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Tone mapping and unsharp masking of PSToneMap.hlsl, from a linear HDR image to
+// the display values in [0, 1]. Out-of-range neighbors read as 0, as out-of-bounds
+// texture loads do.
+void ToneMap(const float3* pSrc, float3* pDst, uint32_t width, uint32_t height);
+
+// The same over tiles of strips in parallel, 8 pixels at a time with AVX2 if enabled: each
+// strip tone-maps its rows once into a ring of 3. The sources are float or R11G11B10_FLOAT
+// as the output views; the results are float, or 8-bit RGBA as the R8G8B8A8_UNORM back
+// buffers store them.
+void ToneMapTiled(const float3* pSrc, float3* pDst, uint32_t width, uint32_t height);
+void ToneMapTiled(const float3* pSrc, uint32_t* pDst, uint32_t width, uint32_t height);
+void ToneMapTiled(const uint32_t* pSrc, float3* pDst, uint32_t width, uint32_t height);
+void ToneMapTiled(const uint32_t* pSrc, uint32_t* pDst, uint32_t width, uint32_t height);
+
+// UNORM8 conversion of the display values, rounding to the nearest
+uint32_t ToRGBA8(const float3& color);
+
+// Tiled against ToneMap on the sizes around the tiles and vectors, in all the formats
+bool VerifyToneMap();
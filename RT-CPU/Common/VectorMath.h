@@ -0,0 +1,201 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Minimal portable vector math for the CPU path.
+// Matrices follow the DirectXMath conventions (row vectors, v' = v * M,
+// left-handed view and projection), so that the matrices built here match
+// those built by the GPU application.
+
+struct float2
+{
+    float x;
+    float y;
+
+    float2() = default;
+    constexpr float2(float _x, float _y) : x(_x), y(_y) {}
+};
+
+struct float3
+{
+    float x;
+    float y;
+    float z;
+
+    float3() = default;
+    constexpr float3(float s) : x(s), y(s), z(s) {}
+    constexpr float3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+
+    float& operator[](uint32_t i) { return (&x)[i]; }
+    float operator[](uint32_t i) const { return (&x)[i]; }
+
+    float3& operator+=(const float3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+    float3& operator-=(const float3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+    float3& operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+};
+
+struct float4
+{
+    float x;
+    float y;
+    float z;
+    float w;
+
+    float4() = default;
+    constexpr float4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    constexpr float4(const float3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+    float3 xyz() const { return float3(x, y, z); }
+};
+
+struct float4x4
+{
+    float m[4][4];
+};
+
+inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+inline float3 operator*(float s, const float3& a) { return float3(a.x * s, a.y * s, a.z * s); }
+inline float3 operator/(const float3& a, float s) { return a * (1.0f / s); }
+inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+
+inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const float3& a) { return std::sqrt(dot(a, a)); }
+inline float3 normalize(const float3& a) { return a / length(a); }
+inline float saturate(float s) { return (std::min)((std::max)(s, 0.0f), 1.0f); }
+inline float3 min3(const float3& a, const float3& b) { return float3((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z)); }
+inline float3 max3(const float3& a, const float3& b) { return float3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z)); }
+
+inline float3 cross(const float3& a, const float3& b)
+{
+    return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// Same as HLSL reflect()
+inline float3 reflect(const float3& i, const float3& n)
+{
+    return i - 2.0f * dot(i, n) * n;
+}
+
+inline float4x4 MatrixIdentity()
+{
+    return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+inline float4x4 MatrixScaling(float x, float y, float z)
+{
+    return { { { x, 0.0f, 0.0f, 0.0f }, { 0.0f, y, 0.0f, 0.0f }, { 0.0f, 0.0f, z, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+inline float4x4 MatrixTranslation(float x, float y, float z)
+{
+    return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { x, y, z, 1.0f } } };
+}
+
+inline float4x4 MatrixRotationY(float angle)
+{
+    const auto s = std::sin(angle);
+    const auto c = std::cos(angle);
+
+    return { { { c, 0.0f, -s, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { s, 0.0f, c, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+inline float4x4 MatrixLookAtLH(const float3& eyePt, const float3& focusPt, const float3& up)
+{
+    const auto zAxis = normalize(focusPt - eyePt);
+    const auto xAxis = normalize(cross(up, zAxis));
+    const auto yAxis = cross(zAxis, xAxis);
+
+    return { {
+        { xAxis.x, yAxis.x, zAxis.x, 0.0f },
+        { xAxis.y, yAxis.y, zAxis.y, 0.0f },
+        { xAxis.z, yAxis.z, zAxis.z, 0.0f },
+        { -dot(xAxis, eyePt), -dot(yAxis, eyePt), -dot(zAxis, eyePt), 1.0f }
+    } };
+}
+
+inline float4x4 MatrixPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+{
+    const auto h = 1.0f / std::tan(0.5f * fovAngleY);
+    const auto w = h / aspectRatio;
+    const auto range = farZ / (farZ - nearZ);
+
+    return { {
+        { w, 0.0f, 0.0f, 0.0f },
+        { 0.0f, h, 0.0f, 0.0f },
+        { 0.0f, 0.0f, range, 1.0f },
+        { 0.0f, 0.0f, -range * nearZ, 0.0f }
+    } };
+}
+
+inline float4x4 operator*(const float4x4& a, const float4x4& b)
+{
+    float4x4 r;
+    for (auto i = 0; i < 4; ++i)
+        for (auto j = 0; j < 4; ++j)
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+
+    return r;
+}
+
+// General inverse by cofactor expansion
+inline float4x4 MatrixInverse(const float4x4& a)
+{
+    const float* m = &a.m[0][0];
+    float inv[16];
+
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    const auto det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    const auto invDet = 1.0f / det;
+
+    float4x4 r;
+    for (auto i = 0; i < 16; ++i) (&r.m[0][0])[i] = inv[i] * invDet;
+
+    return r;
+}
+
+inline float4 Transform(const float4& v, const float4x4& a)
+{
+    return float4(
+        v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0] + v.w * a.m[3][0],
+        v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1] + v.w * a.m[3][1],
+        v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2] + v.w * a.m[3][2],
+        v.x * a.m[0][3] + v.y * a.m[1][3] + v.z * a.m[2][3] + v.w * a.m[3][3]);
+}
+
+// Point transform with the homogeneous divide
+inline float3 TransformCoord(const float3& v, const float4x4& a)
+{
+    const auto r = Transform(float4(v, 1.0f), a);
+
+    return r.xyz() / r.w;
+}
+
+// Direction transform by the upper 3x3
+inline float3 TransformNormal(const float3& v, const float4x4& a)
+{
+    return float3(
+        v.x * a.m[0][0] + v.y * a.m[1][0] + v.z * a.m[2][0],
+        v.x * a.m[0][1] + v.y * a.m[1][1] + v.z * a.m[2][1],
+        v.x * a.m[0][2] + v.y * a.m[1][2] + v.z * a.m[2][2]);
+}
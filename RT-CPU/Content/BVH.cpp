@@ -0,0 +1,342 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "BVH.h"
+#include "RayStats.h"
+
+using namespace std;
+
+struct BuildEntry
+{
+    uint32_t NodeIdx;
+    uint32_t Begin;
+    uint32_t End;
+    uint32_t Depth;
+};
+
+struct Bound
+{
+    float3 Min;
+    float3 Max;
+
+    Bound() : Min(FLT_MAX), Max(-FLT_MAX) {}
+    void Grow(const float3& p) { Min = min3(Min, p); Max = max3(Max, p); }
+    void Grow(const Bound& b) { Min = min3(Min, b.Min); Max = max3(Max, b.Max); }
+    float Area() const
+    {
+        const auto e = Max - Min;
+        return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+BVH::BVH()
+{
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::Build(const float3* pPositions, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices)
+{
+    const auto numTriangles = numIndices / 3;
+    const auto getPos = [&](uint32_t i) -> const float3&
+    {
+        return *reinterpret_cast<const float3*>(reinterpret_cast<const uint8_t*>(pPositions) + stride * pIndices[i]);
+    };
+
+    // Per-triangle bounds and centroids
+    vector<Bound> bounds(numTriangles);
+    vector<float3> centroids(numTriangles);
+    vector<uint32_t> primIndices(numTriangles);
+    for (auto i = 0u; i < numTriangles; ++i)
+    {
+        for (auto j = 0u; j < 3; ++j) bounds[i].Grow(getPos(3 * i + j));
+        centroids[i] = (bounds[i].Min + bounds[i].Max) * 0.5f;
+        primIndices[i] = i;
+    }
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * (max)(numTriangles, 1u));
+    m_nodes.emplace_back();
+
+    vector<BuildEntry> stack;
+    stack.push_back({ 0, 0, numTriangles, 0 });
+    while (!stack.empty())
+    {
+        const auto entry = stack.back();
+        stack.pop_back();
+
+        Bound nodeBound, centroidBound;
+        for (auto i = entry.Begin; i < entry.End; ++i)
+        {
+            nodeBound.Grow(bounds[primIndices[i]]);
+            centroidBound.Grow(centroids[primIndices[i]]);
+        }
+
+        auto& node = m_nodes[entry.NodeIdx];
+        node.BoundMin = nodeBound.Min;
+        node.BoundMax = nodeBound.Max;
+        node.LeftOrFirst = entry.Begin;
+        node.NumTriangles = entry.End - entry.Begin;
+
+        const auto count = entry.End - entry.Begin;
+        if (count <= MaxLeafSize || entry.Depth + 1 >= MaxDepth) continue;
+
+        // Evaluate the binned SAH on all 3 axes
+        auto bestCost = FLT_MAX;
+        auto bestAxis = 0u;
+        auto bestSplit = 0u;
+        const auto extent = centroidBound.Max - centroidBound.Min;
+        for (auto axis = 0u; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0.0f) continue;
+
+            Bound binBounds[NumBins];
+            uint32_t binCounts[NumBins] = {};
+            const auto scale = NumBins / extent[axis];
+            for (auto i = entry.Begin; i < entry.End; ++i)
+            {
+                const auto prim = primIndices[i];
+                const auto bin = (min)(static_cast<uint32_t>((centroids[prim][axis] - centroidBound.Min[axis]) * scale), NumBins - 1);
+                binBounds[bin].Grow(bounds[prim]);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the right, then from the left
+            float rightAreas[NumBins];
+            uint32_t rightCounts[NumBins];
+            Bound right;
+            auto rightCount = 0u;
+            for (auto i = NumBins - 1; i > 0; --i)
+            {
+                right.Grow(binBounds[i]);
+                rightCount += binCounts[i];
+                rightAreas[i] = right.Area();
+                rightCounts[i] = rightCount;
+            }
+
+            Bound left;
+            auto leftCount = 0u;
+            for (auto i = 1u; i < NumBins; ++i)
+            {
+                left.Grow(binBounds[i - 1]);
+                leftCount += binCounts[i - 1];
+                if (leftCount == 0 || rightCounts[i] == 0) continue;
+
+                const auto cost = leftCount * left.Area() + rightCounts[i] * rightAreas[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // Keep a leaf if no split beats intersecting all triangles
+        const auto leafCost = count * nodeBound.Area();
+        if (bestCost >= leafCost && count <= 4 * MaxLeafSize) continue;
+
+        uint32_t mid;
+        if (bestCost < FLT_MAX)
+        {
+            const auto scale = NumBins / extent[bestAxis];
+            const auto pMid = partition(primIndices.begin() + entry.Begin, primIndices.begin() + entry.End, [&](uint32_t prim)
+            {
+                const auto bin = (min)(static_cast<uint32_t>((centroids[prim][bestAxis] - centroidBound.Min[bestAxis]) * scale), NumBins - 1);
+                return bin < bestSplit;
+            });
+            mid = static_cast<uint32_t>(pMid - primIndices.begin());
+        }
+        else
+        {
+            // All centroids coincide; split by count
+            mid = entry.Begin + count / 2;
+        }
+
+        const auto leftIdx = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+        m_nodes.emplace_back();
+
+        auto& inner = m_nodes[entry.NodeIdx];
+        inner.LeftOrFirst = leftIdx;
+        inner.NumTriangles = 0;
+
+        stack.push_back({ leftIdx + 1, mid, entry.End, entry.Depth + 1 });
+        stack.push_back({ leftIdx, entry.Begin, mid, entry.Depth + 1 });
+    }
+
+    // Store the triangles in leaf order
+    m_triangles.resize(numTriangles);
+    for (auto i = 0u; i < numTriangles; ++i)
+    {
+        const auto prim = primIndices[i];
+        for (auto j = 0u; j < 3; ++j) m_triangles[i].V[j] = getPos(3 * prim + j);
+        m_triangles[i].PrimitiveIdx = prim;
+    }
+
+    m_nodes.shrink_to_fit();
+}
+
+bool BVH::Intersect(const Ray& ray, Hit& hit, bool cullBackFacing) const
+{
+    return traverse<false>(ray, hit, cullBackFacing);
+}
+
+bool BVH::Occluded(const Ray& ray, bool cullBackFacing) const
+{
+    Hit hit;
+
+    return traverse<true>(ray, hit, cullBackFacing);
+}
+
+size_t BVH::GetMemorySize() const
+{
+    return sizeof(Node) * m_nodes.size() + sizeof(Triangle) * m_triangles.size();
+}
+
+uint32_t BVH::GetNumNodes() const
+{
+    return static_cast<uint32_t>(m_nodes.size());
+}
+
+template<bool anyHit>
+bool BVH::traverse(const Ray& ray, Hit& hit, bool cullBackFacing) const
+{
+    if (m_triangles.empty()) return false;
+
+    const auto invDir = float3(1.0f / ray.Direction.x, 1.0f / ray.Direction.y, 1.0f / ray.Direction.z);
+    auto tMax = ray.TMax;
+    auto isHit = false;
+
+    // Permute the axes, so that z is the dominant direction, and keep the winding
+    const auto absDir = float3(fabs(ray.Direction.x), fabs(ray.Direction.y), fabs(ray.Direction.z));
+    const auto kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0u : 2u) : (absDir.y > absDir.z ? 1u : 2u);
+    auto kx = (kz + 1) % 3;
+    auto ky = (kx + 1) % 3;
+    if (ray.Direction[kz] < 0.0f) swap(kx, ky);
+    const auto shear = float3(ray.Direction[kx], ray.Direction[ky], 1.0f) / ray.Direction[kz];
+
+    // Axes the ray is parallel to, where an origin on a bounding plane would give 0 * inf
+    const auto hasParallelAxis = ray.Direction.x == 0.0f || ray.Direction.y == 0.0f || ray.Direction.z == 0.0f;
+
+    const auto intersectBox = [&](const Node& node, float& tNear)
+    {
+        const auto t0 = (node.BoundMin - ray.Origin) * invDir;
+        const auto t1 = (node.BoundMax - ray.Origin) * invDir;
+        auto tMin3 = min3(t0, t1);
+        auto tMax3 = max3(t0, t1);
+        if (hasParallelAxis)
+        {
+            // A parallel ray is within the slab for all t, or for none
+            for (auto k = 0u; k < 3; ++k)
+            {
+                if (ray.Direction[k] != 0.0f) continue;
+                if (ray.Origin[k] < node.BoundMin[k] || ray.Origin[k] > node.BoundMax[k]) return false;
+                tMin3[k] = -FLT_MAX;
+                tMax3[k] = FLT_MAX;
+            }
+        }
+        tNear = (max)((max)(tMin3.x, tMin3.y), (max)(tMin3.z, ray.TMin));
+        const auto tFar = (min)((min)(tMax3.x, tMax3.y), (min)(tMax3.z, tMax));
+
+        // Conservative for flat boxes, e.g. those of the ground faces [Ize 2013]
+        return tNear <= tFar * 1.00000024f;
+    };
+
+    uint32_t stack[MaxDepth];
+    auto stackSize = 0u;
+    auto nodeIdx = 0u;
+
+    RayStats::LocalCounter numNodesVisited(RayStats::NODES_VISITED);
+    RayStats::LocalCounter numTrianglesTested(RayStats::TRIANGLES_TESTED);
+
+    float tNear;
+    if (!intersectBox(m_nodes[0], tNear)) return false;
+
+    while (true)
+    {
+        const auto& node = m_nodes[nodeIdx];
+        ++numNodesVisited;
+        if (node.NumTriangles > 0)
+        {
+            // Watertight ray-triangle intersection [Woop et al. 2013]
+            for (auto i = node.LeftOrFirst; i < node.LeftOrFirst + node.NumTriangles; ++i)
+            {
+                const auto& tri = m_triangles[i];
+                ++numTrianglesTested;
+                const auto a = tri.V[0] - ray.Origin;
+                const auto b = tri.V[1] - ray.Origin;
+                const auto c = tri.V[2] - ray.Origin;
+                const auto ax = a[kx] - shear.x * a[kz];
+                const auto ay = a[ky] - shear.y * a[kz];
+                const auto bx = b[kx] - shear.x * b[kz];
+                const auto by = b[ky] - shear.y * b[kz];
+                const auto cx = c[kx] - shear.x * c[kz];
+                const auto cy = c[ky] - shear.y * c[kz];
+
+                // Scaled barycentric weights of the 3 vertices, always in double precision: the
+                // products of floats are exact, so the sign of each difference is exact too, and
+                // a shared edge gets opposite weights in its triangles, even if the compiler
+                // contracts them into FMAs (/fp:fast or -mfma). In float, both can be slightly
+                // negative, and the ray then leaks through the edge.
+                const auto u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+                const auto v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+                const auto w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+
+                // Clockwise triangles seen from the origin have positive determinants
+                const auto det = u + v + w;
+                if (cullBackFacing ? det <= 0.0f : det == 0.0f) continue;
+                if (det > 0.0f ? (u < 0.0f || v < 0.0f || w < 0.0f) : (u > 0.0f || v > 0.0f || w > 0.0f)) continue;
+
+                const auto invDet = 1.0f / det;
+                const auto t = (u * a[kz] + v * b[kz] + w * c[kz]) * shear.z * invDet;
+                if (t < ray.TMin || t > tMax) continue;
+
+                if (anyHit) return true;
+
+                tMax = t;
+                hit.T = t;
+                hit.Barycentrics = float2(v * invDet, w * invDet);
+                hit.PrimitiveIdx = tri.PrimitiveIdx;
+                isHit = true;
+            }
+        }
+        else
+        {
+            // Visit the nearer child first
+            auto childIdx = node.LeftOrFirst;
+            float tLeft, tRight;
+            const auto isLeftHit = intersectBox(m_nodes[childIdx], tLeft);
+            const auto isRightHit = intersectBox(m_nodes[childIdx + 1], tRight);
+
+            if (isLeftHit && isRightHit)
+            {
+                if (tRight < tLeft)
+                {
+                    stack[stackSize++] = childIdx;
+                    nodeIdx = childIdx + 1;
+                }
+                else
+                {
+                    stack[stackSize++] = childIdx + 1;
+                    nodeIdx = childIdx;
+                }
+                continue;
+            }
+            else if (isLeftHit || isRightHit)
+            {
+                nodeIdx = isLeftHit ? childIdx : childIdx + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0) break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    return isHit;
+}
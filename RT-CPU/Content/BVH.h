@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+struct Ray
+{
+    float3 Origin;
+    float3 Direction;
+    float  TMin;
+    float  TMax;
+};
+
+struct Hit
+{
+    float    T;
+    float2   Barycentrics;  // Weights of the 2nd and 3rd vertices, as in DXR
+    uint32_t PrimitiveIdx;
+    uint32_t InstanceIdx;
+};
+
+// Bottom-level bounding volume hierarchy over an indexed triangle mesh,
+// built with the binned surface area heuristic.
+// Triangles are front-facing when their vertices appear clockwise from the
+// ray origin, the same as the default DXR triangle facing. The ray-triangle test
+// is watertight, as required by DXR, so rays aimed at shared vertices or edges,
+// like those of per-vertex ray tracing, never leak through the mesh.
+class BVH
+{
+public:
+    BVH();
+    virtual ~BVH();
+
+    void Build(const float3* pPositions, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices);
+
+    // Closest hit; hit.T is only updated when a hit closer than ray.TMax is found
+    bool Intersect(const Ray& ray, Hit& hit, bool cullBackFacing) const;
+
+    // Any hit, for shadow rays
+    bool Occluded(const Ray& ray, bool cullBackFacing) const;
+
+    size_t GetMemorySize() const;
+    uint32_t GetNumNodes() const;
+
+protected:
+    struct Node
+    {
+        float3   BoundMin;
+        uint32_t LeftOrFirst;   // Left child for inner nodes, first triangle for leaves
+        float3   BoundMax;
+        uint32_t NumTriangles;  // 0 for inner nodes
+    };
+
+    struct Triangle
+    {
+        float3   V[3];
+        uint32_t PrimitiveIdx;
+    };
+
+    template<bool anyHit>
+    bool traverse(const Ray& ray, Hit& hit, bool cullBackFacing) const;
+
+    static const uint32_t MaxLeafSize = 4;
+    static const uint32_t NumBins = 16;
+    static const uint32_t MaxDepth = 64;
+
+    std::vector<Node>       m_nodes;
+    std::vector<Triangle>   m_triangles;
+};
@@ -0,0 +1,254 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "ImageMetrics.h"
+#include "Sampler.h"
+#include "ToneMap.h"
+
+using namespace std;
+
+static const float g_FOVAngleY = 0.785398163f;
+static const float g_zNear = 1.0f;
+static const float g_zFar = 1000.0f;
+
+// The first pose is the camera of the GPU application
+const Benchmark::Pose Benchmark::Poses[] =
+{
+    { "Default", float3(10.0f, 10.0f, -24.0f), float3(0.0f, 3.0f, 0.0f) },
+    { "Front", float3(0.0f, 6.0f, -18.0f), float3(0.0f, 3.0f, 0.0f) },
+    { "Side", float3(-22.0f, 8.0f, -6.0f), float3(0.0f, 3.0f, 0.0f) },
+    { "High", float3(6.0f, 30.0f, -12.0f), float3(0.0f, 2.0f, 0.0f) },
+    { "Close", float3(4.0f, 5.0f, -9.0f), float3(0.0f, 2.0f, 0.0f) }
+};
+
+const uint32_t Benchmark::NumPoses = static_cast<uint32_t>(size(Poses));
+
+Benchmark::Benchmark() :
+    m_width(0),
+    m_height(0)
+{
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+bool Benchmark::Init(const char* meshFileName, const float4& posScale, uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+
+    if (!m_coarseScene.Init(meshFileName, posScale, 2)) return false;
+    if (!m_fineScene.Init(meshFileName, posScale, 100)) return false;
+
+    m_pRayTracer = make_unique<CPUPRayTracer>(m_coarseScene);
+    m_vRayTracer = make_unique<CPUVRayTracer>(m_fineScene);
+    m_tvRayTracer = make_unique<CPUTVRayTracer>(m_fineScene);
+    m_hRayTracer = make_unique<CPUHRayTracer>(m_fineScene);
+    if (!m_pRayTracer->Init(width, height)) return false;
+    if (!m_vRayTracer->Init(width, height)) return false;
+    if (!m_tvRayTracer->Init(width, height)) return false;
+    if (!m_hRayTracer->Init(width, height)) return false;
+
+    const auto numPixels = static_cast<size_t>(width) * height;
+    m_reference.resize(numPixels);
+    m_toneMapped.resize(numPixels);
+
+    return true;
+}
+
+bool Benchmark::Run(uint32_t numRefSamples, uint32_t numFrames, const char* csvFileName,
+    const char* paretoFileName, float targetFLIP)
+{
+    m_results.clear();
+
+    for (const auto& pose : Poses)
+    {
+        const auto view = MatrixLookAtLH(pose.EyePt, pose.FocusPt, float3(0.0f, 1.0f, 0.0f));
+        const auto proj = MatrixPerspectiveFovLH(g_FOVAngleY, m_width / static_cast<float>(m_height), g_zNear, g_zFar);
+        const auto viewProj = view * proj;
+        m_coarseScene.UpdateFrame(pose.EyePt, 0.0f);
+        m_fineScene.UpdateFrame(pose.EyePt, 0.0f);
+
+        cout << "Pose " << pose.Name << ": reference of " << numRefSamples << " samples per pixel" << endl;
+        renderReference(pose.EyePt, viewProj, numRefSamples);
+
+        evaluate(m_pRayTracer.get(), m_coarseScene, pose, "pixel", 0, viewProj, numFrames);
+        evaluate(m_vRayTracer.get(), m_fineScene, pose, "vertex", 0, viewProj, numFrames);
+        for (auto tessFactor = CPUTVRayTracer::MinTessFactor; tessFactor <= CPUTVRayTracer::MaxTessFactor; ++tessFactor)
+        {
+            m_tvRayTracer->SetTessFactor(tessFactor);
+            evaluate(m_tvRayTracer.get(), m_fineScene, pose, "tessvertex", tessFactor, viewProj, numFrames);
+        }
+        evaluate(m_hRayTracer.get(), m_fineScene, pose, "hybrid", 0, viewProj, numFrames);
+    }
+
+    if (!writeCSV(csvFileName))
+    {
+        cerr << "Failed to write " << csvFileName << endl;
+
+        return false;
+    }
+
+    if (!writePareto(paretoFileName, targetFLIP))
+    {
+        cerr << "Failed to write " << paretoFileName << endl;
+
+        return false;
+    }
+
+    return true;
+}
+
+const vector<Benchmark::Result>& Benchmark::GetResults() const
+{
+    return m_results;
+}
+
+// Average of per-pixel frames jittered within the pixels by the Halton sequence (2, 3),
+// the same jitter as the progressive accumulation of the GPU application
+void Benchmark::renderReference(const float3& eyePt, const float4x4& viewProj, uint32_t numSamples)
+{
+    const auto numPixels = m_reference.size();
+    const Sampler sampler(Sampler::HALTON);
+    vector<float3> sum(numPixels, float3(0.0f));
+    for (auto i = 0u; i < numSamples; ++i)
+    {
+        const auto halton = sampler.Get(i + 1);
+        const auto jitterX = (halton.x * 2.0f - 1.0f) / m_width;
+        const auto jitterY = (halton.y * 2.0f - 1.0f) / m_height;
+        m_pRayTracer->Render(eyePt, viewProj * MatrixTranslation(jitterX, jitterY, 0.0f));
+
+        const auto pImage = m_pRayTracer->GetImage();
+        for (size_t j = 0; j < numPixels; ++j) sum[j] += pImage[j];
+    }
+
+    for (auto& color : sum) color = color / static_cast<float>(numSamples);
+    ToneMapTiled(sum.data(), m_reference.data(), m_width, m_height);
+}
+
+void Benchmark::evaluate(CPURayTracer* pRayTracer, const Scene& scene, const Pose& pose, const char* config,
+    uint32_t tessFactor, const float4x4& viewProj, uint32_t numFrames)
+{
+    Result result = {};
+    result.Pose = pose.Name;
+    result.Config = config;
+    result.TessFactor = tessFactor;
+    for (auto i = 0u; i < numFrames; ++i)
+    {
+        pRayTracer->Render(pose.EyePt, viewProj);
+        result.TraceTime += pRayTracer->GetTraceTime();
+        result.RasterTime += pRayTracer->GetRasterTime();
+    }
+
+    result.TraceTime /= numFrames;
+    result.RasterTime /= numFrames;
+    result.NumRays = pRayTracer->GetNumRays();
+    result.NumUsefulRays = pRayTracer->GetNumUsefulRays();
+    result.MemorySize = pRayTracer->GetMemorySize() + scene.GetMemorySize();
+
+    ToneMapTiled(pRayTracer->GetImage(), m_toneMapped.data(), m_width, m_height);
+    result.PSNR = ImageMetrics::PSNR(m_reference.data(), m_toneMapped.data(), m_width, m_height);
+    result.SSIM = ImageMetrics::SSIM(m_reference.data(), m_toneMapped.data(), m_width, m_height);
+    result.FLIP = ImageMetrics::FLIP(m_reference.data(), m_toneMapped.data(), m_width, m_height);
+
+    cout << fixed << setprecision(3) << "  " << config;
+    if (tessFactor) cout << " " << tessFactor;
+    cout << ": " << result.NumRays << " rays, " << (result.TraceTime + result.RasterTime) * 1000.0 <<
+        " ms, PSNR " << result.PSNR << " dB, SSIM " << setprecision(4) << result.SSIM <<
+        ", FLIP " << result.FLIP << endl;
+
+    m_results.push_back(result);
+}
+
+bool Benchmark::writeCSV(const char* fileName) const
+{
+    ofstream file(fileName);
+    if (!file) return false;
+
+    file << "pose,config,tess_factor,rays,useful_rays,trace_ms,raster_ms,total_ms,memory_mb,psnr,ssim,flip\n";
+    file << fixed;
+    for (const auto& result : m_results)
+    {
+        file << result.Pose << "," << result.Config << "," << result.TessFactor << "," <<
+            result.NumRays << "," << result.NumUsefulRays << "," << setprecision(3) <<
+            result.TraceTime * 1000.0 << "," << result.RasterTime * 1000.0 << "," <<
+            (result.TraceTime + result.RasterTime) * 1000.0 << "," <<
+            result.MemorySize / (1024.0 * 1024.0) << "," << setprecision(4) << result.PSNR << "," <<
+            setprecision(6) << result.SSIM << "," << result.FLIP << "\n";
+    }
+
+    return file.good();
+}
+
+bool Benchmark::writePareto(const char* fileName, float targetFLIP) const
+{
+    // Means over the poses; the results are grouped by pose, with the same configurations in order
+    const auto numConfigs = m_results.size() / NumPoses;
+    vector<Result> means(m_results.begin(), m_results.begin() + numConfigs);
+    for (auto i = numConfigs; i < m_results.size(); ++i)
+    {
+        auto& mean = means[i % numConfigs];
+        const auto& result = m_results[i];
+        mean.NumRays += result.NumRays;
+        mean.NumUsefulRays += result.NumUsefulRays;
+        mean.TraceTime += result.TraceTime;
+        mean.RasterTime += result.RasterTime;
+        mean.MemorySize = (max)(mean.MemorySize, result.MemorySize);
+        mean.PSNR += result.PSNR;
+        mean.SSIM += result.SSIM;
+        mean.FLIP += result.FLIP;
+    }
+
+    for (auto& mean : means)
+    {
+        mean.NumRays /= NumPoses;
+        mean.NumUsefulRays /= NumPoses;
+        mean.TraceTime /= NumPoses;
+        mean.RasterTime /= NumPoses;
+        mean.PSNR /= NumPoses;
+        mean.SSIM /= NumPoses;
+        mean.FLIP /= NumPoses;
+    }
+
+    sort(means.begin(), means.end(), [](const Result& a, const Result& b)
+    {
+        return a.TraceTime + a.RasterTime < b.TraceTime + b.RasterTime;
+    });
+
+    ofstream file(fileName);
+    if (!file) return false;
+
+    // Sorted by time, a configuration is Pareto-optimal if it has a lower FLIP than all faster ones
+    file << "# config tess_factor rays total_ms memory_mb psnr ssim flip pareto\n";
+    file << fixed;
+    auto minFLIP = INFINITY;
+    const Result* pSelected = nullptr;
+    for (const auto& mean : means)
+    {
+        const auto isPareto = mean.FLIP < minFLIP;
+        minFLIP = (min)(minFLIP, static_cast<float>(mean.FLIP));
+        if (!pSelected && targetFLIP > 0.0f && mean.FLIP <= targetFLIP) pSelected = &mean;
+
+        file << mean.Config << " " << mean.TessFactor << " " << mean.NumRays << " " << setprecision(3) <<
+            (mean.TraceTime + mean.RasterTime) * 1000.0 << " " << mean.MemorySize / (1024.0 * 1024.0) << " " <<
+            setprecision(4) << mean.PSNR << " " << setprecision(6) << mean.SSIM << " " << mean.FLIP << " " <<
+            isPareto << "\n";
+    }
+
+    if (targetFLIP > 0.0f)
+    {
+        if (pSelected)
+        {
+            cout << "Fastest configuration with a mean FLIP of at most " << targetFLIP << ": " << pSelected->Config;
+            if (pSelected->TessFactor) cout << " " << pSelected->TessFactor;
+            cout << setprecision(3) << " (" << (pSelected->TraceTime + pSelected->RasterTime) * 1000.0 << " ms)" << endl;
+        }
+        else cout << "No configuration has a mean FLIP of at most " << targetFLIP << endl;
+    }
+
+    return file.good();
+}
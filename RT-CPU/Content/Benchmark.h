@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPUPRayTracer.h"
+#include "CPUVRayTracer.h"
+#include "CPUTVRayTracer.h"
+#include "CPUHRayTracer.h"
+
+// Image quality vs. cost of the ray tracing granularities. Each camera pose is rendered
+// per pixel, per vertex, per tessellated vertex at each tessellation factor and with the
+// hybrid granularity, and compared, after tone mapping, with a converged per-pixel
+// reference of jittered samples.
+class Benchmark
+{
+public:
+    struct Pose
+    {
+        const char* Name;
+        float3      EyePt;
+        float3      FocusPt;
+    };
+
+    struct Result
+    {
+        std::string Pose;
+        std::string Config;
+        uint32_t    TessFactor;     // 0 if not tessellated
+        uint64_t    NumRays;
+        uint64_t    NumUsefulRays;
+        double      TraceTime;      // Seconds, averaged over the frames
+        double      RasterTime;
+        size_t      MemorySize;     // Bytes, including the scene
+        double      PSNR;
+        double      SSIM;
+        double      FLIP;
+    };
+
+    Benchmark();
+    virtual ~Benchmark();
+
+    bool Init(const char* meshFileName, const float4& posScale, uint32_t width, uint32_t height);
+
+    // Writes a row per pose and configuration to the CSV file, and the means over the poses,
+    // flagging the Pareto-optimal configurations in time and FLIP, to the plot data file.
+    // With a positive target, reports the fastest configuration whose mean FLIP meets it.
+    bool Run(uint32_t numRefSamples, uint32_t numFrames, const char* csvFileName,
+        const char* paretoFileName, float targetFLIP = 0.0f);
+
+    const std::vector<Result>& GetResults() const;
+
+    static const Pose Poses[];
+    static const uint32_t NumPoses;
+
+protected:
+    void renderReference(const float3& eyePt, const float4x4& viewProj, uint32_t numSamples);
+    void evaluate(CPURayTracer* pRayTracer, const Scene& scene, const Pose& pose, const char* config,
+        uint32_t tessFactor, const float4x4& viewProj, uint32_t numFrames);
+    bool writeCSV(const char* fileName) const;
+    bool writePareto(const char* fileName, float targetFLIP) const;
+
+    // Per-pixel tracing keeps the coarse ground of PRayTracer, while the per-vertex tracers
+    // need the finely divided ground of VRayTracer and TVRayTracer.
+    Scene                           m_coarseScene;
+    Scene                           m_fineScene;
+
+    std::unique_ptr<CPUPRayTracer>  m_pRayTracer;
+    std::unique_ptr<CPUVRayTracer>  m_vRayTracer;
+    std::unique_ptr<CPUTVRayTracer> m_tvRayTracer;
+    std::unique_ptr<CPUHRayTracer>  m_hRayTracer;
+
+    uint32_t                        m_width;
+    uint32_t                        m_height;
+
+    std::vector<float3>             m_reference;    // Tone mapped
+    std::vector<float3>             m_toneMapped;
+    std::vector<Result>             m_results;
+};
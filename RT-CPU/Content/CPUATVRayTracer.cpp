@@ -0,0 +1,399 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPUATVRayTracer.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const uint32_t PatchesPerBatch = 8192;
+static const uint32_t NumFactorKeys = CPUATVRayTracer::MaxTessFactor + 1;
+
+CPUATVRayTracer::CPUATVRayTracer(const Scene& scene) :
+    CPURayTracer(scene),
+    m_pixelsPerSample(8.0f),
+    m_numVisiblePatches(0),
+    m_maxUsedTessFactor(0)
+{
+}
+
+CPUATVRayTracer::~CPUATVRayTracer()
+{
+}
+
+bool CPUATVRayTracer::Init(uint32_t width, uint32_t height)
+{
+    if (!CPURayTracer::Init(width, height)) return false;
+
+    m_rasterizer.Init(width, height);
+    m_tessellators.resize(NumFactorKeys * NumFactorKeys * NumFactorKeys * NumFactorKeys);
+
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        auto& topology = m_topologies[i];
+        topology.Init(&mesh.Vertices[0].Pos, sizeof(Scene::Vertex), mesh.Indices.data(),
+            static_cast<uint32_t>(mesh.Indices.size()));
+
+        const auto numPatches = topology.GetNumPatches();
+        m_patchFactors[i].resize(numPatches);
+        m_edgeFactors[i].resize(topology.GetNumEdges());
+        m_tessKeys[i].resize(numPatches);
+        m_pointOffsets[i].resize(numPatches + 1);
+        m_indexOffsets[i].resize(numPatches + 1);
+        m_innerOffsets[i].resize(numPatches + 1);
+        m_vertSlots[i].resize(topology.GetNumVerts());
+        m_edgeOffsets[i].resize(topology.GetNumEdges() + 1);
+    }
+
+    return true;
+}
+
+void CPUATVRayTracer::Render(const float3& eyePt, const float4x4& viewProj)
+{
+    // Factors, compaction, and ray tracing of the work items
+    auto start = Clock::now();
+    computeTessFactors(viewProj);
+    compact();
+    raytrace(eyePt);
+    m_traceTime = getSeconds(start);
+
+    // Environment prepass and rasterization of the visible patches
+    start = Clock::now();
+    renderEnvironment(eyePt, viewProj);
+    m_rasterizer.Clear(m_background.data());
+    rasterize(viewProj);
+    m_rasterizer.Resolve(m_image.data());
+    m_rasterTime = getSeconds(start);
+}
+
+void CPUATVRayTracer::SetPixelsPerSample(float pixelsPerSample)
+{
+    m_pixelsPerSample = (max)(pixelsPerSample, 0.25f);
+}
+
+float CPUATVRayTracer::GetPixelsPerSample() const
+{
+    return m_pixelsPerSample;
+}
+
+uint32_t CPUATVRayTracer::GetNumPatches() const
+{
+    auto numPatches = 0u;
+    for (const auto& topology : m_topologies) numPatches += topology.GetNumPatches();
+
+    return numPatches;
+}
+
+uint32_t CPUATVRayTracer::GetNumVisiblePatches() const
+{
+    return m_numVisiblePatches;
+}
+
+uint32_t CPUATVRayTracer::GetMaxUsedTessFactor() const
+{
+    return m_maxUsedTessFactor;
+}
+
+uint64_t CPUATVRayTracer::GetNumUniformRays() const
+{
+    uint64_t numRays = 0;
+    for (const auto& topology : m_topologies) numRays += topology.GetNumTessVerts((max)(m_maxUsedTessFactor, 1u));
+
+    return numRays;
+}
+
+size_t CPUATVRayTracer::GetMemorySize() const
+{
+    auto size = CPURayTracer::GetMemorySize() + m_rasterizer.GetMemorySize() +
+        sizeof(float4) * m_clipPositions.capacity() + sizeof(float3) * m_colors.capacity() +
+        sizeof(uint32_t) * m_indices.capacity();
+    for (const auto& tessellator : m_tessellators)
+        size += sizeof(float2) * tessellator.GetDomainPoints().capacity() + sizeof(uint32_t) * tessellator.GetIndices().capacity();
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+        size += m_topologies[i].GetMemorySize() + m_patchFactors[i].capacity() + m_edgeFactors[i].capacity() +
+            sizeof(uint32_t) * (m_tessKeys[i].capacity() + m_pointOffsets[i].capacity() + m_indexOffsets[i].capacity() +
+            m_innerOffsets[i].capacity() + m_vertSlots[i].capacity() + m_edgeOffsets[i].capacity()) +
+            sizeof(WorkItem) * m_workItems[i].capacity() + sizeof(float3) * m_tessColors[i].capacity();
+
+    return size;
+}
+
+void CPUATVRayTracer::computeTessFactors(const float4x4& viewProj)
+{
+    const auto halfWidth = 0.5f * m_width;
+    const auto halfHeight = 0.5f * m_height;
+    const auto invPixelsPerSample = 1.0f / m_pixelsPerSample;
+
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        auto& patchFactors = m_patchFactors[i];
+        ThreadPool::GetDefault().ParallelFor(m_topologies[i].GetNumPatches(), 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto patchIdx = begin; patchIdx < end; ++patchIdx)
+            {
+                float4 c[3];
+                for (auto j = 0u; j < 3; ++j)
+                    c[j] = Transform(float4(mesh.Vertices[mesh.Indices[3 * patchIdx + j]].Pos, 1.0f), worldViewProj);
+
+                // Frustum culling, with all the corners outside the same plane
+                auto outCodes = 0x3fu;
+                for (const auto& p : c)
+                    outCodes &= (p.x > p.w ? 0x1u : 0) | (p.x < -p.w ? 0x2u : 0) | (p.y > p.w ? 0x4u : 0) |
+                        (p.y < -p.w ? 0x8u : 0) | (p.z < 0.0f ? 0x10u : 0) | (p.z > p.w ? 0x20u : 0);
+                if (outCodes)
+                {
+                    patchFactors[patchIdx] = 0;
+                    continue;
+                }
+
+                // Patches crossing the near plane have no projected size
+                if (c[0].z < 0.0f || c[1].z < 0.0f || c[2].z < 0.0f)
+                {
+                    patchFactors[patchIdx] = MaxTessFactor;
+                    continue;
+                }
+
+                // Back-face culling, as the rasterizer: clockwise on screen, with y pointing down, is front-facing
+                float2 s[3];
+                for (auto j = 0u; j < 3; ++j) s[j] = float2(c[j].x / c[j].w * halfWidth, -c[j].y / c[j].w * halfHeight);
+                const auto area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+                if (area <= 0.0f)
+                {
+                    patchFactors[patchIdx] = 0;
+                    continue;
+                }
+
+                // Longest projected edge, in samples
+                auto maxLength = 0.0f;
+                for (auto j = 0u; j < 3; ++j)
+                {
+                    const auto& e0 = s[j];
+                    const auto& e1 = s[(j + 1) % 3];
+                    maxLength = (max)(maxLength, hypot(e1.x - e0.x, e1.y - e0.y));
+                }
+                const auto tessFactor = static_cast<uint32_t>(ceil(maxLength * invPixelsPerSample));
+                patchFactors[patchIdx] = static_cast<uint8_t>((min)((max)(tessFactor, 1u), MaxTessFactor));
+            }
+        });
+    }
+}
+
+void CPUATVRayTracer::compact()
+{
+    m_numVisiblePatches = 0;
+    m_maxUsedTessFactor = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& topology = m_topologies[i];
+        const auto& patches = topology.GetPatches();
+        const auto& patchFactors = m_patchFactors[i];
+        const auto numPatches = static_cast<uint32_t>(patches.size());
+
+        // Shared edges take the larger factor of their visible patches
+        auto& edgeFactors = m_edgeFactors[i];
+        fill(edgeFactors.begin(), edgeFactors.end(), 0);
+        for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+            for (const auto edge : patches[patchIdx].Edges)
+                edgeFactors[edge] = (max)(edgeFactors[edge], patchFactors[patchIdx]);
+
+        // Exclusive prefix sums of the points, indices and inner points of the patches;
+        // the vertices get their slots in the order of their first visible patch
+        auto& tessKeys = m_tessKeys[i];
+        auto& pointOffsets = m_pointOffsets[i];
+        auto& indexOffsets = m_indexOffsets[i];
+        auto& innerOffsets = m_innerOffsets[i];
+        auto& vertSlots = m_vertSlots[i];
+        auto numVertSlots = 0u;
+        fill(vertSlots.begin(), vertSlots.end(), ~0u);
+        pointOffsets[0] = indexOffsets[0] = innerOffsets[0] = 0;
+        for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+        {
+            const auto insideFactor = patchFactors[patchIdx];
+            auto numPoints = 0u, numIndices = 0u, numInnerPoints = 0u;
+            tessKeys[patchIdx] = 0;
+            if (insideFactor > 0)
+            {
+                const auto& patch = patches[patchIdx];
+                const auto& edges = patch.Edges;
+                const uint32_t factors[] = { edgeFactors[edges[0]], edgeFactors[edges[1]], edgeFactors[edges[2]] };
+                const auto key = getTessKey(insideFactor, factors);
+                auto& tessellator = m_tessellators[key];
+                if (tessellator.GetTessFactor() == 0) tessellator.Tessellate(insideFactor, factors);
+
+                tessKeys[patchIdx] = key;
+                numPoints = static_cast<uint32_t>(tessellator.GetDomainPoints().size());
+                numIndices = static_cast<uint32_t>(tessellator.GetIndices().size());
+                numInnerPoints = numPoints - (factors[0] + factors[1] + factors[2]);
+                for (const auto vert : patch.Verts)
+                    if (vertSlots[vert] == ~0u) vertSlots[vert] = numVertSlots++;
+                m_maxUsedTessFactor = (max)(m_maxUsedTessFactor, static_cast<uint32_t>(insideFactor));
+                ++m_numVisiblePatches;
+            }
+            pointOffsets[patchIdx + 1] = pointOffsets[patchIdx] + numPoints;
+            indexOffsets[patchIdx + 1] = indexOffsets[patchIdx] + numIndices;
+            innerOffsets[patchIdx + 1] = innerOffsets[patchIdx] + numInnerPoints;
+        }
+
+        // The edge points follow the vertices, and the inner points follow the edge points
+        auto& edgeOffsets = m_edgeOffsets[i];
+        const auto numEdges = topology.GetNumEdges();
+        edgeOffsets[0] = numVertSlots;
+        for (auto edge = 0u; edge < numEdges; ++edge)
+            edgeOffsets[edge + 1] = edgeOffsets[edge] + (edgeFactors[edge] > 0 ? edgeFactors[edge] - 1u : 0u);
+
+        // Dense work items of the slots; the inner points have a single patch, while the
+        // shared points are traced from the last visible patch around them
+        auto& workItems = m_workItems[i];
+        const auto innerBase = edgeOffsets[numEdges];
+        workItems.resize(innerBase + innerOffsets[numPatches]);
+        ThreadPool::GetDefault().ParallelFor(numPatches, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto patchIdx = begin; patchIdx < end; ++patchIdx)
+            {
+                const auto numInnerPoints = innerOffsets[patchIdx + 1] - innerOffsets[patchIdx];
+                const auto firstInnerPoint = pointOffsets[patchIdx + 1] - pointOffsets[patchIdx] - numInnerPoints;
+                for (auto k = 0u; k < numInnerPoints; ++k)
+                    workItems[innerBase + innerOffsets[patchIdx] + k] = { patchIdx, firstInnerPoint + k };
+            }
+        });
+
+        for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+        {
+            const auto numOuterPoints = pointOffsets[patchIdx + 1] - pointOffsets[patchIdx] -
+                (innerOffsets[patchIdx + 1] - innerOffsets[patchIdx]);
+            for (auto k = 0u; k < numOuterPoints; ++k)
+                workItems[getPointSlot(i, patchIdx, k)] = { patchIdx, k };
+        }
+    }
+}
+
+void CPUATVRayTracer::raytrace(const float3& eyePt)
+{
+    m_numRays = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto& world = m_scene.GetWorld(i);
+        const auto& tessKeys = m_tessKeys[i];
+        const auto& workItems = m_workItems[i];
+        auto& tessColors = m_tessColors[i];
+        const auto numWorkItems = static_cast<uint32_t>(workItems.size());
+        tessColors.resize(numWorkItems);
+        ThreadPool::GetDefault().ParallelFor(numWorkItems, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto j = begin; j < end; ++j)
+            {
+                const auto& workItem = workItems[j];
+                const auto& dom = m_tessellators[tessKeys[workItem.PatchIdx]].GetDomainPoints()[workItem.PointIdx];
+                const auto baseIdx = 3 * workItem.PatchIdx;
+                const auto hitObjPos = mesh.Vertices[mesh.Indices[baseIdx]].Pos * dom.x +
+                    mesh.Vertices[mesh.Indices[baseIdx + 1]].Pos * dom.y +
+                    mesh.Vertices[mesh.Indices[baseIdx + 2]].Pos * (1.0f - (dom.x + dom.y));
+                const auto hitPos = TransformCoord(hitObjPos, world);
+
+                tessColors[j] = m_scene.TraceRadianceRay(eyePt, normalize(hitPos - eyePt), 0);
+            }
+        });
+        m_numRays += numWorkItems;
+    }
+}
+
+void CPUATVRayTracer::rasterize(const float4x4& viewProj)
+{
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        const auto& tessKeys = m_tessKeys[i];
+        const auto& pointOffsets = m_pointOffsets[i];
+        const auto& indexOffsets = m_indexOffsets[i];
+        const auto& tessColors = m_tessColors[i];
+        const auto numPatches = m_topologies[i].GetNumPatches();
+
+        // The points of each patch fetch the colors of their slots, as in CPUTVRayTracer
+        for (auto firstPatch = 0u; firstPatch < numPatches; firstPatch += PatchesPerBatch)
+        {
+            const auto endPatch = (min)(firstPatch + PatchesPerBatch, numPatches);
+            const auto firstPoint = pointOffsets[firstPatch];
+            const auto firstIndex = indexOffsets[firstPatch];
+            m_clipPositions.resize(pointOffsets[endPatch] - firstPoint);
+            m_colors.resize(pointOffsets[endPatch] - firstPoint);
+            m_indices.resize(indexOffsets[endPatch] - firstIndex);
+            if (m_indices.empty()) continue;
+
+            ThreadPool::GetDefault().ParallelFor(endPatch - firstPatch, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+            {
+                for (auto patchIdx = firstPatch + begin; patchIdx < firstPatch + end; ++patchIdx)
+                {
+                    if (tessKeys[patchIdx] == 0) continue;
+
+                    const auto& tessellator = m_tessellators[tessKeys[patchIdx]];
+                    const auto& domainPoints = tessellator.GetDomainPoints();
+                    const auto& tessIndices = tessellator.GetIndices();
+                    const auto& p0 = mesh.Vertices[mesh.Indices[3 * patchIdx]].Pos;
+                    const auto& p1 = mesh.Vertices[mesh.Indices[3 * patchIdx + 1]].Pos;
+                    const auto& p2 = mesh.Vertices[mesh.Indices[3 * patchIdx + 2]].Pos;
+                    const auto baseVertex = pointOffsets[patchIdx] - firstPoint;
+                    const auto baseIndex = indexOffsets[patchIdx] - firstIndex;
+
+                    for (auto k = 0u; k < domainPoints.size(); ++k)
+                    {
+                        const auto& domain = domainPoints[k];
+                        const auto pos = domain.x * p0 + domain.y * p1 + (1.0f - domain.x - domain.y) * p2;
+                        m_clipPositions[baseVertex + k] = Transform(float4(pos, 1.0f), worldViewProj);
+                        m_colors[baseVertex + k] = tessColors[getPointSlot(i, patchIdx, k)];
+                    }
+
+                    for (auto k = 0u; k < tessIndices.size(); ++k)
+                        m_indices[baseIndex + k] = baseVertex + tessIndices[k];
+                }
+            });
+
+            m_rasterizer.DrawIndexed(m_clipPositions.data(), m_colors.data(), m_indices.data(),
+                static_cast<uint32_t>(m_indices.size()));
+        }
+    }
+}
+
+uint32_t CPUATVRayTracer::getPointSlot(uint32_t meshIdx, uint32_t patchIdx, uint32_t pointIdx) const
+{
+    // The outer ring of the tessellator has edgeFactors[j] points per edge j, the first
+    // one at the corner (j + 1) % 3, and is followed by the inner points
+    const auto& patch = m_topologies[meshIdx].GetPatches()[patchIdx];
+    const auto& edgeFactors = m_edgeFactors[meshIdx];
+    const auto& edgeOffsets = m_edgeOffsets[meshIdx];
+    auto firstPoint = 0u;
+    for (auto j = 0u; j < 3; ++j)
+    {
+        const auto edge = patch.Edges[j];
+        const uint32_t edgeFactor = edgeFactors[edge];
+        if (pointIdx >= firstPoint + edgeFactor)
+        {
+            firstPoint += edgeFactor;
+            continue;
+        }
+
+        const auto c0 = (j + 1) % 3;
+        const auto c1 = (j + 2) % 3;
+        if (pointIdx == firstPoint) return m_vertSlots[meshIdx][patch.Verts[c0]];
+
+        // Steps of the point along the edge from its first endpoint, as TessTopology::GetTessVertIndex()
+        const auto& dom = m_tessellators[m_tessKeys[meshIdx][patchIdx]].GetDomainPoints()[pointIdx];
+        const float b[] = { dom.x, dom.y, 1.0f - (dom.x + dom.y) };
+        const auto step = static_cast<uint32_t>(lround((patch.Verts[c0] <= patch.Verts[c1] ? b[c1] : b[c0]) * edgeFactor));
+
+        return edgeOffsets[edge] + step - 1;
+    }
+
+    return edgeOffsets.back() + m_innerOffsets[meshIdx][patchIdx] + pointIdx - firstPoint;
+}
+
+uint32_t CPUATVRayTracer::getTessKey(uint32_t insideFactor, const uint32_t edgeFactors[3])
+{
+    return ((insideFactor * NumFactorKeys + edgeFactors[0]) * NumFactorKeys + edgeFactors[1]) * NumFactorKeys + edgeFactors[2];
+}
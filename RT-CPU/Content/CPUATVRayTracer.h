@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURayTracer.h"
+#include "Rasterizer.h"
+#include "TessTopology.h"
+#include "Tessellator.h"
+
+// Per-tessellated-vertex ray tracing with adaptive tessellation factors: each patch
+// gets a factor from its longest projected edge against a target of pixels per sample,
+// or 0 when it is outside the frustum or back-facing. Shared edges take the larger
+// factor of their patches, so that both sides place the same points. As in
+// CPUTVRayTracer, the corners and the edge points of the visible patches are shared
+// through the slots of their TessTopology vertices and edges, and only the inner points
+// belong to a single patch; the slots are compacted into a dense list of work items by
+// prefix sums, and each of them is traced once.
+class CPUATVRayTracer :
+    public CPURayTracer
+{
+public:
+    CPUATVRayTracer(const Scene& scene);
+    virtual ~CPUATVRayTracer();
+
+    bool Init(uint32_t width, uint32_t height) override;
+    void Render(const float3& eyePt, const float4x4& viewProj) override;
+
+    void SetPixelsPerSample(float pixelsPerSample);
+    float GetPixelsPerSample() const;
+
+    uint32_t GetNumPatches() const;
+    uint32_t GetNumVisiblePatches() const;
+    uint32_t GetMaxUsedTessFactor() const;
+
+    // Rays of CPUTVRayTracer with the uniform factor of GetMaxUsedTessFactor()
+    uint64_t GetNumUniformRays() const;
+    size_t GetMemorySize() const override;
+
+    static const uint32_t MaxTessFactor = 8;
+
+protected:
+    // A shared point is traced from any one of the visible patches around it
+    struct WorkItem
+    {
+        uint32_t PatchIdx;
+        uint32_t PointIdx;  // Domain point of the tessellation of the patch
+    };
+
+    void computeTessFactors(const float4x4& viewProj);
+    void compact();
+    void raytrace(const float3& eyePt);
+    void rasterize(const float4x4& viewProj);
+
+    // Slot of a domain point of a visible patch in the work items
+    uint32_t getPointSlot(uint32_t meshIdx, uint32_t patchIdx, uint32_t pointIdx) const;
+
+    static uint32_t getTessKey(uint32_t insideFactor, const uint32_t edgeFactors[3]);
+
+    Rasterizer              m_rasterizer;
+    TessTopology            m_topologies[Scene::NUM_MESH];
+    std::vector<Tessellator> m_tessellators;    // By getTessKey(), tessellated on demand
+
+    float                   m_pixelsPerSample;
+    uint32_t                m_numVisiblePatches;
+    uint32_t                m_maxUsedTessFactor;
+
+    std::vector<uint8_t>    m_patchFactors[Scene::NUM_MESH];
+    std::vector<uint8_t>    m_edgeFactors[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_tessKeys[Scene::NUM_MESH];        // 0 for the culled patches
+    std::vector<uint32_t>   m_pointOffsets[Scene::NUM_MESH];    // Exclusive prefix sums, per patch
+    std::vector<uint32_t>   m_indexOffsets[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_innerOffsets[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_vertSlots[Scene::NUM_MESH];       // ~0u for the vertices of no visible patch
+    std::vector<uint32_t>   m_edgeOffsets[Scene::NUM_MESH];     // Past the vertex slots, per edge
+    std::vector<WorkItem>   m_workItems[Scene::NUM_MESH];       // Vertex, edge, then inner slots
+    std::vector<float3>     m_tessColors[Scene::NUM_MESH];      // Per work item
+
+    std::vector<float4>     m_clipPositions;
+    std::vector<float3>     m_colors;
+    std::vector<uint32_t>   m_indices;
+};
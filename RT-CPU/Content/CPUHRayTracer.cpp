@@ -0,0 +1,352 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPUHRayTracer.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const uint32_t PatchesPerBatch = 8192;
+static const float MarkerColor = -1.0f;
+
+CPUHRayTracer::CPUHRayTracer(const Scene& scene) :
+    CPURayTracer(scene),
+    m_vertexMaxArea(4.0f),
+    m_pixelMinArea(64.0f),
+    m_pixelsPerSample(8.0f),
+    m_frameStamp(0),
+    m_numPatches(),
+    m_numRaysPerGranularity()
+{
+}
+
+CPUHRayTracer::~CPUHRayTracer()
+{
+}
+
+bool CPUHRayTracer::Init(uint32_t width, uint32_t height)
+{
+    if (!CPURayTracer::Init(width, height)) return false;
+
+    m_rasterizer.Init(width, height);
+    for (auto tessFactor = 1u; tessFactor <= MaxTessFactor; ++tessFactor)
+        m_tessellators[tessFactor].Tessellate(tessFactor);
+
+    size_t maxNumVerts = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto numPatches = mesh.Indices.size() / 3;
+        m_granularities[i].resize(numPatches);
+        m_tessFactors[i].resize(numPatches);
+        m_vertexStamps[i] = vector<atomic<uint32_t>>(mesh.Vertices.size());
+        m_visibleVerts[i].reserve(mesh.Vertices.size());
+        m_vertexColors[i].resize(mesh.Vertices.size());
+        maxNumVerts = (max)(maxNumVerts, mesh.Vertices.size());
+    }
+    m_markerColors.assign(maxNumVerts, float3(MarkerColor));
+
+    return true;
+}
+
+void CPUHRayTracer::Render(const float3& eyePt, const float4x4& viewProj)
+{
+    // Classification, and ray tracing of the vertex granularities
+    auto start = Clock::now();
+    classify(viewProj);
+    raytraceVertices(eyePt);
+    raytraceTessVerts(eyePt);
+    m_traceTime = getSeconds(start);
+
+    // Environment prepass and rasterization of all the granularities
+    start = Clock::now();
+    renderEnvironment(eyePt, viewProj);
+    m_rasterizer.Clear(m_background.data());
+    rasterize(viewProj);
+    m_rasterizer.Resolve(m_image.data());
+    m_rasterTime = getSeconds(start);
+
+    // Ray tracing of the pixels covered by the per-pixel triangles
+    start = Clock::now();
+    raytracePixels(eyePt, viewProj);
+    m_traceTime += getSeconds(start);
+
+    m_numRays = 0;
+    for (const auto numRays : m_numRaysPerGranularity) m_numRays += numRays;
+}
+
+void CPUHRayTracer::SetThresholds(float vertexMaxArea, float pixelMinArea)
+{
+    m_vertexMaxArea = (max)(vertexMaxArea, 0.0f);
+    m_pixelMinArea = (max)(pixelMinArea, m_vertexMaxArea);
+}
+
+void CPUHRayTracer::SetPixelsPerSample(float pixelsPerSample)
+{
+    m_pixelsPerSample = (max)(pixelsPerSample, 0.25f);
+}
+
+uint32_t CPUHRayTracer::GetNumPatches(Granularity granularity) const
+{
+    return m_numPatches[granularity];
+}
+
+uint64_t CPUHRayTracer::GetNumGranularityRays(Granularity granularity) const
+{
+    return m_numRaysPerGranularity[granularity];
+}
+
+size_t CPUHRayTracer::GetMemorySize() const
+{
+    auto size = CPURayTracer::GetMemorySize() + m_rasterizer.GetMemorySize() +
+        sizeof(float3) * m_markerColors.capacity() + sizeof(float4) * (m_clipPositions.capacity() +
+        m_tessPositions.capacity()) + sizeof(uint32_t) * m_indices.capacity();
+    for (const auto& tessellator : m_tessellators)
+        size += sizeof(float2) * tessellator.GetDomainPoints().capacity() + sizeof(uint32_t) * tessellator.GetIndices().capacity();
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+        size += m_granularities[i].capacity() + m_tessFactors[i].capacity() +
+            sizeof(uint32_t) * (m_vertexStamps[i].size() + m_visibleVerts[i].capacity() +
+            m_tessPatches[i].capacity() + m_pointOffsets[i].capacity()) +
+            sizeof(float3) * (m_vertexColors[i].capacity() + m_tessColors[i].capacity());
+
+    return size;
+}
+
+void CPUHRayTracer::classify(const float4x4& viewProj)
+{
+    const auto halfWidth = 0.5f * m_width;
+    const auto halfHeight = 0.5f * m_height;
+    const auto invPixelsPerSample = 1.0f / m_pixelsPerSample;
+
+    ++m_frameStamp;
+    fill(begin(m_numPatches), end(m_numPatches), 0);
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        const auto numPatches = static_cast<uint32_t>(mesh.Indices.size() / 3);
+        auto& granularities = m_granularities[i];
+        auto& tessFactors = m_tessFactors[i];
+        auto& vertexStamps = m_vertexStamps[i];
+        ThreadPool::GetDefault().ParallelFor(numPatches, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto patchIdx = begin; patchIdx < end; ++patchIdx)
+            {
+                float4 c[3];
+                for (auto j = 0u; j < 3; ++j)
+                    c[j] = Transform(float4(mesh.Vertices[mesh.Indices[3 * patchIdx + j]].Pos, 1.0f), worldViewProj);
+
+                // Frustum culling, with all the corners outside the same plane
+                auto outCodes = 0x3fu;
+                for (const auto& p : c)
+                    outCodes &= (p.x > p.w ? 0x1u : 0) | (p.x < -p.w ? 0x2u : 0) | (p.y > p.w ? 0x4u : 0) |
+                        (p.y < -p.w ? 0x8u : 0) | (p.z < 0.0f ? 0x10u : 0) | (p.z > p.w ? 0x20u : 0);
+                auto granularity = outCodes ? CULLED : PER_PIXEL;
+
+                // Patches crossing the near plane have no projected size, so they stay per pixel
+                if (granularity == PER_PIXEL && c[0].z >= 0.0f && c[1].z >= 0.0f && c[2].z >= 0.0f)
+                {
+                    // Back-face culling, as the rasterizer: clockwise on screen, with y pointing down, is front-facing
+                    float2 s[3];
+                    for (auto j = 0u; j < 3; ++j) s[j] = float2(c[j].x / c[j].w * halfWidth, -c[j].y / c[j].w * halfHeight);
+                    const auto area = 0.5f * ((s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x));
+                    if (area <= 0.0f) granularity = CULLED;
+                    else if (area <= m_vertexMaxArea) granularity = PER_VERTEX;
+                    else if (area < m_pixelMinArea)
+                    {
+                        // Longest projected edge, in samples
+                        auto maxLength = 0.0f;
+                        for (auto j = 0u; j < 3; ++j)
+                            maxLength = (max)(maxLength, hypot(s[(j + 1) % 3].x - s[j].x, s[(j + 1) % 3].y - s[j].y));
+                        const auto tessFactor = static_cast<uint32_t>(ceil(maxLength * invPixelsPerSample));
+                        tessFactors[patchIdx] = static_cast<uint8_t>((min)((max)(tessFactor, 2u), MaxTessFactor));
+                        granularity = PER_TESS_VERTEX;
+                    }
+                }
+
+                if (granularity == PER_VERTEX)
+                    for (auto j = 0u; j < 3; ++j)
+                        vertexStamps[mesh.Indices[3 * patchIdx + j]].store(m_frameStamp, memory_order_relaxed);
+                granularities[patchIdx] = granularity;
+            }
+        });
+
+        // Compact the stamped vertices and the tessellated patches
+        auto& visibleVerts = m_visibleVerts[i];
+        visibleVerts.clear();
+        for (auto j = 0u; j < vertexStamps.size(); ++j)
+            if (vertexStamps[j].load(memory_order_relaxed) == m_frameStamp) visibleVerts.push_back(j);
+
+        auto& tessPatches = m_tessPatches[i];
+        auto& pointOffsets = m_pointOffsets[i];
+        tessPatches.clear();
+        pointOffsets.assign(1, 0);
+        for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+        {
+            const auto granularity = granularities[patchIdx];
+            ++m_numPatches[granularity];
+            if (granularity != PER_TESS_VERTEX) continue;
+
+            tessPatches.push_back(patchIdx);
+            pointOffsets.push_back(pointOffsets.back() +
+                static_cast<uint32_t>(m_tessellators[tessFactors[patchIdx]].GetDomainPoints().size()));
+        }
+    }
+}
+
+void CPUHRayTracer::raytraceVertices(const float3& eyePt)
+{
+    // Same as CPUVRayTracer
+    m_numRaysPerGranularity[PER_VERTEX] = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& vertices = m_scene.GetMesh(i).Vertices;
+        const auto& world = m_scene.GetWorld(i);
+        const auto& visibleVerts = m_visibleVerts[i];
+        auto& colors = m_vertexColors[i];
+        ThreadPool::GetDefault().ParallelFor(static_cast<uint32_t>(visibleVerts.size()), 256, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto j = begin; j < end; ++j)
+            {
+                const auto vertexIdx = visibleVerts[j];
+                const auto hitPos = TransformCoord(vertices[vertexIdx].Pos, world);
+                colors[vertexIdx] = m_scene.TraceRadianceRay(eyePt, normalize(hitPos - eyePt), 0);
+            }
+        });
+        m_numRaysPerGranularity[PER_VERTEX] += visibleVerts.size();
+    }
+}
+
+void CPUHRayTracer::raytraceTessVerts(const float3& eyePt)
+{
+    // Domain points of each tessellated patch, not shared with the neighbors
+    m_numRaysPerGranularity[PER_TESS_VERTEX] = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto& world = m_scene.GetWorld(i);
+        const auto& tessFactors = m_tessFactors[i];
+        const auto& tessPatches = m_tessPatches[i];
+        const auto& pointOffsets = m_pointOffsets[i];
+        auto& tessColors = m_tessColors[i];
+        tessColors.resize(pointOffsets.back());
+        ThreadPool::GetDefault().ParallelFor(static_cast<uint32_t>(tessPatches.size()), 64, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto j = begin; j < end; ++j)
+            {
+                const auto patchIdx = tessPatches[j];
+                const auto& domainPoints = m_tessellators[tessFactors[patchIdx]].GetDomainPoints();
+                const auto& p0 = mesh.Vertices[mesh.Indices[3 * patchIdx]].Pos;
+                const auto& p1 = mesh.Vertices[mesh.Indices[3 * patchIdx + 1]].Pos;
+                const auto& p2 = mesh.Vertices[mesh.Indices[3 * patchIdx + 2]].Pos;
+                for (auto k = 0u; k < domainPoints.size(); ++k)
+                {
+                    const auto& dom = domainPoints[k];
+                    const auto hitPos = TransformCoord(p0 * dom.x + p1 * dom.y + p2 * (1.0f - (dom.x + dom.y)), world);
+                    tessColors[pointOffsets[j] + k] = m_scene.TraceRadianceRay(eyePt, normalize(hitPos - eyePt), 0);
+                }
+            }
+        });
+        m_numRaysPerGranularity[PER_TESS_VERTEX] += tessColors.size();
+    }
+}
+
+void CPUHRayTracer::rasterize(const float4x4& viewProj)
+{
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        const auto& granularities = m_granularities[i];
+        const auto numPatches = static_cast<uint32_t>(granularities.size());
+
+        // The per-vertex and per-pixel triangles share the transformed mesh vertices
+        const auto numVertices = static_cast<uint32_t>(mesh.Vertices.size());
+        m_clipPositions.resize(numVertices);
+        ThreadPool::GetDefault().ParallelFor(numVertices, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto j = begin; j < end; ++j)
+                m_clipPositions[j] = Transform(float4(mesh.Vertices[j].Pos, 1.0f), worldViewProj);
+        });
+
+        for (const auto granularity : { PER_VERTEX, PER_PIXEL })
+        {
+            m_indices.clear();
+            for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+                if (granularities[patchIdx] == granularity)
+                    m_indices.insert(m_indices.end(), &mesh.Indices[3 * patchIdx], &mesh.Indices[3 * patchIdx] + 3);
+
+            if (m_indices.empty()) continue;
+            m_rasterizer.DrawIndexed(m_clipPositions.data(), granularity == PER_VERTEX ?
+                m_vertexColors[i].data() : m_markerColors.data(), m_indices.data(), static_cast<uint32_t>(m_indices.size()));
+        }
+
+        // Tessellated patches in batches, as CPUATVRayTracer
+        const auto& tessFactors = m_tessFactors[i];
+        const auto& tessPatches = m_tessPatches[i];
+        const auto& pointOffsets = m_pointOffsets[i];
+        const auto numTessPatches = static_cast<uint32_t>(tessPatches.size());
+        for (auto firstPatch = 0u; firstPatch < numTessPatches; firstPatch += PatchesPerBatch)
+        {
+            const auto endPatch = (min)(firstPatch + PatchesPerBatch, numTessPatches);
+            const auto firstPoint = pointOffsets[firstPatch];
+            m_tessPositions.resize(pointOffsets[endPatch] - firstPoint);
+            m_indices.clear();
+            for (auto j = firstPatch; j < endPatch; ++j)
+                for (const auto index : m_tessellators[tessFactors[tessPatches[j]]].GetIndices())
+                    m_indices.push_back(pointOffsets[j] - firstPoint + index);
+
+            ThreadPool::GetDefault().ParallelFor(endPatch - firstPatch, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+            {
+                for (auto j = firstPatch + begin; j < firstPatch + end; ++j)
+                {
+                    const auto patchIdx = tessPatches[j];
+                    const auto& domainPoints = m_tessellators[tessFactors[patchIdx]].GetDomainPoints();
+                    const auto& p0 = mesh.Vertices[mesh.Indices[3 * patchIdx]].Pos;
+                    const auto& p1 = mesh.Vertices[mesh.Indices[3 * patchIdx + 1]].Pos;
+                    const auto& p2 = mesh.Vertices[mesh.Indices[3 * patchIdx + 2]].Pos;
+                    const auto baseVertex = pointOffsets[j] - firstPoint;
+                    for (auto k = 0u; k < domainPoints.size(); ++k)
+                    {
+                        const auto& dom = domainPoints[k];
+                        const auto pos = dom.x * p0 + dom.y * p1 + (1.0f - dom.x - dom.y) * p2;
+                        m_tessPositions[baseVertex + k] = Transform(float4(pos, 1.0f), worldViewProj);
+                    }
+                }
+            });
+
+            m_rasterizer.DrawIndexed(m_tessPositions.data(), m_tessColors[i].data() + firstPoint, m_indices.data(),
+                static_cast<uint32_t>(m_indices.size()));
+        }
+    }
+}
+
+void CPUHRayTracer::raytracePixels(const float3& eyePt, const float4x4& viewProj)
+{
+    // Same primary rays as CPUPRayTracer, only where the marker color was rasterized
+    const auto projToWorld = MatrixInverse(viewProj);
+    atomic<uint64_t> numRays(0);
+    ThreadPool::GetDefault().ParallelFor(m_height, 4, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        auto numChunkRays = 0u;
+        for (auto y = begin; y < end; ++y)
+        {
+            for (auto x = 0u; x < m_width; ++x)
+            {
+                auto& color = m_image[m_width * y + x];
+                if (color.x >= 0.0f) continue;
+
+                const auto screenX = (x + 0.5f) / m_width * 2.0f - 1.0f;
+                const auto screenY = 1.0f - (y + 0.5f) / m_height * 2.0f;
+                const auto hitPos = TransformCoord(float3(screenX, screenY, 0.0f), projToWorld);
+                color = m_scene.TraceRadianceRay(eyePt, normalize(hitPos - eyePt), 0);
+                ++numChunkRays;
+            }
+        }
+        numRays += numChunkRays;
+    });
+
+    m_numRaysPerGranularity[PER_PIXEL] = numRays;
+}
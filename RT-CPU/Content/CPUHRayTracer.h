@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURayTracer.h"
+#include "Rasterizer.h"
+#include "Tessellator.h"
+
+// Hybrid granularity: each visible triangle is classified by its projected area. Small
+// triangles are shaded per vertex, mid-sized ones per tessellated vertex, with a factor
+// from their longest edge against the pixels per sample, and large ones per pixel.
+// All the classes are rasterized into the same depth buffer, the per-pixel triangles
+// with a negative marker color, and the pixels left with the marker are then traced.
+class CPUHRayTracer :
+    public CPURayTracer
+{
+public:
+    enum Granularity : uint8_t
+    {
+        CULLED,
+        PER_VERTEX,
+        PER_TESS_VERTEX,
+        PER_PIXEL,
+
+        NUM_GRANULARITY
+    };
+
+    CPUHRayTracer(const Scene& scene);
+    virtual ~CPUHRayTracer();
+
+    bool Init(uint32_t width, uint32_t height) override;
+    void Render(const float3& eyePt, const float4x4& viewProj) override;
+
+    // Areas in pixels: per vertex up to vertexMaxArea, per pixel from pixelMinArea on
+    void SetThresholds(float vertexMaxArea, float pixelMinArea);
+    void SetPixelsPerSample(float pixelsPerSample);
+
+    uint32_t GetNumPatches(Granularity granularity) const;  // In the last frame
+    uint64_t GetNumGranularityRays(Granularity granularity) const;
+    size_t GetMemorySize() const override;
+
+    static const uint32_t MaxTessFactor = 8;
+
+protected:
+    void classify(const float4x4& viewProj);
+    void raytraceVertices(const float3& eyePt);
+    void raytraceTessVerts(const float3& eyePt);
+    void rasterize(const float4x4& viewProj);
+    void raytracePixels(const float3& eyePt, const float4x4& viewProj);
+
+    Rasterizer              m_rasterizer;
+    Tessellator             m_tessellators[MaxTessFactor + 1];
+
+    float                   m_vertexMaxArea;
+    float                   m_pixelMinArea;
+    float                   m_pixelsPerSample;
+    uint32_t                m_frameStamp;
+    uint32_t                m_numPatches[NUM_GRANULARITY];
+    uint64_t                m_numRaysPerGranularity[NUM_GRANULARITY];
+
+    std::vector<uint8_t>    m_granularities[Scene::NUM_MESH];   // Per patch
+    std::vector<uint8_t>    m_tessFactors[Scene::NUM_MESH];
+    std::vector<std::atomic<uint32_t>> m_vertexStamps[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_visibleVerts[Scene::NUM_MESH];
+    std::vector<float3>     m_vertexColors[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_tessPatches[Scene::NUM_MESH];     // Per-tessellated-vertex patches
+    std::vector<uint32_t>   m_pointOffsets[Scene::NUM_MESH];    // Exclusive prefix sums, per tessellated patch
+    std::vector<float3>     m_tessColors[Scene::NUM_MESH];
+
+    std::vector<float3>     m_markerColors;
+    std::vector<float4>     m_clipPositions;
+    std::vector<float4>     m_tessPositions;
+    std::vector<uint32_t>   m_indices;
+};
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPUPRayTracer.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+CPUPRayTracer::CPUPRayTracer(const Scene& scene) :
+    CPURayTracer(scene)
+{
+}
+
+CPUPRayTracer::~CPUPRayTracer()
+{
+}
+
+void CPUPRayTracer::Render(const float3& eyePt, const float4x4& viewProj)
+{
+    const auto start = Clock::now();
+    const auto projToWorld = MatrixInverse(viewProj);
+
+    // Same primary rays as PRayTracing.hlsl, through the pixel centers
+    ThreadPool::GetDefault().ParallelFor(m_height, 4, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = begin; y < end; ++y)
+        {
+            for (auto x = 0u; x < m_width; ++x)
+            {
+                const auto screenX = (x + 0.5f) / m_width * 2.0f - 1.0f;
+                const auto screenY = 1.0f - (y + 0.5f) / m_height * 2.0f;
+                const auto hitPos = TransformCoord(float3(screenX, screenY, 0.0f), projToWorld);
+                const auto rayDirection = normalize(hitPos - eyePt);
+                m_image[m_width * y + x] = m_scene.TraceRadianceRay(eyePt, rayDirection, 0);
+            }
+        }
+    });
+
+    m_numRays = static_cast<uint64_t>(m_width) * m_height;
+    m_traceTime = getSeconds(start);
+    m_rasterTime = 0.0;
+}
@@ -0,0 +1,18 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURayTracer.h"
+
+// Per-pixel ray tracing, the CPU counterpart of PRayTracer
+class CPUPRayTracer :
+    public CPURayTracer
+{
+public:
+    CPUPRayTracer(const Scene& scene);
+    virtual ~CPUPRayTracer();
+
+    void Render(const float3& eyePt, const float4x4& viewProj) override;
+};
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPURayTracer.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+CPURayTracer::CPURayTracer(const Scene& scene) :
+    m_scene(scene),
+    m_width(0),
+    m_height(0),
+    m_traceTime(0.0),
+    m_rasterTime(0.0),
+    m_numRays(0)
+{
+}
+
+CPURayTracer::~CPURayTracer()
+{
+}
+
+bool CPURayTracer::Init(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    m_image.resize(static_cast<size_t>(width) * height);
+
+    return width > 0 && height > 0;
+}
+
+const float3* CPURayTracer::GetImage() const
+{
+    return m_image.data();
+}
+
+uint32_t CPURayTracer::GetWidth() const
+{
+    return m_width;
+}
+
+uint32_t CPURayTracer::GetHeight() const
+{
+    return m_height;
+}
+
+double CPURayTracer::GetTraceTime() const
+{
+    return m_traceTime;
+}
+
+double CPURayTracer::GetRasterTime() const
+{
+    return m_rasterTime;
+}
+
+uint64_t CPURayTracer::GetNumRays() const
+{
+    return m_numRays;
+}
+
+uint64_t CPURayTracer::GetNumUsefulRays() const
+{
+    return m_numRays;
+}
+
+size_t CPURayTracer::GetMemorySize() const
+{
+    return sizeof(float3) * (m_image.size() + m_background.size());
+}
+
+double CPURayTracer::getSeconds(const Clock::time_point& start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+void CPURayTracer::renderEnvironment(const float3& eyePt, const float4x4& viewProj)
+{
+    m_background.resize(m_image.size());
+    const auto projToWorld = MatrixInverse(viewProj);
+    ThreadPool::GetDefault().ParallelFor(m_height, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = begin; y < end; ++y)
+        {
+            for (auto x = 0u; x < m_width; ++x)
+            {
+                const auto screenX = (x + 0.5f) / m_width * 2.0f - 1.0f;
+                const auto screenY = 1.0f - (y + 0.5f) / m_height * 2.0f;
+                const auto world = TransformCoord(float3(screenX, screenY, 0.0f), projToWorld);
+                m_background[m_width * y + x] = m_scene.EnvironmentColor(world - eyePt);
+            }
+        }
+    });
+}
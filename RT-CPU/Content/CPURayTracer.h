@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Scene.h"
+
+// Common interface of the CPU ray tracers, which render the scene of the GPU
+// application into a linear HDR image before tone mapping.
+class CPURayTracer
+{
+public:
+    CPURayTracer(const Scene& scene);
+    virtual ~CPURayTracer();
+
+    virtual bool Init(uint32_t width, uint32_t height);
+    virtual void Render(const float3& eyePt, const float4x4& viewProj) = 0;
+
+    const float3* GetImage() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+
+    double GetTraceTime() const;    // Seconds spent tracing rays in the last frame
+    double GetRasterTime() const;   // Seconds spent rasterizing in the last frame
+    uint64_t GetNumRays() const;    // Primary rays traced in the last frame
+    virtual uint64_t GetNumUsefulRays() const;
+    virtual size_t GetMemorySize() const;
+
+protected:
+    using Clock = std::chrono::high_resolution_clock;
+
+    static double getSeconds(const Clock::time_point& start);
+
+    // Environment per pixel, the same as PSEnv.hlsl
+    void renderEnvironment(const float3& eyePt, const float4x4& viewProj);
+
+    const Scene&        m_scene;
+
+    uint32_t            m_width;
+    uint32_t            m_height;
+    std::vector<float3> m_image;
+    std::vector<float3> m_background;
+
+    double              m_traceTime;
+    double              m_rasterTime;
+    uint64_t            m_numRays;
+};
@@ -0,0 +1,219 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPUTVRayTracer.h"
+#include "PackedColor.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const uint32_t PatchesPerBatch = 8192;
+
+CPUTVRayTracer::CPUTVRayTracer(const Scene& scene) :
+    CPURayTracer(scene),
+    m_tessFactor(0),
+    m_numInnerPoints(0)
+{
+}
+
+CPUTVRayTracer::~CPUTVRayTracer()
+{
+}
+
+bool CPUTVRayTracer::Init(uint32_t width, uint32_t height)
+{
+    if (!CPURayTracer::Init(width, height)) return false;
+
+    m_rasterizer.Init(width, height);
+
+    // Allocate for the max tessellation factor, as TVRayTracer does
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        auto& topology = m_topologies[i];
+        topology.Init(&mesh.Vertices[0].Pos, sizeof(Scene::Vertex), mesh.Indices.data(),
+            static_cast<uint32_t>(mesh.Indices.size()));
+        m_tessDomains[i].resize(topology.GetNumPatches() * TessTopology::CalcNumInnerPoints(MaxTessFactor));
+        m_tessColors[i].resize(topology.GetNumTessVerts(MaxTessFactor));
+        m_shadingCaches[i].Init(topology.GetNumTessVerts(MaxTessFactor));
+    }
+
+    if (m_tessFactor == 0) SetTessFactor(2);
+
+    return true;
+}
+
+void CPUTVRayTracer::Render(const float3& eyePt, const float4x4& viewProj)
+{
+    // Tessellation and ray tracing per domain point
+    auto start = Clock::now();
+    tessellate();
+    raytrace(eyePt);
+    m_traceTime = getSeconds(start);
+
+    // Environment prepass and rasterization of the re-tessellated patches
+    start = Clock::now();
+    renderEnvironment(eyePt, viewProj);
+    m_rasterizer.Clear(m_background.data());
+    rasterize(viewProj);
+    m_rasterizer.Resolve(m_image.data());
+    m_rasterTime = getSeconds(start);
+}
+
+void CPUTVRayTracer::SetTessFactor(uint32_t tessFactor)
+{
+    tessFactor = (min)((max)(tessFactor, MinTessFactor), MaxTessFactor);
+    if (m_tessFactor == tessFactor) return;
+
+    m_tessFactor = tessFactor;
+    m_numInnerPoints = TessTopology::CalcNumInnerPoints(tessFactor);
+    m_tessellator.Tessellate(tessFactor);
+
+    // The tessellated vertices are renumbered
+    for (auto& shadingCache : m_shadingCaches) shadingCache.Invalidate();
+}
+
+uint32_t CPUTVRayTracer::GetTessFactor() const
+{
+    return m_tessFactor;
+}
+
+void CPUTVRayTracer::SetShadingCache(float maxAngle, float refreshRate)
+{
+    for (auto& shadingCache : m_shadingCaches)
+    {
+        shadingCache.SetMaxAngle(maxAngle);
+        shadingCache.SetRefreshRate(refreshRate);
+    }
+}
+
+uint64_t CPUTVRayTracer::GetNumDomainPoints() const
+{
+    uint64_t numPatches = 0;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i) numPatches += m_scene.GetMesh(i).Indices.size() / 3;
+
+    return numPatches * m_tessellator.GetDomainPoints().size();
+}
+
+uint64_t CPUTVRayTracer::GetNumTessVerts() const
+{
+    uint64_t numTessVerts = 0;
+    for (const auto& topology : m_topologies) numTessVerts += topology.GetNumTessVerts(m_tessFactor);
+
+    return numTessVerts;
+}
+
+size_t CPUTVRayTracer::GetMemorySize() const
+{
+    auto size = CPURayTracer::GetMemorySize() + m_rasterizer.GetMemorySize() +
+        sizeof(float4) * m_clipPositions.capacity() + sizeof(float3) * m_colors.capacity() +
+        sizeof(uint32_t) * m_indices.capacity();
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+        size += m_topologies[i].GetMemorySize() + sizeof(float2) * m_tessDomains[i].size() +
+            sizeof(uint32_t) * m_tessColors[i].size() + m_shadingCaches[i].GetMemorySize();
+
+    return size;
+}
+
+void CPUTVRayTracer::tessellate()
+{
+    // Same as TVDSTess.hlsl: only the inner points are owned by a single patch, so
+    // only they are written, at their dense indices past the outer ring
+    const auto& domainPoints = m_tessellator.GetDomainPoints();
+    const auto firstInnerPoint = domainPoints.end() - m_numInnerPoints;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        auto& tessDomains = m_tessDomains[i];
+        ThreadPool::GetDefault().ParallelFor(m_topologies[i].GetNumPatches(), 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto patchIdx = begin; patchIdx < end; ++patchIdx)
+                copy(firstInnerPoint, domainPoints.end(), tessDomains.begin() + m_numInnerPoints * patchIdx);
+        });
+    }
+}
+
+void CPUTVRayTracer::raytrace(const float3& eyePt)
+{
+    // Same as TVRayTracing.hlsl: one ray per shared tessellated vertex
+    atomic<uint64_t> numRays(0);
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& topology = m_topologies[i];
+        const auto& world = m_scene.GetWorld(i);
+        const auto localEyePt = TransformCoord(eyePt, MatrixInverse(world));
+        const auto pTessDomains = m_tessDomains[i].data();
+        auto& tessColors = m_tessColors[i];
+        auto& shadingCache = m_shadingCaches[i];
+        shadingCache.UpdateWorlds(&m_scene.GetWorld(0), Scene::NUM_MESH, i);
+        const auto numTessVerts = topology.GetNumTessVerts(m_tessFactor);
+        ThreadPool::GetDefault().ParallelFor(numTessVerts, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            auto numChunkRays = 0u;
+            for (auto vertIdx = begin; vertIdx < end; ++vertIdx)
+            {
+                const auto hitObjPos = topology.GetTessVertPos(vertIdx, m_tessFactor, pTessDomains);
+                if (!shadingCache.Refresh(vertIdx, hitObjPos, localEyePt)) continue;
+
+                const auto hitPos = TransformCoord(hitObjPos, world);
+                tessColors[vertIdx] = PackR11G11B10(m_scene.TraceRadianceRay(eyePt, normalize(hitPos - eyePt), 0));
+                ++numChunkRays;
+            }
+            numRays += numChunkRays;
+        });
+        shadingCache.NextFrame();
+    }
+    m_numRays = numRays;
+}
+
+void CPUTVRayTracer::rasterize(const float4x4& viewProj)
+{
+    // Same as TVDSGraphics.hlsl, in batches of patches to bound the memory
+    const auto& domainPoints = m_tessellator.GetDomainPoints();
+    const auto& tessIndices = m_tessellator.GetIndices();
+    const auto numPoints = static_cast<uint32_t>(domainPoints.size());
+    const auto numTessIndices = static_cast<uint32_t>(tessIndices.size());
+
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        const auto& topology = m_topologies[i];
+        const auto& tessColors = m_tessColors[i];
+        const auto numPatches = static_cast<uint32_t>(mesh.Indices.size() / 3);
+
+        for (auto firstPatch = 0u; firstPatch < numPatches; firstPatch += PatchesPerBatch)
+        {
+            const auto numBatchPatches = (min)(PatchesPerBatch, numPatches - firstPatch);
+            m_clipPositions.resize(numBatchPatches * numPoints);
+            m_colors.resize(numBatchPatches * numPoints);
+            m_indices.resize(numBatchPatches * numTessIndices);
+
+            ThreadPool::GetDefault().ParallelFor(numBatchPatches, 256, [&](uint32_t begin, uint32_t end, uint32_t)
+            {
+                for (auto j = begin; j < end; ++j)
+                {
+                    const auto patchIdx = firstPatch + j;
+                    const auto& p0 = mesh.Vertices[mesh.Indices[3 * patchIdx]].Pos;
+                    const auto& p1 = mesh.Vertices[mesh.Indices[3 * patchIdx + 1]].Pos;
+                    const auto& p2 = mesh.Vertices[mesh.Indices[3 * patchIdx + 2]].Pos;
+
+                    for (auto k = 0u; k < numPoints; ++k)
+                    {
+                        const auto& domain = domainPoints[k];
+                        const auto pos = domain.x * p0 + domain.y * p1 + (1.0f - domain.x - domain.y) * p2;
+                        m_clipPositions[numPoints * j + k] = Transform(float4(pos, 1.0f), worldViewProj);
+                        m_colors[numPoints * j + k] = UnpackR11G11B10(tessColors[topology.GetTessVertIndex(patchIdx, domain, m_tessFactor)]);
+                    }
+
+                    for (auto k = 0u; k < numTessIndices; ++k)
+                        m_indices[numTessIndices * j + k] = numPoints * j + tessIndices[k];
+                }
+            });
+
+            m_rasterizer.DrawIndexed(m_clipPositions.data(), m_colors.data(), m_indices.data(),
+                static_cast<uint32_t>(m_indices.size()));
+        }
+    }
+}
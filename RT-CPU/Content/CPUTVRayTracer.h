@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURayTracer.h"
+#include "Rasterizer.h"
+#include "ShadingCache.h"
+#include "TessTopology.h"
+#include "Tessellator.h"
+
+// Per-tessellated-vertex ray tracing, the CPU counterpart of TVRayTracer:
+// one ray is traced per tessellated vertex, shared by the adjacent patches along
+// their edges and corners, and the patches are re-tessellated to rasterize the colors.
+// The shading cache, if enabled, skips the rays of the vertices seen from nearly the
+// same direction as when last traced.
+class CPUTVRayTracer :
+    public CPURayTracer
+{
+public:
+    CPUTVRayTracer(const Scene& scene);
+    virtual ~CPUTVRayTracer();
+
+    bool Init(uint32_t width, uint32_t height) override;
+    void Render(const float3& eyePt, const float4x4& viewProj) override;
+
+    void SetTessFactor(uint32_t tessFactor);
+    uint32_t GetTessFactor() const;
+    void SetShadingCache(float maxAngle, float refreshRate);
+
+    uint64_t GetNumDomainPoints() const;
+    uint64_t GetNumTessVerts() const;
+    size_t GetMemorySize() const override;
+
+    static const uint32_t MinTessFactor = 1;
+    static const uint32_t MaxTessFactor = 5;
+
+protected:
+    void tessellate();
+    void raytrace(const float3& eyePt);
+    void rasterize(const float4x4& viewProj);
+
+    Tessellator             m_tessellator;
+    Rasterizer              m_rasterizer;
+    TessTopology            m_topologies[Scene::NUM_MESH];
+
+    uint32_t                m_tessFactor;
+    uint32_t                m_numInnerPoints;
+
+    std::vector<float2>     m_tessDomains[Scene::NUM_MESH];  // Of the inner points of the patches
+    std::vector<uint32_t>   m_tessColors[Scene::NUM_MESH];   // R11G11B10_FLOAT
+    ShadingCache            m_shadingCaches[Scene::NUM_MESH];
+
+    std::vector<float4>     m_clipPositions;
+    std::vector<float3>     m_colors;
+    std::vector<uint32_t>   m_indices;
+};
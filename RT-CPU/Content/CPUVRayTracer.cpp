@@ -0,0 +1,262 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CPUVRayTracer.h"
+#include "PackedColor.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Planes of the clip-space frustum that a point is outside of
+static uint32_t getOutCode(const float4& p)
+{
+    return (p.x > p.w ? 0x1 : 0) | (p.x < -p.w ? 0x2 : 0) | (p.y > p.w ? 0x4 : 0) |
+        (p.y < -p.w ? 0x8 : 0) | (p.z < 0.0f ? 0x10 : 0) | (p.z > p.w ? 0x20 : 0);
+}
+
+CPUVRayTracer::CPUVRayTracer(const Scene& scene) :
+    CPURayTracer(scene),
+    m_frameStamp(0)
+{
+}
+
+CPUVRayTracer::~CPUVRayTracer()
+{
+}
+
+bool CPUVRayTracer::Init(uint32_t width, uint32_t height)
+{
+    if (!CPURayTracer::Init(width, height)) return false;
+
+    m_rasterizer.Init(width, height);
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        buildClusters(mesh, m_clusters[i]);
+        m_vertexStamps[i] = vector<atomic<uint32_t>>(mesh.Vertices.size());
+        m_visibleVerts[i].reserve(mesh.Vertices.size());
+        m_vertexColors[i].resize(mesh.Vertices.size());
+        m_shadingCaches[i].Init(static_cast<uint32_t>(mesh.Vertices.size()));
+    }
+
+    return true;
+}
+
+void CPUVRayTracer::Render(const float3& eyePt, const float4x4& viewProj)
+{
+    auto& threadPool = ThreadPool::GetDefault();
+
+    // Ray tracing per visible vertex, as VRayTracing.hlsl
+    auto start = Clock::now();
+    cull(eyePt, viewProj);
+    atomic<uint64_t> numRays(0);
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& vertices = m_scene.GetMesh(i).Vertices;
+        const auto& world = m_scene.GetWorld(i);
+        const auto localEyePt = TransformCoord(eyePt, MatrixInverse(world));
+        const auto& visibleVerts = m_visibleVerts[i];
+        auto& colors = m_vertexColors[i];
+        auto& shadingCache = m_shadingCaches[i];
+        shadingCache.UpdateWorlds(&m_scene.GetWorld(0), Scene::NUM_MESH, i);
+        threadPool.ParallelFor(static_cast<uint32_t>(visibleVerts.size()), 256, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            auto numChunkRays = 0u;
+            for (auto j = begin; j < end; ++j)
+            {
+                const auto vertexIdx = visibleVerts[j];
+                if (!shadingCache.Refresh(vertexIdx, vertices[vertexIdx].Pos, localEyePt)) continue;
+
+                const auto hitPos = TransformCoord(vertices[vertexIdx].Pos, world);
+                const auto rayDirection = normalize(hitPos - eyePt);
+                colors[vertexIdx] = PackR11G11B10(m_scene.TraceRadianceRay(eyePt, rayDirection, 0));
+                ++numChunkRays;
+            }
+            numRays += numChunkRays;
+        });
+        shadingCache.NextFrame();
+    }
+    m_numRays = numRays;
+    m_traceTime = getSeconds(start);
+
+    // Environment prepass and rasterization
+    start = Clock::now();
+    renderEnvironment(eyePt, viewProj);
+    m_rasterizer.Clear(m_background.data());
+
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto worldViewProj = m_scene.GetWorld(i) * viewProj;
+        const auto numVertices = static_cast<uint32_t>(mesh.Vertices.size());
+        m_clipPositions.resize(numVertices);
+        m_colors.resize(numVertices);
+        threadPool.ParallelFor(numVertices, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto j = begin; j < end; ++j)
+                m_clipPositions[j] = Transform(float4(mesh.Vertices[j].Pos, 1.0f), worldViewProj);
+            UnpackR11G11B10(&m_vertexColors[i][begin], &m_colors[begin], end - begin);
+        });
+
+        m_rasterizer.DrawIndexed(m_clipPositions.data(), m_colors.data(),
+            mesh.Indices.data(), static_cast<uint32_t>(mesh.Indices.size()));
+    }
+
+    m_rasterizer.Resolve(m_image.data());
+    m_rasterTime = getSeconds(start);
+}
+
+void CPUVRayTracer::SetShadingCache(float maxAngle, float refreshRate)
+{
+    for (auto& shadingCache : m_shadingCaches)
+    {
+        shadingCache.SetMaxAngle(maxAngle);
+        shadingCache.SetRefreshRate(refreshRate);
+    }
+}
+
+uint64_t CPUVRayTracer::GetNumVerts() const
+{
+    uint64_t numVerts = 0;
+    for (const auto& colors : m_vertexColors) numVerts += colors.size();
+
+    return numVerts;
+}
+
+uint64_t CPUVRayTracer::GetNumVisibleVerts() const
+{
+    uint64_t numVerts = 0;
+    for (const auto& visibleVerts : m_visibleVerts) numVerts += visibleVerts.size();
+
+    return numVerts;
+}
+
+size_t CPUVRayTracer::GetMemorySize() const
+{
+    auto size = CPURayTracer::GetMemorySize() + m_rasterizer.GetMemorySize() +
+        sizeof(float4) * m_clipPositions.capacity() + sizeof(float3) * m_colors.capacity();
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+        size += sizeof(Cluster) * m_clusters[i].capacity() + sizeof(uint32_t) * m_vertexStamps[i].size() +
+            sizeof(uint32_t) * m_visibleVerts[i].capacity() + sizeof(uint32_t) * m_vertexColors[i].size() +
+            m_shadingCaches[i].GetMemorySize();
+
+    return size;
+}
+
+void CPUVRayTracer::cull(const float3& eyePt, const float4x4& viewProj)
+{
+    ++m_frameStamp;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = m_scene.GetMesh(i);
+        const auto& world = m_scene.GetWorld(i);
+        const auto worldViewProj = world * viewProj;
+        const auto localEyePt = TransformCoord(eyePt, MatrixInverse(world));
+        const auto& clusters = m_clusters[i];
+        const auto numTriangles = static_cast<uint32_t>(mesh.Indices.size() / 3);
+        auto& vertexStamps = m_vertexStamps[i];
+
+        // Mark the vertices of the visible triangles, as CSVisibility.hlsl
+        ThreadPool::GetDefault().ParallelFor(static_cast<uint32_t>(clusters.size()), 16, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto c = begin; c < end; ++c)
+            {
+                // Back-facing clusters, whose normal cones face away from the eye
+                const auto& cluster = clusters[c];
+                const auto toCenter = cluster.Center - localEyePt;
+                if (dot(toCenter, cluster.ConeAxis) >= cluster.ConeCutoff * length(toCenter) + length(cluster.Extents)) continue;
+
+                // Clusters outside the frustum
+                auto outCode = 0x3fu;
+                for (auto k = 0u; k < 8; ++k)
+                {
+                    const auto corner = cluster.Center + cluster.Extents * float3(k & 1 ? 1.0f : -1.0f,
+                        k & 2 ? 1.0f : -1.0f, k & 4 ? 1.0f : -1.0f);
+                    outCode &= getOutCode(Transform(float4(corner, 1.0f), worldViewProj));
+                }
+                if (outCode) continue;
+
+                const auto endTriangle = (min)((c + 1) * TrianglesPerCluster, numTriangles);
+                for (auto t = c * TrianglesPerCluster; t < endTriangle; ++t)
+                {
+                    const uint32_t indices[] = { mesh.Indices[3 * t], mesh.Indices[3 * t + 1], mesh.Indices[3 * t + 2] };
+                    const auto& p0 = mesh.Vertices[indices[0]].Pos;
+                    const auto& p1 = mesh.Vertices[indices[1]].Pos;
+                    const auto& p2 = mesh.Vertices[indices[2]].Pos;
+
+                    // Clockwise triangles, seen from the eye in the left-handed space, are front-facing
+                    if (dot(cross(p1 - p0, p2 - p0), localEyePt - p0) <= 0.0f) continue;
+
+                    outCode = getOutCode(Transform(float4(p0, 1.0f), worldViewProj)) &
+                        getOutCode(Transform(float4(p1, 1.0f), worldViewProj)) &
+                        getOutCode(Transform(float4(p2, 1.0f), worldViewProj));
+                    if (outCode) continue;
+
+                    for (const auto idx : indices) vertexStamps[idx].store(m_frameStamp, memory_order_relaxed);
+                }
+            }
+        });
+
+        // Compact the marked vertices, as CSCompactVerts.hlsl
+        auto& visibleVerts = m_visibleVerts[i];
+        visibleVerts.clear();
+        for (auto j = 0u; j < vertexStamps.size(); ++j)
+            if (vertexStamps[j].load(memory_order_relaxed) == m_frameStamp) visibleVerts.push_back(j);
+    }
+}
+
+void CPUVRayTracer::buildClusters(const Scene::Mesh& mesh, vector<Cluster>& clusters)
+{
+    const auto numTriangles = static_cast<uint32_t>(mesh.Indices.size() / 3);
+    clusters.resize(DIV_UP(numTriangles, TrianglesPerCluster));
+    for (auto c = 0u; c < clusters.size(); ++c)
+    {
+        const auto firstTriangle = c * TrianglesPerCluster;
+        const auto endTriangle = (min)(firstTriangle + TrianglesPerCluster, numTriangles);
+
+        auto minPt = float3(FLT_MAX, FLT_MAX, FLT_MAX);
+        auto maxPt = float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        auto normalSum = float3(0.0f, 0.0f, 0.0f);
+        for (auto t = firstTriangle; t < endTriangle; ++t)
+        {
+            const auto& p0 = mesh.Vertices[mesh.Indices[3 * t]].Pos;
+            const auto& p1 = mesh.Vertices[mesh.Indices[3 * t + 1]].Pos;
+            const auto& p2 = mesh.Vertices[mesh.Indices[3 * t + 2]].Pos;
+            minPt = min3(min3(minPt, p0), min3(p1, p2));
+            maxPt = max3(max3(maxPt, p0), max3(p1, p2));
+
+            const auto normal = cross(p1 - p0, p2 - p0);
+            const auto len = length(normal);
+            if (len > 0.0f) normalSum = normalSum + normal / len;
+        }
+
+        // The cone around the mean normal, given up for spreads of 90 degrees and more
+        auto& cluster = clusters[c];
+        cluster.Center = (minPt + maxPt) * 0.5f;
+        cluster.Extents = (maxPt - minPt) * 0.5f;
+        cluster.ConeAxis = float3(0.0f, 0.0f, 0.0f);
+        cluster.ConeCutoff = 2.0f;
+
+        const auto sumLength = length(normalSum);
+        if (sumLength <= 0.0f) continue;
+
+        auto minDot = 1.0f;
+        const auto axis = normalSum / sumLength;
+        for (auto t = firstTriangle; t < endTriangle; ++t)
+        {
+            const auto& p0 = mesh.Vertices[mesh.Indices[3 * t]].Pos;
+            const auto normal = cross(mesh.Vertices[mesh.Indices[3 * t + 1]].Pos - p0,
+                mesh.Vertices[mesh.Indices[3 * t + 2]].Pos - p0);
+            const auto len = length(normal);
+            if (len > 0.0f) minDot = (min)(minDot, dot(normal, axis) / len);
+        }
+
+        if (minDot > 0.0f)
+        {
+            cluster.ConeAxis = axis;
+            cluster.ConeCutoff = sqrt(1.0f - minDot * minDot);
+        }
+    }
+}
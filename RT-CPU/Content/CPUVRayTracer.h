@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPURayTracer.h"
+#include "Rasterizer.h"
+#include "ShadingCache.h"
+
+// Per-vertex ray tracing, the CPU counterpart of VRayTracer: one ray per mesh vertex,
+// then the vertex colors are rasterized over the environment.
+// The flat tessellation of VRayTracer interpolates the colors linearly over each
+// original triangle, so the triangles are rasterized without subdivision here.
+// As in VRayTracer, only the vertices of the front-facing triangles in the frustum
+// are traced, after culling clusters of triangles by their bounds and normal cones.
+// With the shading cache enabled, the colors of the earlier frames are reused for
+// the vertices whose view directions have barely turned.
+class CPUVRayTracer :
+    public CPURayTracer
+{
+public:
+    CPUVRayTracer(const Scene& scene);
+    virtual ~CPUVRayTracer();
+
+    bool Init(uint32_t width, uint32_t height) override;
+    void Render(const float3& eyePt, const float4x4& viewProj) override;
+
+    void SetShadingCache(float maxAngle, float refreshRate);
+
+    uint64_t GetNumVerts() const;
+    uint64_t GetNumVisibleVerts() const;
+    size_t GetMemorySize() const override;
+
+    static const uint32_t TrianglesPerCluster = 64;
+
+protected:
+    // Object-space bounds and normal cone of a run of TrianglesPerCluster triangles
+    struct Cluster
+    {
+        float3  Center;
+        float3  Extents;
+        float3  ConeAxis;
+        float   ConeCutoff; // Sine of the cone angle, or above 1 for no cone culling
+    };
+
+    void cull(const float3& eyePt, const float4x4& viewProj);
+
+    static void buildClusters(const Scene::Mesh& mesh, std::vector<Cluster>& clusters);
+
+    Rasterizer              m_rasterizer;
+    uint32_t                m_frameStamp;
+
+    std::vector<Cluster>    m_clusters[Scene::NUM_MESH];
+    std::vector<std::atomic<uint32_t>> m_vertexStamps[Scene::NUM_MESH];   // Frame last seen
+    std::vector<uint32_t>   m_visibleVerts[Scene::NUM_MESH];
+    std::vector<uint32_t>   m_vertexColors[Scene::NUM_MESH];  // R11G11B10_FLOAT
+    ShadingCache            m_shadingCaches[Scene::NUM_MESH];
+    std::vector<float4>     m_clipPositions;
+    std::vector<float3>     m_colors;
+};
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "RadianceCache.h"
+
+using namespace std;
+
+// Key bits: the pending flag, the 16-bit epoch, and the upper 47 bits of the hash
+static const uint64_t PendingBit = 0x1;
+static const uint32_t EpochShift = 1;
+static const uint64_t EpochMask = 0xffff;
+static const uint64_t HashMask = ~0x1ffffull;
+
+// Finalizer of SplitMix64, a bijection that spreads the packed cell over all the bits
+static uint64_t mixBits(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+
+    return x ^ (x >> 31);
+}
+
+static uint32_t getNormalBin(const float3& normal)
+{
+    // Octahedral map of the unit normal onto [-1, 1]^2
+    const auto invL1 = 1.0f / (fabs(normal.x) + fabs(normal.y) + fabs(normal.z));
+    auto u = normal.x * invL1;
+    auto v = normal.y * invL1;
+    if (normal.z < 0.0f)
+    {
+        const auto fu = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        v = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+    }
+
+    const auto n = static_cast<float>(RadianceCache::NormalBins);
+    const auto i = (min)(static_cast<uint32_t>((u * 0.5f + 0.5f) * n), RadianceCache::NormalBins - 1);
+    const auto j = (min)(static_cast<uint32_t>((v * 0.5f + 0.5f) * n), RadianceCache::NormalBins - 1);
+
+    return RadianceCache::NormalBins * j + i;
+}
+
+RadianceCache::RadianceCache() :
+    m_mask(0),
+    m_epoch(1),
+    m_invCellSize(1.0f)
+{
+}
+
+RadianceCache::~RadianceCache()
+{
+}
+
+void RadianceCache::Init(uint32_t numEntriesLog2, float cellSize)
+{
+    const auto numEntries = 1ull << numEntriesLog2;
+    m_entries = make_unique<Entry[]>(numEntries);
+    for (auto i = 0ull; i < numEntries; ++i) m_entries[i].Key.store(0, memory_order_relaxed);
+    m_mask = numEntries - 1;
+    m_epoch = 1;
+    m_invCellSize = 1.0f / cellSize;
+}
+
+void RadianceCache::NextFrame()
+{
+    // Only when the epoch wraps around must the entries be cleared
+    m_epoch = (m_epoch + 1) & EpochMask;
+    if (m_epoch == 0)
+    {
+        for (auto i = 0ull; i <= m_mask; ++i) m_entries[i].Key.store(0, memory_order_relaxed);
+        m_epoch = 1;
+    }
+}
+
+bool RadianceCache::Find(const float3& pos, const float3& normal, float3& radiance) const
+{
+    const auto key = getKey(pos, normal);
+    for (auto i = 0u; i < MaxProbes; ++i)
+    {
+        const auto& entry = m_entries[(key + i) & m_mask];
+        const auto slotKey = entry.Key.load(memory_order_acquire);
+        if ((slotKey & HashMask) == (key & HashMask) && isCurrent(slotKey))
+        {
+            if (slotKey & PendingBit) return false;
+            radiance = float3(entry.Radiance[0].load(memory_order_relaxed),
+                entry.Radiance[1].load(memory_order_relaxed), entry.Radiance[2].load(memory_order_relaxed));
+
+            return true;
+        }
+
+        // Probe chains end at empty or expired slots
+        if (!isCurrent(slotKey)) return false;
+    }
+
+    return false;
+}
+
+void RadianceCache::Insert(const float3& pos, const float3& normal, const float3& radiance)
+{
+    const auto key = getKey(pos, normal);
+    const auto keyWithEpoch = (key & HashMask) | (static_cast<uint64_t>(m_epoch) << EpochShift);
+    for (auto i = 0u; i < MaxProbes; ++i)
+    {
+        auto& entry = m_entries[(key + i) & m_mask];
+        auto slotKey = entry.Key.load(memory_order_relaxed);
+        if (isCurrent(slotKey))
+        {
+            if ((slotKey & ~PendingBit) == keyWithEpoch) return;    // Inserted by another thread
+            continue;
+        }
+
+        // Claim the slot, then publish the radiance by clearing the pending bit
+        if (entry.Key.compare_exchange_strong(slotKey, keyWithEpoch | PendingBit, memory_order_acquire))
+        {
+            entry.Radiance[0].store(radiance.x, memory_order_relaxed);
+            entry.Radiance[1].store(radiance.y, memory_order_relaxed);
+            entry.Radiance[2].store(radiance.z, memory_order_relaxed);
+            entry.Key.store(keyWithEpoch, memory_order_release);
+
+            return;
+        }
+
+        if ((slotKey & ~PendingBit) == keyWithEpoch) return;
+    }
+}
+
+float RadianceCache::GetCellSize() const
+{
+    return 1.0f / m_invCellSize;
+}
+
+size_t RadianceCache::GetMemorySize() const
+{
+    return m_entries ? sizeof(Entry) * (m_mask + 1) : 0;
+}
+
+uint64_t RadianceCache::getKey(const float3& pos, const float3& normal) const
+{
+    // 19 bits per cell coordinate and 6 bits of the normal bin
+    const auto cellMask = (1ull << 19) - 1;
+    const auto x = static_cast<uint64_t>(static_cast<int64_t>(floor(pos.x * m_invCellSize))) & cellMask;
+    const auto y = static_cast<uint64_t>(static_cast<int64_t>(floor(pos.y * m_invCellSize))) & cellMask;
+    const auto z = static_cast<uint64_t>(static_cast<int64_t>(floor(pos.z * m_invCellSize))) & cellMask;
+
+    return mixBits((x << 45) | (y << 26) | (z << 7) | getNormalBin(normal));
+}
+
+bool RadianceCache::isCurrent(uint64_t key) const
+{
+    return key != 0 && ((key >> EpochShift) & EpochMask) == m_epoch;
+}
@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// World-space cache of the view-independent radiance of the bounce hits, that is the
+// diffuse and shadowed direct light without the mirror term, shared by all the
+// granularities through the scene. Entries are keyed on the hit position, quantized
+// to cells, and on the normal, quantized to octahedral bins, in an open-addressed
+// table that threads insert into and look up in without locks. Each key carries the
+// epoch it was written in, so a new frame drops all the entries at once, and the
+// slots of the old epochs are reclaimed as empty.
+class RadianceCache
+{
+public:
+    RadianceCache();
+    virtual ~RadianceCache();
+
+    void Init(uint32_t numEntriesLog2, float cellSize);
+    void NextFrame();
+
+    bool Find(const float3& pos, const float3& normal, float3& radiance) const;
+    void Insert(const float3& pos, const float3& normal, const float3& radiance);
+
+    float GetCellSize() const;
+    size_t GetMemorySize() const;
+
+    static const uint32_t NormalBins = 8;   // Per side of the octahedral map
+    static const uint32_t MaxProbes = 8;
+
+protected:
+    struct Entry
+    {
+        std::atomic<uint64_t>   Key;            // Hash, epoch and pending bit; 0 if empty
+        std::atomic<float>      Radiance[3];
+    };
+
+    uint64_t getKey(const float3& pos, const float3& normal) const;
+    bool isCurrent(uint64_t key) const;
+
+    std::unique_ptr<Entry[]> m_entries;
+    uint64_t                m_mask;
+    uint32_t                m_epoch;
+    float                   m_invCellSize;
+};
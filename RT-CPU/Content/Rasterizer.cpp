@@ -0,0 +1,442 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Rasterizer.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const uint32_t TrianglesPerChunk = 1024;
+static const float GuardBandPixels = 16384.0f;
+
+Rasterizer::Rasterizer() :
+    m_width(0),
+    m_height(0),
+    m_pitch(0),
+    m_numTilesX(0),
+    m_numTilesY(0),
+    m_guardBand(0.0f),
+    m_numChunks(0),
+    m_numRasterized(0)
+{
+}
+
+Rasterizer::~Rasterizer()
+{
+}
+
+void Rasterizer::Init(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    m_numTilesX = DIV_UP(width, TileSize);
+    m_numTilesY = DIV_UP(height, TileSize);
+
+    // Screen coordinates within +-GuardBandPixels keep the edge functions exact in 64 bits
+    m_guardBand = 2.0f * GuardBandPixels / (max)(width, height) - 1.0f;
+
+    // Pad to whole tiles, so that 8-wide accesses never leave the buffers
+    m_pitch = m_numTilesX * TileSize;
+    const auto size = static_cast<size_t>(m_pitch) * m_numTilesY * TileSize;
+    m_depth.assign(size, 1.0f);
+    for (auto& colors : m_colors) colors.assign(size, 0.0f);
+}
+
+void Rasterizer::Clear(const float3* pBackground)
+{
+    ThreadPool::GetDefault().ParallelFor(m_height, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = begin; y < end; ++y)
+        {
+            const auto row = static_cast<size_t>(m_pitch) * y;
+            fill_n(&m_depth[row], m_pitch, 1.0f);
+            for (auto i = 0u; i < 3; ++i)
+            {
+                if (pBackground)
+                    for (auto x = 0u; x < m_width; ++x)
+                        m_colors[i][row + x] = pBackground[m_width * y + x][i];
+                else fill_n(&m_colors[i][row], m_pitch, 0.0f);
+            }
+        }
+    });
+    m_numRasterized = 0;
+}
+
+void Rasterizer::DrawIndexed(const float4* pPositions, const float3* pColors,
+    const uint32_t* pIndices, uint32_t numIndices)
+{
+    const auto numTriangles = numIndices / 3;
+    const auto numTiles = m_numTilesX * m_numTilesY;
+    m_numChunks = DIV_UP(numTriangles, TrianglesPerChunk);
+    if (m_chunks.size() < m_numChunks) m_chunks.resize(m_numChunks);
+
+    // Set up and bin the triangles, one chunk per task, so that the bins of the
+    // chunks keep the triangles in the submission order.
+    auto& threadPool = ThreadPool::GetDefault();
+    threadPool.ParallelFor(m_numChunks, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto c = begin; c < end; ++c)
+        {
+            auto& chunk = m_chunks[c];
+            chunk.Triangles.clear();
+            chunk.Bins.resize(numTiles);
+            for (auto& bin : chunk.Bins) bin.clear();
+
+            const auto triEnd = (min)((c + 1) * TrianglesPerChunk, numTriangles);
+            for (auto t = c * TrianglesPerChunk; t < triEnd; ++t)
+            {
+                Vertex vertices[3];
+                for (auto i = 0u; i < 3; ++i)
+                {
+                    const auto idx = pIndices[3 * t + i];
+                    vertices[i] = { pPositions[idx], pColors[idx] };
+                }
+                setupTriangle(vertices, chunk);
+            }
+        }
+    });
+
+    // Rasterize the tiles
+    threadPool.ParallelFor(numTiles, 1, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto i = begin; i < end; ++i) rasterizeTile(i);
+    });
+}
+
+void Rasterizer::Resolve(float3* pImage) const
+{
+    ThreadPool::GetDefault().ParallelFor(m_height, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (auto y = begin; y < end; ++y)
+        {
+            const auto row = static_cast<size_t>(m_pitch) * y;
+            for (auto x = 0u; x < m_width; ++x)
+                pImage[m_width * y + x] = float3(m_colors[0][row + x], m_colors[1][row + x], m_colors[2][row + x]);
+        }
+    });
+}
+
+uint32_t Rasterizer::GetNumRasterizedTriangles() const
+{
+    return m_numRasterized;
+}
+
+size_t Rasterizer::GetMemorySize() const
+{
+    auto size = sizeof(float) * m_depth.size() * 4;
+    for (auto c = 0u; c < m_numChunks; ++c)
+    {
+        size += sizeof(Triangle) * m_chunks[c].Triangles.capacity();
+        for (const auto& bin : m_chunks[c].Bins) size += sizeof(uint32_t) * bin.capacity();
+    }
+
+    return size;
+}
+
+void Rasterizer::setupTriangle(const Vertex* pVertices, Chunk& chunk)
+{
+    const auto& p0 = pVertices[0].Pos;
+    const auto& p1 = pVertices[1].Pos;
+    const auto& p2 = pVertices[2].Pos;
+
+    // Trivially reject the triangles outside a frustum plane
+    if (p0.x > p0.w && p1.x > p1.w && p2.x > p2.w) return;
+    if (p0.x < -p0.w && p1.x < -p1.w && p2.x < -p2.w) return;
+    if (p0.y > p0.w && p1.y > p1.w && p2.y > p2.w) return;
+    if (p0.y < -p0.w && p1.y < -p1.w && p2.y < -p2.w) return;
+    if (p0.z > p0.w && p1.z > p1.w && p2.z > p2.w) return;
+    if (p0.z < 0.0f && p1.z < 0.0f && p2.z < 0.0f) return;
+
+    // Clip-space distances to the near plane (z = 0) and the guard-band planes
+    const auto g = m_guardBand;
+    const auto distance = [g](const float4& p, uint32_t plane)
+    {
+        switch (plane)
+        {
+        case 0: return p.z;
+        case 1: return g * p.w - p.x;
+        case 2: return g * p.w + p.x;
+        case 3: return g * p.w - p.y;
+        default: return g * p.w + p.y;
+        }
+    };
+
+    auto isInside = true;
+    for (auto plane = 0u; plane < 5 && isInside; ++plane)
+        for (auto i = 0u; i < 3 && isInside; ++i)
+            isInside = distance(pVertices[i].Pos, plane) >= 0.0f;
+
+    if (isInside)
+    {
+        setupScreenTriangle(pVertices[0], pVertices[1], pVertices[2], chunk);
+        return;
+    }
+
+    // Clip the polygon against each plane in turn [Sutherland and Hodgman 1974]
+    Vertex polygons[2][8];
+    auto pIn = polygons[0];
+    auto pOut = polygons[1];
+    copy(pVertices, pVertices + 3, pIn);
+    auto n = 3u;
+    for (auto plane = 0u; plane < 5 && n >= 3; ++plane)
+    {
+        auto m = 0u;
+        for (auto i = 0u; i < n; ++i)
+        {
+            const auto& a = pIn[i];
+            const auto& b = pIn[(i + 1) % n];
+            const auto da = distance(a.Pos, plane);
+            const auto db = distance(b.Pos, plane);
+            if (da >= 0.0f) pOut[m++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+            {
+                const auto t = da / (da - db);
+                auto& v = pOut[m++];
+                v.Pos = float4(
+                    a.Pos.x + (b.Pos.x - a.Pos.x) * t,
+                    a.Pos.y + (b.Pos.y - a.Pos.y) * t,
+                    plane ? a.Pos.z + (b.Pos.z - a.Pos.z) * t : 0.0f,
+                    a.Pos.w + (b.Pos.w - a.Pos.w) * t);
+                v.Color = a.Color + (b.Color - a.Color) * t;
+            }
+        }
+        swap(pIn, pOut);
+        n = m;
+    }
+
+    for (auto i = 2u; i < n; ++i) setupScreenTriangle(pIn[0], pIn[i - 1], pIn[i], chunk);
+}
+
+void Rasterizer::setupScreenTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk)
+{
+    const Vertex* pVertices[] = { &v0, &v1, &v2 };
+    const auto subPixelScale = static_cast<float>(1 << SubPixelBits);
+
+    // Viewport transform, with y pointing down, snapped to the subpixel grid
+    int64_t fx[3], fy[3];
+    float sx[3], sy[3], sz[3], invW[3];
+    for (auto i = 0u; i < 3; ++i)
+    {
+        const auto& pos = pVertices[i]->Pos;
+        invW[i] = 1.0f / pos.w;
+        fx[i] = llround((pos.x * invW[i] * 0.5f + 0.5f) * m_width * subPixelScale);
+        fy[i] = llround((0.5f - pos.y * invW[i] * 0.5f) * m_height * subPixelScale);
+        sx[i] = fx[i] / subPixelScale;
+        sy[i] = fy[i] / subPixelScale;
+        sz[i] = pos.z * invW[i];
+    }
+
+    // Clockwise triangles on screen have positive areas with y pointing down;
+    // counter-clockwise (back-facing) and degenerate ones are culled.
+    const auto fixedArea = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+    if (fixedArea <= 0) return;
+
+    // Pixel bounds, sampling at the pixel centers
+    const auto minX = (max)(floor((min)((min)(sx[0], sx[1]), sx[2]) - 0.5f), 0.0f);
+    const auto minY = (max)(floor((min)((min)(sy[0], sy[1]), sy[2]) - 0.5f), 0.0f);
+    const auto maxX = (min)(ceil((max)((max)(sx[0], sx[1]), sx[2]) - 0.5f), m_width - 1.0f);
+    const auto maxY = (min)(ceil((max)((max)(sy[0], sy[1]), sy[2]) - 0.5f), m_height - 1.0f);
+    if (minX > maxX || minY > maxY) return;
+
+    Triangle tri;
+    tri.MinX = static_cast<uint32_t>(minX);
+    tri.MinY = static_cast<uint32_t>(minY);
+    tri.MaxX = static_cast<uint32_t>(maxX);
+    tri.MaxY = static_cast<uint32_t>(maxY);
+
+    // Edge functions, positive inside; the i-th edge is opposite to the i-th vertex.
+    // In subpixel units, E(p) = a * p.x + b * p.y + c, with p = pixel * scale + scale / 2.
+    const int64_t scale = 1 << SubPixelBits;
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (auto i = 0u; i < 3; ++i)
+    {
+        const auto j = (i + 1) % 3;
+        const auto k = (i + 2) % 3;
+        const auto a = fy[j] - fy[k];
+        const auto b = fx[k] - fx[j];
+        const auto c = fx[j] * fy[k] - fy[j] * fx[k];
+
+        // Top edges are horizontal with the inside below, and left edges have the inside on their right;
+        // pixels exactly on the other edges are excluded by a bias of -1.
+        const auto isTopLeft = a > 0 || (a == 0 && b > 0);
+        tri.EdgeA[i] = a * scale;
+        tri.EdgeB[i] = b * scale;
+        tri.EdgeC[i] = c + (a + b) * (scale / 2) - (isTopLeft ? 0 : 1);
+
+        // Unbiased, in pixels, for the attributes
+        edgeA[i] = static_cast<float>(a) / scale;
+        edgeB[i] = static_cast<float>(b) / scale;
+        edgeC[i] = static_cast<float>(c) / (scale * scale);
+    }
+    const auto area = static_cast<float>(fixedArea) / (scale * scale);
+
+    // Attribute planes, from the barycentric weights E_i / area
+    float attribs[5][3];
+    for (auto i = 0u; i < 3; ++i)
+    {
+        attribs[0][i] = sz[i];
+        attribs[1][i] = invW[i];
+        for (auto j = 0u; j < 3; ++j) attribs[2 + j][i] = pVertices[i]->Color[j] * invW[i];
+    }
+
+    const auto invArea = 1.0f / area;
+    for (auto k = 0u; k < 5; ++k)
+    {
+        const auto& f = attribs[k];
+        tri.Planes[k][0] = (f[0] * edgeA[0] + f[1] * edgeA[1] + f[2] * edgeA[2]) * invArea;
+        tri.Planes[k][1] = (f[0] * edgeB[0] + f[1] * edgeB[1] + f[2] * edgeB[2]) * invArea;
+        tri.Planes[k][2] = (f[0] * edgeC[0] + f[1] * edgeC[1] + f[2] * edgeC[2]) * invArea;
+    }
+
+    // Bin to the overlapped tiles
+    const auto triIdx = static_cast<uint32_t>(chunk.Triangles.size());
+    chunk.Triangles.push_back(tri);
+    for (auto ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ++ty)
+        for (auto tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; ++tx)
+            chunk.Bins[m_numTilesX * ty + tx].push_back(triIdx);
+}
+
+void Rasterizer::rasterizeTile(uint32_t tileIdx)
+{
+    const auto tileX = (tileIdx % m_numTilesX) * TileSize;
+    const auto tileY = (tileIdx / m_numTilesX) * TileSize;
+    auto numRasterized = 0u;
+
+    for (auto c = 0u; c < m_numChunks; ++c)
+    {
+        const auto& chunk = m_chunks[c];
+        for (const auto triIdx : chunk.Bins[tileIdx])
+        {
+            const auto& tri = chunk.Triangles[triIdx];
+            const auto x0 = (max)(tri.MinX, tileX);
+            const auto y0 = (max)(tri.MinY, tileY);
+            const auto x1 = (min)(tri.MaxX, tileX + TileSize - 1);
+            const auto y1 = (min)(tri.MaxY, tileY + TileSize - 1);
+            rasterizeTriangle(tri, x0, y0, x1, y1);
+
+            // Count each triangle once, at the tile of its first pixel bound
+            if (tri.MinX >= tileX && tri.MinY >= tileY) ++numRasterized;
+        }
+    }
+
+    m_numRasterized += numRasterized;
+}
+
+void Rasterizer::rasterizeTriangle(const Triangle& tri, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+#if defined(__AVX2__)
+    // Process 8 pixels per step from an 8-aligned start; the lanes past x1 stay within the tile
+    x0 &= ~7u;
+
+    const auto laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const auto eight = _mm256_set1_ps(8.0f);
+    const auto minusOne = _mm256_set1_epi64x(-1);
+
+    // The edge functions take 64-bit lanes, for pixels 0 - 3 and 4 - 7 of each step
+    const auto lanePermute = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i edgeLanesLo[3], edgeLanesHi[3], edgeStep[3];
+    __m256 planeA[5], planeStep[5];
+    for (auto i = 0u; i < 3; ++i)
+    {
+        const auto a = tri.EdgeA[i];
+        edgeLanesLo[i] = _mm256_setr_epi64x(0, a, 2 * a, 3 * a);
+        edgeLanesHi[i] = _mm256_setr_epi64x(4 * a, 5 * a, 6 * a, 7 * a);
+        edgeStep[i] = _mm256_set1_epi64x(8 * a);
+    }
+    for (auto k = 0u; k < 5; ++k)
+    {
+        planeA[k] = _mm256_set1_ps(tri.Planes[k][0]);
+        planeStep[k] = _mm256_mul_ps(planeA[k], eight);
+    }
+
+    for (auto y = y0; y <= y1; ++y)
+    {
+        const auto py = y + 0.5f;
+        const auto px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x0)), laneOffsets);
+
+        __m256i eLo[3], eHi[3];
+        for (auto i = 0u; i < 3; ++i)
+        {
+            const auto e = _mm256_set1_epi64x(tri.EdgeA[i] * x0 + tri.EdgeB[i] * y + tri.EdgeC[i]);
+            eLo[i] = _mm256_add_epi64(e, edgeLanesLo[i]);
+            eHi[i] = _mm256_add_epi64(e, edgeLanesHi[i]);
+        }
+
+        __m256 f[5];
+        for (auto k = 0u; k < 5; ++k)
+            f[k] = _mm256_fmadd_ps(planeA[k], px, _mm256_set1_ps(tri.Planes[k][1] * py + tri.Planes[k][2]));
+
+        const auto row = static_cast<size_t>(m_pitch) * y;
+        for (auto x = x0; x <= x1; x += 8)
+        {
+            // Inside test, with the top-left rule in the biases, and the 64-bit lane
+            // masks packed into 8 32-bit lanes
+            auto maskLo = _mm256_cmpgt_epi64(eLo[0], minusOne);
+            auto maskHi = _mm256_cmpgt_epi64(eHi[0], minusOne);
+            for (auto i = 1u; i < 3; ++i)
+            {
+                maskLo = _mm256_and_si256(maskLo, _mm256_cmpgt_epi64(eLo[i], minusOne));
+                maskHi = _mm256_and_si256(maskHi, _mm256_cmpgt_epi64(eHi[i], minusOne));
+            }
+            auto mask = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(
+                _mm256_blend_epi32(maskLo, maskHi, 0xaa), lanePermute));
+
+            if (_mm256_movemask_ps(mask))
+            {
+                // Depth test
+                const auto pDepth = &m_depth[row + x];
+                const auto depth = _mm256_loadu_ps(pDepth);
+                mask = _mm256_and_ps(mask, _mm256_cmp_ps(f[0], depth, _CMP_LT_OQ));
+
+                if (_mm256_movemask_ps(mask))
+                {
+                    _mm256_storeu_ps(pDepth, _mm256_blendv_ps(depth, f[0], mask));
+
+                    // Perspective-correct colors
+                    const auto w = _mm256_div_ps(_mm256_set1_ps(1.0f), f[1]);
+                    for (auto j = 0u; j < 3; ++j)
+                    {
+                        const auto pColor = &m_colors[j][row + x];
+                        const auto color = _mm256_mul_ps(f[2 + j], w);
+                        _mm256_storeu_ps(pColor, _mm256_blendv_ps(_mm256_loadu_ps(pColor), color, mask));
+                    }
+                }
+            }
+
+            for (auto i = 0u; i < 3; ++i)
+            {
+                eLo[i] = _mm256_add_epi64(eLo[i], edgeStep[i]);
+                eHi[i] = _mm256_add_epi64(eHi[i], edgeStep[i]);
+            }
+            for (auto k = 0u; k < 5; ++k) f[k] = _mm256_add_ps(f[k], planeStep[k]);
+        }
+    }
+#else
+    for (auto y = y0; y <= y1; ++y)
+    {
+        const auto py = y + 0.5f;
+        const auto row = static_cast<size_t>(m_pitch) * y;
+        for (auto x = x0; x <= x1; ++x)
+        {
+            const auto px = x + 0.5f;
+
+            auto isInside = true;
+            for (auto i = 0u; i < 3 && isInside; ++i)
+                isInside = tri.EdgeA[i] * x + tri.EdgeB[i] * y + tri.EdgeC[i] >= 0;
+            if (!isInside) continue;
+
+            float f[5];
+            for (auto k = 0u; k < 5; ++k) f[k] = tri.Planes[k][0] * px + tri.Planes[k][1] * py + tri.Planes[k][2];
+
+            auto& depth = m_depth[row + x];
+            if (!(f[0] < depth)) continue;
+            depth = f[0];
+
+            const auto w = 1.0f / f[1];
+            for (auto j = 0u; j < 3; ++j) m_colors[j][row + x] = f[2 + j] * w;
+        }
+    }
+#endif
+}
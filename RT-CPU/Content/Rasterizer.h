@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Tile-binned triangle rasterizer with a depth test (LESS) and perspective-correct
+// interpolation of per-vertex colors, following the D3D rasterization rules:
+// pixel-center sampling, 8-bit subpixel precision, top-left fill rule, clockwise front
+// faces, back-face culling, and clipping at the near plane and at a guard band that
+// keeps the fixed-point coordinates in range. Triangles are set up and binned to screen
+// tiles in parallel, then the tiles are rasterized in parallel, 8 pixels at a time with AVX2.
+class Rasterizer
+{
+public:
+    Rasterizer();
+    virtual ~Rasterizer();
+
+    void Init(uint32_t width, uint32_t height);
+
+    // Sets the colors to pBackground (black if null) and the depths to 1
+    void Clear(const float3* pBackground = nullptr);
+
+    // Positions are in clip space, as output by a vertex or domain shader
+    void DrawIndexed(const float4* pPositions, const float3* pColors,
+        const uint32_t* pIndices, uint32_t numIndices);
+
+    void Resolve(float3* pImage) const;
+
+    uint32_t GetNumRasterizedTriangles() const;
+    size_t GetMemorySize() const;
+
+    static const uint32_t TileSize = 64;
+    static const uint32_t SubPixelBits = 8;
+
+protected:
+    struct Vertex
+    {
+        float4 Pos;
+        float3 Color;
+    };
+
+    // Edge functions are exact in fixed point, so that the pixels on a shared edge
+    // belong to exactly one of the triangles.
+    struct Triangle
+    {
+        int64_t     EdgeA[3];       // E(x, y) = A * x + B * y + C at the center of pixel (x, y),
+        int64_t     EdgeB[3];       // biased by the top-left rule, so that pixels with
+        int64_t     EdgeC[3];       // E >= 0 for all the edges are covered
+        float       Planes[5][3];   // Screen-space planes of z, 1/w, r/w, g/w and b/w
+        uint32_t    MinX, MinY, MaxX, MaxY;
+    };
+
+    struct Chunk
+    {
+        std::vector<Triangle>               Triangles;
+        std::vector<std::vector<uint32_t>>  Bins;
+    };
+
+    void setupTriangle(const Vertex* pVertices, Chunk& chunk);
+    void setupScreenTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk);
+    void rasterizeTile(uint32_t tileIdx);
+    void rasterizeTriangle(const Triangle& tri, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+    uint32_t            m_width;
+    uint32_t            m_height;
+    uint32_t            m_pitch;
+    uint32_t            m_numTilesX;
+    uint32_t            m_numTilesY;
+    float               m_guardBand;    // Clip-space bound of x / w and y / w
+
+    std::vector<float>  m_depth;
+    std::vector<float>  m_colors[3];
+
+    std::vector<Chunk>  m_chunks;
+    uint32_t            m_numChunks;
+    std::atomic_uint32_t m_numRasterized;
+};
@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "RayStats.h"
+
+using namespace std;
+
+#if ENABLE_RAY_STATS
+// Registry of the counters of the live threads; the counts of exited threads are kept
+// until the next merge.
+static mutex g_registryMutex;
+static vector<RayStats*> g_registry;
+static RayStats g_retired = {};
+
+class ThreadRayStats
+{
+public:
+    ThreadRayStats() :
+        Stats()
+    {
+        lock_guard<mutex> lock(g_registryMutex);
+        g_registry.push_back(&Stats);
+    }
+
+    ~ThreadRayStats()
+    {
+        lock_guard<mutex> lock(g_registryMutex);
+        for (auto i = 0u; i < RayStats::NUM_COUNTER; ++i)
+            g_retired.Counters[i] += Stats.Counters[i];
+        g_registry.erase(find(g_registry.begin(), g_registry.end(), &Stats));
+    }
+
+    RayStats Stats;
+};
+
+RayStats& RayStats::GetLocal()
+{
+    static thread_local ThreadRayStats threadStats;
+
+    return threadStats.Stats;
+}
+#endif
+
+RayStats RayStats::EndFrame()
+{
+    RayStats stats = {};
+
+#if ENABLE_RAY_STATS
+    lock_guard<mutex> lock(g_registryMutex);
+    for (auto pThreadStats : g_registry)
+    {
+        for (auto i = 0u; i < NUM_COUNTER; ++i)
+            stats.Counters[i] += pThreadStats->Counters[i];
+        *pThreadStats = {};
+    }
+
+    for (auto i = 0u; i < NUM_COUNTER; ++i)
+        stats.Counters[i] += g_retired.Counters[i];
+    g_retired = {};
+#endif
+
+    return stats;
+}
+
+const char* RayStats::GetName(Counter counter)
+{
+    static const char* names[] =
+    {
+        "primary_rays",
+        "bounce_rays",
+        "shadow_rays",
+        "nodes_visited",
+        "triangles_tested",
+        "radiance_misses",
+        "shadow_misses",
+        "depth_cutoffs",
+        "radiance_cache_hits",
+        "radiance_cache_misses"
+    };
+    static_assert(size(names) == NUM_COUNTER, "Missing counter names");
+
+    return names[counter];
+}
+
+RayStatsWriter::RayStatsWriter() :
+    m_isJSON(false),
+    m_numFrames(0)
+{
+}
+
+RayStatsWriter::~RayStatsWriter()
+{
+    Close();
+}
+
+bool RayStatsWriter::Open(const char* fileName)
+{
+    m_file.open(fileName);
+    if (!m_file) return false;
+
+    const auto length = strlen(fileName);
+    m_isJSON = length >= 5 && strcmp(fileName + length - 5, ".json") == 0;
+    m_numFrames = 0;
+
+    if (m_isJSON) m_file << "[";
+    else
+    {
+        m_file << "frame";
+        for (auto i = 0u; i < RayStats::NUM_COUNTER; ++i)
+            m_file << "," << RayStats::GetName(static_cast<RayStats::Counter>(i));
+        m_file << "\n";
+    }
+
+    return m_file.good();
+}
+
+void RayStatsWriter::Write(const RayStats& stats)
+{
+    if (m_isJSON)
+    {
+        m_file << (m_numFrames ? ",\n" : "\n") << "  { \"frame\": " << m_numFrames;
+        for (auto i = 0u; i < RayStats::NUM_COUNTER; ++i)
+            m_file << ", \"" << RayStats::GetName(static_cast<RayStats::Counter>(i)) << "\": " << stats.Counters[i];
+        m_file << " }";
+    }
+    else
+    {
+        m_file << m_numFrames;
+        for (auto i = 0u; i < RayStats::NUM_COUNTER; ++i)
+            m_file << "," << stats.Counters[i];
+        m_file << "\n";
+    }
+
+    ++m_numFrames;
+}
+
+bool RayStatsWriter::Close()
+{
+    if (!m_file.is_open()) return true;
+
+    if (m_isJSON) m_file << "\n]\n";
+    const auto isGood = m_file.good();
+    m_file.close();
+
+    return isGood;
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Set to 0 to compile the counters out
+#ifndef ENABLE_RAY_STATS
+#define ENABLE_RAY_STATS 1
+#endif
+
+// Per-frame ray tracing counters. Each thread counts into its own copy without
+// synchronization, and EndFrame() merges and resets the copies of all threads;
+// it must be called between frames, while no rays are being traced.
+struct RayStats
+{
+    enum Counter : uint8_t
+    {
+        PRIMARY_RAYS,       // TraceRadianceRay() at depth 0
+        BOUNCE_RAYS,        // TraceRadianceRay() from a closest hit
+        SHADOW_RAYS,        // TraceShadowRay()
+        NODES_VISITED,
+        TRIANGLES_TESTED,
+        RADIANCE_MISSES,    // Calls to the radiance miss shader
+        SHADOW_MISSES,      // Calls to the shadow miss shader
+        DEPTH_CUTOFFS,      // Rays not traced at MaxRecursionDepth
+        RADIANCE_CACHE_HITS,
+        RADIANCE_CACHE_MISSES,
+
+        NUM_COUNTER
+    };
+
+    uint64_t Counters[NUM_COUNTER];
+
+    static const bool IsEnabled = ENABLE_RAY_STATS != 0;
+
+    static RayStats EndFrame();
+    static const char* GetName(Counter counter);
+
+#if ENABLE_RAY_STATS
+    static void Add(Counter counter, uint64_t n = 1) { GetLocal().Counters[counter] += n; }
+    static RayStats& GetLocal();
+#else
+    static void Add(Counter, uint64_t = 1) {}
+#endif
+
+    // Counts into a local variable within traversal loops, and adds the count once
+    class LocalCounter
+    {
+    public:
+#if ENABLE_RAY_STATS
+        LocalCounter(Counter counter) : m_counter(counter), m_count(0) {}
+        ~LocalCounter() { Add(m_counter, m_count); }
+        void operator++() { ++m_count; }
+
+    protected:
+        Counter     m_counter;
+        uint32_t    m_count;
+#else
+        LocalCounter(Counter) {}
+        void operator++() {}
+#endif
+    };
+};
+
+// Writes the stats of each frame as a row of a CSV file, or as an object in the JSON
+// array of a file ending with .json
+class RayStatsWriter
+{
+public:
+    RayStatsWriter();
+    virtual ~RayStatsWriter();
+
+    bool Open(const char* fileName);
+    void Write(const RayStats& stats);
+    bool Close();
+
+protected:
+    std::ofstream   m_file;
+    bool            m_isJSON;
+    uint32_t        m_numFrames;
+};
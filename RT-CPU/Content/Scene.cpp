@@ -0,0 +1,327 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Scene.h"
+#include "RayStats.h"
+#include "XUSGObjLoader.h"
+
+using namespace std;
+using namespace XUSG;
+
+static const float InShadowRadiance = 0.35f;
+static const float TMax = 1000.0f;
+static const float Pi = 3.141592654f;
+
+Scene::Scene() :
+    m_angle(0.0f),
+    m_eyePt(0.0f),
+    m_pRadianceCache(nullptr)
+{
+    m_baseColors[GROUND] = float4(0.3f, 0.1f, 0.1f, 10.0f);
+    m_albedos[GROUND] = float4(0.9f, 0.1f, 0.0f, 0.0f);
+    m_baseColors[MODEL_OBJ] = float4(1.0f, 1.0f, 1.0f, 1425.0f);
+    m_albedos[MODEL_OBJ] = float4(0.0f, 10.0f, 0.8f, 0.0f);
+
+    // Stand-in sky until a light probe is assigned
+    m_environment = [](const float3& dir)
+    {
+        const auto t = saturate(normalize(dir).y * 0.5f + 0.5f);
+
+        return float3(0.25f, 0.2f, 0.15f) * (1.0f - t) + float3(0.6f, 0.75f, 1.0f) * t;
+    };
+}
+
+Scene::~Scene()
+{
+}
+
+bool Scene::Init(const char* fileName, const float4& posScale, uint32_t groundDivisions)
+{
+    m_posScale = posScale;
+
+    // Load inputs
+    ObjLoader objLoader;
+    if (!objLoader.Import(fileName, true, true)) return false;
+
+    auto& model = m_meshes[MODEL_OBJ];
+    const auto pVertices = reinterpret_cast<const Vertex*>(objLoader.GetVertices());
+    model.Vertices.assign(pVertices, pVertices + objLoader.GetNumVertices());
+    model.Indices.assign(objLoader.GetIndices(), objLoader.GetIndices() + objLoader.GetNumIndices());
+
+    createGroundMesh(groundDivisions);
+
+    // Build acceleration structures
+    for (auto& mesh : m_meshes)
+        mesh.Bvh.Build(&mesh.Vertices[0].Pos, sizeof(Vertex), mesh.Indices.data(),
+            static_cast<uint32_t>(mesh.Indices.size()));
+
+    UpdateFrame(m_eyePt, 0.0f);
+
+    return true;
+}
+
+void Scene::UpdateFrame(const float3& eyePt, float timeStep)
+{
+    m_eyePt = eyePt;
+    m_angle += 16.0f * timeStep * Pi / 180.0f;
+    const auto rot = MatrixRotationY(m_angle);
+
+    m_worlds[GROUND] = MatrixScaling(10.0f, 0.5f, 10.0f) * MatrixTranslation(0.0f, -0.5f, 0.0f);
+    m_worlds[MODEL_OBJ] = MatrixScaling(m_posScale.w, m_posScale.w, m_posScale.w) * rot *
+        MatrixTranslation(m_posScale.x, m_posScale.y, m_posScale.z);
+
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        m_worldInvs[i] = MatrixInverse(m_worlds[i]);
+        m_worldITs[i] = i ? rot : MatrixIdentity();
+    }
+
+    // The light follows the eye, so the cached radiance is only valid within a frame
+    if (m_pRadianceCache) m_pRadianceCache->NextFrame();
+}
+
+void Scene::SetEnvironment(const Environment& environment)
+{
+    m_environment = environment;
+}
+
+void Scene::SetRadianceCache(RadianceCache* pRadianceCache)
+{
+    m_pRadianceCache = pRadianceCache;
+}
+
+float3 Scene::TraceRadianceRay(const float3& rayOrigin, const float3& rayDirection, uint32_t currentDepth) const
+{
+    if (currentDepth >= MaxRecursionDepth)
+    {
+        RayStats::Add(RayStats::DEPTH_CUTOFFS);
+
+        return EnvironmentColor(rayDirection);
+    }
+
+    RayStats::Add(currentDepth ? RayStats::BOUNCE_RAYS : RayStats::PRIMARY_RAYS);
+    const Ray ray = { rayOrigin, rayDirection, 0.0f, TMax };
+    Hit hit;
+    if (!intersect(ray, hit, false))
+    {
+        RayStats::Add(RayStats::RADIANCE_MISSES);
+
+        return EnvironmentColor(rayDirection); // Miss
+    }
+
+    return closestHitRadiance(ray, hit, currentDepth + 1);
+}
+
+bool Scene::TraceShadowRay(const float3& rayOrigin, const float3& rayDirection, uint32_t currentDepth) const
+{
+    if (currentDepth >= MaxRecursionDepth)
+    {
+        RayStats::Add(RayStats::DEPTH_CUTOFFS);
+
+        return false;
+    }
+
+    RayStats::Add(RayStats::SHADOW_RAYS);
+    const Ray ray = { rayOrigin, rayDirection, 0.0f, TMax };
+    Hit hit;
+    if (intersect(ray, hit, true)) return true;
+
+    RayStats::Add(RayStats::SHADOW_MISSES);
+
+    return false;
+}
+
+float3 Scene::EnvironmentColor(const float3& dir) const
+{
+    return m_environment(dir);
+}
+
+const Scene::Mesh& Scene::GetMesh(uint32_t i) const
+{
+    return m_meshes[i];
+}
+
+const float4x4& Scene::GetWorld(uint32_t i) const
+{
+    return m_worlds[i];
+}
+
+size_t Scene::GetMemorySize() const
+{
+    size_t size = 0;
+    for (const auto& mesh : m_meshes)
+        size += sizeof(Vertex) * mesh.Vertices.size() + sizeof(uint32_t) * mesh.Indices.size() + mesh.Bvh.GetMemorySize();
+
+    return size;
+}
+
+bool Scene::intersect(const Ray& ray, Hit& hit, bool anyHit) const
+{
+    auto isHit = false;
+    auto tMax = ray.TMax;
+
+    // Instances are few; test them all in object space, as the top level of DXR does.
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        const Ray objRay =
+        {
+            TransformCoord(ray.Origin, m_worldInvs[i]),
+            TransformNormal(ray.Direction, m_worldInvs[i]),
+            ray.TMin, tMax
+        };
+
+        if (anyHit)
+        {
+            if (m_meshes[i].Bvh.Occluded(objRay, true)) return true;
+        }
+        else if (m_meshes[i].Bvh.Intersect(objRay, hit, true))
+        {
+            hit.InstanceIdx = i;
+            tMax = hit.T;
+            isHit = true;
+        }
+    }
+
+    return isHit;
+}
+
+float3 Scene::closestHitRadiance(const Ray& ray, const Hit& hit, uint32_t recursionDepth) const
+{
+    const auto instanceIdx = hit.InstanceIdx;
+    const auto& mesh = m_meshes[instanceIdx];
+    const auto baseIdx = hit.PrimitiveIdx * 3;
+
+    const float3 baryWeights =
+    {
+        1.0f - (hit.Barycentrics.x + hit.Barycentrics.y),
+        hit.Barycentrics.x,
+        hit.Barycentrics.y
+    };
+
+    auto norm = float3(0.0f);
+    for (auto i = 0u; i < 3; ++i)
+        norm += baryWeights[i] * mesh.Vertices[mesh.Indices[baseIdx + i]].Norm;
+
+    const auto normal = normalize(TransformNormal(norm, m_worldITs[instanceIdx]));
+    const auto hitPos = ray.Origin + hit.T * ray.Direction;
+
+    // The mirror term depends on the incoming direction, so it is traced for every ray
+    const auto reflectDirection = reflect(ray.Direction, normal);
+    const auto& albedo = m_albedos[instanceIdx];
+    const auto reflColor = albedo.z * TraceRadianceRay(hitPos, reflectDirection, recursionDepth);
+
+    // Bounce hits reuse the view-independent radiance, the diffuse and shadowed direct
+    // light, of the nearby hits of the frame
+    const auto isCached = m_pRadianceCache && recursionDepth > 1;
+    float3 otherColor;
+    if (isCached && m_pRadianceCache->Find(hitPos, normal, otherColor))
+    {
+        RayStats::Add(RayStats::RADIANCE_CACHE_HITS);
+
+        return reflColor + otherColor;
+    }
+    if (isCached) RayStats::Add(RayStats::RADIANCE_CACHE_MISSES);
+
+    const auto lightPos = m_eyePt + float3(20.0f, 20.0f, 0.0f);
+
+    const auto shadowDirection = normalize(lightPos - hitPos);
+    const auto inShadow = TraceShadowRay(hitPos, shadowDirection, recursionDepth);
+
+    const auto& baseColor = m_baseColors[instanceIdx];
+    otherColor = simpleLighting(hitPos, normal, inShadow, albedo, baseColor.xyz(), baseColor.w);
+    if (isCached) m_pRadianceCache->Insert(hitPos, normal, otherColor);
+
+    return reflColor + otherColor;
+}
+
+float3 Scene::simpleLighting(const float3& hitPos, const float3& normal, bool inShadow,
+    const float4& albedo, const float3& materialColor, float specularPower) const
+{
+    const auto lightPos = m_eyePt + float3(20.0f, 20.0f, 0.0f);
+    const auto shadowFactor = inShadow ? InShadowRadiance : 1.0f;
+    const auto incidentLightRay = normalize(hitPos - lightPos);
+
+    // diffuse
+    const auto kd = saturate(dot(-incidentLightRay, normal));
+    const auto diffuseColor = shadowFactor * kd * albedo.x * materialColor;
+
+    // specular
+    auto specularColor = float3(0.0f);
+    if (!inShadow)
+    {
+        const auto reflectedLightRay = normalize(reflect(incidentLightRay, normal));
+        const auto ks = pow(saturate(dot(reflectedLightRay, normalize(-incidentLightRay))), specularPower);
+        specularColor = ks * albedo.y * float3(1.0f);
+    }
+
+    return diffuseColor + specularColor;
+}
+
+void Scene::createGroundMesh(uint32_t n)
+{
+    auto& mesh = m_meshes[GROUND];
+
+    // Cube vertices positions and corresponding face normals, with n x n vertices per face
+    const float3 normals[] =
+    {
+        float3(0.0f, 1.0f, 0.0f), float3(0.0f, -1.0f, 0.0f),
+        float3(-1.0f, 0.0f, 0.0f), float3(1.0f, 0.0f, 0.0f),
+        float3(0.0f, 0.0f, -1.0f), float3(0.0f, 0.0f, 1.0f)
+    };
+
+    mesh.Vertices.resize(6 * n * n);
+    for (auto s = 0u; s < 6; ++s)
+    {
+        for (auto i = 0u; i < n; ++i)
+        {
+            for (auto j = 0u; j < n; ++j)
+            {
+                const auto u = -1.0f + 2.0f * j / (n - 1);
+                const auto v = 1.0f - 2.0f * i / (n - 1);
+                const auto sign = s & 1 ? 1.0f : -1.0f;
+                float3 pos;
+                switch (s)
+                {
+                case 0:
+                case 1:
+                    pos = float3(u, -sign, v);
+                    break;
+                case 2:
+                case 3:
+                    pos = float3(sign, u, v);
+                    break;
+                default:
+                    pos = float3(u, v, sign);
+                }
+                mesh.Vertices[n * n * s + n * i + j] = { pos, normals[s] };
+            }
+        }
+    }
+
+    // Cube indices, with opposite windings on opposite faces
+    mesh.Indices.resize(36 * (n - 1) * (n - 1));
+    auto k = 0u;
+    for (auto s = 0u; s < 6; ++s)
+    {
+        const auto base = s * n * n;
+        for (auto i = 0u; i < n - 1; ++i)
+        {
+            for (auto j = 0u; j < n - 1; ++j)
+            {
+                const uint32_t quad[] =
+                {
+                    base + i * n + j, base + i * n + j + 1,
+                    base + (i + 1) * n + j + 1, base + (i + 1) * n + j
+                };
+                const uint32_t tris[2][6] =
+                {
+                    { 0, 1, 2, 0, 2, 3 },
+                    { 0, 2, 1, 0, 3, 2 }
+                };
+                for (auto t : tris[s & 1]) mesh.Indices[k++] = quad[t];
+            }
+        }
+    }
+}
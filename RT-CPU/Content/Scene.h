@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "BVH.h"
+#include "RadianceCache.h"
+
+// CPU counterpart of the scene shared by the GPU ray tracers: a ground box and
+// an OBJ model, their materials, and the shading of RTCommon.hlsli.
+class Scene
+{
+public:
+    enum MeshIndex : uint32_t
+    {
+        GROUND,
+        MODEL_OBJ,
+
+        NUM_MESH
+    };
+
+    struct Vertex
+    {
+        float3 Pos;
+        float3 Norm;
+    };
+
+    struct Mesh
+    {
+        std::vector<Vertex>     Vertices;
+        std::vector<uint32_t>   Indices;
+        BVH                     Bvh;
+    };
+
+    using Environment = std::function<float3(const float3& dir)>;
+
+    Scene();
+    virtual ~Scene();
+
+    // groundDivisions is the number of vertices along each edge of a ground face,
+    // 2 for the box of PRayTracer, and 100 for those of VRayTracer and TVRayTracer.
+    bool Init(const char* fileName, const float4& posScale = float4(0.0f, 0.0f, 0.0f, 1.0f),
+        uint32_t groundDivisions = 2);
+    void UpdateFrame(const float3& eyePt, float timeStep);
+    void SetEnvironment(const Environment& environment);
+    void SetRadianceCache(RadianceCache* pRadianceCache);   // For the bounce hits, or null
+
+    float3 TraceRadianceRay(const float3& rayOrigin, const float3& rayDirection, uint32_t currentDepth) const;
+    bool TraceShadowRay(const float3& rayOrigin, const float3& rayDirection, uint32_t currentDepth) const;
+    float3 EnvironmentColor(const float3& dir) const;
+
+    const Mesh& GetMesh(uint32_t i) const;
+    const float4x4& GetWorld(uint32_t i) const;
+    size_t GetMemorySize() const;
+
+    static const uint32_t MaxRecursionDepth = 2;
+
+protected:
+    bool intersect(const Ray& ray, Hit& hit, bool anyHit) const;
+    float3 closestHitRadiance(const Ray& ray, const Hit& hit, uint32_t recursionDepth) const;
+    float3 simpleLighting(const float3& hitPos, const float3& normal, bool inShadow,
+        const float4& albedo, const float3& materialColor, float specularPower) const;
+
+    void createGroundMesh(uint32_t n);
+
+    Mesh            m_meshes[NUM_MESH];
+
+    float4          m_posScale;
+    float           m_angle;
+    float3          m_eyePt;
+    float4x4        m_worlds[NUM_MESH];
+    float4x4        m_worldInvs[NUM_MESH];
+    float4x4        m_worldITs[NUM_MESH];
+
+    float4          m_baseColors[NUM_MESH];
+    float4          m_albedos[NUM_MESH];
+
+    Environment     m_environment;
+    RadianceCache*  m_pRadianceCache;
+};
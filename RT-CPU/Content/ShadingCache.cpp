@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "ShadingCache.h"
+
+using namespace std;
+
+static const float Pi = 3.141592654f;
+
+ShadingCache::ShadingCache() :
+    m_maxAngle(-1.0f),
+    m_cosMaxAngle(1.0f),
+    m_refreshPeriod(0),
+    m_refreshPhase(0)
+{
+}
+
+ShadingCache::~ShadingCache()
+{
+}
+
+void ShadingCache::Init(uint32_t numVerts)
+{
+    m_eyePts.resize(numVerts);
+    m_isValid.assign(numVerts, 0);
+}
+
+void ShadingCache::SetMaxAngle(float maxAngle)
+{
+    m_maxAngle = maxAngle;
+    m_cosMaxAngle = cos((min)(maxAngle, Pi));
+    Invalidate();
+}
+
+void ShadingCache::SetRefreshRate(float refreshRate)
+{
+    m_refreshPeriod = refreshRate > 0.0f ? static_cast<uint32_t>(ceil(1.0f / (min)(refreshRate, 1.0f))) : 0;
+    m_refreshPhase = 0;
+}
+
+void ShadingCache::Invalidate()
+{
+    fill(m_isValid.begin(), m_isValid.end(), 0);
+}
+
+void ShadingCache::NextFrame()
+{
+    if (m_refreshPeriod > 0) m_refreshPhase = (m_refreshPhase + 1) % m_refreshPeriod;
+}
+
+void ShadingCache::UpdateWorlds(const float4x4* worlds, uint32_t numMeshes, uint32_t meshIdx)
+{
+    if (m_worlds.size() != numMeshes)
+    {
+        m_worlds.assign(worlds, worlds + numMeshes);
+        Invalidate();
+
+        return;
+    }
+
+    // Its own world is in the object-space eye points
+    for (auto i = 0u; i < numMeshes; ++i)
+    {
+        if (memcmp(&m_worlds[i], &worlds[i], sizeof(float4x4)) == 0) continue;
+        m_worlds[i] = worlds[i];
+        if (i != meshIdx) Invalidate();
+    }
+}
+
+bool ShadingCache::Refresh(uint32_t vertIdx, const float3& localPos, const float3& localEyePt)
+{
+    if (!IsEnabled()) return true;
+
+    auto isStale = !m_isValid[vertIdx] || (m_refreshPeriod > 0 && vertIdx % m_refreshPeriod == m_refreshPhase);
+    if (!isStale)
+    {
+        // Angle between the view directions, without normalizing them
+        const auto viewDir = localEyePt - localPos;
+        const auto cachedViewDir = m_eyePts[vertIdx] - localPos;
+        const auto cosAngle = dot(viewDir, cachedViewDir);
+        const auto threshold = m_cosMaxAngle * sqrt(dot(viewDir, viewDir) * dot(cachedViewDir, cachedViewDir));
+        isStale = cosAngle < threshold;
+    }
+
+    if (isStale)
+    {
+        m_eyePts[vertIdx] = localEyePt;
+        m_isValid[vertIdx] = 1;
+    }
+
+    return isStale;
+}
+
+bool ShadingCache::IsEnabled() const
+{
+    return m_maxAngle >= 0.0f;
+}
+
+size_t ShadingCache::GetMemorySize() const
+{
+    return sizeof(float3) * m_eyePts.capacity() + m_isValid.capacity() + sizeof(float4x4) * m_worlds.capacity();
+}
@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Temporal cache of the vertex colors of the per-vertex tracers. Each vertex keeps the
+// eye point, in the object space of its mesh, that it was last shaded from, which
+// covers both the camera motion and the object transform. A vertex is re-traced when
+// its view direction has turned by more than the max angle since, or on its turn of
+// a round-robin refresh of a fraction of the vertices per frame. The shadows and
+// reflections of the other meshes are not in the object space, so the whole cache is
+// invalidated when any of their world transforms changes.
+class ShadingCache
+{
+public:
+    ShadingCache();
+    virtual ~ShadingCache();
+
+    void Init(uint32_t numVerts);
+    void SetMaxAngle(float maxAngle);       // Radians, or negative to re-trace every vertex
+    void SetRefreshRate(float refreshRate); // Fraction of the vertices refreshed per frame
+    void Invalidate();
+    void NextFrame();
+
+    // Invalidates the cache if the world of any mesh other than its own has changed
+    void UpdateWorlds(const float4x4* worlds, uint32_t numMeshes, uint32_t meshIdx);
+
+    // Whether the vertex is to be re-traced, in which case the eye point is recorded
+    bool Refresh(uint32_t vertIdx, const float3& localPos, const float3& localEyePt);
+
+    bool IsEnabled() const;
+    size_t GetMemorySize() const;
+
+protected:
+    float                   m_maxAngle;
+    float                   m_cosMaxAngle;
+    uint32_t                m_refreshPeriod;    // 0 for no refresh
+    uint32_t                m_refreshPhase;
+
+    std::vector<float3>     m_eyePts;           // Object-space eye points of the cached colors
+    std::vector<uint8_t>    m_isValid;
+    std::vector<float4x4>   m_worlds;           // World transforms of the meshes the colors are shaded with
+};
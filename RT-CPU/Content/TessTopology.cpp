@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "TessTopology.h"
+#include "Tessellator.h"
+
+using namespace std;
+
+TessTopology::TessTopology()
+{
+}
+
+TessTopology::~TessTopology()
+{
+}
+
+void TessTopology::Init(const float3* pPositions, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices)
+{
+    const auto getPos = [&](uint32_t i) -> const float3&
+    {
+        return *reinterpret_cast<const float3*>(reinterpret_cast<const uint8_t*>(pPositions) + stride * i);
+    };
+
+    m_positions.clear();
+    m_patches.resize(numIndices / 3);
+    m_edges.clear();
+
+    // Weld the vertices with bitwise equal positions, e.g. those of the ground faces
+    struct PosHash
+    {
+        size_t operator()(const float3& p) const
+        {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+    struct PosEqual
+    {
+        bool operator()(const float3& a, const float3& b) const
+        {
+            return memcmp(&a, &b, sizeof(float3)) == 0;
+        }
+    };
+    unordered_map<float3, uint32_t, PosHash, PosEqual> vertMap;
+    unordered_map<uint64_t, uint32_t> edgeMap;
+
+    for (auto i = 0u; i < numIndices / 3; ++i)
+    {
+        auto& patch = m_patches[i];
+        for (auto j = 0u; j < 3; ++j)
+        {
+            const auto& pos = getPos(pIndices[3 * i + j]);
+            const auto result = vertMap.emplace(pos, static_cast<uint32_t>(m_positions.size()));
+            if (result.second) m_positions.push_back(pos);
+            patch.Verts[j] = result.first->second;
+        }
+
+        // Edge j is opposite to corner j
+        for (auto j = 0u; j < 3; ++j)
+        {
+            const auto v0 = patch.Verts[(j + 1) % 3];
+            const auto v1 = patch.Verts[(j + 2) % 3];
+            const auto edge = Edge{ (min)(v0, v1), (max)(v0, v1) };
+            const auto key = (static_cast<uint64_t>(edge.Verts[0]) << 32) | edge.Verts[1];
+            const auto result = edgeMap.emplace(key, static_cast<uint32_t>(m_edges.size()));
+            if (result.second) m_edges.push_back(edge);
+            patch.Edges[j] = result.first->second;
+        }
+    }
+}
+
+uint32_t TessTopology::GetTessVertIndex(uint32_t patchIdx, const float2& domain, uint32_t tessFactor) const
+{
+    // Lattice coordinates of 1 / (3 * tessFactor), as in Tessellator::DomainIndex()
+    const auto n = 3 * tessFactor;
+    const auto u = static_cast<uint32_t>(lround(domain.x * n));
+    const auto v = static_cast<uint32_t>(lround(domain.y * n));
+    const uint32_t b[] = { u, v, n - u - v };
+
+    const auto& patch = m_patches[patchIdx];
+    for (auto j = 0u; j < 3; ++j)
+    {
+        if (b[j] == n) return patch.Verts[j];
+        if (b[j] == 0)
+        {
+            // Steps of the point along the edge from its first endpoint
+            const auto c0 = (j + 1) % 3;
+            const auto c1 = (j + 2) % 3;
+            const auto step = (patch.Verts[c0] <= patch.Verts[c1] ? b[c1] : b[c0]) / 3;
+
+            return GetNumVerts() + (tessFactor - 1) * patch.Edges[j] + step - 1;
+        }
+    }
+
+    // Inner points keep their dense index, past the points of the outer ring
+    const auto innerBase = GetNumVerts() + (tessFactor - 1) * GetNumEdges();
+
+    return innerBase + CalcNumInnerPoints(tessFactor) * patchIdx + Tessellator::DomainIndex(domain, tessFactor) - n;
+}
+
+float3 TessTopology::GetTessVertPos(uint32_t tessVertIdx, uint32_t tessFactor, const float2* pInnerDomains) const
+{
+    if (tessVertIdx < GetNumVerts()) return m_positions[tessVertIdx];
+    tessVertIdx -= GetNumVerts();
+
+    const auto numEdgePoints = (tessFactor - 1) * GetNumEdges();
+    if (tessVertIdx < numEdgePoints)
+    {
+        const auto& edge = m_edges[tessVertIdx / (tessFactor - 1)];
+        const auto t = static_cast<float>(tessVertIdx % (tessFactor - 1) + 1) / tessFactor;
+        const auto& p0 = m_positions[edge.Verts[0]];
+
+        return p0 + (m_positions[edge.Verts[1]] - p0) * t;
+    }
+    tessVertIdx -= numEdgePoints;
+
+    const auto& patch = m_patches[tessVertIdx / CalcNumInnerPoints(tessFactor)];
+    const auto& dom = pInnerDomains[tessVertIdx];
+
+    return m_positions[patch.Verts[0]] * dom.x + m_positions[patch.Verts[1]] * dom.y +
+        m_positions[patch.Verts[2]] * (1.0f - (dom.x + dom.y));
+}
+
+uint32_t TessTopology::GetNumTessVerts(uint32_t tessFactor) const
+{
+    return GetNumVerts() + (tessFactor - 1) * GetNumEdges() + CalcNumInnerPoints(tessFactor) * GetNumPatches();
+}
+
+uint32_t TessTopology::GetNumVerts() const
+{
+    return static_cast<uint32_t>(m_positions.size());
+}
+
+uint32_t TessTopology::GetNumEdges() const
+{
+    return static_cast<uint32_t>(m_edges.size());
+}
+
+uint32_t TessTopology::GetNumPatches() const
+{
+    return static_cast<uint32_t>(m_patches.size());
+}
+
+const vector<TessTopology::Patch>& TessTopology::GetPatches() const
+{
+    return m_patches;
+}
+
+const vector<TessTopology::Edge>& TessTopology::GetEdges() const
+{
+    return m_edges;
+}
+
+size_t TessTopology::GetMemorySize() const
+{
+    return sizeof(float3) * m_positions.capacity() + sizeof(Patch) * m_patches.capacity() +
+        sizeof(Edge) * m_edges.capacity();
+}
+
+uint32_t TessTopology::CalcNumInnerPoints(uint32_t tessFactor)
+{
+    return Tessellator::CalcNumDomainPoints(tessFactor) - 3 * tessFactor;
+}
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Shared numbering of the tessellated vertices of a mesh, as in TVRayTracer: the
+// vertices of the mesh, welded by position, come first, then the inner points of
+// each edge, from the edge table, and then the inner points of each patch. Every
+// point of the tessellated surface thus gets a single index, and a single ray.
+class TessTopology
+{
+public:
+    // Welded vertices of the corners 0, 1 and 2, and the edges opposite to them
+    struct Patch
+    {
+        uint32_t Verts[3];
+        uint32_t Edges[3];
+    };
+
+    // Welded vertex endpoints, the smaller first; the inner points run from Verts[0]
+    struct Edge
+    {
+        uint32_t Verts[2];
+    };
+
+    TessTopology();
+    virtual ~TessTopology();
+
+    void Init(const float3* pPositions, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices);
+
+    // Index of a domain point of a patch in [0, GetNumTessVerts())
+    uint32_t GetTessVertIndex(uint32_t patchIdx, const float2& domain, uint32_t tessFactor) const;
+
+    // The position of a tessellated vertex, from its shared index
+    float3 GetTessVertPos(uint32_t tessVertIdx, uint32_t tessFactor, const float2* pInnerDomains) const;
+
+    uint32_t GetNumTessVerts(uint32_t tessFactor) const;
+    uint32_t GetNumVerts() const;
+    uint32_t GetNumEdges() const;
+    uint32_t GetNumPatches() const;
+
+    const std::vector<Patch>& GetPatches() const;
+    const std::vector<Edge>& GetEdges() const;
+    size_t GetMemorySize() const;
+
+    // Domain points inside a patch, i.e. without the 3 * tessFactor of its edges
+    static uint32_t CalcNumInnerPoints(uint32_t tessFactor);
+
+protected:
+    std::vector<float3>     m_positions;    // Of the welded vertices
+    std::vector<Patch>      m_patches;
+    std::vector<Edge>       m_edges;
+};
@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Tessellator.h"
+
+using namespace std;
+
+static const int32_t FxpFractionBits = 16;
+static const int32_t FxpOne = 1 << FxpFractionBits;
+static const int32_t FxpOneHalf = FxpOne >> 1;
+static const int32_t FxpOneThird = 0x00005555;
+static const int32_t FxpTwoThirds = 0x0000aaab;
+
+// Rounded 16.16 reciprocals, as the table of the reference tessellator
+static int32_t fixedReciprocal(uint32_t n)
+{
+    return static_cast<int32_t>((static_cast<int64_t>(FxpOne) * 2 + n) / (2 * n));
+}
+
+static float fxpToFloat(int32_t fxp)
+{
+    return static_cast<float>(fxp) / FxpOne;
+}
+
+Tessellator::Tessellator() :
+    m_tessFactor(0),
+    m_edgeFactors()
+{
+}
+
+Tessellator::~Tessellator()
+{
+}
+
+void Tessellator::Tessellate(uint32_t tessFactor)
+{
+    const uint32_t edgeFactors[] = { tessFactor, tessFactor, tessFactor };
+    Tessellate(tessFactor, edgeFactors);
+}
+
+void Tessellator::Tessellate(uint32_t insideFactor, const uint32_t edgeFactors[3])
+{
+    uint32_t factors[3];
+    for (auto i = 0u; i < 3; ++i) factors[i] = (min)((max)(edgeFactors[i], 1u), MaxTessFactor);
+    insideFactor = (min)((max)(insideFactor, 1u), MaxTessFactor);
+
+    // As the reference tessellator, an inside factor of 1 is raised for an inner ring,
+    // once any edge is subdivided
+    if (insideFactor == 1 && (factors[0] > 1 || factors[1] > 1 || factors[2] > 1)) insideFactor = 2;
+    if (m_tessFactor == insideFactor && equal(factors, factors + 3, m_edgeFactors)) return;
+
+    m_tessFactor = insideFactor;
+    copy(factors, factors + 3, m_edgeFactors);
+    m_domainPoints.clear();
+    m_indices.clear();
+
+    // Rings of points, each with 3 edges of numSegments each, from the outside in;
+    // with uniform factors, ring r has insideFactor - 2r segments per edge. The
+    // outer ring has the edge factors instead.
+    const auto numRings = (insideFactor + 1) / 2;
+    vector<uint32_t> ringOffsets(numRings);
+    uint32_t edgeOffsets[3];
+    for (auto ring = 0u; ring < numRings; ++ring)
+    {
+        ringOffsets[ring] = static_cast<uint32_t>(m_domainPoints.size());
+        const auto startPoint = ring;
+
+        // Perpendicular parameter of the ring, mapped to the barycentric space
+        auto fxpPerp = placePointIn1D(startPoint, insideFactor);
+        fxpPerp = (fxpPerp * FxpTwoThirds + FxpOneHalf) >> FxpFractionBits;
+        const auto fxpHalfPerp = (fxpPerp + 1) / 2;
+
+        for (auto edge = 0u; edge < 3; ++edge)
+        {
+            // Clockwise from V: edge 0 (U = 0 outside) has V decreasing,
+            // edge 1 (V = 0 outside) has U increasing, and edge 2 has U decreasing.
+            const auto parity = edge & 1;
+            const auto edgeFactor = ring ? insideFactor : factors[edge];
+            const auto endPoint = edgeFactor - ring;
+            if (ring == 0) edgeOffsets[edge] = static_cast<uint32_t>(m_domainPoints.size());
+            for (auto p = startPoint; p < endPoint; ++p)
+            {
+                const auto q = parity ? p : endPoint - (p - startPoint);
+                const auto fxpParam = placePointIn1D(q, edgeFactor) - fxpHalfPerp;
+
+                FXP u, v;
+                switch (edge)
+                {
+                case 0:
+                    u = fxpPerp;
+                    v = fxpParam;
+                    break;
+                case 1:
+                    u = fxpParam;
+                    v = fxpPerp;
+                    break;
+                default:
+                    u = fxpParam;
+                    v = FxpOne - fxpParam - fxpPerp;
+                }
+                m_domainPoints.emplace_back(fxpToFloat(u), fxpToFloat(v));
+            }
+        }
+    }
+
+    // Center point for even factors
+    const auto isOdd = (insideFactor & 1) != 0;
+    if (!isOdd) m_domainPoints.emplace_back(fxpToFloat(FxpOneThird), fxpToFloat(FxpOneThird));
+
+    // Stitch each ring to the next one inside, edge by edge
+    vector<uint32_t> outside, inside;
+    const auto numOuterPoints = factors[0] + factors[1] + factors[2];
+    for (auto ring = 0u; ring < numRings; ++ring)
+    {
+        const auto numSegments = insideFactor - 2 * ring;
+        const auto numRingPoints = 3 * numSegments;
+        if (numSegments == 1)
+        {
+            // The innermost ring of odd factors is a single triangle
+            addTriangle(ringOffsets[ring], ringOffsets[ring] + 1, ringOffsets[ring] + 2);
+            break;
+        }
+
+        const auto isInnermost = ring + 1 == numRings;
+        const auto numInsideSegments = isInnermost ? 0 : numSegments - 2;
+        for (auto edge = 0u; edge < 3; ++edge)
+        {
+            const auto numOutsideSegments = ring ? numSegments : factors[edge];
+            outside.resize(numOutsideSegments + 1);
+            for (auto i = 0u; i <= numOutsideSegments; ++i)
+                outside[i] = ring ? ringOffsets[ring] + (edge * numSegments + i) % numRingPoints :
+                (edgeOffsets[edge] + i) % numOuterPoints;
+
+            inside.resize(numInsideSegments + 1);
+            if (isInnermost) inside[0] = static_cast<uint32_t>(m_domainPoints.size() - 1);
+            else for (auto i = 0u; i <= numInsideSegments; ++i)
+                inside[i] = ringOffsets[ring + 1] + (edge * numInsideSegments + i) % (3 * numInsideSegments);
+
+            if (numOutsideSegments == numSegments) stitchRegular(outside.data(), inside.data(), numInsideSegments + 1);
+            else stitchTransition(outside.data(), numOutsideSegments, inside.data(), numInsideSegments);
+        }
+    }
+}
+
+const vector<float2>& Tessellator::GetDomainPoints() const
+{
+    return m_domainPoints;
+}
+
+const vector<uint32_t>& Tessellator::GetIndices() const
+{
+    return m_indices;
+}
+
+uint32_t Tessellator::GetTessFactor() const
+{
+    return m_tessFactor;
+}
+
+uint32_t Tessellator::CalcNumDomainPoints(uint32_t tessFactor)
+{
+    // 3 * k * k points in k rings for odd factors; 3 * (k - 1) * k points in k - 1 rings,
+    // and the center, for even ones
+    const auto k = tessFactor / 2 + 1;
+
+    return tessFactor & 1 ? 3 * k * k : 3 * k * (k - 1) + 1;
+}
+
+uint32_t Tessellator::DomainIndex(const float2& domain, uint32_t tessFactor)
+{
+    // Lattice coordinates of 1 / (3 * tessFactor); the smallest one is 2 * ring
+    const auto n = 3 * tessFactor;
+    const auto u = static_cast<uint32_t>(lround(domain.x * n));
+    const auto v = static_cast<uint32_t>(lround(domain.y * n));
+    const auto w = n - u - v;
+    const auto perp = (min)(u, (min)(v, w));
+    const auto ring = perp / 2;
+    const auto numSegments = tessFactor - 2 * ring;
+    const auto ringOffset = 3 * ring * (tessFactor - ring + 1);
+    if (numSegments == 0) return ringOffset;
+
+    // Edges 0 and 2 run toward decreasing points, edge 1 toward increasing ones
+    const auto endPoint = tessFactor - ring;
+    if (u == perp && v != perp) return ringOffset + endPoint - (v + ring) / 3;
+    if (v == perp && w != perp) return ringOffset + numSegments + (u + ring) / 3 - ring;
+
+    return ringOffset + 2 * numSegments + endPoint - (u + ring) / 3;
+}
+
+bool Tessellator::VerifyDomainIndex(uint32_t tessFactor)
+{
+    Tessellator tessellator;
+    tessellator.Tessellate(tessFactor);
+
+    const auto& domainPoints = tessellator.GetDomainPoints();
+    const auto numPoints = CalcNumDomainPoints(tessFactor);
+    if (domainPoints.size() != numPoints) return false;
+
+    // Every index is hit exactly once
+    vector<bool> isHit(numPoints);
+    for (const auto& domain : domainPoints)
+    {
+        const auto index = DomainIndex(domain, tessFactor);
+        if (index >= numPoints || isHit[index]) return false;
+        isHit[index] = true;
+    }
+
+    // The index is also the position in the output of the tessellator
+    for (auto i = 0u; i < numPoints; ++i)
+        if (DomainIndex(domainPoints[i], tessFactor) != i) return false;
+
+    return true;
+}
+
+// Location of the point-th point of an edge with tessFactor segments, in 16.16
+// fixed point; the edge is built symmetrically from both ends toward the middle.
+Tessellator::FXP Tessellator::placePointIn1D(uint32_t point, uint32_t tessFactor) const
+{
+    // With integer partitioning, half of the factor is integral after the parity adjustment
+    const auto isOdd = (tessFactor & 1) != 0;
+    const auto numHalfTessFactorPoints = (tessFactor + 1) / 2;
+
+    auto isFlipped = false;
+    if (point >= numHalfTessFactorPoints)
+    {
+        point = (numHalfTessFactorPoints << 1) - point;
+        if (isOdd) --point;
+        isFlipped = true;
+    }
+
+    if (point == numHalfTessFactorPoints) return FxpOneHalf;
+
+    // Integral half factors have no fraction, so the locations on the floor and ceiling
+    // half factors coincide, and their lerp reduces to a single product.
+    const auto fxpLocation = static_cast<FXP>(point) * fixedReciprocal(tessFactor);
+
+    return isFlipped ? FxpOne - fxpLocation : fxpLocation;
+}
+
+// Stitches an outside edge of numInsidePoints + 1 segments to an inside edge of
+// numInsidePoints points, with a trapezoid triangle at each end and mirrored diagonals
+void Tessellator::stitchRegular(const uint32_t* pOutside, const uint32_t* pInside, uint32_t numInsidePoints)
+{
+    auto o = 0u;
+    auto i = 0u;
+
+    addTriangle(pOutside[o], pOutside[o + 1], pInside[i]);
+    ++o;
+
+    // First half, diagonals from the outside edge to the inside edge
+    auto p = 0u;
+    for (; p < numInsidePoints / 2; ++p, ++i, ++o)
+    {
+        addTriangle(pOutside[o], pInside[i + 1], pInside[i]);
+        addTriangle(pOutside[o], pOutside[o + 1], pInside[i + 1]);
+    }
+
+    // Second half, diagonals from the inside edge to the outside edge
+    for (; p + 1 < numInsidePoints; ++p, ++i, ++o)
+    {
+        addTriangle(pInside[i], pOutside[o], pOutside[o + 1]);
+        addTriangle(pInside[i], pOutside[o + 1], pInside[i + 1]);
+    }
+
+    addTriangle(pOutside[o], pOutside[o + 1], pInside[i]);
+}
+
+// Stitches an outside edge to an inside edge of a different number of segments, where the
+// edge factors differ from the inside one, advancing along the edge whose next point comes
+// first; the inside edge spans the middle numInsideSegments of numInsideSegments + 2.
+void Tessellator::stitchTransition(const uint32_t* pOutside, uint32_t numOutsideSegments,
+    const uint32_t* pInside, uint32_t numInsideSegments)
+{
+    auto o = 0u;
+    auto i = 0u;
+    while (o < numOutsideSegments || i < numInsideSegments)
+    {
+        const auto isOutsideNext = i == numInsideSegments || (o < numOutsideSegments &&
+            (o + 1) * (numInsideSegments + 2) <= (i + 2) * numOutsideSegments);
+        if (isOutsideNext)
+        {
+            addTriangle(pOutside[o], pOutside[o + 1], pInside[i]);
+            ++o;
+        }
+        else
+        {
+            addTriangle(pOutside[o], pInside[i + 1], pInside[i]);
+            ++i;
+        }
+    }
+}
+
+void Tessellator::addTriangle(uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    // Keep the winding of the patch (1, 0, 0), (0, 1, 0), (0, 0, 1), i.e. a positive area in the UV plane
+    const auto& a = m_domainPoints[i0];
+    const auto& b = m_domainPoints[i1];
+    const auto& c = m_domainPoints[i2];
+    const auto area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area < 0.0f) swap(i1, i2);
+
+    m_indices.push_back(i0);
+    m_indices.push_back(i1);
+    m_indices.push_back(i2);
+}
@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VectorMath.h"
+
+// Fixed-function tessellator for triangle patches with uniform tessellation factors
+// and integer partitioning, as used by TVHullShader.hlsl. The domain points follow
+// the 16.16 fixed-point arithmetic of the D3D11 reference tessellator, so they are
+// bit-exact with SV_DomainLocation; the rings are stitched the same way, with
+// mirrored diagonals.
+class Tessellator
+{
+public:
+    Tessellator();
+    virtual ~Tessellator();
+
+    void Tessellate(uint32_t tessFactor);
+
+    // Edge i, opposite to the corner i, has edgeFactors[i] segments; the transitions to the
+    // inner rings are stitched in order along the edges, rather than bit-exactly with D3D.
+    void Tessellate(uint32_t insideFactor, const uint32_t edgeFactors[3]);
+
+    // Barycentric weights of patch[0] and patch[1], i.e. SV_DomainLocation.xy
+    const std::vector<float2>& GetDomainPoints() const;
+
+    // Triangles with the winding of the patch, as outputtopology("triangle_cw")
+    const std::vector<uint32_t>& GetIndices() const;
+
+    uint32_t GetTessFactor() const;     // Inside factor
+
+    // Domain points per patch, the same as calcNumVertPerPatch() of TVRayTracer
+    static uint32_t CalcNumDomainPoints(uint32_t tessFactor);
+
+    // domainIndex() of TVTessCommon.hlsli: the index of a domain point in GetDomainPoints()
+    static uint32_t DomainIndex(const float2& domain, uint32_t tessFactor);
+
+    // Checks that DomainIndex() maps the domain points of a factor onto
+    // [0, CalcNumDomainPoints()) one to one, without collisions or gaps
+    static bool VerifyDomainIndex(uint32_t tessFactor);
+
+    static const uint32_t MaxTessFactor = 64;
+
+protected:
+    using FXP = int32_t;
+
+    FXP placePointIn1D(uint32_t point, uint32_t tessFactor) const;
+    void stitchRegular(const uint32_t* pOutside, const uint32_t* pInside, uint32_t numInsidePoints);
+    void stitchTransition(const uint32_t* pOutside, uint32_t numOutsideSegments,
+        const uint32_t* pInside, uint32_t numInsideSegments);
+    void addTriangle(uint32_t i0, uint32_t i1, uint32_t i2);
+
+    uint32_t                m_tessFactor;
+    uint32_t                m_edgeFactors[3];
+    std::vector<float2>     m_domainPoints;
+    std::vector<uint32_t>   m_indices;
+};
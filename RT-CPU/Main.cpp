@@ -0,0 +1,1703 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "BC6H.h"
+#include "Benchmark.h"
+#include "CameraPath.h"
+#include "CPUATVRayTracer.h"
+#include "CPUHRayTracer.h"
+#include "CubeMap.h"
+#include "DDSReader.h"
+#include "FrameCapture.h"
+#include "ImageIO.h"
+#include "ImageMetrics.h"
+#include "LightProbe.h"
+#include "PackedColor.h"
+#include "RayStats.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+#include "ToneMap.h"
+
+using namespace std;
+
+static const float g_FOVAngleY = 0.785398163f;
+static const float g_zNear = 1.0f;
+static const float g_zFar = 1000.0f;
+static const float Pi = 3.141592654f;
+
+static bool isArg(const char* arg, const char* name)
+{
+    return (arg[0] == '-' || arg[0] == '/') && strcmp(arg + 1, name) == 0;
+}
+
+// Renders the frames, timing the ray tracing and the rasterization separately, and
+// hands the first ones to the frame capture
+static void renderFrames(CPURayTracer* pRayTracer, const float3& eyePt, const float4x4& viewProj,
+    uint32_t numFrames, RayStatsWriter* pStatsWriter, FrameCapture* pCapture, uint32_t numCaptureFrames)
+{
+    auto traceTime = 0.0, rasterTime = 0.0;
+    FrameHistogram frameTimes;
+    RayStats totalStats = {};
+    RayStats::EndFrame(); // Drops any counts from before the first frame
+    for (auto i = 0u; i < numFrames; ++i)
+    {
+        pRayTracer->Render(eyePt, viewProj);
+        traceTime += pRayTracer->GetTraceTime();
+        rasterTime += pRayTracer->GetRasterTime();
+        frameTimes.Record(static_cast<uint64_t>((pRayTracer->GetTraceTime() + pRayTracer->GetRasterTime()) * 1e9));
+
+        const auto stats = RayStats::EndFrame();
+        if (pStatsWriter) pStatsWriter->Write(stats);
+        if (pCapture && i < numCaptureFrames)
+            pCapture->Submit(pRayTracer->GetImage(), pRayTracer->GetWidth(), pRayTracer->GetHeight());
+        for (auto j = 0u; j < RayStats::NUM_COUNTER; ++j)
+            totalStats.Counters[j] += stats.Counters[j];
+
+        cout << fixed << setprecision(3) << "Frame " << i << ": trace " << pRayTracer->GetTraceTime() * 1000.0 <<
+            " ms, raster " << pRayTracer->GetRasterTime() * 1000.0 << " ms" << endl;
+    }
+
+    traceTime /= numFrames;
+    rasterTime /= numFrames;
+    const auto numRays = pRayTracer->GetNumRays();
+    const auto numUsefulRays = pRayTracer->GetNumUsefulRays();
+    cout << fixed << setprecision(3) << "Average: trace " << traceTime * 1000.0 << " ms, raster " <<
+        rasterTime * 1000.0 << " ms, total " << (traceTime + rasterTime) * 1000.0 << " ms, " <<
+        numRays / traceTime * 1e-6 << " Mrays/s, " << pRayTracer->GetMemorySize() / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "Frame times: p50 " << frameTimes.GetPercentile(50.0) << " ms, p95 " << frameTimes.GetPercentile(95.0) <<
+        " ms, p99 " << frameTimes.GetPercentile(99.0) << " ms, max " << frameTimes.GetMax() << " ms" << endl;
+    cout << "Rays: " << numRays << " traced, " << numUsefulRays << " useful (" <<
+        setprecision(1) << 100.0 * numUsefulRays / numRays << "%)" << endl;
+
+    if (RayStats::IsEnabled)
+    {
+        const auto& counters = totalStats.Counters;
+        const auto numTraced = counters[RayStats::PRIMARY_RAYS] + counters[RayStats::BOUNCE_RAYS] +
+            counters[RayStats::SHADOW_RAYS];
+        cout << "Per frame: " << counters[RayStats::PRIMARY_RAYS] / numFrames << " primary, " <<
+            counters[RayStats::BOUNCE_RAYS] / numFrames << " bounce, " <<
+            counters[RayStats::SHADOW_RAYS] / numFrames << " shadow rays, " <<
+            counters[RayStats::DEPTH_CUTOFFS] / numFrames << " depth cutoffs; " <<
+            static_cast<double>(counters[RayStats::NODES_VISITED]) / numTraced << " nodes and " <<
+            static_cast<double>(counters[RayStats::TRIANGLES_TESTED]) / numTraced << " triangles per ray" << endl;
+    }
+}
+
+// Frames written, dropped and queued, and the encode throughput against the wall time
+static void reportCapture(FrameCapture& capture)
+{
+    capture.Flush();
+    const auto stats = capture.GetStats();
+    cout << fixed << setprecision(2) << "Capture: " << stats.NumWritten << " of " << stats.NumSubmitted <<
+        " frames written, " << stats.NumDropped << " dropped, " << stats.NumFailed << " failed; queue depth max " <<
+        stats.MaxQueueDepth << ", mean " << stats.MeanQueueDepth << endl;
+    if (stats.NumWritten + stats.NumFailed == 0) return;
+
+    const auto numEncoded = stats.NumWritten + stats.NumFailed;
+    cout << "    Encode " << stats.EncodeTime / numEncoded * 1000.0 << " ms per frame, " <<
+        stats.NumPixels / stats.EncodeTime * 1e-6 << " Mpixels/s per worker; " <<
+        numEncoded / stats.WallTime << " frames/s overall, submit blocked " << stats.BlockTime * 1000.0 << " ms" << endl;
+}
+
+// Eye and focus points along the closed path through the benchmark poses
+static void getPathPose(uint32_t frame, uint32_t numFrames, float3& eyePt, float3& focusPt)
+{
+    const auto t = static_cast<float>(frame) * Benchmark::NumPoses / numFrames;
+    const auto i = static_cast<uint32_t>(t) % Benchmark::NumPoses;
+    const auto& pose0 = Benchmark::Poses[i];
+    const auto& pose1 = Benchmark::Poses[(i + 1) % Benchmark::NumPoses];
+    const auto s = t - floor(t);
+    eyePt = pose0.EyePt + (pose1.EyePt - pose0.EyePt) * s;
+    focusPt = pose0.FocusPt + (pose1.FocusPt - pose0.FocusPt) * s;
+}
+
+// Renders the frames of the camera path with the shading cache and without it, at 60 fps
+// with the model turning, comparing the rays and the tone-mapped images frame by frame
+static void renderPath(CPURayTracer* pCachedRayTracer, CPURayTracer* pRayTracer, Scene& scene,
+    uint32_t numFrames, uint32_t width, uint32_t height)
+{
+    const auto proj = MatrixPerspectiveFovLH(g_FOVAngleY, width / static_cast<float>(height), g_zNear, g_zFar);
+    vector<float3> reference(width * height), toneMapped(width * height);
+    uint64_t numCachedRays = 0, numRays = 0;
+    auto meanPSNR = 0.0, minPSNR = DBL_MAX;
+    for (auto i = 0u; i < numFrames; ++i)
+    {
+        float3 eyePt, focusPt;
+        getPathPose(i, numFrames, eyePt, focusPt);
+        const auto viewProj = MatrixLookAtLH(eyePt, focusPt, float3(0.0f, 1.0f, 0.0f)) * proj;
+        scene.UpdateFrame(eyePt, i ? 1.0f / 60.0f : 0.0f);
+
+        pRayTracer->Render(eyePt, viewProj);
+        pCachedRayTracer->Render(eyePt, viewProj);
+        ToneMapTiled(pRayTracer->GetImage(), reference.data(), width, height);
+        ToneMapTiled(pCachedRayTracer->GetImage(), toneMapped.data(), width, height);
+
+        // Identical images have an infinite PSNR, so it is capped at 100 dB
+        const auto psnr = (min)(ImageMetrics::PSNR(reference.data(), toneMapped.data(), width, height), 100.0);
+        meanPSNR += psnr;
+        minPSNR = (min)(minPSNR, psnr);
+        numCachedRays += pCachedRayTracer->GetNumRays();
+        numRays += pRayTracer->GetNumRays();
+
+        cout << fixed << setprecision(2) << "Frame " << i << ": " << pCachedRayTracer->GetNumRays() << " of " <<
+            pRayTracer->GetNumRays() << " rays, PSNR " << psnr << " dB" << endl;
+    }
+
+    cout << fixed << setprecision(1) << "Path: " << numCachedRays << " rays vs. " << numRays << " (" <<
+        100.0 * (1.0 - static_cast<double>(numCachedRays) / numRays) << "% saved), PSNR mean " <<
+        setprecision(2) << meanPSNR / numFrames << " dB, min " << minPSNR << " dB" << endl;
+}
+
+// Renders the frames without and then with the radiance cache, each from an empty cache,
+// and reports the hit rate and the speedup of the cache against the image error
+static void compareRadianceCache(CPURayTracer* pRayTracer, Scene& scene, RadianceCache& radianceCache,
+    const float3& eyePt, const float4x4& viewProj, uint32_t numFrames)
+{
+    const auto width = pRayTracer->GetWidth();
+    const auto height = pRayTracer->GetHeight();
+    vector<float3> reference(width * height), toneMapped(width * height);
+    double traceTimes[2] = {};
+    RayStats stats = {};
+    for (auto pass = 0u; pass < 2; ++pass)
+    {
+        scene.SetRadianceCache(pass ? &radianceCache : nullptr);
+        RayStats::EndFrame();
+        for (auto i = 0u; i < numFrames; ++i)
+        {
+            scene.UpdateFrame(eyePt, 0.0f);
+            pRayTracer->Render(eyePt, viewProj);
+            traceTimes[pass] += pRayTracer->GetTraceTime() / numFrames;
+        }
+        stats = RayStats::EndFrame();
+        ToneMapTiled(pRayTracer->GetImage(), pass ? toneMapped.data() : reference.data(), width, height);
+    }
+    scene.SetRadianceCache(nullptr);
+
+    cout << fixed << setprecision(3) << "Radiance cache: cell " << radianceCache.GetCellSize() << ", " <<
+        radianceCache.GetMemorySize() / (1024.0 * 1024.0) << " MB" << endl;
+    if (RayStats::IsEnabled)
+    {
+        const auto numHits = stats.Counters[RayStats::RADIANCE_CACHE_HITS];
+        const auto numLookups = numHits + stats.Counters[RayStats::RADIANCE_CACHE_MISSES];
+        cout << setprecision(1) << "    " << numHits / numFrames << " of " << numLookups / numFrames <<
+            " bounce hits per frame from the cache (" << 100.0 * numHits / (max)(numLookups, static_cast<uint64_t>(1)) << "%)" << endl;
+    }
+    cout << setprecision(3) << "    Trace " << traceTimes[0] * 1000.0 << " ms without, " << traceTimes[1] * 1000.0 <<
+        " ms with (" << setprecision(2) << traceTimes[0] / traceTimes[1] << "x), PSNR " <<
+        ImageMetrics::PSNR(reference.data(), toneMapped.data(), width, height) << " dB" << endl;
+}
+
+// Headless backend of the replay: each frame of the camera path turns the model and sets
+// the tessellation factor, then renders on the CPU tracer. Without the scene and the
+// tracer, only the camera is updated.
+class CPUReplayBackend : public CameraReplay::Backend
+{
+public:
+    CPUReplayBackend(const float4x4& proj, Scene* pScene = nullptr, CPURayTracer* pRayTracer = nullptr,
+        CPUTVRayTracer* pTVRayTracer = nullptr) :
+        m_proj(proj),
+        m_pScene(pScene),
+        m_pRayTracer(pRayTracer),
+        m_pTVRayTracer(pTVRayTracer)
+    {
+    }
+
+    virtual void UpdateFrame(const CameraPath::Frame& frame, float timeStep)
+    {
+        float4x4 view;
+        memcpy(view.m, frame.View, sizeof(view.m));
+        m_eyePt = float3(frame.EyePt[0], frame.EyePt[1], frame.EyePt[2]);
+        m_viewProj = view * m_proj;
+        if (m_pScene) m_pScene->UpdateFrame(m_eyePt, timeStep);
+        if (m_pTVRayTracer) m_pTVRayTracer->SetTessFactor(frame.TessFactor);
+    }
+
+    virtual void RenderFrame()
+    {
+        if (m_pRayTracer) m_pRayTracer->Render(m_eyePt, m_viewProj);
+    }
+
+protected:
+    float4x4        m_proj;
+    float4x4        m_viewProj;
+    float3          m_eyePt;
+    Scene*          m_pScene;
+    CPURayTracer*   m_pRayTracer;
+    CPUTVRayTracer* m_pTVRayTracer;
+};
+
+// Replays the camera path on the tracer, and writes the timings of each frame
+static bool replayPath(CPURayTracer* pRayTracer, CPUTVRayTracer* pTVRayTracer, Scene& scene,
+    const char* fileName, uint32_t numFrames, uint32_t width, uint32_t height)
+{
+    CameraPath cameraPath;
+    CameraReplay replay;
+    if (!cameraPath.Load(fileName) || !replay.Init(cameraPath, numFrames))
+    {
+        cerr << "Failed to load " << fileName << endl;
+
+        return false;
+    }
+
+    const auto proj = MatrixPerspectiveFovLH(g_FOVAngleY, width / static_cast<float>(height), g_zNear, g_zFar);
+    CPUReplayBackend backend(proj, &scene, pRayTracer, pTVRayTracer);
+    cout << "Replay: " << replay.GetNumFrames() << " frames of the " << cameraPath.GetNumFrames() <<
+        " in " << fileName << ", stepping 1/60 s per frame" << endl;
+    replay.Run(backend);
+
+    const auto& frameTimes = replay.GetHistogram();
+    auto updateTime = 0.0, renderTime = 0.0;
+    for (auto i = 0u; i < replay.GetNumPlayedFrames(); ++i)
+    {
+        updateTime += replay.GetTimings()[i].UpdateTime;
+        renderTime += replay.GetTimings()[i].RenderTime;
+    }
+    cout << fixed << setprecision(3) << "Average: update " << updateTime / replay.GetNumPlayedFrames() <<
+        " ms, render " << renderTime / replay.GetNumPlayedFrames() << " ms; model time " << replay.GetModelTime() <<
+        " s" << endl;
+    cout << "Frame times: p50 " << frameTimes.GetPercentile(50.0) << " ms, p95 " << frameTimes.GetPercentile(95.0) <<
+        " ms, p99 " << frameTimes.GetPercentile(99.0) << " ms, max " << frameTimes.GetMax() << " ms" << endl;
+
+    if (!replay.WriteCSV("ReplayTimes.csv"))
+    {
+        cerr << "Failed to write ReplayTimes.csv" << endl;
+
+        return false;
+    }
+
+    return true;
+}
+
+// Lookups per second of the cube-map sampler on random directions, on a single thread
+static void sampleCubeMap(const DDSReader& reader)
+{
+    using Clock = chrono::high_resolution_clock;
+    const auto getSeconds = [](const Clock::time_point& start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    CubeMap cubeMap;
+    auto start = Clock::now();
+    cubeMap.Init(reader);
+    const auto initTime = getSeconds(start);
+
+    start = Clock::now();
+    cubeMap.BuildLookupGrid();
+    const auto gridTime = getSeconds(start);
+    cout << "    Decoded in " << initTime * 1000.0 << " ms, lookup grid built in " << gridTime * 1000.0 << " ms, " <<
+        cubeMap.GetMemorySize() / (1024.0 * 1024.0) << " MB" << endl;
+
+    const auto numDirs = 1u << 20;
+    vector<float3> dirs(numDirs), colors(numDirs), batchColors(numDirs);
+    auto seed = 1u;
+    for (auto& dir : dirs)
+    {
+        for (auto c = 0u; c < 3; ++c)
+        {
+            seed = 1664525u * seed + 1013904223u;
+            dir[c] = (seed >> 8) / 8388608.0f - 1.0f;
+        }
+    }
+
+    const auto report = [numDirs](const char* name, double seconds)
+    {
+        cout << "    " << setw(17) << left << name << right << setprecision(1) << numDirs / seconds * 1e-6 <<
+            " M lookups/s" << setprecision(3) << endl;
+    };
+
+    start = Clock::now();
+    for (auto i = 0u; i < numDirs; ++i) colors[i] = cubeMap.SampleLevel(dirs[i]);
+    report("Bilinear:", getSeconds(start));
+
+    start = Clock::now();
+    cubeMap.SampleLevel(dirs.data(), batchColors.data(), numDirs);
+    report("Bilinear x8:", getSeconds(start));
+
+    auto maxError = 0.0f;
+    for (auto i = 0u; i < numDirs; ++i)
+        for (auto c = 0u; c < 3; ++c) maxError = (max)(maxError, fabs(batchColors[i][c] - colors[i][c]));
+
+    start = Clock::now();
+    for (auto i = 0u; i < numDirs; ++i) batchColors[i] = cubeMap.SampleNearest(dirs[i]);
+    report("Nearest (grid):", getSeconds(start));
+
+    CubeMap faceMap;
+    faceMap.Init(reader);
+    start = Clock::now();
+    for (auto i = 0u; i < numDirs; ++i) batchColors[i] = faceMap.SampleNearest(dirs[i]);
+    report("Nearest (faces):", getSeconds(start));
+
+    cout << "    Max difference of the batch from the scalar bilinear: " << maxError << endl;
+}
+
+// Irradiance estimates from the alias table of a light probe vs. uniform directions:
+// the variance per sample, and the samples per second on a single thread
+static void sampleProbe(const LightProbe& probe)
+{
+    using Clock = chrono::high_resolution_clock;
+    const auto numSamples = 1u << 20;
+    auto seed = 1u;
+    const auto random = [&seed]()
+    {
+        seed = 1664525u * seed + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+
+    // PDFs of the samples against the lookups of their directions
+    vector<float3> dirs(numSamples);
+    vector<float> pdfs(numSamples);
+    auto start = Clock::now();
+    for (auto i = 0u; i < numSamples; ++i) dirs[i] = probe.Sample(float3(random(), random(), random()), pdfs[i]);
+    const auto sampleTime = chrono::duration<double>(Clock::now() - start).count();
+
+    // Directions on the edges of the texels may round into their neighbors
+    auto numMatched = 0u;
+    start = Clock::now();
+    for (auto i = 0u; i < numSamples; ++i) numMatched += fabs(probe.GetPdf(dirs[i]) / pdfs[i] - 1.0f) < 1e-3f ? 1 : 0;
+    const auto pdfTime = chrono::duration<double>(Clock::now() - start).count();
+    cout << setprecision(1) << "    Alias table: " << probe.GetAliasTable().GetCount() << " texels, " <<
+        numSamples / sampleTime * 1e-6 << " M samples/s, " << numSamples / pdfTime * 1e-6 <<
+        " M PDFs/s, " << setprecision(4) << 100.0 * numMatched / numSamples << "% matching the PDFs of the samples" <<
+        setprecision(3) << endl;
+
+    const float3 normals[] = { float3(0.0f, 1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float3(0.0f, 0.0f, 1.0f) };
+    for (const auto& normal : normals)
+    {
+        // Mean and variance of the luminance of the estimates
+        double uniform[3] = {}, importance[3] = {};
+        const auto accumulate = [](double moments[3], const float3& estimate)
+        {
+            const double luminance = 0.2126f * estimate.x + 0.7152f * estimate.y + 0.0722f * estimate.z;
+            moments[0] += 1.0;
+            moments[1] += luminance;
+            moments[2] += luminance * luminance;
+        };
+
+        for (auto i = 0u; i < numSamples; ++i)
+        {
+            const auto z = 1.0f - 2.0f * random();
+            const auto phi = 2.0f * Pi * random();
+            const auto r = sqrt((max)(1.0f - z * z, 0.0f));
+            const float3 dir(r * cos(phi), r * sin(phi), z);
+            accumulate(uniform, probe.SampleLevel(dir) * ((max)(dot(normal, dir), 0.0f) * 4.0f * Pi));
+
+            float pdf;
+            const auto sampleDir = probe.Sample(float3(random(), random(), random()), pdf);
+            accumulate(importance, probe.SampleLevel(sampleDir) * ((max)(dot(normal, sampleDir), 0.0f) / pdf));
+        }
+
+        const auto getVariance = [](const double moments[3])
+        {
+            const auto mean = moments[1] / moments[0];
+
+            return moments[2] / moments[0] - mean * mean;
+        };
+
+        cout << "    Irradiance at (" << setprecision(0) << normal.x << ", " << normal.y << ", " << normal.z << "): " <<
+            setprecision(4) << uniform[1] / uniform[0] << " uniform, " << importance[1] / importance[0] <<
+            " by luminance; variance " << getVariance(uniform) << " vs. " << getVariance(importance) << " (" <<
+            setprecision(1) << getVariance(uniform) / getVariance(importance) << "x lower)" << setprecision(3) << endl;
+    }
+}
+
+// Prefiltering time of a light probe on 2, 4, ... threads, then through its cache, and
+// the SH irradiance against the cosine-weighted sum over the texels, and the sampling
+static bool prefilterProbe(const char* fileName, LightProbe::Filter filter)
+{
+    const auto numThreads = ThreadPool::GetDefault().GetNumThreads() + 1;
+    LightProbe probe;
+    auto baseTime = 0.0;
+    for (auto n = 2u; n < numThreads * 2; n *= 2)
+    {
+        ThreadPool threadPool((min)(n, numThreads) - 1);
+        if (!probe.Init(fileName, filter, false, &threadPool)) return false;
+        if (n == 2)
+        {
+            const auto& cubeMap = probe.GetCubeMap();
+            cout << fileName << ": " << cubeMap.GetSize() << "x" << cubeMap.GetSize() << ", " << cubeMap.GetNumMips() <<
+                (filter == LightProbe::GGX ? " GGX" : " box") << "-filtered mips, decoded in " << fixed << setprecision(3) <<
+                probe.GetDecodeTime() * 1000.0 << " ms" << endl;
+            baseTime = probe.GetPrefilterTime();
+        }
+        cout << "    " << setw(2) << (min)(n, numThreads) << " threads: " << probe.GetPrefilterTime() * 1000.0 << " ms (" <<
+            setprecision(2) << baseTime / probe.GetPrefilterTime() << "x), alias table in " << setprecision(3) <<
+            probe.GetTableTime() * 1000.0 << " ms" << endl;
+    }
+
+    for (auto i = 0u; i < 2; ++i)
+    {
+        if (!probe.Init(fileName, filter)) return false;
+        cout << "    " << (probe.IsFromCache() ? "Loaded " : "Built and saved ") << LightProbe::GetCacheFileName(fileName) <<
+            " in " << (probe.GetPrefilterTime() + probe.GetCacheTime()) * 1000.0 << " ms" << endl;
+    }
+
+    const auto& cubeMap = probe.GetCubeMap();
+    const auto n = cubeMap.GetSize();
+    const float3 normals[] = { float3(0.0f, 1.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float3(0.0f, 0.0f, 1.0f) };
+    for (const auto& normal : normals)
+    {
+        // Texels of equal solid angle up to the density of the directions
+        float3 irradiance = 0.0f;
+        for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        {
+            for (auto y = 0u; y < n; ++y)
+            {
+                for (auto x = 0u; x < n; ++x)
+                {
+                    const auto dir = CubeMap::GetDirection(CubeMap::Face(face), float2((x + 0.5f) / n, (y + 0.5f) / n));
+                    const auto r2 = dot(dir, dir);
+                    const auto solidAngle = 4.0f / (n * n * r2 * sqrt(r2));
+                    irradiance += cubeMap.GetTexel(0, CubeMap::Face(face), x, y) *
+                        ((max)(dot(normal, dir), 0.0f) / sqrt(r2) * solidAngle);
+                }
+            }
+        }
+
+        const auto sh = probe.EvaluateIrradiance(normal);
+        cout << "    Irradiance at (" << setprecision(0) << normal.x << ", " << normal.y << ", " << normal.z << "): " <<
+            setprecision(4) << sh.x << ", " << sh.y << ", " << sh.z << " (SH), " << irradiance.x << ", " << irradiance.y <<
+            ", " << irradiance.z << " (texels)" << setprecision(3) << endl;
+    }
+    sampleProbe(probe);
+
+    return true;
+}
+
+// BC6H_UF16 of all the faces and mips of a light probe, cached next to it as name.bc6h<quality>.dds
+// until the probe changes, with the encoding throughput and the PSNR of mip 0 after x / (1 + x)
+static bool compressProbe(const char* fileName, uint32_t quality)
+{
+    DDSReader source;
+    CubeMap sourceMap;
+    if (!source.Load(fileName) || !sourceMap.Init(source)) return false;
+
+    string cacheFileName = fileName;
+    const auto dot = cacheFileName.find_last_of('.');
+    const auto slash = cacheFileName.find_last_of("/\\");
+    if (dot != string::npos && (slash == string::npos || dot > slash)) cacheFileName.resize(dot);
+    cacheFileName += ".bc6h" + to_string(quality) + ".dds";
+
+    const auto size = sourceMap.GetSize();
+    const auto numMips = sourceMap.GetNumMips();
+    const auto sourceHash = source.GetHash();
+    cout << fileName << ": " << DDSReader::GetFormatName(source.GetFormat()) << ", " << size << "x" << size << ", " <<
+        numMips << " mips, quality " << quality << endl;
+
+    DDSReader cache;
+    if (cache.Load(cacheFileName.c_str()) && cache.GetSourceHash() == sourceHash &&
+        cache.GetFormat() == DDSReader::FORMAT_BC6H_UF16 && cache.GetWidth() == size && cache.GetNumMips() == numMips)
+        cout << fixed << setprecision(3) << "    Loaded " << cacheFileName << " in " << cache.GetLoadTime() * 1000.0 << " ms" << endl;
+    else
+    {
+        // Faces one after another, each with all its mips
+        vector<size_t> offsets;
+        size_t dataSize = 0;
+        for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        {
+            for (auto mip = 0u; mip < numMips; ++mip)
+            {
+                offsets.push_back(dataSize);
+                dataSize += static_cast<size_t>(DIV_UP(sourceMap.GetSize(mip), 4)) * DIV_UP(sourceMap.GetSize(mip), 4) * 16;
+            }
+        }
+
+        vector<uint8_t> data(dataSize);
+        vector<float3> image;
+        auto encodeTime = 0.0;
+        size_t numTexels = 0;
+        for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+        {
+            for (auto mip = 0u; mip < numMips; ++mip)
+            {
+                const auto n = sourceMap.GetSize(mip);
+                image.resize(static_cast<size_t>(n) * n);
+                for (auto y = 0u; y < n; ++y)
+                    for (auto x = 0u; x < n; ++x) image[static_cast<size_t>(n) * y + x] = sourceMap.GetTexel(mip, CubeMap::Face(face), x, y);
+
+                const auto start = chrono::high_resolution_clock::now();
+                EncodeBC6H(image.data(), n, n, quality, &data[offsets[numMips * face + mip]], DIV_UP(n, 4) * 16);
+                encodeTime += chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+                numTexels += image.size();
+            }
+        }
+
+        cout << fixed << setprecision(3) << "    Encoded " << numTexels << " texels in " << encodeTime * 1000.0 << " ms, " <<
+            setprecision(2) << numTexels / encodeTime * 1e-6 << " M texels/s on " <<
+            ThreadPool::GetDefault().GetNumThreads() + 1 << " threads, " << dataSize / 1024.0 << " KB vs. " <<
+            numTexels * sizeof(uint16_t) * 4 / 1024.0 << " KB as R16G16B16A16_FLOAT" << setprecision(3) << endl;
+
+        if (!DDSReader::SaveCube(cacheFileName.c_str(), DDSReader::FORMAT_BC6H_UF16, size, numMips, data.data(),
+            dataSize, sourceHash) || !cache.Load(cacheFileName.c_str()))
+        {
+            cerr << "Failed to write " << cacheFileName << endl;
+
+            return false;
+        }
+        cout << "    Saved " << cacheFileName << endl;
+    }
+
+    // Mip 0 of the faces stacked vertically
+    CubeMap compressedMap;
+    if (!compressedMap.Init(cache)) return false;
+
+    vector<float3> reference(CubeMap::NUM_FACE * static_cast<size_t>(size) * size), test(reference.size());
+    for (auto face = 0u; face < CubeMap::NUM_FACE; ++face)
+    {
+        for (auto y = 0u; y < size; ++y)
+        {
+            for (auto x = 0u; x < size; ++x)
+            {
+                const auto i = (static_cast<size_t>(size) * face + y) * size + x;
+                const auto& ref = sourceMap.GetTexel(0, CubeMap::Face(face), x, y);
+                const auto& texel = compressedMap.GetTexel(0, CubeMap::Face(face), x, y);
+                for (auto c = 0u; c < 3; ++c)
+                {
+                    reference[i][c] = ref[c] / (1.0f + ref[c]);
+                    test[i][c] = texel[c] / (1.0f + texel[c]);
+                }
+            }
+        }
+    }
+    cout << setprecision(2) << "    PSNR of mip 0: " << ImageMetrics::PSNR(reference.data(), test.data(), size,
+        CubeMap::NUM_FACE * size) << " dB" << setprecision(3) << endl;
+
+    return true;
+}
+
+// IncrementalHalton of the GPU ray tracers before the sampler, the reference for its Halton points
+static float2 incrementalHalton()
+{
+    static auto haltonBase = 0ull;
+    static auto halton = float2(0.0f, 0.0f);
+    static auto haltonBase3 = 0u;
+
+    // Base 2
+    {
+        auto change = 0.5f;
+        auto oldBase = haltonBase++;
+        auto diff = haltonBase ^ oldBase;
+        do
+        {
+            halton.x += (oldBase & 1) ? -change : change;
+            change *= 0.5f;
+            diff = diff >> 1;
+            oldBase = oldBase >> 1;
+        } while (diff);
+    }
+
+    // Base 3, in 2-bit digits
+    {
+        const auto oneThird = 1.0f / 3.0f;
+        auto mask = 0x3u;
+        auto add = 0x1u;
+        auto change = oneThird;
+        ++haltonBase3;
+        while (true)
+        {
+            if ((haltonBase3 & mask) == mask)
+            {
+                haltonBase3 += add;
+                halton.y -= 2 * change;
+                mask = mask << 2;
+                add = add << 2;
+                change *= oneThird;
+            }
+            else
+            {
+                halton.y += change;
+                break;
+            }
+        }
+    }
+
+    return halton;
+}
+
+// Halton points against IncrementalHalton and the exact radical inverses, the batches against
+// the single points, in parallel too, the stratification of the power-of-2 prefixes, and the
+// points per second of each sequence
+static bool checkSampler()
+{
+    const auto numPoints = 1u << 20;
+    auto isPassed = true;
+
+    // IncrementalHalton accumulates in float: exact in base 2, but drifting in base 3
+    const Sampler halton(Sampler::HALTON);
+    auto numBase2Mismatches = 0u;
+    auto maxBase3Error = 0.0, maxDrift = 0.0;
+    for (auto i = 1u; i <= numPoints; ++i)
+    {
+        const auto reference = incrementalHalton();
+        const auto point = halton.Get(i);
+        if (point.x != reference.x) ++numBase2Mismatches;
+
+        auto exact = 0.0, invBase = 1.0 / 3.0;
+        for (auto j = i; j > 0; j /= 3, invBase /= 3.0) exact += invBase * (j % 3);
+        maxBase3Error = (max)(maxBase3Error, abs(point.y - exact));
+        maxDrift = (max)(maxDrift, abs(reference.y - exact));
+    }
+    isPassed = isPassed && numBase2Mismatches == 0 && maxBase3Error < 2.0 / (1 << 24); // Truncated to 24 bits
+    cout << scientific << setprecision(2) << "Halton, " << numPoints << " points: base 2 " <<
+        (numBase2Mismatches ? "differs from" : "bit-exact with") << " IncrementalHalton; base 3 within " <<
+        maxBase3Error << " of the radical inverse, where IncrementalHalton drifted by " << maxDrift << endl;
+
+    // Batches from unaligned indices, past 2^24 and wrapping around, for the seeds of 2 pixels
+    const uint32_t firstIndices[] = { 0, 5, (1u << 24) - 3, 3486784401u - 11, 0xffffffffu - 17 };
+    const uint32_t seeds[] = { 0, 1, Sampler::GetPixelSeed(0, 0), Sampler::GetPixelSeed(1599, 899, 7) };
+    for (auto type = 0u; type < Sampler::NUM_TYPE; ++type)
+    {
+        const Sampler sampler(static_cast<Sampler::Type>(type));
+        auto numMismatches = 0u;
+        vector<float> xs(37), ys(37);
+        for (const auto firstIndex : firstIndices)
+        {
+            for (const auto seed : seeds)
+            {
+                sampler.Get(firstIndex, static_cast<uint32_t>(xs.size()), seed, xs.data(), ys.data());
+                for (auto i = 0u; i < xs.size(); ++i)
+                {
+                    const auto point = sampler.Get(firstIndex + i, seed);
+                    if (point.x != xs[i] || point.y != ys[i] || !(xs[i] >= 0.0f && xs[i] < 1.0f) ||
+                        !(ys[i] >= 0.0f && ys[i] < 1.0f)) ++numMismatches;
+                }
+            }
+        }
+
+        // Every pixel of a strip draws its own points on the thread pool
+        const auto width = 256u, numPixelPoints = 64u;
+        vector<float> parallelXs(width * numPixelPoints), parallelYs(width * numPixelPoints);
+        ThreadPool::GetDefault().ParallelFor(width, 16, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (auto x = begin; x < end; ++x)
+                sampler.Get(0, numPixelPoints, Sampler::GetPixelSeed(x, 0), &parallelXs[x * numPixelPoints],
+                    &parallelYs[x * numPixelPoints]);
+        });
+        for (auto x = 0u; x < width; ++x)
+        {
+            for (auto i = 0u; i < numPixelPoints; ++i)
+            {
+                const auto point = sampler.Get(i, Sampler::GetPixelSeed(x, 0));
+                if (point.x != parallelXs[x * numPixelPoints + i] || point.y != parallelYs[x * numPixelPoints + i])
+                    ++numMismatches;
+            }
+        }
+
+        // Sobol keeps each coordinate of the first 2^k points in distinct 1/2^k strips, for any seed;
+        // Halton does in base 2
+        auto numUnstratified = 0u;
+        if (type != Sampler::R2)
+        {
+            for (auto log2Count = 2u; log2Count <= 12; ++log2Count)
+            {
+                const auto count = 1u << log2Count;
+                for (const auto seed : { 0u, seeds[2] })
+                {
+                    vector<uint8_t> stripsX(count), stripsY(count);
+                    for (auto i = 0u; i < count; ++i)
+                    {
+                        // The rotation of Halton moves the strips
+                        const auto point = sampler.Get(i, type == Sampler::HALTON ? 0 : seed);
+                        ++stripsX[static_cast<uint32_t>(point.x * count)];
+                        ++stripsY[static_cast<uint32_t>(point.y * count)];
+                    }
+                    for (auto i = 0u; i < count; ++i)
+                        if (stripsX[i] != 1 || (type == Sampler::SOBOL && stripsY[i] != 1)) ++numUnstratified;
+                }
+            }
+        }
+
+        isPassed = isPassed && numMismatches == 0 && numUnstratified == 0;
+        cout << "    " << setw(7) << left << Sampler::GetName(sampler.GetType()) << right << ": batches " <<
+            (numMismatches ? "differ from" : "bit-exact with") << " single points, in parallel too";
+        if (type != Sampler::R2) cout << "; prefixes " << (numUnstratified ? "not stratified" : "stratified");
+        cout << endl;
+    }
+
+    // Single-threaded; the mean of x + y, around 1, keeps the points from being optimized out
+    cout << fixed << setprecision(1) << "Points per second, " << numPoints << " points:" << endl;
+    vector<float> xs(numPoints), ys(numPoints);
+    for (auto type = 0u; type < Sampler::NUM_TYPE; ++type)
+    {
+        const Sampler sampler(static_cast<Sampler::Type>(type));
+        auto sum = 0.0;
+        auto start = chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < numPoints; ++i)
+        {
+            const auto point = sampler.Get(i, 12345);
+            sum += point.x + point.y;
+        }
+        const auto singleTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+        start = chrono::high_resolution_clock::now();
+        sampler.Get(0, numPoints, 12345, xs.data(), ys.data());
+        const auto batchTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+        for (auto i = 0u; i < numPoints; ++i) sum += xs[i] + ys[i];
+
+        cout << "    " << setw(7) << left << Sampler::GetName(sampler.GetType()) << right << ": " <<
+            numPoints / singleTime * 1e-6 << " M single, " << numPoints / batchTime * 1e-6 << " M batched (" <<
+            singleTime / batchTime << "x), mean x + y " << setprecision(4) << sum / (2.0 * numPoints) <<
+            setprecision(1) << endl;
+    }
+
+    return isPassed;
+}
+
+// Resolution and cost of the clock, the histogram percentiles against the sorted times,
+// concurrent recording, and the phases of the frame recorder on busy-waited frames
+static bool checkTimer()
+{
+    auto isPassed = true;
+
+    // Smallest step and cost of the clock, which must never go back
+    const auto numReads = 1000000u;
+    auto minStep = UINT64_MAX;
+    auto isMonotonic = true;
+    const auto start = GetTimeNs();
+    auto previous = start;
+    for (auto i = 0u; i < numReads; ++i)
+    {
+        const auto time = GetTimeNs();
+        if (time < previous) isMonotonic = false;
+        else if (time > previous) minStep = (min)(minStep, time - previous);
+        previous = time;
+    }
+    isPassed = isPassed && isMonotonic;
+    cout << fixed << setprecision(1) << "Clock: " << (isMonotonic ? "monotonic" : "went back") << ", step " <<
+        minStep << " ns, " << static_cast<double>(previous - start) / numReads << " ns per read" << endl;
+
+    // Mostly around 16 ms with a tail of hitches, and durations of every scale
+    const auto numTimes = 200000u;
+    vector<uint64_t> times(numTimes);
+    auto seed = 1u;
+    const auto random = [&seed]()
+    {
+        seed = 1664525u * seed + 1013904223u;
+
+        return (seed >> 8) / 16777216.0;
+    };
+    for (auto distribution = 0u; distribution < 2; ++distribution)
+    {
+        FrameHistogram histogram;
+        for (auto& time : times)
+        {
+            time = distribution == 0 ? static_cast<uint64_t>(16e6 * (0.9 + 0.2 * random()) * (random() < 0.02 ? 4.0 : 1.0)) :
+                static_cast<uint64_t>(exp2(34.0 * random()));
+            histogram.Record(time);
+        }
+        sort(times.begin(), times.end());
+
+        auto maxError = 0.0;
+        for (const auto percentile : { 1.0, 50.0, 95.0, 99.0, 99.9 })
+        {
+            const auto rank = static_cast<uint32_t>(ceil(percentile / 100.0 * numTimes));
+            const auto exact = times[rank - 1] * 1e-6;
+            maxError = (max)(maxError, abs(histogram.GetPercentile(percentile) - exact) / (max)(exact, 1e-6));
+        }
+        const auto isMaxExact = histogram.GetMax() == times.back() * 1e-6;
+        isPassed = isPassed && maxError <= 1.0 / 64.0 && isMaxExact;
+        cout << setprecision(4) << (distribution ? "    Every scale" : "    16 ms with hitches") << ": p50 " <<
+            histogram.GetPercentile(50.0) << " ms, p99 " << histogram.GetPercentile(99.0) << " ms, max " <<
+            histogram.GetMax() << " ms; percentiles within " << setprecision(2) << maxError * 100.0 <<
+            "% of the sorted times, max " << (isMaxExact ? "exact" : "wrong") << endl;
+    }
+
+    // Threads recording at once lose no counts, and keep the max
+    {
+        const auto numThreads = 4u, numPerThread = 250000u;
+        FrameHistogram histogram;
+        vector<thread> threads;
+        for (auto i = 0u; i < numThreads; ++i)
+            threads.emplace_back([&histogram, i]() { for (auto j = 0u; j < numPerThread; ++j) histogram.Record(j * numThreads + i); });
+        for (auto& thread : threads) thread.join();
+
+        const auto count = static_cast<uint64_t>(numThreads) * numPerThread;
+        const auto isExact = histogram.GetCount() == count && histogram.GetMax() == (count - 1) * 1e-6 &&
+            abs(histogram.GetMean() - (count - 1) * 0.5e-6) < 1e-9;
+        isPassed = isPassed && isExact;
+        cout << "    " << numThreads << " threads, " << count << " records: count, mean and max " <<
+            (isExact ? "exact" : "wrong") << endl;
+    }
+
+    // Frames of 2 ms of submission, 1 of waiting and a gap, the frame time closing each
+    {
+        const auto spin = [](double ms)
+        {
+            const auto end = GetTimeNs() + static_cast<uint64_t>(ms * 1e6);
+            while (GetTimeNs() < end);
+        };
+
+        FrameRecorder recorder;
+        recorder.Lap(FrameRecorder::WAIT); // Before the first frame, not recorded
+        for (auto i = 0u; i <= 20; ++i)
+        {
+            recorder.BeginFrame();
+            spin(2.0);
+            recorder.Lap(FrameRecorder::SUBMIT);
+            spin(1.0);
+            recorder.Lap(FrameRecorder::WAIT);
+            spin(0.5);
+        }
+
+        const auto& frames = recorder.GetHistogram(FrameRecorder::FRAME);
+        const auto& submits = recorder.GetHistogram(FrameRecorder::SUBMIT);
+        const auto& waits = recorder.GetHistogram(FrameRecorder::WAIT);
+        const auto& presents = recorder.GetHistogram(FrameRecorder::PRESENT);
+        const auto isSplit = frames.GetCount() == 20 && presents.GetMax() == 0.0 && submits.GetPercentile(50.0) >= 1.9 &&
+            waits.GetPercentile(50.0) >= 0.95 && frames.GetPercentile(50.0) >= 3.4;
+        isPassed = isPassed && isSplit;
+        cout << setprecision(3) << "    Recorder, " << frames.GetCount() << " frames: p50 " << frames.GetPercentile(50.0) <<
+            " ms, submit " << submits.GetPercentile(50.0) << " ms, wait " << waits.GetPercentile(50.0) << " ms, present " <<
+            presents.GetPercentile(50.0) << " ms" << endl;
+    }
+
+    return isPassed;
+}
+
+// Stub of the replay backend, hashing the camera, the tessellation factor and the model
+// angle that the frames update, as the scene would turn it
+class StubReplayBackend : public CPUReplayBackend
+{
+public:
+    StubReplayBackend(const float4x4& proj) :
+        CPUReplayBackend(proj),
+        m_angle(0.0f),
+        m_numRendered(0)
+    {
+    }
+
+    virtual void UpdateFrame(const CameraPath::Frame& frame, float timeStep)
+    {
+        CPUReplayBackend::UpdateFrame(frame, timeStep);
+        m_angle += 16.0f * timeStep * Pi / 180.0f;
+
+        // FNV-1a
+        auto hash = 14695981039346656037ull;
+        const auto hashBytes = [&hash](const void* pData, size_t size)
+        {
+            for (auto i = 0u; i < size; ++i) hash = (hash ^ static_cast<const uint8_t*>(pData)[i]) * 1099511628211ull;
+        };
+        hashBytes(&m_eyePt, sizeof(m_eyePt));
+        hashBytes(&m_viewProj, sizeof(m_viewProj));
+        hashBytes(&frame.TessFactor, sizeof(frame.TessFactor));
+        hashBytes(&m_angle, sizeof(m_angle));
+        m_hashes.push_back(hash);
+        m_timeSteps.push_back(timeStep);
+    }
+
+    virtual void RenderFrame()
+    {
+        ++m_numRendered;
+    }
+
+    const vector<uint64_t>& GetHashes() const { return m_hashes; }
+    const vector<float>& GetTimeSteps() const { return m_timeSteps; }
+    uint32_t GetNumRendered() const { return m_numRendered; }
+
+protected:
+    vector<uint64_t>    m_hashes;
+    vector<float>       m_timeSteps;
+    float               m_angle;
+    uint32_t            m_numRendered;
+};
+
+// Round trip of a camera path through its file, and replays of it on the stub backend:
+// the same frames twice, paused frames stepping by 0, and the path looped past its end
+static bool checkReplay()
+{
+    auto isPassed = true;
+
+    // An orbit around the model, paused for 10 frames, with the tessellation factor rising
+    const auto numPathFrames = 120u;
+    CameraPath cameraPath;
+    for (auto i = 0u; i < numPathFrames; ++i)
+    {
+        const auto angle = 2.0f * Pi * i / numPathFrames;
+        const auto eyePt = float3(26.0f * sin(angle), 10.0f, -26.0f * cos(angle));
+        const auto view = MatrixLookAtLH(eyePt, float3(0.0f, 3.0f, 0.0f), float3(0.0f, 1.0f, 0.0f));
+
+        CameraPath::Frame frame;
+        memcpy(frame.EyePt, &eyePt, sizeof(frame.EyePt));
+        memcpy(frame.View, view.m, sizeof(frame.View));
+        frame.TessFactor = 2 + i / 20;
+        frame.IsPaused = i >= 40 && i < 50;
+        cameraPath.Append(frame);
+    }
+
+    const auto fileName = "CheckReplay.csv";
+    CameraPath loadedPath;
+    auto isExact = cameraPath.Save(fileName) && loadedPath.Load(fileName) &&
+        loadedPath.GetNumFrames() == numPathFrames;
+    for (auto i = 0u; isExact && i < numPathFrames; ++i)
+    {
+        const auto& frame = cameraPath.GetFrame(i);
+        const auto& loadedFrame = loadedPath.GetFrame(i);
+        isExact = memcmp(frame.EyePt, loadedFrame.EyePt, sizeof(frame.EyePt)) == 0 &&
+            memcmp(frame.View, loadedFrame.View, sizeof(frame.View)) == 0 &&
+            frame.TessFactor == loadedFrame.TessFactor && frame.IsPaused == loadedFrame.IsPaused;
+    }
+    remove(fileName);
+    isPassed = isPassed && isExact;
+    cout << "Camera path: " << numPathFrames << " frames saved and loaded " << (isExact ? "bit-exact" : "with changes") << endl;
+
+    // Twice over the loaded path, looping it 2.5 times, against the original once
+    const auto proj = MatrixPerspectiveFovLH(g_FOVAngleY, 16.0f / 9.0f, g_zNear, g_zFar);
+    const auto numFrames = numPathFrames * 5 / 2;
+    const auto timeStep = 1.0f / 60.0f;
+    StubReplayBackend backends[3] = { StubReplayBackend(proj), StubReplayBackend(proj), StubReplayBackend(proj) };
+    CameraReplay replays[3];
+    for (auto i = 0u; i < 3; ++i)
+    {
+        replays[i].Init(i < 2 ? loadedPath : cameraPath, i < 2 ? numFrames : 0, timeStep);
+        replays[i].Run(backends[i]);
+    }
+
+    const auto& hashes = backends[0].GetHashes();
+    const auto& timeSteps = backends[0].GetTimeSteps();
+    const auto isRepeated = hashes == backends[1].GetHashes() && hashes.size() == numFrames &&
+        equal(backends[2].GetHashes().begin(), backends[2].GetHashes().end(), hashes.begin());
+    auto isPauseStill = backends[0].GetNumRendered() == numFrames && replays[2].GetNumPlayedFrames() == numPathFrames;
+    auto numPaused = 0u;
+    for (auto i = 0u; i < numFrames; ++i)
+    {
+        const auto& timing = replays[0].GetTimings()[i];
+        const auto isPaused = loadedPath.GetFrame(i).IsPaused;
+        isPauseStill = isPauseStill && timing.PathFrame == i % numPathFrames &&
+            timeSteps[i] == (isPaused ? 0.0f : timeStep) && timing.TimeStep == timeSteps[i];
+        numPaused += isPaused ? 1 : 0;
+    }
+    const auto modelTime = replays[0].GetModelTime();
+    isPauseStill = isPauseStill && abs(modelTime - (numFrames - numPaused) * static_cast<double>(timeStep)) < 1e-6;
+    isPassed = isPassed && isRepeated && isPauseStill;
+    cout << "    Replays of " << numFrames << " frames: " << (isRepeated ? "identical" : "different") << ", " <<
+        numPaused << " paused frames " << (isPauseStill ? "stepping by 0" : "wrong") << ", model time " <<
+        fixed << setprecision(3) << modelTime << " s" << endl;
+
+    const auto& frameTimes = replays[0].GetHistogram();
+    cout << "    Stub frame times: p50 " << frameTimes.GetPercentile(50.0) * 1000.0 << " us, max " <<
+        frameTimes.GetMax() * 1000.0 << " us" << endl;
+
+    return isPassed;
+}
+
+// Tiled tone mapping against the scalar reference, and the time per frame of each
+static bool checkToneMap(uint32_t width, uint32_t height, uint32_t numFrames)
+{
+    const auto isPassed = VerifyToneMap();
+    cout << "Tiled tone mapping checked: " << (isPassed ? "matches the reference" : "failed") << endl;
+
+    const auto numPixels = static_cast<size_t>(width) * height;
+    vector<float3> src(numPixels), dst(numPixels);
+    vector<uint32_t> packed(numPixels), rgba(numPixels);
+    auto seed = 1u;
+    for (auto& color : src)
+    {
+        for (auto c = 0u; c < 3; ++c)
+        {
+            seed = 1664525u * seed + 1013904223u;
+            color[c] = (seed >> 8) / 4194304.0f;
+        }
+    }
+    PackR11G11B10(src.data(), packed.data(), numPixels);
+
+    const auto time = [numFrames](const char* name, const function<void()>& toneMap)
+    {
+        const auto start = chrono::high_resolution_clock::now();
+        for (auto i = 0u; i < numFrames; ++i) toneMap();
+        const auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count() / numFrames;
+        cout << "    " << setw(28) << left << name << right << fixed << setprecision(3) << seconds * 1000.0 << " ms" << endl;
+    };
+
+    cout << width << "x" << height << ", threads: " << ThreadPool::GetDefault().GetNumThreads() << endl;
+    time("Reference, float:", [&]() { ToneMap(src.data(), dst.data(), width, height); });
+    time("Tiled, float:", [&]() { ToneMapTiled(src.data(), dst.data(), width, height); });
+    time("Tiled, R11G11B10 to RGBA8:", [&]() { ToneMapTiled(packed.data(), rgba.data(), width, height); });
+
+    return isPassed;
+}
+
+// Rays aimed at the shared vertices and edge points of the tessellated meshes, from
+// the camera and from around each point, none of which may leak between the triangles
+static bool checkWatertight(const char* meshFileName, const float4& meshPosScale)
+{
+    Scene scene;
+    if (!scene.Init(meshFileName, meshPosScale, 100))
+    {
+        cerr << "Failed to load " << meshFileName << endl;
+
+        return false;
+    }
+
+    const auto eyePt = float3(10.0f, 10.0f, -24.0f);
+    scene.UpdateFrame(eyePt, 0.0f);
+
+    auto isPassed = true;
+    for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+    {
+        const auto& mesh = scene.GetMesh(i);
+        TessTopology topology;
+        topology.Init(&mesh.Vertices[0].Pos, sizeof(Scene::Vertex), mesh.Indices.data(),
+            static_cast<uint32_t>(mesh.Indices.size()));
+
+        // Edges of a single patch are on the boundary, where rays may pass by legitimately
+        const auto& patches = topology.GetPatches();
+        const auto& edges = topology.GetEdges();
+        const auto numPatches = topology.GetNumPatches();
+        const auto numVerts = topology.GetNumVerts();
+        vector<uint32_t> edgePatches(2 * edges.size(), ~0u);
+        for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+            for (const auto edge : patches[patchIdx].Edges)
+                edgePatches[2 * edge + (edgePatches[2 * edge] == ~0u ? 0 : 1)] = patchIdx;
+
+        vector<uint8_t> isBoundaryVert(numVerts, 0);
+        for (auto edge = 0u; edge < edges.size(); ++edge)
+            if (edgePatches[2 * edge + 1] == ~0u)
+                for (const auto vert : edges[edge].Verts) isBoundaryVert[vert] = 1;
+
+        // Patches around each vertex, by prefix sums
+        vector<uint32_t> vertPatchOffsets(numVerts + 1, 0), vertPatches(3 * numPatches);
+        for (const auto& patch : patches)
+            for (const auto vert : patch.Verts) ++vertPatchOffsets[vert + 1];
+        for (auto j = 0u; j < numVerts; ++j) vertPatchOffsets[j + 1] += vertPatchOffsets[j];
+        {
+            auto offsets = vertPatchOffsets;
+            for (auto patchIdx = 0u; patchIdx < numPatches; ++patchIdx)
+                for (const auto vert : patches[patchIdx].Verts) vertPatches[offsets[vert]++] = patchIdx;
+        }
+
+        const auto getNormal = [&](uint32_t patchIdx)
+        {
+            const auto& patch = patches[patchIdx];
+            const auto p0 = topology.GetTessVertPos(patch.Verts[0], 1, nullptr);
+            const auto p1 = topology.GetTessVertPos(patch.Verts[1], 1, nullptr);
+            const auto p2 = topology.GetTessVertPos(patch.Verts[2], 1, nullptr);
+
+            return cross(p1 - p0, p2 - p0);
+        };
+
+        const auto& world = scene.GetWorld(i);
+        const auto worldInv = MatrixInverse(world);
+        const auto localEyePt = TransformCoord(eyePt, worldInv);
+        for (auto tessFactor = 1u; tessFactor <= 4; ++tessFactor)
+        {
+            // The vertices, then the inner points of the edges, as numbered by TessTopology
+            const auto numTargets = numVerts + (tessFactor - 1) * topology.GetNumEdges();
+            atomic<uint64_t> numRays(0), numEscaped(0);
+            ThreadPool::GetDefault().ParallelFor(numTargets, 1024, [&](uint32_t begin, uint32_t end, uint32_t)
+            {
+                auto numChunkRays = 0u, numChunkEscaped = 0u;
+                for (auto j = begin; j < end; ++j)
+                {
+                    // Patches around the point
+                    const uint32_t* pPatches;
+                    uint32_t numPointPatches;
+                    if (j < numVerts)
+                    {
+                        if (isBoundaryVert[j]) continue;
+                        pPatches = &vertPatches[vertPatchOffsets[j]];
+                        numPointPatches = vertPatchOffsets[j + 1] - vertPatchOffsets[j];
+                    }
+                    else
+                    {
+                        const auto edge = (j - numVerts) / (tessFactor - 1);
+                        if (edgePatches[2 * edge + 1] == ~0u) continue;
+                        pPatches = &edgePatches[2 * edge];
+                        numPointPatches = 2;
+                    }
+                    if (numPointPatches == 0) continue;
+
+                    // Origins at the camera, and tilted away from the surface around the point; the
+                    // camera ray is aimed in world space and taken to object space, as by Scene
+                    const auto target = topology.GetTessVertPos(j, tessFactor, nullptr);
+                    const auto cameraDir = TransformNormal(normalize(TransformCoord(target, world) - eyePt), worldInv);
+                    const auto normal = normalize(getNormal(pPatches[0]));
+                    const auto tangent = normalize(cross(normal, fabs(normal.x) < 0.9f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f)));
+                    const auto bitangent = cross(normal, tangent);
+                    const float3 origins[] =
+                    {
+                        localEyePt,
+                        target + normal * 2.0f,
+                        target + (normal + 0.7f * tangent) * 2.0f,
+                        target + (normal - 0.7f * tangent) * 2.0f,
+                        target + (normal + 0.7f * bitangent) * 2.0f,
+                        target + (normal - 0.7f * bitangent) * 2.0f
+                    };
+
+                    for (const auto& origin : origins)
+                    {
+                        // Skip the silhouettes, where the ray may only graze the surface
+                        const auto dir = &origin == origins ? cameraDir : normalize(target - origin);
+                        auto numFacing = 0u;
+                        for (auto k = 0u; k < numPointPatches; ++k) numFacing += dot(getNormal(pPatches[k]), dir) < 0.0f ? 1 : 0;
+                        if (numFacing != 0 && numFacing != numPointPatches) continue;
+
+                        // Front faces are clockwise from the origin, and culled from behind as by Scene;
+                        // a leak through them would otherwise hit the back of the closed mesh instead
+                        const Ray ray = { origin, dir, 0.0f, FLT_MAX };
+                        Hit hit;
+                        if (!mesh.Bvh.Intersect(ray, hit, numFacing == numPointPatches)) ++numChunkEscaped;
+                        ++numChunkRays;
+                    }
+                }
+                numRays += numChunkRays;
+                numEscaped += numChunkEscaped;
+            });
+
+            isPassed = isPassed && numEscaped == 0;
+            cout << (i == Scene::GROUND ? "Ground" : meshFileName) << ", tessellation factor " << tessFactor << ": " <<
+                numEscaped << " of " << numRays << " rays at the shared vertices and edges escaped" << endl;
+        }
+    }
+
+    return isPassed;
+}
+
+static void printUsage()
+{
+    cerr << "Usage: RT-CPU [-mesh file [x y z scale]] [-type pixel|vertex|tessvertex|adaptive|hybrid]" << endl <<
+        "    [-tess factor|all] [-pps pixels] [-hybrid vertexarea pixelarea] [-width w] [-height h] [-frames n] [-o image.pfm]" << endl <<
+        "    [-stats frames.csv|frames.json] [-cache degrees [refresh%]] [-path frames] [-replay path.csv [frames]]" << endl <<
+        "    [-capture frames [png|pfm|exr] [block|drop]]" << endl <<
+        "    [-rcache [cell [log2 entries]]] [-env probe.dds]" << endl <<
+        "    [-bench [name] [-refspp n] [-target flip]] [-checkdomain] [-checkpack] [-checktonemap] [-checksampler] [-checktimer]" << endl <<
+        "    [-checkreplay] [-checkwatertight] [-countshared] [-dds file]" << endl <<
+        "    [-probe probe.dds [box|ggx]] [-bc6h probe.dds [quality 0-2]]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    string meshFileName = "../RT-Granularity/Assets/bunny.obj";
+    string ddsFileName;
+    string envFileName;
+    string probeFileName;
+    string bc6hFileName;
+    auto bc6hQuality = 1u;
+    auto probeFilter = LightProbe::GGX;
+    string outFileName;
+    string type = "vertex";
+    string tessFactorArg = "2";
+    string benchName;
+    string statsFileName;
+    auto meshPosScale = float4(0.0f, 0.0f, 0.0f, 1.0f);
+    auto width = 1600u;
+    auto height = 900u;
+    auto numFrames = 1u;
+    auto numRefSamples = 64u;
+    auto targetFLIP = 0.0f;
+    auto pixelsPerSample = 8.0f;
+    auto vertexMaxArea = 4.0f;
+    auto pixelMinArea = 64.0f;
+    auto cacheAngle = -1.0f;
+    auto cacheRefreshRate = 0.0f;
+    auto numPathFrames = 0u;
+    auto numCaptureFrames = 0u;
+    auto captureFormat = FrameCapture::PNG;
+    auto capturePolicy = FrameCapture::BLOCK;
+    auto radianceCellSize = 0.0f;
+    auto radianceCacheLog2 = 20u;
+    auto isDomainCheck = false;
+    auto isPackCheck = false;
+    auto isToneMapCheck = false;
+    auto isSamplerCheck = false;
+    auto isTimerCheck = false;
+    auto isReplayCheck = false;
+    auto isWatertightCheck = false;
+    string replayFileName;
+    auto numReplayFrames = 0u;
+    auto isSharedCount = false;
+
+    try
+    {
+        for (auto i = 1; i < argc; ++i)
+        {
+            if (isArg(argv[i], "mesh"))
+            {
+                if (i + 1 < argc) meshFileName = argv[++i];
+                if (i + 1 < argc) i += sscanf(argv[i + 1], "%f", &meshPosScale.x);
+                if (i + 1 < argc) i += sscanf(argv[i + 1], "%f", &meshPosScale.y);
+                if (i + 1 < argc) i += sscanf(argv[i + 1], "%f", &meshPosScale.z);
+                if (i + 1 < argc) i += sscanf(argv[i + 1], "%f", &meshPosScale.w);
+            }
+            else if (isArg(argv[i], "type") && i + 1 < argc) type = argv[++i];
+            else if (isArg(argv[i], "tess") && i + 1 < argc)
+            {
+                tessFactorArg = argv[++i];
+                if (tessFactorArg != "all") stoul(tessFactorArg); // Parsed again once the tracer exists
+            }
+            else if (isArg(argv[i], "pps") && i + 1 < argc) pixelsPerSample = stof(argv[++i]);
+            else if (isArg(argv[i], "hybrid") && i + 2 < argc)
+            {
+                vertexMaxArea = stof(argv[++i]);
+                pixelMinArea = stof(argv[++i]);
+            }
+            else if (isArg(argv[i], "cache") && i + 1 < argc)
+            {
+                cacheAngle = stof(argv[++i]) * Pi / 180.0f;
+                if (i + 1 < argc && argv[i + 1][0] != '-') cacheRefreshRate = stof(argv[++i]) / 100.0f;
+            }
+            else if (isArg(argv[i], "path") && i + 1 < argc) numPathFrames = (max)(stoul(argv[++i]), 1ul);
+            else if (isArg(argv[i], "rcache"))
+            {
+                radianceCellSize = 0.05f;
+                if (i + 1 < argc && argv[i + 1][0] != '-') radianceCellSize = stof(argv[++i]);
+                if (i + 1 < argc && argv[i + 1][0] != '-') radianceCacheLog2 = (min)(stoul(argv[++i]), 30ul);
+            }
+            else if (isArg(argv[i], "capture") && i + 1 < argc)
+            {
+                numCaptureFrames = stoul(argv[++i]);
+                for (; i + 1 < argc && argv[i + 1][0] != '-'; ++i)
+                {
+                    const string option = argv[i + 1];
+                    if (option == "pfm") captureFormat = FrameCapture::PFM;
+                    else if (option == "exr") captureFormat = FrameCapture::EXR;
+                    else if (option == "drop") capturePolicy = FrameCapture::DROP;
+                }
+            }
+            else if (isArg(argv[i], "width") && i + 1 < argc) width = stoul(argv[++i]);
+            else if (isArg(argv[i], "height") && i + 1 < argc) height = stoul(argv[++i]);
+            else if (isArg(argv[i], "frames") && i + 1 < argc) numFrames = (max)(stoul(argv[++i]), 1ul);
+            else if (isArg(argv[i], "o") && i + 1 < argc) outFileName = argv[++i];
+            else if (isArg(argv[i], "stats") && i + 1 < argc) statsFileName = argv[++i];
+            else if (isArg(argv[i], "checkdomain")) isDomainCheck = true;
+            else if (isArg(argv[i], "checkpack")) isPackCheck = true;
+            else if (isArg(argv[i], "checktonemap")) isToneMapCheck = true;
+            else if (isArg(argv[i], "checksampler")) isSamplerCheck = true;
+            else if (isArg(argv[i], "checktimer")) isTimerCheck = true;
+            else if (isArg(argv[i], "checkreplay")) isReplayCheck = true;
+            else if (isArg(argv[i], "checkwatertight")) isWatertightCheck = true;
+            else if (isArg(argv[i], "replay") && i + 1 < argc)
+            {
+                replayFileName = argv[++i];
+                if (i + 1 < argc && argv[i + 1][0] != '-') numReplayFrames = stoul(argv[++i]);
+            }
+            else if (isArg(argv[i], "dds") && i + 1 < argc) ddsFileName = argv[++i];
+            else if (isArg(argv[i], "env") && i + 1 < argc) envFileName = argv[++i];
+            else if (isArg(argv[i], "probe") && i + 1 < argc)
+            {
+                probeFileName = argv[++i];
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                    probeFilter = strcmp(argv[++i], "box") == 0 ? LightProbe::BOX : LightProbe::GGX;
+            }
+            else if (isArg(argv[i], "bc6h") && i + 1 < argc)
+            {
+                bc6hFileName = argv[++i];
+                if (i + 1 < argc && argv[i + 1][0] != '-') bc6hQuality = (min)(stoul(argv[++i]), 2ul);
+            }
+            else if (isArg(argv[i], "countshared")) isSharedCount = true;
+            else if (isArg(argv[i], "bench")) benchName = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "Benchmark";
+            else if (isArg(argv[i], "refspp") && i + 1 < argc) numRefSamples = (max)(stoul(argv[++i]), 1ul);
+            else if (isArg(argv[i], "target") && i + 1 < argc) targetFLIP = stof(argv[++i]);
+            else
+            {
+                printUsage();
+
+                return 1;
+            }
+        }
+    }
+    catch (const logic_error&)
+    {
+        // A numeric option that stoul or stof cannot parse, or that is out of range
+        printUsage();
+
+        return 1;
+    }
+
+    // Bijectivity of the dense domain-point index for all the tessellation factors
+    if (isDomainCheck)
+    {
+        auto numFailed = 0u;
+        for (auto tessFactor = 1u; tessFactor <= Tessellator::MaxTessFactor; ++tessFactor)
+        {
+            if (Tessellator::VerifyDomainIndex(tessFactor)) continue;
+            cerr << "Domain index check failed for tessellation factor " << tessFactor << endl;
+            ++numFailed;
+        }
+
+        cout << "Domain index checked for tessellation factors 1 to " << Tessellator::MaxTessFactor << ": " <<
+            (numFailed ? "failed" : "no collisions or gaps") << endl;
+
+        return numFailed ? 1 : 0;
+    }
+
+    // Round trips of the packed vertex colors within their error bounds
+    if (isPackCheck)
+    {
+        const auto isPassed = VerifyR11G11B10();
+        cout << "R11G11B10 packing checked: " << (isPassed ? "within the error bounds" : "failed") << endl;
+
+        return isPassed ? 0 : 1;
+    }
+
+    // Tiled tone mapping against the reference, at the output size
+    if (isToneMapCheck) return checkToneMap(width, height, numFrames) ? 0 : 1;
+
+    // Sequences of the sampler against IncrementalHalton, and their throughput
+    if (isSamplerCheck)
+    {
+        const auto isPassed = checkSampler();
+        cout << "Sampler checked: " << (isPassed ? "passed" : "failed") << endl;
+
+        return isPassed ? 0 : 1;
+    }
+
+    // Frame timer and its percentiles
+    if (isTimerCheck)
+    {
+        const auto isPassed = checkTimer();
+        cout << "Frame timer checked: " << (isPassed ? "passed" : "failed") << endl;
+
+        return isPassed ? 0 : 1;
+    }
+
+    // Camera path round trip and deterministic replays, on the stub backend
+    if (isReplayCheck)
+    {
+        const auto isPassed = checkReplay();
+        cout << "Camera replay checked: " << (isPassed ? "passed" : "failed") << endl;
+
+        return isPassed ? 0 : 1;
+    }
+
+    // Rays at the shared vertices and edges of the scene, against the BVHs
+    if (isWatertightCheck)
+    {
+        const auto isPassed = checkWatertight(meshFileName.c_str(), meshPosScale);
+        cout << "Watertight ray-triangle test checked: " << (isPassed ? "no rays escaped" : "failed") << endl;
+
+        return isPassed ? 0 : 1;
+    }
+
+    // Layout of a light probe, and the time to read all its texels through the mapping
+    if (!ddsFileName.empty())
+    {
+        DDSReader reader;
+        if (!reader.Load(ddsFileName.c_str()))
+        {
+            cerr << "Failed to load " << ddsFileName << endl;
+
+            return 1;
+        }
+
+        cout << ddsFileName << ": " << DDSReader::GetFormatName(reader.GetFormat()) << ", " << reader.GetWidth() << "x" <<
+            reader.GetHeight() << ", " << reader.GetNumMips() << " mips, " << reader.GetNumFaces() <<
+            (reader.IsCube() ? " cube faces" : " slices") << endl;
+        cout << fixed << setprecision(3) << "    Mapped " << reader.GetFileSize() << " bytes in " <<
+            reader.GetLoadTime() * 1000.0 << " ms, touching " << reader.GetNumBytesTouched() << " bytes" << endl;
+
+        const auto start = chrono::high_resolution_clock::now();
+        size_t numBytes = 0;
+        uint32_t checksum = 0;
+        for (auto face = 0u; face < reader.GetNumFaces(); ++face)
+        {
+            for (auto mip = 0u; mip < reader.GetNumMips(); ++mip)
+            {
+                const auto& subresource = reader.GetSubresource(face, mip);
+                const auto size = static_cast<size_t>(subresource.RowPitch) * subresource.NumRows;
+                for (size_t j = 0; j < size; ++j) checksum = 31 * checksum + subresource.pData[j];
+                numBytes += size;
+            }
+        }
+        const auto readTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+        cout << "    Read " << numBytes << " bytes of texels in " << readTime * 1000.0 << " ms, checksum " <<
+            hex << checksum << dec << endl;
+
+        if (!DDSReader::IsBlockCompressed(reader.GetFormat()))
+        {
+            const auto& subresource = reader.GetSubresource(0, 0);
+            const auto texel = reader.LoadTexel(subresource, subresource.Width / 2, subresource.Height / 2);
+            cout << "    Center texel of face 0: " << texel.x << ", " << texel.y << ", " << texel.z << endl;
+        }
+
+        if (reader.IsCube()) sampleCubeMap(reader);
+
+        return 0;
+    }
+
+    // Prefiltered mips and irradiance of a light probe, and their cache
+    if (!probeFileName.empty())
+    {
+        if (prefilterProbe(probeFileName.c_str(), probeFilter)) return 0;
+        cerr << "Failed to load " << probeFileName << endl;
+
+        return 1;
+    }
+
+    // Compressed light probe, and its cache
+    if (!bc6hFileName.empty())
+    {
+        if (compressProbe(bc6hFileName.c_str(), bc6hQuality)) return 0;
+        cerr << "Failed to load " << bc6hFileName << endl;
+
+        return 1;
+    }
+
+    // Rays per frame with private domain points per patch vs. shared tessellated vertices
+    if (isSharedCount)
+    {
+        Scene scene;
+        if (!scene.Init(meshFileName.c_str(), meshPosScale, 100))
+        {
+            cerr << "Failed to load " << meshFileName << endl;
+
+            return 1;
+        }
+
+        for (auto i = 0u; i < Scene::NUM_MESH; ++i)
+        {
+            const auto& mesh = scene.GetMesh(i);
+            TessTopology topology;
+            topology.Init(&mesh.Vertices[0].Pos, sizeof(Scene::Vertex), mesh.Indices.data(),
+                static_cast<uint32_t>(mesh.Indices.size()));
+            cout << (i == Scene::GROUND ? "Ground" : meshFileName) << ": " << topology.GetNumPatches() << " patches, " <<
+                mesh.Vertices.size() << " vertices (" << topology.GetNumVerts() << " welded), " <<
+                topology.GetNumEdges() << " edges" << endl;
+
+            for (auto tessFactor = 1u; tessFactor <= Tessellator::MaxTessFactor; tessFactor += tessFactor < 8 ? 1 : tessFactor)
+            {
+                const auto numPerPatch = static_cast<uint64_t>(topology.GetNumPatches()) *
+                    Tessellator::CalcNumDomainPoints(tessFactor);
+                const auto numShared = topology.GetNumTessVerts(tessFactor);
+                cout << fixed << setprecision(2) << "    Tessellation factor " << setw(2) << tessFactor << ": " <<
+                    numPerPatch << " rays per patch, " << numShared << " shared, " <<
+                    static_cast<double>(numPerPatch) / numShared << "x fewer" << endl;
+            }
+        }
+
+        return 0;
+    }
+
+    // Quality vs. cost of all the granularities, into name.csv and name_pareto.dat
+    if (!benchName.empty())
+    {
+        cout << "Benchmark, " << width << "x" << height << ", threads: " << ThreadPool::GetDefault().GetNumThreads() << endl;
+        Benchmark benchmark;
+        if (!benchmark.Init(meshFileName.c_str(), meshPosScale, width, height))
+        {
+            cerr << "Failed to load " << meshFileName << endl;
+
+            return 1;
+        }
+
+        return benchmark.Run(numRefSamples, numFrames, (benchName + ".csv").c_str(),
+            (benchName + "_pareto.dat").c_str(), targetFLIP) ? 0 : 1;
+    }
+
+    const auto isPerVertex = type != "pixel";
+    const auto isAdaptive = type == "adaptive";
+    const auto isHybrid = type == "hybrid";
+    const auto isPerTessVertex = type == "tessvertex";
+
+    // Scene, with the ground of the matching GPU ray tracer
+    const auto loadStart = chrono::high_resolution_clock::now();
+    Scene scene;
+    if (!scene.Init(meshFileName.c_str(), meshPosScale, isPerVertex ? 100 : 2))
+    {
+        cerr << "Failed to load " << meshFileName << endl;
+
+        return 1;
+    }
+    const auto loadTime = chrono::duration<double>(chrono::high_resolution_clock::now() - loadStart).count();
+
+    // Light probe for the miss rays, instead of the stand-in sky
+    CubeMap envMap;
+    if (!envFileName.empty())
+    {
+        DDSReader reader;
+        if (!reader.Load(envFileName.c_str()) || !envMap.Init(reader))
+        {
+            cerr << "Failed to load " << envFileName << endl;
+
+            return 1;
+        }
+        scene.SetEnvironment([&envMap](const float3& dir) { return envMap.SampleLevel(dir); });
+    }
+
+    unique_ptr<CPURayTracer> rayTracer;
+    if (isHybrid) rayTracer = make_unique<CPUHRayTracer>(scene);
+    else if (isAdaptive) rayTracer = make_unique<CPUATVRayTracer>(scene);
+    else if (isPerTessVertex) rayTracer = make_unique<CPUTVRayTracer>(scene);
+    else if (isPerVertex) rayTracer = make_unique<CPUVRayTracer>(scene);
+    else rayTracer = make_unique<CPUPRayTracer>(scene);
+    if (!rayTracer->Init(width, height)) return 1;
+
+    // Same camera as the GPU application
+    const auto eyePt = float3(10.0f, 10.0f, -24.0f);
+    const auto view = MatrixLookAtLH(eyePt, float3(0.0f, 3.0f, 0.0f), float3(0.0f, 1.0f, 0.0f));
+    const auto proj = MatrixPerspectiveFovLH(g_FOVAngleY, width / static_cast<float>(height), g_zNear, g_zFar);
+    const auto viewProj = view * proj;
+    scene.UpdateFrame(eyePt, 0.0f);
+
+    cout << "Type: " << (isHybrid ? "hybrid" : (isAdaptive ? "per adaptively tessellated vertex" :
+        (isPerTessVertex ? "per tessellated vertex" : (isPerVertex ? "per vertex" : "per pixel")))) <<
+        ", " << width << "x" << height <<
+        ", threads: " << ThreadPool::GetDefault().GetNumThreads() << endl;
+    cout << "Scene loaded and BVHs built in " << loadTime * 1000.0 << " ms, " <<
+        scene.GetMemorySize() / (1024.0 * 1024.0) << " MB" << endl;
+
+    // Per-frame counters, one row or object per frame
+    RayStatsWriter statsWriter;
+    RayStatsWriter* pStatsWriter = nullptr;
+    if (!statsFileName.empty())
+    {
+        if (!RayStats::IsEnabled) cerr << "Ray stats are compiled out (ENABLE_RAY_STATS is 0)" << endl;
+        if (!statsWriter.Open(statsFileName.c_str()))
+        {
+            cerr << "Failed to open " << statsFileName << endl;
+
+            return 1;
+        }
+        pStatsWriter = &statsWriter;
+    }
+
+    // Frames encoded to capture_NNNNN by the workers while the next ones render
+    FrameCapture capture;
+    FrameCapture* pCapture = nullptr;
+    if (numCaptureFrames > 0)
+    {
+        capture.Init("capture", captureFormat, capturePolicy, 4, 2);
+        pCapture = &capture;
+        numFrames = (max)(numFrames, numCaptureFrames);
+        cout << "Capture: " << numCaptureFrames << " frames to capture_*" << FrameCapture::GetExtension(captureFormat) <<
+            ", " << (capturePolicy == FrameCapture::DROP ? "dropped" : "blocking") << " when 4 are queued" << endl;
+    }
+
+    // Shading cache of the per-vertex tracers
+    if (cacheAngle >= 0.0f)
+    {
+        if (isPerTessVertex) static_cast<CPUTVRayTracer*>(rayTracer.get())->SetShadingCache(cacheAngle, cacheRefreshRate);
+        else if (isPerVertex && !isAdaptive && !isHybrid) static_cast<CPUVRayTracer*>(rayTracer.get())->SetShadingCache(cacheAngle, cacheRefreshRate);
+        else
+        {
+            cerr << "The shading cache is only for the vertex and tessvertex types" << endl;
+
+            return 1;
+        }
+        cout << "Shading cache: " << cacheAngle * 180.0f / Pi << " degrees, " <<
+            cacheRefreshRate * 100.0f << "% refreshed per frame" << endl;
+    }
+
+    if (radianceCellSize > 0.0f)
+    {
+        if (isPerTessVertex && tessFactorArg != "all")
+            static_cast<CPUTVRayTracer*>(rayTracer.get())->SetTessFactor(static_cast<uint32_t>(stoul(tessFactorArg)));
+
+        RadianceCache radianceCache;
+        radianceCache.Init(radianceCacheLog2, radianceCellSize);
+        compareRadianceCache(rayTracer.get(), scene, radianceCache, eyePt, viewProj, numFrames);
+    }
+    else if (numPathFrames > 0)
+    {
+        // Against the same tracer without the cache
+        if (isAdaptive || isHybrid || !isPerVertex)
+        {
+            cerr << "The camera path is only for the vertex and tessvertex types" << endl;
+
+            return 1;
+        }
+
+        unique_ptr<CPURayTracer> refRayTracer;
+        if (isPerTessVertex) refRayTracer = make_unique<CPUTVRayTracer>(scene);
+        else refRayTracer = make_unique<CPUVRayTracer>(scene);
+        if (!refRayTracer->Init(width, height)) return 1;
+
+        if (isPerTessVertex && tessFactorArg != "all")
+        {
+            const auto tessFactor = static_cast<uint32_t>(stoul(tessFactorArg));
+            static_cast<CPUTVRayTracer*>(rayTracer.get())->SetTessFactor(tessFactor);
+            static_cast<CPUTVRayTracer*>(refRayTracer.get())->SetTessFactor(tessFactor);
+        }
+
+        cout << "Camera path: " << numPathFrames << " frames" << endl;
+        renderPath(rayTracer.get(), refRayTracer.get(), scene, numPathFrames, width, height);
+    }
+    else if (!replayFileName.empty())
+    {
+        // The tessellation factor of each frame is only for the tessvertex type
+        const auto pTVRayTracer = isPerTessVertex ? static_cast<CPUTVRayTracer*>(rayTracer.get()) : nullptr;
+        if (!replayPath(rayTracer.get(), pTVRayTracer, scene, replayFileName.c_str(), numReplayFrames, width, height))
+            return 1;
+    }
+    else if (isPerTessVertex)
+    {
+        // Each tessellation factor, or all of them
+        const auto pTVRayTracer = static_cast<CPUTVRayTracer*>(rayTracer.get());
+        const auto isSweep = tessFactorArg == "all";
+        const auto firstFactor = isSweep ? CPUTVRayTracer::MinTessFactor : stoul(tessFactorArg);
+        const auto lastFactor = isSweep ? CPUTVRayTracer::MaxTessFactor : firstFactor;
+        for (auto tessFactor = firstFactor; tessFactor <= lastFactor; ++tessFactor)
+        {
+            pTVRayTracer->SetTessFactor(static_cast<uint32_t>(tessFactor));
+            cout << "Tessellation factor: " << pTVRayTracer->GetTessFactor() << ", " <<
+                pTVRayTracer->GetNumDomainPoints() << " domain points, " <<
+                pTVRayTracer->GetNumTessVerts() << " shared" << endl;
+            renderFrames(pTVRayTracer, eyePt, viewProj, numFrames, pStatsWriter, pCapture, numCaptureFrames);
+        }
+    }
+    else if (isHybrid)
+    {
+        // Triangles and rays per granularity
+        const auto pHRayTracer = static_cast<CPUHRayTracer*>(rayTracer.get());
+        pHRayTracer->SetThresholds(vertexMaxArea, pixelMinArea);
+        pHRayTracer->SetPixelsPerSample(pixelsPerSample);
+        cout << "Per vertex up to " << vertexMaxArea << " pixels, per pixel from " << pixelMinArea <<
+            " pixels, " << pixelsPerSample << " pixels per sample in between" << endl;
+        renderFrames(pHRayTracer, eyePt, viewProj, numFrames, pStatsWriter, pCapture, numCaptureFrames);
+
+        static const char* names[] = { "culled", "per vertex", "per tessellated vertex", "per pixel" };
+        for (auto i = 0u; i < CPUHRayTracer::NUM_GRANULARITY; ++i)
+        {
+            const auto granularity = static_cast<CPUHRayTracer::Granularity>(i);
+            cout << "    " << names[i] << ": " << pHRayTracer->GetNumPatches(granularity) << " triangles";
+            if (granularity != CPUHRayTracer::CULLED) cout << ", " << pHRayTracer->GetNumGranularityRays(granularity) << " rays";
+            cout << endl;
+        }
+    }
+    else if (isAdaptive)
+    {
+        // Rays of the visible patches vs. all the patches at the uniform factor
+        const auto pATVRayTracer = static_cast<CPUATVRayTracer*>(rayTracer.get());
+        pATVRayTracer->SetPixelsPerSample(pixelsPerSample);
+        cout << "Pixels per sample: " << pATVRayTracer->GetPixelsPerSample() << endl;
+        renderFrames(pATVRayTracer, eyePt, viewProj, numFrames, pStatsWriter, pCapture, numCaptureFrames);
+
+        const auto numRays = pATVRayTracer->GetNumRays();
+        const auto numUniformRays = pATVRayTracer->GetNumUniformRays();
+        cout << "Adaptive: " << pATVRayTracer->GetNumVisiblePatches() << " of " << pATVRayTracer->GetNumPatches() <<
+            " patches visible, max factor " << pATVRayTracer->GetMaxUsedTessFactor() << "; " << numRays << " rays vs. " <<
+            numUniformRays << " with the uniform factor (" << fixed << setprecision(1) <<
+            100.0 * (1.0 - static_cast<double>(numRays) / numUniformRays) << "% saved)" << endl;
+    }
+    else if (isPerVertex)
+    {
+        // Vertices of the front-facing triangles in the frustum vs. all the vertices
+        const auto pVRayTracer = static_cast<CPUVRayTracer*>(rayTracer.get());
+        renderFrames(pVRayTracer, eyePt, viewProj, numFrames, pStatsWriter, pCapture, numCaptureFrames);
+
+        const auto numVerts = pVRayTracer->GetNumVerts();
+        const auto numVisibleVerts = pVRayTracer->GetNumVisibleVerts();
+        cout << "Shaded vertices: " << numVisibleVerts << " of " << numVerts << " (" << fixed << setprecision(1) <<
+            100.0 * numVisibleVerts / numVerts << "%)" << endl;
+    }
+    else renderFrames(rayTracer.get(), eyePt, viewProj, numFrames, pStatsWriter, pCapture, numCaptureFrames);
+
+    if (pCapture) reportCapture(capture);
+
+    if (!statsWriter.Close())
+    {
+        cerr << "Failed to write " << statsFileName << endl;
+
+        return 1;
+    }
+
+    if (!outFileName.empty() && !WritePFM(outFileName.c_str(), rayTracer->GetImage(), width, height))
+    {
+        cerr << "Failed to write " << outFileName << endl;
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently.
+// Unlike the GPU application, this project is kept free of Windows and
+// Direct3D dependencies, so that it also builds with GCC or Clang.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define DIV_UP(x, n) (((x) + (n) - 1) / (n))
+
+#ifndef _MSC_VER
+// Secure CRT shims for the shared OBJ loader
+inline int fopen_s(FILE** ppFile, const char* fileName, const char* mode)
+{
+    *ppFile = fopen(fileName, mode);
+
+    return *ppFile ? 0 : errno;
+}
+
+// A string conversion takes its buffer size as the next argument, which is turned into
+// a field width here, so that a long token cannot overrun the buffer
+inline int fscanf_s(FILE* pFile, const char* format, char* buffer, uint32_t size)
+{
+    // Insert the width after the '%' of the single conversion in the format, e.g. "%s" to "%255s"
+    const auto pPercent = strchr(format, '%');
+    if (!pPercent || size == 0) return EOF;
+    const auto pSpec = pPercent + 1;
+    const auto width = *pSpec == 'c' ? size : size - 1;
+
+    char sizedFormat[64];
+    const auto prefixLength = static_cast<int>(pSpec - format);
+    if (snprintf(sizedFormat, sizeof(sizedFormat), "%.*s%u%s", prefixLength, format, width, pSpec)
+        >= static_cast<int>(sizeof(sizedFormat))) return EOF;
+
+    return fscanf(pFile, sizedFormat, buffer);
+}
+
+// Numeric conversions take no sizes, and are the same as the standard ones
+template<typename... Args>
+inline int fscanf_s(FILE* pFile, const char* format, Args... args)
+{
+    return fscanf(pFile, format, args...);
+}
+
+template<typename... Args>
+inline int sscanf_s(const char* buffer, const char* format, Args... args)
+{
+    return sscanf(buffer, format, args...);
+}
+#endif
@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "CameraPath.h"
+
+using namespace std;
+
+CameraPath::CameraPath()
+{
+}
+
+CameraPath::~CameraPath()
+{
+}
+
+void CameraPath::Clear()
+{
+    m_frames.clear();
+}
+
+void CameraPath::Append(const Frame& frame)
+{
+    m_frames.push_back(frame);
+}
+
+bool CameraPath::Save(const char* fileName) const
+{
+    ofstream file(fileName);
+    if (!file) return false;
+
+    file << "frame,eye x,eye y,eye z";
+    for (auto i = 0u; i < 16; ++i) file << ",view " << i / 4 << i % 4;
+    file << ",tess factor,paused" << endl;
+
+    file << setprecision(9);
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        const auto& frame = m_frames[i];
+        file << i;
+        for (const auto value : frame.EyePt) file << "," << value;
+        for (const auto value : frame.View) file << "," << value;
+        file << "," << frame.TessFactor << "," << (frame.IsPaused ? 1 : 0) << endl;
+    }
+
+    return file.good();
+}
+
+bool CameraPath::Load(const char* fileName)
+{
+    ifstream file(fileName);
+    if (!file) return false;
+
+    // The header, then a frame per line
+    string line;
+    if (!getline(file, line)) return false;
+
+    m_frames.clear();
+    while (getline(file, line))
+    {
+        if (line.empty()) continue;
+        replace(line.begin(), line.end(), ',', ' ');
+        istringstream values(line);
+
+        Frame frame;
+        uint32_t index, isPaused;
+        values >> index;
+        for (auto& value : frame.EyePt) values >> value;
+        for (auto& value : frame.View) values >> value;
+        values >> frame.TessFactor >> isPaused;
+        if (values.fail()) return false;
+
+        frame.IsPaused = isPaused != 0;
+        m_frames.push_back(frame);
+    }
+
+    return !m_frames.empty();
+}
+
+uint32_t CameraPath::GetNumFrames() const
+{
+    return static_cast<uint32_t>(m_frames.size());
+}
+
+const CameraPath::Frame& CameraPath::GetFrame(uint32_t i) const
+{
+    return m_frames[i % m_frames.size()];
+}
+
+CameraReplay::CameraReplay() :
+    m_pPath(nullptr),
+    m_numFrames(0),
+    m_timeStep(0.0f),
+    m_modelTime(0.0)
+{
+}
+
+CameraReplay::~CameraReplay()
+{
+}
+
+bool CameraReplay::Init(const CameraPath& path, uint32_t numFrames, float timeStep)
+{
+    if (path.GetNumFrames() == 0) return false;
+
+    m_pPath = &path;
+    m_numFrames = numFrames ? numFrames : path.GetNumFrames();
+    m_timeStep = timeStep;
+    m_modelTime = 0.0;
+    m_timings.clear();
+    m_timings.reserve(m_numFrames);
+    m_frameTimes.Reset();
+
+    return true;
+}
+
+bool CameraReplay::Step(Backend& backend)
+{
+    if (!m_pPath || m_timings.size() >= m_numFrames) return false;
+
+    Timing timing;
+    timing.PathFrame = static_cast<uint32_t>(m_timings.size() % m_pPath->GetNumFrames());
+    const auto& frame = m_pPath->GetFrame(timing.PathFrame);
+    timing.TimeStep = frame.IsPaused ? 0.0f : m_timeStep;
+
+    const auto start = GetTimeNs();
+    backend.UpdateFrame(frame, timing.TimeStep);
+    const auto updated = GetTimeNs();
+    backend.RenderFrame();
+    const auto end = GetTimeNs();
+
+    timing.UpdateTime = (updated - start) * 1e-6;
+    timing.RenderTime = (end - updated) * 1e-6;
+    m_timings.push_back(timing);
+    m_frameTimes.Record(end - start);
+    m_modelTime += timing.TimeStep;
+
+    return true;
+}
+
+void CameraReplay::Run(Backend& backend)
+{
+    while (Step(backend));
+}
+
+uint32_t CameraReplay::GetNumFrames() const
+{
+    return m_numFrames;
+}
+
+uint32_t CameraReplay::GetNumPlayedFrames() const
+{
+    return static_cast<uint32_t>(m_timings.size());
+}
+
+double CameraReplay::GetModelTime() const
+{
+    return m_modelTime;
+}
+
+const CameraReplay::Timing* CameraReplay::GetTimings() const
+{
+    return m_timings.data();
+}
+
+const FrameHistogram& CameraReplay::GetHistogram() const
+{
+    return m_frameTimes;
+}
+
+bool CameraReplay::WriteCSV(const char* fileName) const
+{
+    ofstream file(fileName);
+    if (!file) return false;
+
+    file << "frame,path frame,time step (s),update (ms),render (ms)" << endl;
+    for (size_t i = 0; i < m_timings.size(); ++i)
+    {
+        const auto& timing = m_timings[i];
+        file << i << "," << timing.PathFrame << "," << setprecision(9) << timing.TimeStep << "," << fixed <<
+            setprecision(4) << timing.UpdateTime << "," << timing.RenderTime << defaultfloat << endl;
+    }
+
+    return file.good();
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameRecorder.h"
+
+// Camera and controls of each frame, as recorded from the application. Saved as CSV with
+// 9 significant digits, so that the floats load back bit-exact.
+class CameraPath
+{
+public:
+    struct Frame
+    {
+        float       EyePt[3];
+        float       View[16];   // Row-major, as XMFLOAT4X4
+        uint32_t    TessFactor;
+        bool        IsPaused;
+    };
+
+    CameraPath();
+    virtual ~CameraPath();
+
+    void Clear();
+    void Append(const Frame& frame);
+
+    bool Save(const char* fileName) const;
+    bool Load(const char* fileName);
+
+    uint32_t GetNumFrames() const;
+    const Frame& GetFrame(uint32_t i) const;    // Wraps around past the last frame
+
+protected:
+    std::vector<Frame> m_frames;
+};
+
+// Replays a camera path at a fixed time step, whatever the wall time, so that two runs
+// update the same frames; paused frames step by 0. The update and the render of each
+// frame are timed separately.
+class CameraReplay
+{
+public:
+    // What the replay drives: the application, a headless tracer or a stub
+    class Backend
+    {
+    public:
+        virtual ~Backend() {}
+
+        virtual void UpdateFrame(const CameraPath::Frame& frame, float timeStep) = 0;
+        virtual void RenderFrame() = 0;
+    };
+
+    struct Timing
+    {
+        uint32_t    PathFrame;
+        float       TimeStep;
+        double      UpdateTime; // In ms
+        double      RenderTime;
+    };
+
+    CameraReplay();
+    virtual ~CameraReplay();
+
+    // The path is looped up to numFrames, or played once if it is 0
+    bool Init(const CameraPath& path, uint32_t numFrames = 0, float timeStep = 1.0f / 60.0f);
+
+    // Updates and renders the next frame; false once all the frames have been played
+    bool Step(Backend& backend);
+    void Run(Backend& backend);
+
+    uint32_t GetNumFrames() const;
+    uint32_t GetNumPlayedFrames() const;
+    double GetModelTime() const;    // Sum of the time steps so far
+    const Timing* GetTimings() const;
+    const FrameHistogram& GetHistogram() const; // Of the update plus the render
+
+    // One row per frame, with the path frame, the time step and the times in ms
+    bool WriteCSV(const char* fileName) const;
+
+protected:
+    const CameraPath*   m_pPath;
+    std::vector<Timing> m_timings;
+    FrameHistogram      m_frameTimes;
+    uint32_t            m_numFrames;
+    float               m_timeStep;
+    double              m_modelTime;
+};
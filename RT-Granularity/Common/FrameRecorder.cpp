@@ -0,0 +1,190 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "FrameRecorder.h"
+
+using namespace std;
+
+uint64_t GetTimeNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t floorLog2(uint64_t x)
+{
+    auto result = 0u;
+    for (auto shift = 32u; shift > 0; shift >>= 1)
+    {
+        if (x >> shift)
+        {
+            x >>= shift;
+            result += shift;
+        }
+    }
+
+    return result;
+}
+
+FrameHistogram::FrameHistogram()
+{
+    Reset();
+}
+
+FrameHistogram::~FrameHistogram()
+{
+}
+
+void FrameHistogram::Record(uint64_t ns)
+{
+    m_counts[getBucket(ns)].fetch_add(1, memory_order_relaxed);
+    m_count.fetch_add(1, memory_order_relaxed);
+    m_sum.fetch_add(ns, memory_order_relaxed);
+
+    auto max = m_max.load(memory_order_relaxed);
+    while (ns > max && !m_max.compare_exchange_weak(max, ns, memory_order_relaxed));
+}
+
+void FrameHistogram::Reset()
+{
+    for (auto& count : m_counts) count.store(0, memory_order_relaxed);
+    m_count.store(0, memory_order_relaxed);
+    m_sum.store(0, memory_order_relaxed);
+    m_max.store(0, memory_order_relaxed);
+}
+
+double FrameHistogram::GetPercentile(double percentile) const
+{
+    const auto count = GetCount();
+    if (count == 0) return 0.0;
+
+    // The bucket of the sample at the rank, counting from 1
+    const auto rank = (max)(static_cast<uint64_t>(ceil(percentile / 100.0 * count)), static_cast<uint64_t>(1));
+    uint64_t numBelow = 0;
+    for (auto i = 0u; i < NumBuckets; ++i)
+    {
+        numBelow += m_counts[i].load(memory_order_relaxed);
+        if (numBelow >= rank) return (min)(getBucketMiddle(i) * 1e-6, GetMax());
+    }
+
+    return GetMax();
+}
+
+double FrameHistogram::GetMean() const
+{
+    const auto count = GetCount();
+
+    return count ? m_sum.load(memory_order_relaxed) * 1e-6 / count : 0.0;
+}
+
+double FrameHistogram::GetMax() const
+{
+    return m_max.load(memory_order_relaxed) * 1e-6;
+}
+
+uint64_t FrameHistogram::GetCount() const
+{
+    return m_count.load(memory_order_relaxed);
+}
+
+// Linear up to 2^(SubBucketBits + 1) ns, then SubBucketBits of mantissa per power of 2
+uint32_t FrameHistogram::getBucket(uint64_t ns)
+{
+    const auto subBucketCount = 1u << SubBucketBits;
+    if (ns < 2 * subBucketCount) return static_cast<uint32_t>(ns);
+
+    const auto exponent = floorLog2(ns);
+    const auto mantissa = static_cast<uint32_t>(ns >> (exponent - SubBucketBits));
+
+    return ((exponent - SubBucketBits) << SubBucketBits) + mantissa;
+}
+
+double FrameHistogram::getBucketMiddle(uint32_t bucket)
+{
+    const auto subBucketCount = 1u << SubBucketBits;
+    if (bucket < 2 * subBucketCount) return bucket;
+
+    const auto shift = (bucket >> SubBucketBits) - 1;
+    const auto mantissa = (bucket & (subBucketCount - 1)) + subBucketCount;
+
+    return ldexp(mantissa + 0.5, shift);
+}
+
+FrameRecorder::FrameRecorder() :
+    m_phaseTimes(),
+    m_frameStart(0),
+    m_lapStart(0)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+}
+
+void FrameRecorder::BeginFrame()
+{
+    const auto time = GetTimeNs();
+    if (m_frameStart > 0)
+    {
+        m_phaseTimes[FRAME] = time - m_frameStart;
+        endFrame();
+    }
+
+    m_frameStart = time;
+    m_lapStart = time;
+}
+
+void FrameRecorder::Lap(Phase phase)
+{
+    // Laps before the first frame, as the waits of the initialization, are not recorded
+    if (m_frameStart == 0) return;
+
+    const auto time = GetTimeNs();
+    m_phaseTimes[phase] += time - m_lapStart;
+    m_lapStart = time;
+}
+
+void FrameRecorder::Reset()
+{
+    for (auto& histogram : m_histograms) histogram.Reset();
+    memset(m_phaseTimes, 0, sizeof(m_phaseTimes));
+    m_frameStart = 0;
+    m_lapStart = 0;
+}
+
+const FrameHistogram& FrameRecorder::GetHistogram(Phase phase) const
+{
+    return m_histograms[phase];
+}
+
+bool FrameRecorder::WriteCSV(const char* fileName) const
+{
+    ofstream file(fileName);
+    if (!file) return false;
+
+    file << "phase,frames,mean (ms),p50 (ms),p95 (ms),p99 (ms),max (ms)" << endl;
+    for (auto i = 0u; i < NUM_PHASE; ++i)
+    {
+        const auto& histogram = m_histograms[i];
+        file << GetPhaseName(static_cast<Phase>(i)) << "," << histogram.GetCount() << "," << fixed <<
+            setprecision(4) << histogram.GetMean() << "," << histogram.GetPercentile(50.0) << "," <<
+            histogram.GetPercentile(95.0) << "," << histogram.GetPercentile(99.0) << "," <<
+            histogram.GetMax() << endl;
+    }
+
+    return file.good();
+}
+
+const char* FrameRecorder::GetPhaseName(Phase phase)
+{
+    static const char* names[] = { "frame", "submit", "present", "wait" };
+
+    return names[phase];
+}
+
+void FrameRecorder::endFrame()
+{
+    for (auto i = 0u; i < NUM_PHASE; ++i) m_histograms[i].Record(m_phaseTimes[i]);
+    memset(m_phaseTimes, 0, sizeof(m_phaseTimes));
+}
@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Nanoseconds of the monotonic clock, std::chrono::steady_clock: QueryPerformanceCounter
+// with MSVC, clock_gettime(CLOCK_MONOTONIC) on Linux
+uint64_t GetTimeNs();
+
+// Histogram of durations with 32 buckets per power of 2, so that the percentiles are within
+// 1/64 of the times; the max is exact. Record is lock-free and may be called from any thread.
+class FrameHistogram
+{
+public:
+    FrameHistogram();
+    virtual ~FrameHistogram();
+
+    void Record(uint64_t ns);
+    void Reset();   // Not concurrently with Record
+
+    // In ms; the percentile is in [0, 100]
+    double GetPercentile(double percentile) const;
+    double GetMean() const;
+    double GetMax() const;
+    uint64_t GetCount() const;
+
+    static const uint32_t SubBucketBits = 5;
+    static const uint32_t NumBuckets = (65 - SubBucketBits) << SubBucketBits;
+
+protected:
+    static uint32_t getBucket(uint64_t ns);
+    static double getBucketMiddle(uint32_t bucket);
+
+    std::atomic<uint32_t>   m_counts[NumBuckets];
+    std::atomic<uint64_t>   m_count;
+    std::atomic<uint64_t>   m_sum;
+    std::atomic<uint64_t>   m_max;
+};
+
+// Frame times split by phase. BeginFrame records the time since the previous frame, and
+// each Lap charges the time since the previous lap or the frame start to its phase. The
+// phases are summed per frame, so a frame that does not wait records a wait of 0.
+class FrameRecorder
+{
+public:
+    enum Phase : uint8_t
+    {
+        FRAME,
+        SUBMIT,     // CPU time to update and record the frame, and submit it
+        PRESENT,
+        WAIT,       // For the GPU, on the fences
+
+        NUM_PHASE
+    };
+
+    FrameRecorder();
+    virtual ~FrameRecorder();
+
+    void BeginFrame();
+    void Lap(Phase phase);
+    void Reset();
+
+    const FrameHistogram& GetHistogram(Phase phase) const;
+
+    // One row per phase, with the frames, and the mean, percentiles and max in ms
+    bool WriteCSV(const char* fileName) const;
+
+    static const char* GetPhaseName(Phase phase);
+
+protected:
+    void endFrame();
+
+    FrameHistogram  m_histograms[NUM_PHASE];
+    uint64_t        m_phaseTimes[NUM_PHASE];    // Of the current frame
+    uint64_t        m_frameStart;
+    uint64_t        m_lapStart;
+};
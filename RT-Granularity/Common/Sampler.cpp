@@ -0,0 +1,259 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Sampler.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// 2^32 / 3^20 as a multiplier and a shift of 31, and the R2 steps: 2^32 over the plastic
+// number and its square
+static const uint32_t Base3Digits = 20;
+static const uint32_t Base3Scale = 2645237266u;
+static const uint32_t R2StepX = 3242174889u;
+static const uint32_t R2StepY = 2447445414u;
+
+static uint32_t hashSeed(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+
+    return x;
+}
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+
+    return x;
+}
+
+// Owen scrambling of the bits from the top, as the Laine-Karras permutation of the reversed bits
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+
+    return reverseBits(x);
+}
+
+static uint32_t radicalInverse3(uint32_t i)
+{
+    auto reversed = 0u;
+    for (auto k = 0u; k < Base3Digits; ++k)
+    {
+        const auto q = static_cast<uint32_t>((static_cast<uint64_t>(i) * 0xaaaaaaabu) >> 33);
+        reversed = reversed * 3 + (i - q * 3);
+        i = q;
+    }
+
+    return static_cast<uint32_t>((static_cast<uint64_t>(reversed) * Base3Scale) >> 31);
+}
+
+// Second dimension of Sobol: the direction numbers of x + 1
+static uint32_t sobol1(uint32_t i)
+{
+    auto result = 0u;
+    for (auto v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+        if (i & 1) result ^= v;
+
+    return result;
+}
+
+// Cranley-Patterson rotation: R2 starts at 1/2 unless seeded, and Halton only moves when seeded
+static void getRotation(Sampler::Type type, uint32_t seed, uint32_t& x, uint32_t& y)
+{
+    const auto origin = type == Sampler::R2 ? 1u << 31 : 0u;
+    x = seed ? hashSeed(seed) : origin;
+    y = seed ? hashSeed(seed ^ 0x9e3779b9u) : origin;
+}
+
+// 24-bit floats in [0, 1)
+static float toFloat(uint32_t x)
+{
+    return static_cast<float>(x >> 8) * 5.96046448e-8f;
+}
+
+Sampler::Sampler(Type type) :
+    m_type(type)
+{
+}
+
+Sampler::~Sampler()
+{
+}
+
+Sampler::Point Sampler::Get(uint32_t index, uint32_t seed) const
+{
+    uint32_t x, y;
+    getRotation(m_type, seed, x, y);
+    switch (m_type)
+    {
+    case SOBOL:
+        // The index is shuffled as well, which keeps the power-of-2 prefixes nets
+        index = owenScramble(index, hashSeed(seed));
+        x = owenScramble(reverseBits(index), hashSeed(seed ^ 0x9e3779b9u));
+        y = owenScramble(sobol1(index), hashSeed(seed ^ 0x3c6ef372u));
+        break;
+    case R2:
+        x += index * R2StepX;
+        y += index * R2StepY;
+        break;
+    default:
+        x += reverseBits(index);
+        y += radicalInverse3(index);
+    }
+
+    return { toFloat(x), toFloat(y) };
+}
+
+#if defined(__AVX2__)
+static __m256i reverseBits(__m256i x)
+{
+    const auto bytes = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const auto nibbles = _mm256_setr_epi8(0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf,
+        0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+    const auto mask = _mm256_set1_epi8(0x0f);
+    x = _mm256_shuffle_epi8(x, bytes);
+    const auto lo = _mm256_shuffle_epi8(nibbles, _mm256_and_si256(x, mask));
+    const auto hi = _mm256_shuffle_epi8(nibbles, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+
+    return _mm256_or_si256(_mm256_slli_epi16(lo, 4), hi);
+}
+
+static __m256i owenScramble(__m256i x, uint32_t seed)
+{
+    x = _mm256_add_epi32(reverseBits(x), _mm256_set1_epi32(static_cast<int>(seed)));
+    x = _mm256_xor_si256(x, _mm256_mullo_epi32(x, _mm256_set1_epi32(0x6c50b47c)));
+    x = _mm256_xor_si256(x, _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0xb82f1e52u))));
+    x = _mm256_xor_si256(x, _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0xc7afe638u))));
+    x = _mm256_xor_si256(x, _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0x8d22f6e6u))));
+
+    return reverseBits(x);
+}
+
+// High halves of the 32x32-bit products, shifted right by a further shift bits
+static __m256i mulHi(__m256i x, __m256i m, int shift)
+{
+    const auto even = _mm256_srli_epi64(_mm256_mul_epu32(x, m), 32 + shift);
+    const auto odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), m), 32 + shift);
+
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+}
+
+static __m256i radicalInverse3(__m256i i)
+{
+    const auto oneThird = _mm256_set1_epi32(static_cast<int>(0xaaaaaaabu));
+    auto reversed = _mm256_setzero_si256();
+    for (auto k = 0u; k < Base3Digits; ++k)
+    {
+        const auto q = mulHi(i, oneThird, 1);
+        const auto q3 = _mm256_add_epi32(q, _mm256_add_epi32(q, q));
+        reversed = _mm256_add_epi32(_mm256_add_epi32(reversed, _mm256_add_epi32(reversed, reversed)),
+            _mm256_sub_epi32(i, q3));
+        i = q;
+    }
+
+    // (reversed * scale) >> 31, as the high half shifted left by 1 with the top bit of the low half
+    const auto scale = _mm256_set1_epi32(static_cast<int>(Base3Scale));
+    const auto even = _mm256_srli_epi64(_mm256_mul_epu32(reversed, scale), 31);
+    const auto odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(reversed, 32), scale), 31);
+
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+}
+
+static __m256i sobol1(__m256i i)
+{
+    auto result = _mm256_setzero_si256();
+    auto v = 1u << 31;
+    for (auto k = 0; k < 32; ++k, v ^= v >> 1)
+    {
+        const auto bit = _mm256_slli_epi32(i, 31 - k);
+        const auto mask = _mm256_srai_epi32(bit, 31);
+        result = _mm256_xor_si256(result, _mm256_and_si256(mask, _mm256_set1_epi32(static_cast<int>(v))));
+    }
+
+    return result;
+}
+
+static __m256 toFloat(__m256i x)
+{
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(5.96046448e-8f));
+}
+#endif
+
+void Sampler::Get(uint32_t firstIndex, uint32_t count, uint32_t seed, float* pX, float* pY) const
+{
+    auto i = 0u;
+#if defined(__AVX2__)
+    uint32_t rotationX, rotationY;
+    getRotation(m_type, seed, rotationX, rotationY);
+    const auto offsetX = _mm256_set1_epi32(static_cast<int>(rotationX));
+    const auto offsetY = _mm256_set1_epi32(static_cast<int>(rotationY));
+    const auto lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (; i + 8 <= count; i += 8)
+    {
+        auto index = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(firstIndex + i)), lanes);
+        __m256i x, y;
+        switch (m_type)
+        {
+        case SOBOL:
+            index = owenScramble(index, hashSeed(seed));
+            x = owenScramble(reverseBits(index), hashSeed(seed ^ 0x9e3779b9u));
+            y = owenScramble(sobol1(index), hashSeed(seed ^ 0x3c6ef372u));
+            break;
+        case R2:
+            x = _mm256_add_epi32(offsetX, _mm256_mullo_epi32(index, _mm256_set1_epi32(static_cast<int>(R2StepX))));
+            y = _mm256_add_epi32(offsetY, _mm256_mullo_epi32(index, _mm256_set1_epi32(static_cast<int>(R2StepY))));
+            break;
+        default:
+            x = _mm256_add_epi32(reverseBits(index), offsetX);
+            y = _mm256_add_epi32(radicalInverse3(index), offsetY);
+        }
+
+        _mm256_storeu_ps(&pX[i], toFloat(x));
+        _mm256_storeu_ps(&pY[i], toFloat(y));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const auto point = Get(firstIndex + i, seed);
+        pX[i] = point.x;
+        pY[i] = point.y;
+    }
+}
+
+Sampler::Type Sampler::GetType() const
+{
+    return m_type;
+}
+
+uint32_t Sampler::GetPixelSeed(uint32_t x, uint32_t y, uint32_t seed)
+{
+    return hashSeed(x + hashSeed(y + hashSeed(seed)));
+}
+
+const char* Sampler::GetName(Type type)
+{
+    static const char* names[] = { "Halton", "Sobol", "R2" };
+
+    return names[type];
+}
@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Low-discrepancy 2D sequences with stateless indexed access: the Halton sequence (2, 3),
+// Sobol with hash-based Owen scrambling, and the R2 sequence. A sampler holds no state
+// past its type, so any thread may draw any point. Seeds decorrelate the pixels: Sobol is
+// scrambled and shuffled per seed, Halton and R2 get a Cranley-Patterson rotation, and
+// seed 0 leaves Halton as it is. Points are in [0, 1) with 24-bit precision; Halton drops
+// the digits past the 20th in base 3, for indices from 3^20.
+// Shared with RT-CPU, so it only relies on the standard library.
+class Sampler
+{
+public:
+    enum Type : uint8_t
+    {
+        HALTON,
+        SOBOL,
+        R2,
+
+        NUM_TYPE
+    };
+
+    struct Point
+    {
+        float x;
+        float y;
+    };
+
+    Sampler(Type type = HALTON);
+    virtual ~Sampler();
+
+    Point Get(uint32_t index, uint32_t seed = 0) const;
+
+    // Points firstIndex to firstIndex + count - 1, 8 at a time with AVX2 if enabled
+    void Get(uint32_t firstIndex, uint32_t count, uint32_t seed, float* pX, float* pY) const;
+
+    Type GetType() const;
+
+    // Seed of pixel (x, y) for the frame or sequence seed
+    static uint32_t GetPixelSeed(uint32_t x, uint32_t y, uint32_t seed = 0);
+    static const char* GetName(Type type);
+
+protected:
+    Type m_type;
+};
@@ -0,0 +1,335 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "Accumulator.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+#define ACCUMULATE_GROUP_SIZE   8
+#define RMSE_GROUP_SIZE         16
+
+Accumulator::Accumulator(const Device::sptr& device) :
+    m_device(device),
+    m_isEnabled(false),
+    m_isCaptureRequested(false),
+    m_hasReference(false),
+    m_tessFactor(0),
+    m_numSamples(0),
+    m_numReferenceSamples(0),
+    m_numAutoRefSamples(0),
+    m_numMeasuredSamples(0),
+    m_pendingSamples(),
+    m_rmse(0.0f),
+    m_pSource(nullptr),
+    m_pDescriptorTableCache(nullptr)
+{
+    m_shaderPool = ShaderPool::MakeUnique();
+    m_computePipelineCache = Compute::PipelineCache::MakeUnique(device.get());
+    m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(device.get());
+}
+
+Accumulator::~Accumulator()
+{
+}
+
+bool Accumulator::Init(
+    uint32_t              width,
+    uint32_t              height,
+    Texture2D*            pSource,
+    DescriptorTableCache* pDescriptorTableCache)
+{
+    m_viewport = XMUINT2(width, height);
+    m_numGroups = XMUINT2(DIV_UP(width, RMSE_GROUP_SIZE), DIV_UP(height, RMSE_GROUP_SIZE));
+    m_pSource = pSource;
+    m_pDescriptorTableCache = pDescriptorTableCache;
+    XMStoreFloat4x4(&m_viewProj, XMMatrixIdentity());
+
+    // Create the running average and the reference image in full precision,
+    // since R11G11B10 cannot represent small per-frame increments.
+    m_accumulation = Texture2D::MakeUnique();
+    N_RETURN(m_accumulation->Create(m_device.get(), width, height, Format::R32G32B32A32_FLOAT, 1,
+        ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE,
+        L"Accumulation"), false);
+
+    m_reference = Texture2D::MakeUnique();
+    N_RETURN(m_reference->Create(m_device.get(), width, height, Format::R32G32B32A32_FLOAT, 1,
+        ResourceFlag::NONE, 1, 1, false, MemoryFlag::NONE, L"AccumulationReference"), false);
+
+    // Per-group sums of squared errors, and their CPU-readable copies
+    const auto numGroups = m_numGroups.x * m_numGroups.y;
+    m_errors = StructuredBuffer::MakeUnique();
+    N_RETURN(m_errors->Create(m_device.get(), numGroups, sizeof(float),
+        ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 0, nullptr,
+        1, nullptr, MemoryFlag::NONE, L"AccumulationErrors"), false);
+
+    for (uint8_t i = 0; i < FrameCount; ++i)
+    {
+        m_readbacks[i] = RawBuffer::MakeUnique();
+        N_RETURN(m_readbacks[i]->Create(m_device.get(), sizeof(float) * numGroups, ResourceFlag::NONE,
+            MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE,
+            (L"AccumulationErrorReadback" + to_wstring(i)).c_str()), false);
+    }
+
+    N_RETURN(createPipelineLayouts(), false);
+    N_RETURN(createPipelines(), false);
+    N_RETURN(createDescriptorTables(), false);
+
+    return true;
+}
+
+void Accumulator::UpdateFrame(
+    uint8_t   frameIndex,
+    CXMMATRIX viewProj,
+    float     timeStep,
+    uint32_t  tessFactor)
+{
+    // The results of the frame that previously used this slot are ready
+    readbackRMSE(frameIndex);
+
+    // Restart the accumulation whenever the image is expected to change
+    XMFLOAT4X4 viewProjF;
+    XMStoreFloat4x4(&viewProjF, viewProj);
+    if (timeStep > 0.0f || tessFactor != m_tessFactor || memcmp(&viewProjF, &m_viewProj, sizeof(XMFLOAT4X4)) != 0)
+    {
+        Reset();
+        invalidateReference();
+    }
+
+    m_viewProj = viewProjF;
+    m_tessFactor = tessFactor;
+}
+
+void Accumulator::Accumulate(const CommandList* pCommandList, uint8_t frameIndex)
+{
+    ResourceBarrier barriers[3];
+    auto numBarriers = m_pSource->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+    numBarriers = m_accumulation->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+    pCommandList->Barrier(numBarriers, barriers);
+
+    // Blend the current frame into the running average
+    pCommandList->SetComputePipelineLayout(m_pipelineLayouts[ACCUMULATE]);
+    pCommandList->SetComputeDescriptorTable(0, m_srvTables[SRV_TABLE_SOURCE]);
+    pCommandList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_ACCUM]);
+    pCommandList->SetCompute32BitConstant(2, m_numSamples);
+    pCommandList->SetPipelineState(m_pipelines[ACCUMULATE]);
+    pCommandList->Dispatch(DIV_UP(m_viewport.x, ACCUMULATE_GROUP_SIZE), DIV_UP(m_viewport.y, ACCUMULATE_GROUP_SIZE), 1);
+    ++m_numSamples;
+
+    // Measure the error against the reference
+    m_pendingSamples[frameIndex] = 0;
+    if (m_hasReference)
+    {
+        numBarriers = m_accumulation->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+        numBarriers = m_reference->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+        numBarriers = m_errors->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+        pCommandList->Barrier(numBarriers, barriers);
+
+        pCommandList->SetComputePipelineLayout(m_pipelineLayouts[RMSE]);
+        pCommandList->SetComputeDescriptorTable(0, m_srvTables[SRV_TABLE_ACCUM_REF]);
+        pCommandList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_ERRORS]);
+        pCommandList->SetCompute32BitConstant(2, m_numGroups.x);
+        pCommandList->SetPipelineState(m_pipelines[RMSE]);
+        pCommandList->Dispatch(m_numGroups.x, m_numGroups.y, 1);
+
+        numBarriers = m_errors->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+        pCommandList->Barrier(numBarriers, barriers);
+        pCommandList->CopyBufferRegion(m_readbacks[frameIndex].get(), 0, m_errors.get(), 0,
+            sizeof(float) * m_numGroups.x * m_numGroups.y);
+        m_pendingSamples[frameIndex] = m_numSamples;
+    }
+
+    // Keep the current accumulation as the reference, and measure the next one against it
+    if (!m_hasReference && m_numAutoRefSamples > 0 && m_numSamples >= m_numAutoRefSamples)
+        m_isCaptureRequested = true;
+    if (m_isCaptureRequested)
+    {
+        numBarriers = m_accumulation->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+        numBarriers = m_reference->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
+        pCommandList->Barrier(numBarriers, barriers);
+        pCommandList->CopyResource(m_reference.get(), m_accumulation.get());
+
+        m_isCaptureRequested = false;
+        m_hasReference = true;
+        m_numReferenceSamples = m_numSamples;
+        Reset();
+    }
+
+    numBarriers = m_pSource->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+    numBarriers = m_accumulation->SetBarrier(barriers, ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
+    pCommandList->Barrier(numBarriers, barriers);
+}
+
+void Accumulator::SetEnabled(bool enabled)
+{
+    if (enabled != m_isEnabled) Reset();
+    m_isEnabled = enabled;
+}
+
+void Accumulator::Reset()
+{
+    // The measurements of the previous accumulation do not belong to the next series
+    m_numSamples = 0;
+    m_numMeasuredSamples = 0;
+    for (auto& pendingSamples : m_pendingSamples) pendingSamples = 0;
+}
+
+void Accumulator::CaptureReference()
+{
+    m_isCaptureRequested = m_isEnabled;
+}
+
+void Accumulator::SetAutoReference(uint32_t numSamples)
+{
+    m_numAutoRefSamples = numSamples;
+}
+
+bool Accumulator::IsEnabled() const
+{
+    return m_isEnabled;
+}
+
+bool Accumulator::HasReference() const
+{
+    return m_hasReference;
+}
+
+uint32_t Accumulator::GetNumSamples() const
+{
+    return m_numSamples;
+}
+
+uint32_t Accumulator::GetNumReferenceSamples() const
+{
+    return m_numReferenceSamples;
+}
+
+uint32_t Accumulator::GetNumMeasuredSamples() const
+{
+    return m_numMeasuredSamples;
+}
+
+float Accumulator::GetRMSE() const
+{
+    return m_rmse;
+}
+
+const DescriptorTable& Accumulator::GetSRVTable() const
+{
+    return m_srvTables[SRV_TABLE_ACCUM];
+}
+
+bool Accumulator::createPipelineLayouts()
+{
+    // Accumulation
+    {
+        const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+        pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+        pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0);
+        pipelineLayout->SetConstants(2, 1, 0);
+        X_RETURN(m_pipelineLayouts[ACCUMULATE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutCache.get(),
+            PipelineLayoutFlag::NONE, L"AccumulationPipelineLayout"), false);
+    }
+
+    // Error measurement
+    {
+        const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+        pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+        pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0);
+        pipelineLayout->SetConstants(2, 1, 0);
+        X_RETURN(m_pipelineLayouts[RMSE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutCache.get(),
+            PipelineLayoutFlag::NONE, L"RMSEPipelineLayout"), false);
+    }
+
+    return true;
+}
+
+bool Accumulator::createPipelines()
+{
+    N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, ACCUMULATE, L"CSAccumulate.cso"), false);
+    N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, RMSE, L"CSRMSE.cso"), false);
+
+    for (uint8_t i = 0; i < NUM_PIPELINE; ++i)
+    {
+        const wchar_t* names[] = { L"Accumulation", L"RMSE" };
+        const auto state = Compute::State::MakeUnique();
+        state->SetPipelineLayout(m_pipelineLayouts[i]);
+        state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, i));
+        X_RETURN(m_pipelines[i], state->GetPipeline(m_computePipelineCache.get(), names[i]), false);
+    }
+
+    return true;
+}
+
+bool Accumulator::createDescriptorTables()
+{
+    // Source SRV
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_pSource->GetSRV());
+        X_RETURN(m_srvTables[SRV_TABLE_SOURCE], descriptorTable->GetCbvSrvUavTable(m_pDescriptorTableCache), false);
+    }
+
+    // Accumulation and reference SRVs
+    {
+        const Descriptor descriptors[] = { m_accumulation->GetSRV(), m_reference->GetSRV() };
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_ACCUM_REF], descriptorTable->GetCbvSrvUavTable(m_pDescriptorTableCache), false);
+    }
+
+    // Accumulation SRV for tone mapping
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_accumulation->GetSRV());
+        X_RETURN(m_srvTables[SRV_TABLE_ACCUM], descriptorTable->GetCbvSrvUavTable(m_pDescriptorTableCache), false);
+    }
+
+    // Accumulation UAV
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_accumulation->GetUAV());
+        X_RETURN(m_uavTables[UAV_TABLE_ACCUM], descriptorTable->GetCbvSrvUavTable(m_pDescriptorTableCache), false);
+    }
+
+    // Error UAV
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_errors->GetUAV());
+        X_RETURN(m_uavTables[UAV_TABLE_ERRORS], descriptorTable->GetCbvSrvUavTable(m_pDescriptorTableCache), false);
+    }
+
+    return true;
+}
+
+void Accumulator::invalidateReference()
+{
+    // The reference shows a different image now; the measurements against it
+    // are already dropped by Reset().
+    m_hasReference = false;
+    m_numReferenceSamples = 0;
+    m_rmse = 0.0f;
+}
+
+void Accumulator::readbackRMSE(uint8_t frameIndex)
+{
+    if (m_pendingSamples[frameIndex] == 0) return;
+
+    const auto numGroups = m_numGroups.x * m_numGroups.y;
+    const auto pErrors = reinterpret_cast<const float*>(m_readbacks[frameIndex]->Map(0, 0, sizeof(float) * numGroups));
+    if (pErrors)
+    {
+        // Sum in double precision, as the partial sums span several orders of magnitude
+        auto sum = 0.0;
+        for (auto i = 0u; i < numGroups; ++i) sum += pErrors[i];
+        m_readbacks[frameIndex]->Unmap();
+
+        m_rmse = static_cast<float>(sqrt(sum / (3.0 * m_viewport.x * m_viewport.y)));
+        m_numMeasuredSamples = m_pendingSamples[frameIndex];
+    }
+
+    m_pendingSamples[frameIndex] = 0;
+}
@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+// Progressive accumulation of the jittered ray-tracing output.
+// While the camera and the scene are still, each frame is blended into a running
+// average; the average is reset as soon as the view, the tessellation factor, or
+// the animation changes. A captured accumulation can serve as the reference image
+// for measuring the convergence (RMSE) of later accumulations of the same image;
+// it is dropped together with the accumulation when the image changes. A capture
+// restarts the accumulation, so that the next one is measured from its first sample,
+// and can also be taken automatically once the accumulation reaches a sample count.
+class Accumulator
+{
+public:
+    Accumulator(const XUSG::Device::sptr& device);
+    virtual ~Accumulator();
+
+    bool Init(uint32_t width, uint32_t height, XUSG::Texture2D* pSource,
+        XUSG::DescriptorTableCache* pDescriptorTableCache);
+    void UpdateFrame(uint8_t frameIndex, DirectX::CXMMATRIX viewProj, float timeStep, uint32_t tessFactor);
+    void Accumulate(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
+
+    void SetEnabled(bool enabled);
+    void Reset();
+    void CaptureReference();
+    void SetAutoReference(uint32_t numSamples);     // 0 to capture only on request
+
+    bool IsEnabled() const;
+    bool HasReference() const;
+    uint32_t GetNumSamples() const;
+    uint32_t GetNumReferenceSamples() const;
+    uint32_t GetNumMeasuredSamples() const;
+    float GetRMSE() const;
+    const XUSG::DescriptorTable& GetSRVTable() const;
+
+    static const uint8_t FrameCount = 3;
+private:
+    enum PipelineIndex : uint8_t
+    {
+        ACCUMULATE,
+        RMSE,
+
+        NUM_PIPELINE
+    };
+
+    enum SRVTable : uint8_t
+    {
+        SRV_TABLE_SOURCE,
+        SRV_TABLE_ACCUM_REF,
+        SRV_TABLE_ACCUM,
+
+        NUM_SRV_TABLE
+    };
+
+    enum UAVTable : uint8_t
+    {
+        UAV_TABLE_ACCUM,
+        UAV_TABLE_ERRORS,
+
+        NUM_UAV_TABLE
+    };
+
+    bool createPipelineLayouts();
+    bool createPipelines();
+    bool createDescriptorTables();
+
+    void invalidateReference();
+    void readbackRMSE(uint8_t frameIndex);
+
+    XUSG::Device::sptr m_device;
+
+    DirectX::XMUINT2    m_viewport;
+    DirectX::XMUINT2    m_numGroups;
+    DirectX::XMFLOAT4X4 m_viewProj;
+
+    bool                m_isEnabled;
+    bool                m_isCaptureRequested;
+    bool                m_hasReference;
+    uint32_t            m_tessFactor;
+    uint32_t            m_numSamples;
+    uint32_t            m_numReferenceSamples;
+    uint32_t            m_numAutoRefSamples;
+    uint32_t            m_numMeasuredSamples;
+    uint32_t            m_pendingSamples[FrameCount];
+    float               m_rmse;
+
+    XUSG::Texture2D*                m_pSource;
+    XUSG::DescriptorTableCache*     m_pDescriptorTableCache;
+
+    XUSG::PipelineLayout            m_pipelineLayouts[NUM_PIPELINE];
+    XUSG::Pipeline                  m_pipelines[NUM_PIPELINE];
+
+    XUSG::DescriptorTable           m_srvTables[NUM_SRV_TABLE];
+    XUSG::DescriptorTable           m_uavTables[NUM_UAV_TABLE];
+
+    XUSG::Texture2D::uptr           m_accumulation;
+    XUSG::Texture2D::uptr           m_reference;
+    XUSG::StructuredBuffer::uptr    m_errors;
+    XUSG::RawBuffer::uptr           m_readbacks[FrameCount];
+
+    XUSG::ShaderPool::uptr                  m_shaderPool;
+    XUSG::Compute::PipelineCache::uptr      m_computePipelineCache;
+    XUSG::PipelineLayoutCache::uptr         m_pipelineLayoutCache;
+};
@@ -4,10 +4,7 @@
 
 #include "stdafx.h"
 #include "PRayTracer.h"
-#include "XUSGObjLoader.h"
-#define _INDEPENDENT_DDS_LOADER_
-#include "Advanced/XUSGDDSLoader.h"
-#undef _INDEPENDENT_DDS_LOADER_
+#include "Sampler.h"
 #include "DirectXPackedVector.h"
 
 using namespace std;
@@ -46,13 +43,15 @@ const wchar_t* PRayTracer::MissShaderNames[] = { L"missRadiance", L"missShadow"
 
 PRayTracer::PRayTracer(const RayTracing::Device::sptr& device) :
     m_device(device),
-    m_instances()
+    m_instances(),
+    m_haltonIndex(0)
 {
     m_shaderPool = ShaderPool::MakeUnique();
     m_rayTracingPipelineCache = RayTracing::PipelineCache::MakeUnique(device.get());
     m_graphicsPipelineCache = Graphics::PipelineCache::MakeUnique(device.get());
     m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(device.get());
     m_descriptorTableCache = DescriptorTableCache::MakeUnique(device.get(), L"RayTracerDescriptorTableCache");
+    m_accumulator = make_unique<Accumulator>(device);
 
     AccelerationStructure::SetUAVCount(NUM_MESH + NUM_HIT_GROUP + 1);
 }
@@ -67,17 +66,14 @@ bool PRayTracer::Init(
     uint32_t                 height,
     vector<Resource::uptr>&  uploaders, 
     GeometryBuffer*          pGeometries, 
-    const char*              fileName,
-    const wchar_t*           envFileName, 
-    Format                   rtFormat, 
-    const XMFLOAT4&          posScale)
+    const SceneAssets&       assets,
+    Format                   rtFormat)
 {
     m_viewport = XMUINT2(width, height);
-    m_posScale = posScale;
+    m_posScale = assets.PosScale;
 
-    // Load inputs
-    ObjLoader objLoader;
-    if (!objLoader.Import(fileName, true, true)) return false;
+    // Create the inputs from the shared model
+    const auto& objLoader = assets.Model;
     auto numVertices = objLoader.GetNumVertices();
     auto numIndices = objLoader.GetNumIndices();
     N_RETURN(createVB(pCommandList, numVertices, objLoader.GetVertexStride(), objLoader.GetVertices(), uploaders), false);
@@ -108,15 +104,7 @@ bool PRayTracer::Init(
         pCbData->Albedos[MODEL_OBJ] = XMFLOAT4(0, 10, 0.8, 0);
     }
 
-    // Load input image
-    {
-        DDS::Loader textureLoader;
-        DDS::AlphaMode alphaMode;
-
-        uploaders.emplace_back(Resource::MakeUnique());
-        N_RETURN(textureLoader.CreateTextureFromFile(m_device.get(), static_cast<XUSG::CommandList*>(pCommandList), envFileName,
-            8192, false, m_lightProbe, uploaders.back().get(), &alphaMode), false);
-    }
+    m_lightProbe = assets.LightProbe;
 
     // Create raytracing pipelines
     N_RETURN(createInputLayout(), false);
@@ -127,74 +115,21 @@ bool PRayTracer::Init(
     N_RETURN(buildAccelerationStructures(pCommandList, pGeometries), false);
     N_RETURN(buildShaderTables(), false);
 
-    return true;
-}
-
-static const XMFLOAT2& IncrementalHalton()
-{
-    static auto haltonBase = XMUINT2(0, 0);
-    static auto halton = XMFLOAT2(0.0f, 0.0f);
+    // Create progressive accumulation
+    N_RETURN(m_accumulator->Init(width, height, m_outputView.get(), m_descriptorTableCache.get()), false);
 
-    // Base 2
-    {
-        // Bottom bit always changes, higher bits
-        // Change less frequently.
-        auto change = 0.5f;
-        auto oldBase = haltonBase.x++;
-        auto diff = haltonBase.x ^ oldBase;
-
-        // Diff will be of the form 0*1+, i.e. one bits up until the last carry.
-        // Expected iterations = 1 + 0.5 + 0.25 + ... = 2
-        do
-        {
-            halton.x += (oldBase & 1) ? -change : change;
-            change *= 0.5f;
-
-            diff = diff >> 1;
-            oldBase = oldBase >> 1;
-        } while (diff);
-    }
-
-    // Base 3
-    {
-        const auto oneThird = 1.0f / 3.0f;
-        auto mask = 0x3u;	// Also the max base 3 digit
-        auto add = 0x1u;	// Amount to add to force carry once digit == 3
-        auto change = oneThird;
-        ++haltonBase.y;
-
-        // Expected iterations: 1.5
-        while (true)
-        {
-            if ((haltonBase.y & mask) == mask)
-            {
-                haltonBase.y += add;	// Force carry into next 2-bit digit
-                halton.y -= 2 * change;
-
-                mask = mask << 2;
-                add = add << 2;
-
-                change *= oneThird;
-            }
-            else
-            {
-                halton.y += change;	// We know digit n has gone from a to a + 1
-                break;
-            }
-        };
-    }
-
-    return halton;
+    return true;
 }
 
 void PRayTracer::UpdateFrame(
     uint8_t   frameIndex, 
     CXMVECTOR eyePt, 
     CXMMATRIX viewProj, 
+    float     modelAngle,
     float     timeStep,
     uint32_t tessFactor)
 {
-    const auto halton = IncrementalHalton();
+    const auto halton = Sampler(Sampler::HALTON).Get(++m_haltonIndex);
     XMFLOAT2 projBias =
     {
         (halton.x * 2.0f - 1.0f) / m_viewport.x,
@@ -202,7 +137,10 @@ void PRayTracer::UpdateFrame(
     };
 
     {
-        const auto projToWorld = XMMatrixInverse(nullptr, viewProj);
+        // Jitter the primary rays only when accumulating
+        const auto jitter = m_accumulator->IsEnabled() ?
+            XMMatrixTranslation(projBias.x, projBias.y, 0.0f) : XMMatrixIdentity();
+        const auto projToWorld = XMMatrixInverse(nullptr, viewProj * jitter);
         RayGenConstants cbRayGen = { XMMatrixTranspose(projToWorld), eyePt };
 
         m_rayGenShaderTables[frameIndex]->Reset();
@@ -214,9 +152,7 @@ void PRayTracer::UpdateFrame(
     }
 
     {
-        static auto angle = 0.0f;
-        angle += 16.0f * timeStep * XM_PI / 180.0f;
-        const auto rot = XMMatrixRotationY(angle);
+        const auto rot = XMMatrixRotationY(modelAngle);
 
         XMMATRIX worlds[NUM_MESH] =
         {
@@ -237,6 +173,8 @@ void PRayTracer::UpdateFrame(
             pCbGlobal->Worlds[i] = m_worlds[i];
         }
     }
+
+    m_accumulator->UpdateFrame(frameIndex, viewProj, timeStep, tessFactor);
 }
 
 void PRayTracer::Render(
@@ -255,6 +193,7 @@ void PRayTracer::Render(
     pCommandList->SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
 
     raytrace(pCommandList, frameIndex);
+    if (m_accumulator->IsEnabled()) m_accumulator->Accumulate(pCommandList, frameIndex);
     toneMap(pCommandList, rtv, numBarriers, pBarriers);
 }
 
@@ -277,6 +216,16 @@ void PRayTracer::UpdateAccelerationStructures(
     m_topLevelAS->Build(pCommandList, m_scratch.get(), m_instances[frameIndex].get(), descriptorPool, true);
 }
 
+Accumulator* PRayTracer::GetAccumulator() const
+{
+    return m_accumulator.get();
+}
+
+uint8_t PRayTracer::GetMaxTessFactor() const
+{
+    return MaxTessFactor;
+}
+
 bool PRayTracer::createVB(
     RayTracing::CommandList* pCommandList, 
     uint32_t                 numVert,
@@ -694,7 +643,8 @@ void PRayTracer::toneMap(
     pCommandList->OMSetRenderTargets(1, &rtv);
 
     pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[TONEMAP_LAYOUT]);
-    pCommandList->SetGraphicsDescriptorTable(0, m_srvTables[SRV_TABLE_RTOUT]);
+    pCommandList->SetGraphicsDescriptorTable(0, m_accumulator->IsEnabled() ?
+        m_accumulator->GetSRVTable() : m_srvTables[SRV_TABLE_RTOUT]);
 
     pCommandList->SetPipelineState(m_pipelines[TONEMAP]);
 
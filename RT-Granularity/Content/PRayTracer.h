@@ -4,33 +4,25 @@
 
 #pragma once
 
-#include "Core/XUSG.h"
-#include "RayTracing/XUSGRayTracing.h"
+#include "RayTracer.h"
 
-class PRayTracer
+class PRayTracer :
+    public RayTracer
 {
 public:
-    enum MeshIndex : uint32_t
-    {
-        GROUND,
-        MODEL_OBJ,
-
-        NUM_MESH
-    };
-
     PRayTracer(const XUSG::RayTracing::Device::sptr& device);
     virtual ~PRayTracer();
 
     bool Init(XUSG::RayTracing::CommandList* pCommandList, uint32_t width, uint32_t height,
         std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometries,
-        const char* fileName, const wchar_t* envFileName, XUSG::Format rtFormat,
-        const DirectX::XMFLOAT4& posScale = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
-    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float timeStep, uint32_t tessFactor);
-    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers);
-    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex);
-
-    static const uint8_t FrameCount = 3;
-    static const uint8_t MinTessFactor = 1;
+        const SceneAssets& assets, XUSG::Format rtFormat) override;
+    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float modelAngle, float timeStep, uint32_t tessFactor) override;
+    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers) override;
+    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex) override;
+
+    Accumulator* GetAccumulator() const override;
+    uint8_t GetMaxTessFactor() const override;
+
     static const uint8_t MaxTessFactor = 5;
 private:
     enum PipelineLayoutIndex : uint8_t
@@ -110,6 +102,7 @@ private:
     uint32_t            m_numIndices[NUM_MESH];
 
     DirectX::XMUINT2    m_viewport;
+    uint32_t            m_haltonIndex;  // Of the jitter, one point per frame
     DirectX::XMFLOAT4   m_posScale;
     DirectX::XMFLOAT4X4 m_worlds[NUM_MESH];
 
@@ -137,6 +130,8 @@ private:
 
     XUSG::ShaderResource::sptr  m_lightProbe;
 
+    std::unique_ptr<Accumulator> m_accumulator;
+
     // Shader tables
     static const wchar_t* HitGroupNames[NUM_HIT_GROUP];
     static const wchar_t* RaygenShaderName;
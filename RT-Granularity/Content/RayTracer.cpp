@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "RayTracer.h"
+#include "PRayTracer.h"
+#include "VRayTracer.h"
+#include "TVRayTracer.h"
+#define _INDEPENDENT_DDS_LOADER_
+#include "Advanced/XUSGDDSLoader.h"
+#undef _INDEPENDENT_DDS_LOADER_
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+uint32_t RayTracer::GetNumVisibleVerts() const
+{
+    return 0;
+}
+
+uint32_t RayTracer::GetNumVerts() const
+{
+    return 0;
+}
+
+void RayTracer::SetTessBufferBudget(size_t budget)
+{
+}
+
+size_t RayTracer::GetTessBufferSize() const
+{
+    return 0;
+}
+
+size_t RayTracer::GetTessBufferBudget() const
+{
+    return 0;
+}
+
+bool RayTracer::LoadSceneAssets(
+    SceneAssets&            assets,
+    const Device*           pDevice,
+    CommandList*            pCommandList,
+    vector<Resource::uptr>& uploaders,
+    const char*             fileName,
+    const wchar_t*          envFileName,
+    const XMFLOAT4&         posScale)
+{
+    assets.PosScale = posScale;
+
+    // Load inputs
+    if (!assets.Model.Import(fileName, true, true)) return false;
+
+    // Load input image
+    {
+        DDS::Loader textureLoader;
+        DDS::AlphaMode alphaMode;
+
+        uploaders.emplace_back(Resource::MakeUnique());
+        N_RETURN(textureLoader.CreateTextureFromFile(pDevice, pCommandList, envFileName,
+            8192, false, assets.LightProbe, uploaders.back().get(), &alphaMode), false);
+    }
+
+    return true;
+}
+
+unique_ptr<RayTracer> RayTracer::Create(Mode mode, const RayTracing::Device::sptr& device)
+{
+    switch (mode)
+    {
+    case PER_PIXEL:
+        return make_unique<PRayTracer>(device);
+    case PER_VERTEX:
+        return make_unique<VRayTracer>(device);
+    case PER_TESS_VERTEX:
+        return make_unique<TVRayTracer>(device);
+    default:
+        return nullptr;
+    }
+}
+
+const wchar_t* RayTracer::GetModeName(Mode mode)
+{
+    static const wchar_t* modeNames[] =
+    {
+        L"Per-pixel Ray Tracing",
+        L"Per-vertex Ray Tracing",
+        L"Per-tessellated-vertex Ray Tracing"
+    };
+
+    return mode < NUM_MODE ? modeNames[mode] : L"Unknown";
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "RayTracing/XUSGRayTracing.h"
+#include "XUSGObjLoader.h"
+#include "Accumulator.h"
+
+// Interface of the ray tracing granularities, so that the backend can be selected and
+// switched at run time. The imported model and the environment texture are loaded
+// once into the scene assets, and shared by all the backends.
+class RayTracer
+{
+public:
+    enum Mode : uint8_t
+    {
+        PER_PIXEL,
+        PER_VERTEX,
+        PER_TESS_VERTEX,
+
+        NUM_MODE
+    };
+
+    enum MeshIndex : uint32_t
+    {
+        GROUND,
+        MODEL_OBJ,
+
+        NUM_MESH
+    };
+
+    struct SceneAssets
+    {
+        XUSG::ObjLoader             Model;
+        XUSG::ShaderResource::sptr  LightProbe;
+        DirectX::XMFLOAT4           PosScale;
+    };
+
+    virtual ~RayTracer() {}
+
+    virtual bool Init(XUSG::RayTracing::CommandList* pCommandList, uint32_t width, uint32_t height,
+        std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometries,
+        const SceneAssets& assets, XUSG::Format rtFormat) = 0;
+    // The model angle is kept by the application, so that it carries over when switching the backend
+    virtual void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj,
+        float modelAngle, float timeStep, uint32_t tessFactor) = 0;
+    virtual void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex,
+        const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers) = 0;
+    virtual void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex) = 0;
+
+    virtual Accumulator* GetAccumulator() const = 0;
+
+    virtual uint8_t GetMaxTessFactor() const = 0;
+
+    // Vertices traced per frame vs. all the vertices, or 0 if the backend does not cull them
+    virtual uint32_t GetNumVisibleVerts() const;
+    virtual uint32_t GetNumVerts() const;
+
+    // Bytes allocated for the tessellated vertices vs. their budget, or 0 without tessellation
+    virtual void SetTessBufferBudget(size_t budget);
+    virtual size_t GetTessBufferSize() const;
+    virtual size_t GetTessBufferBudget() const;
+
+    static bool LoadSceneAssets(SceneAssets& assets, const XUSG::Device* pDevice, XUSG::CommandList* pCommandList,
+        std::vector<XUSG::Resource::uptr>& uploaders, const char* fileName, const wchar_t* envFileName,
+        const DirectX::XMFLOAT4& posScale = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+    static std::unique_ptr<RayTracer> Create(Mode mode, const XUSG::RayTracing::Device::sptr& device);
+    static const wchar_t* GetModeName(Mode mode);
+
+    static const uint8_t FrameCount = 3;
+    static const uint8_t MinTessFactor = 1;
+};
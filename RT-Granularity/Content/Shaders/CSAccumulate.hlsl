@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbPerFrame : register(b0)
+{
+    uint g_numSamples;  // Number of samples already in the accumulation
+};
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture2D<float3>   g_txSource       : register(t0);
+RWTexture2D<float4> g_rwAccumulation : register(u0);
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+    const float3 color = g_txSource[DTid];
+    const float3 accum = g_numSamples > 0 ? g_rwAccumulation[DTid].xyz : 0.0;
+
+    // Running average
+    g_rwAccumulation[DTid] = float4(accum + (color - accum) / (g_numSamples + 1.0), 1.0);
+}
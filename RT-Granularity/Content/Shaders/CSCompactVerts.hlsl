@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "VisibilityCommon.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+RWStructuredBuffer<uint> g_rwVertexStamps[]  : register(u0, space0);
+RWStructuredBuffer<uint> g_rwVisibleVerts[]  : register(u0, space1);
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+// Appends the vertices stamped by CSVisibility.hlsl, with one atomic per wave
+//--------------------------------------------------------------------------------------
+[numthreads(64, 1, 1)]
+void main(uint DTid : SV_DispatchThreadID)
+{
+    const bool isVisible = DTid < g_numVerts && g_rwVertexStamps[g_instanceIdx][DTid] == g_frameStamp;
+    const uint numVisible = WaveActiveCountBits(isVisible);
+
+    uint base = 0;
+    if (WaveIsFirstLane() && numVisible > 0) InterlockedAdd(g_rwVisibleCounts[g_instanceIdx], numVisible, base);
+    base = WaveReadLaneFirst(base);
+
+    if (isVisible) g_rwVisibleVerts[g_instanceIdx][base + WavePrefixCountBits(isVisible)] = DTid;
+}
@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define GROUP_SIZE 16
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbPerFrame : register(b0)
+{
+    uint g_numGroupsX;
+};
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture2D<float3>           g_txAccumulation : register(t0);
+Texture2D<float3>           g_txReference    : register(t1);
+RWStructuredBuffer<float>   g_rwErrors       : register(u0);
+
+groupshared float g_errors[GROUP_SIZE * GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+// Sums the squared errors of a tile in the tone-mapped space of PSToneMap
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint2 DTid : SV_DispatchThreadID, uint2 Gid : SV_GroupID, uint GI : SV_GroupIndex)
+{
+    uint2 dim;
+    g_txAccumulation.GetDimensions(dim.x, dim.y);
+
+    float error = 0.0;
+    if (all(DTid < dim))
+    {
+        float3 color = g_txAccumulation[DTid];
+        float3 ref = g_txReference[DTid];
+        color /= color + 0.5;
+        ref /= ref + 0.5;
+
+        const float3 diff = color - ref;
+        error = dot(diff, diff);
+    }
+    g_errors[GI] = error;
+    GroupMemoryBarrierWithGroupSync();
+
+    // Parallel reduction
+    [unroll]
+    for (uint s = GROUP_SIZE * GROUP_SIZE / 2; s > 0; s >>= 1)
+    {
+        if (GI < s) g_errors[GI] += g_errors[GI + s];
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (GI == 0) g_rwErrors[Gid.y * g_numGroupsX + Gid.x] = g_errors[0];
+}
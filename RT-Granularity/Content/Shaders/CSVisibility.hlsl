@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "VisibilityCommon.hlsli"
+
+#define TRIANGLES_PER_CLUSTER 64
+
+//--------------------------------------------------------------------------------------
+// Structs
+//--------------------------------------------------------------------------------------
+struct Vertex
+{
+    float3 Pos;
+    float3 Norm;
+};
+
+struct Cluster
+{
+    float3 Center;
+    float3 Extents;
+    float3 ConeAxis;
+    float  ConeCutoff;  // Sine of the cone angle, or above 1 for no cone culling
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Buffer<uint>                g_indexBuffers[]    : register(t0, space0);
+StructuredBuffer<Vertex>    g_vertexBuffers[]   : register(t0, space1);
+StructuredBuffer<Cluster>   g_clusters[]        : register(t0, space2);
+RWStructuredBuffer<uint>    g_rwVertexStamps[]  : register(u0, space0);
+
+//--------------------------------------------------------------------------------------
+// Planes of the clip-space frustum that a point is outside of
+//--------------------------------------------------------------------------------------
+uint getOutCode(float4 p)
+{
+    return (p.x > p.w ? 0x1 : 0) | (p.x < -p.w ? 0x2 : 0) | (p.y > p.w ? 0x4 : 0) |
+        (p.y < -p.w ? 0x8 : 0) | (p.z < 0.0 ? 0x10 : 0) | (p.z > p.w ? 0x20 : 0);
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader
+// Stamps the vertices of the front-facing triangles in the frustum, one cluster per group
+//--------------------------------------------------------------------------------------
+[numthreads(TRIANGLES_PER_CLUSTER, 1, 1)]
+void main(uint DTid : SV_DispatchThreadID, uint Gid : SV_GroupID)
+{
+    // Restart the compaction of this frame
+    if (DTid == 0) g_rwVisibleCounts[g_instanceIdx] = 0;
+
+    // Back-facing clusters, whose normal cones face away from the eye
+    const Cluster cluster = g_clusters[g_instanceIdx][Gid];
+    const float3 toCenter = cluster.Center - g_localEyePt;
+    if (dot(toCenter, cluster.ConeAxis) >= cluster.ConeCutoff * length(toCenter) + length(cluster.Extents)) return;
+
+    // Clusters outside the frustum
+    uint outCode = 0x3f;
+    [unroll]
+    for (uint i = 0; i < 8; ++i)
+    {
+        const float3 corner = cluster.Center + cluster.Extents *
+            float3((i & 1) ? 1.0 : -1.0, (i & 2) ? 1.0 : -1.0, (i & 4) ? 1.0 : -1.0);
+        outCode &= getOutCode(mul(float4(corner, 1.0), g_worldViewProj));
+    }
+    if (outCode || DTid >= g_numTriangles) return;
+
+    const uint3 indices =
+    {
+        g_indexBuffers[g_instanceIdx][DTid * 3],
+        g_indexBuffers[g_instanceIdx][DTid * 3 + 1],
+        g_indexBuffers[g_instanceIdx][DTid * 3 + 2]
+    };
+    const float3 p0 = g_vertexBuffers[g_instanceIdx][indices.x].Pos;
+    const float3 p1 = g_vertexBuffers[g_instanceIdx][indices.y].Pos;
+    const float3 p2 = g_vertexBuffers[g_instanceIdx][indices.z].Pos;
+
+    // Clockwise triangles, seen from the eye in the left-handed space, are front-facing
+    if (dot(cross(p1 - p0, p2 - p0), g_localEyePt - p0) <= 0.0) return;
+
+    outCode = getOutCode(mul(float4(p0, 1.0), g_worldViewProj)) &
+        getOutCode(mul(float4(p1, 1.0), g_worldViewProj)) &
+        getOutCode(mul(float4(p2, 1.0), g_worldViewProj));
+    if (outCode) return;
+
+    // All the writers store the same stamp, so no atomics are needed
+    g_rwVertexStamps[g_instanceIdx][indices.x] = g_frameStamp;
+    g_rwVertexStamps[g_instanceIdx][indices.y] = g_frameStamp;
+    g_rwVertexStamps[g_instanceIdx][indices.z] = g_frameStamp;
+}
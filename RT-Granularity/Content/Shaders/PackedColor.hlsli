@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// R11G11B10_FLOAT packing of the intermediate colors, as XMFLOAT3PK: the halves share
+// the exponent of the small floats, so the mantissas are rounded to the nearest of
+// 6, 6 and 5 bits. Negative values are clamped to 0, and large ones to the max finite
+// value, 65024 for red and green, and 64512 for blue.
+//--------------------------------------------------------------------------------------
+uint packR11G11B10(float3 color)
+{
+    color = clamp(color, 0.0, float3(65024.0, 65024.0, 64512.0));
+    const uint3 h = f32tof16(color);
+    const uint r = (h.x + 0x7 + ((h.x >> 4) & 1)) >> 4;
+    const uint g = (h.y + 0x7 + ((h.y >> 4) & 1)) >> 4;
+    const uint b = (h.z + 0xf + ((h.z >> 5) & 1)) >> 5;
+
+    return r | (g << 11) | (b << 22);
+}
+
+float3 unpackR11G11B10(uint color)
+{
+    return f16tof32(uint3(color << 4, color >> 7, color >> 17) & uint3(0x7ff0, 0x7ff0, 0x7fe0));
+}
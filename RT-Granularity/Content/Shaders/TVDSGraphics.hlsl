@@ -1,4 +1,5 @@
 #include "TVTessCommon.hlsli"
+#include "PackedColor.hlsli"
 
 struct PSIn
 {
@@ -13,7 +14,8 @@ cbuffer cbGraphics : register(b1)
     float2   g_projBias;
 };
 
-StructuredBuffer<float3> g_tessColors[] : register(t0);
+StructuredBuffer<uint> g_tessColors[] : register(t0);
+StructuredBuffer<PatchTopology> g_patchTopologies[] : register(t0, space1);
 
 [domain("tri")]
 PSIn main(
@@ -24,12 +26,12 @@ PSIn main(
 {
     PSIn output;
     
-    const uint baseIdx = g_maxVertPerPatch * patchID;
-    
+    const PatchTopology topology = g_patchTopologies[g_instanceIdx][patchID];
+
     float3 pos = domain.x * patch[0].Pos + domain.y * patch[1].Pos + domain.z * patch[2].Pos;
     output.Pos = mul(float4(pos, 1), g_worldViewProj);
     output.Pos.xy += g_projBias * output.Pos.w;
-    output.Color = g_tessColors[g_instanceIdx][baseIdx + domainHash(domain.xy, g_tessFactor, g_maxVertPerPatch)];
+    output.Color = unpackR11G11B10(g_tessColors[g_instanceIdx][tessVertIndex(topology, patchID, domain.xy, g_tessFactor)]);
 
     return output;
 }
@@ -9,7 +9,10 @@ void main(
     const OutputPatch<HSControlOut, 3> patch,
     uint patchID : SV_PrimitiveID)
 {
-    const uint baseIdx = g_maxVertPerPatch * patchID;
-    
-    g_tessDomains[g_instanceIdx][baseIdx + domainHash(domain.xy, g_tessFactor, g_maxVertPerPatch)] = domain.xy;
+    // Only the inner points belong to a single patch; the ray generation shader
+    // places the points on the edges, which are shared with the adjacent patches.
+    const uint idx = domainIndex(domain.xy, g_tessFactor);
+    if (idx < 3 * g_tessFactor) return;
+
+    g_tessDomains[g_instanceIdx][g_numInnerPoints * patchID + idx - 3 * g_tessFactor] = domain.xy;
 }
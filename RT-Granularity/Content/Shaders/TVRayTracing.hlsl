@@ -1,4 +1,5 @@
 #include "RTCommon.hlsli"
+#include "PackedColor.hlsli"
 
 //--------------------------------------------------------------------------------------
 // Constant buffers
@@ -7,14 +8,18 @@ cbuffer cbTessellation : register(b3)
 {
     uint g_firstInstanceIdx;
     uint g_tessFactor;
-    uint g_maxVertPerPatch;
+    uint g_numInnerPoints;
+    uint g_numVerts;    // Welded
+    uint g_numEdges;
 };
 
 //--------------------------------------------------------------------------------------
 // Texture and buffers
 //--------------------------------------------------------------------------------------
-RWStructuredBuffer<float3> g_tessColors[] : register(u0);
+RWStructuredBuffer<uint>   g_tessColors[] : register(u0);
 StructuredBuffer<float2>  g_tessDomains[] : register(t2);
+StructuredBuffer<uint>    g_weldedVerts[] : register(t0, space3);  // A vertex of each welded position
+StructuredBuffer<uint2>   g_tessEdges[]   : register(t0, space4);  // Vertices of the welded endpoints
 
 //--------------------------------------------------------------------------------------
 // Ray generation
@@ -22,30 +27,51 @@ StructuredBuffer<float2>  g_tessDomains[] : register(t2);
 [shader("raygeneration")]
 void raygenMain()
 {
-    uint vertIdx = DispatchRaysIndex().x;
-    
-    float2 dom = g_tessDomains[g_firstInstanceIdx][vertIdx];
-    float u = dom.x, v = dom.y, w = 1 - (dom.x + dom.y);
+    const uint vertIdx = DispatchRaysIndex().x;
 
-    uint patchIdx = vertIdx / g_maxVertPerPatch;
-    uint baseIdx = patchIdx * 3;
-    uint3 firstIndices =
+    // Welded vertices, inner points of the edges, and inner points of the patches
+    float3 hitObjPos;
+    uint idx = vertIdx;
+    const uint numEdgePoints = (g_tessFactor - 1) * g_numEdges;
+    if (idx < g_numVerts)
+    {
+        const uint vertex = g_weldedVerts[g_firstInstanceIdx][idx];
+        hitObjPos = g_vertexBuffers[g_firstInstanceIdx][vertex].Pos;
+    }
+    else if ((idx -= g_numVerts) < numEdgePoints)
     {
-        g_indexBuffers[g_firstInstanceIdx][baseIdx],
-        g_indexBuffers[g_firstInstanceIdx][baseIdx + 1],
-        g_indexBuffers[g_firstInstanceIdx][baseIdx + 2]
-    };
-    float3 firstVertices[] =
+        const uint2 edge = g_tessEdges[g_firstInstanceIdx][idx / (g_tessFactor - 1)];
+        const float t = (idx % (g_tessFactor - 1) + 1) / float(g_tessFactor);
+        hitObjPos = lerp(g_vertexBuffers[g_firstInstanceIdx][edge.x].Pos,
+            g_vertexBuffers[g_firstInstanceIdx][edge.y].Pos, t);
+    }
+    else
     {
-        g_vertexBuffers[g_firstInstanceIdx][firstIndices[0]].Pos,
-        g_vertexBuffers[g_firstInstanceIdx][firstIndices[1]].Pos,
-        g_vertexBuffers[g_firstInstanceIdx][firstIndices[2]].Pos
-    };
-    float3 hitObjPos = firstVertices[0] * u + firstVertices[1] * v + firstVertices[2] * w;
+        idx -= numEdgePoints;
+        float2 dom = g_tessDomains[g_firstInstanceIdx][idx];
+        float u = dom.x, v = dom.y, w = 1 - (dom.x + dom.y);
+
+        uint patchIdx = idx / g_numInnerPoints;
+        uint baseIdx = patchIdx * 3;
+        uint3 firstIndices =
+        {
+            g_indexBuffers[g_firstInstanceIdx][baseIdx],
+            g_indexBuffers[g_firstInstanceIdx][baseIdx + 1],
+            g_indexBuffers[g_firstInstanceIdx][baseIdx + 2]
+        };
+        float3 firstVertices[] =
+        {
+            g_vertexBuffers[g_firstInstanceIdx][firstIndices[0]].Pos,
+            g_vertexBuffers[g_firstInstanceIdx][firstIndices[1]].Pos,
+            g_vertexBuffers[g_firstInstanceIdx][firstIndices[2]].Pos
+        };
+        hitObjPos = firstVertices[0] * u + firstVertices[1] * v + firstVertices[2] * w;
+    }
+
     float4 hitPos4 = mul(float4(hitObjPos, 1.0), g_worlds[g_firstInstanceIdx]);
     float3 hitPos = hitPos4.xyz / hitPos4.w;
 
     float3 color = traceRadianceRay(l_eyePt, normalize(hitPos - l_eyePt), 0);
     
-    g_tessColors[g_firstInstanceIdx][vertIdx] = color;
+    g_tessColors[g_firstInstanceIdx][vertIdx] = packR11G11B10(color);
 }
@@ -9,15 +9,72 @@ struct HSConstOut
     float InsideTessFactor  : SV_InsideTessFactor;
 };
 
+// Welded vertices of the corners 0, 1 and 2, and the edges opposite to them
+struct PatchTopology
+{
+    uint3 Verts;
+    uint3 Edges;
+};
+
 cbuffer cbTessellation : register(b0)
 {
     uint g_instanceIdx;
     uint g_tessFactor;
-    uint g_maxVertPerPatch;
+    uint g_numInnerPoints;
+    uint g_numVerts;    // Welded
+    uint g_numEdges;
 };
 
-inline uint domainHash(float2 domain, uint tessFactor, uint maxVertPerPatch)
+// Dense index of a domain point of integer partitioning, in [0, numVertPerPatch):
+// ring by ring from the outside in, and edge by edge within each ring, the same
+// order as the fixed-function tessellator generates the points.
+inline uint domainIndex(float2 domain, uint tessFactor)
+{
+    // The points lie on the lattice of 1 / (3 * tessFactor) in barycentric space,
+    // with 2 * ring as the smallest coordinate.
+    const uint n = 3 * tessFactor;
+    const uint u = uint(round(domain.x * n));
+    const uint v = uint(round(domain.y * n));
+    const uint w = n - u - v;
+    const uint perp = min(u, min(v, w));
+    const uint ring = perp / 2;
+    const uint numSegments = tessFactor - 2 * ring;
+    const uint ringOffset = 3 * ring * (tessFactor - ring + 1);
+    if (numSegments == 0) return ringOffset;    // Center of even factors
+
+    // Each edge starts at a corner of the ring, and the points along the edges
+    // are at the parameters 3 * point - ring.
+    const uint endPoint = tessFactor - ring;
+    if (u == perp && v != perp) return ringOffset + endPoint - (v + ring) / 3;
+    if (v == perp && w != perp) return ringOffset + numSegments + (u + ring) / 3 - ring;
+
+    return ringOffset + 2 * numSegments + endPoint - (u + ring) / 3;
+}
+
+// Index of a tessellated vertex shared with the adjacent patches: the welded vertices
+// come first, then the inner points of each edge, and then the inner points of each patch.
+inline uint tessVertIndex(PatchTopology patch, uint patchID, float2 domain, uint tessFactor)
 {
-    float hash = (domain.x * tessFactor * tessFactor + domain.y) * tessFactor;
-    return uint(hash * 16381) % maxVertPerPatch;
+    const uint n = 3 * tessFactor;
+    const uint u = uint(round(domain.x * n));
+    const uint v = uint(round(domain.y * n));
+    const uint b[] = { u, v, n - u - v };
+
+    [unroll]
+    for (uint i = 0; i < 3; ++i)
+    {
+        if (b[i] == n) return patch.Verts[i];
+        if (b[i] == 0)
+        {
+            // Steps of the point along the edge, from its welded vertex of the smaller index
+            const uint c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+            const uint step = (patch.Verts[c0] <= patch.Verts[c1] ? b[c1] : b[c0]) / 3;
+
+            return g_numVerts + (tessFactor - 1) * patch.Edges[i] + step - 1;
+        }
+    }
+
+    const uint innerBase = g_numVerts + (tessFactor - 1) * g_numEdges;
+
+    return innerBase + g_numInnerPoints * patchID + domainIndex(domain, tessFactor) - n;
 }
@@ -1,4 +1,5 @@
 #include "RTCommon.hlsli"
+#include "PackedColor.hlsli"
 
 //--------------------------------------------------------------------------------------
 // Constant buffers
@@ -11,7 +12,11 @@ cbuffer cbInstanceIdx : register(b3)
 //--------------------------------------------------------------------------------------
 // Texture and buffers
 //--------------------------------------------------------------------------------------
-RWStructuredBuffer<float3> g_vertexColors[] : register(u0);
+RWStructuredBuffer<uint> g_vertexColors[] : register(u0);
+
+// Vertices of the visible triangles, from CSCompactVerts.hlsl
+StructuredBuffer<uint> g_visibleVerts[] : register(t0, space3);
+StructuredBuffer<uint> g_visibleCounts  : register(t2);
 
 //--------------------------------------------------------------------------------------
 // Ray generation
@@ -19,7 +24,11 @@ RWStructuredBuffer<float3> g_vertexColors[] : register(u0);
 [shader("raygeneration")]
 void raygenMain()
 {
-    uint vertexIdx = DispatchRaysIndex().x;
+    // The rays are dispatched for all the vertices, so those past the visible ones exit
+    const uint visibleIdx = DispatchRaysIndex().x;
+    if (visibleIdx >= g_visibleCounts[g_firstInstanceIdx]) return;
+
+    uint vertexIdx = g_visibleVerts[g_firstInstanceIdx][visibleIdx];
     
     float3 rayOrigin = l_eyePt;
     float3 hitObjPos = g_vertexBuffers[g_firstInstanceIdx][vertexIdx].Pos;
@@ -29,5 +38,5 @@ void raygenMain()
 
     float3 color = traceRadianceRay(rayOrigin, rayDirection, 0);
     
-    g_vertexColors[g_firstInstanceIdx][vertexIdx] = color;
+    g_vertexColors[g_firstInstanceIdx][vertexIdx] = packR11G11B10(color);
 }
\ No newline at end of file
@@ -1,18 +1,19 @@
 #include "VCommon.hlsli"
+#include "PackedColor.hlsli"
 
 cbuffer cbInstanceIdx : register(b0)
 {
     uint g_instanceIdx;
 };
 
-StructuredBuffer<float3> g_vertexColors[] : register(t0);
+StructuredBuffer<uint> g_vertexColors[] : register(t0);
 
 VSOut main(VSIn input)
 {
     VSOut output;
 
     output.Pos = input.Pos;
-    output.Color = g_vertexColors[g_instanceIdx][input.vId];
+    output.Color = unpackR11G11B10(g_vertexColors[g_instanceIdx][input.vId]);
 
     return output;
 }
\ No newline at end of file
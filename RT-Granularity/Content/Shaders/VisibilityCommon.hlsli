@@ -0,0 +1,21 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbVisibility : register(b0)
+{
+    float4x4 g_worldViewProj;
+    float3   g_localEyePt;      // Eye point in the object space
+    uint     g_numTriangles;
+    uint     g_numVerts;
+    uint     g_instanceIdx;
+    uint     g_frameStamp;
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+RWStructuredBuffer<uint> g_rwVisibleCounts : register(u0, space2);
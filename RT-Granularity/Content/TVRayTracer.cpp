@@ -4,10 +4,7 @@
 
 #include "stdafx.h"
 #include "TVRayTracer.h"
-#include "XUSGObjLoader.h"
-#define _INDEPENDENT_DDS_LOADER_
-#include "Advanced/XUSGDDSLoader.h"
-#undef _INDEPENDENT_DDS_LOADER_
+#include "Sampler.h"
 #include "DirectXPackedVector.h"
 
 using namespace std;
@@ -57,7 +54,15 @@ struct CBTessellation
 {
     uint32_t InstanceIdx;
     uint32_t TessFactor;
-    uint32_t MaxVertPerPatch;
+    uint32_t NumInnerPoints;
+    uint32_t NumVerts;
+    uint32_t NumEdges;
+};
+
+struct PatchTopology
+{
+    XMUINT3 Verts;  // Welded vertices of the corners
+    XMUINT3 Edges;  // Opposite to the corners
 };
 
 const wchar_t* TVRayTracer::HitGroupNames[] = { L"hitGroupRadiance", L"hitGroupShadow" };
@@ -65,40 +70,43 @@ const wchar_t* TVRayTracer::RaygenShaderName = L"raygenMain";
 const wchar_t* TVRayTracer::ClosestHitShaderNames[] = { L"closestHitRadiance", L"closestHitShadow" };
 const wchar_t* TVRayTracer::MissShaderNames[] = { L"missRadiance", L"missShadow" };
 
-// isPrime for n >= 2
-static inline bool isPrime(uint32_t n)
+// Domain points of a triangle patch with integer partitioning, indexed densely by domainIndex()
+static inline uint32_t calcNumVertPerPatch(uint32_t tessFactor)
 {
-    for (auto i = 2u; i * i <= n; ++i)
-    {
-        if (n % i == 0) return false;
-    }
-    return true;
-}
+    uint32_t k = tessFactor / 2 + 1;
+    return tessFactor & 1 ? 3 * k * k : 3 * k * (k - 1) + 1;
+};
 
-static inline uint32_t nextPrime(uint32_t n)
+// Domain points inside a patch, not shared with the adjacent patches
+static inline uint32_t calcNumInnerPoints(uint32_t tessFactor)
 {
-    while (!isPrime(n)) ++n;
-    return n;
+    return calcNumVertPerPatch(tessFactor) - 3 * tessFactor;
 }
 
-static inline uint32_t calcMaxVertPerPatch(uint32_t tessFactor)
+// Tessellated vertices shared by the adjacent patches, then the inner points of the patches
+static inline uint32_t calcNumTessVerts(uint32_t numWeldedVerts, uint32_t numEdges,
+    uint32_t numPatches, uint32_t tessFactor)
 {
-    uint32_t k = tessFactor / 2 + 1;
-    uint32_t from = (tessFactor & 1 ? 3 * k * k : 3 * k * (k - 1) + 1);
-    return nextPrime(from);
-};
+    return numWeldedVerts + (tessFactor - 1) * numEdges + numPatches * calcNumInnerPoints(tessFactor);
+}
 
 TVRayTracer::TVRayTracer(const RayTracing::Device::sptr& device) :
     m_device(device),
     m_instances(),
-    m_tessFactor(2)
+    m_tessFactor(2),
+    m_budgetTessFactor(MaxTessFactor),
+    m_tessBufferBudget(SIZE_MAX),
+    m_haltonIndex(0)
 {
-    m_maxVertPerPatch = calcMaxVertPerPatch(m_tessFactor);
+    m_numInnerPoints = calcNumInnerPoints(m_tessFactor);
     m_shaderPool = ShaderPool::MakeUnique();
     m_rayTracingPipelineCache = RayTracing::PipelineCache::MakeUnique(device.get());
     m_graphicsPipelineCache = Graphics::PipelineCache::MakeUnique(device.get());
     m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(device.get());
     m_descriptorTableCache = DescriptorTableCache::MakeUnique(device.get(), L"RayTracerDescriptorTableCache");
+    m_accumulator = make_unique<Accumulator>(device);
+    m_tessColors = make_unique<TessBufferAllocator>(device);
+    m_tessDoms = make_unique<TessBufferAllocator>(device);
 
     AccelerationStructure::SetUAVCount(NUM_MESH + NUM_HIT_GROUP + 1);
 }
@@ -113,21 +121,20 @@ bool TVRayTracer::Init(
     uint32_t                 height,
     vector<Resource::uptr>&  uploaders,
     GeometryBuffer*          pGeometries,
-    const char*              fileName,
-    const wchar_t*           envFileName,
-    Format                   rtFormat,
-    const XMFLOAT4&          posScale)
+    const SceneAssets&       assets,
+    Format                   rtFormat)
 {
     m_viewport = XMUINT2(width, height);
-    m_posScale = posScale;
+    m_posScale = assets.PosScale;
 
-    // Load inputs
-    ObjLoader objLoader;
-    if (!objLoader.Import(fileName, true, true)) return false;
+    // Create the inputs from the shared model
+    const auto& objLoader = assets.Model;
     auto numVertices = objLoader.GetNumVertices();
     auto numIndices = objLoader.GetNumIndices();
     N_RETURN(createVB(pCommandList, numVertices, objLoader.GetVertexStride(), objLoader.GetVertices(), uploaders), false);
     N_RETURN(createIB(pCommandList, numIndices, objLoader.GetIndices(), uploaders), false);
+    N_RETURN(createTopology(pCommandList, MODEL_OBJ, objLoader.GetVertices(), objLoader.GetVertexStride(),
+        objLoader.GetIndices(), uploaders), false);
 
     N_RETURN(createGroundMesh(pCommandList, uploaders), false);
 
@@ -139,21 +146,38 @@ bool TVRayTracer::Init(
             L"GraphicsOut"), false);
     }
 
-    for (auto i = 0u; i < NUM_MESH; ++i)
+    // Clamp the tessellation factor to the largest whose buffers fit in the budget
+    m_budgetTessFactor = MaxTessFactor;
+    while (m_budgetTessFactor > MinTessFactor && calcTessBufferSize(m_budgetTessFactor) > m_tessBufferBudget)
+        --m_budgetTessFactor;
+    if (calcTessBufferSize(m_budgetTessFactor) > m_tessBufferBudget)
     {
-        m_numMaxTessVerts[i] = m_numIndices[i] / 3u * m_maxVertPerPatch;
+        // Not even the min factor fits, so the budget is exceeded rather than disabling the tessellation
+        wstringstream warning;
+        warning << L"Warning: the tessellation buffers of the min factor " << m_budgetTessFactor << L" take "
+            << calcTessBufferSize(m_budgetTessFactor) << L" bytes, which exceeds the budget of "
+            << m_tessBufferBudget << L" bytes; no tessellation factor fits, and the budget is not kept.\n";
+        OutputDebugString(warning.str().c_str());
     }
-
-    // Create tessellated vertex color buffer
-    for (auto i = 0u; i < NUM_MESH; ++i)
+    else if (m_budgetTessFactor < MaxTessFactor)
     {
-        const uint32_t MMVerts = m_numIndices[i] / 3u * calcMaxVertPerPatch(MaxTessFactor);
+        wstringstream warning;
+        warning << L"Warning: the tessellation buffers of factor " << m_budgetTessFactor + 1 << L" exceed the budget of "
+            << m_tessBufferBudget << L" bytes; the tessellation factor is clamped to " << m_budgetTessFactor << L".\n";
+        OutputDebugString(warning.str().c_str());
+    }
 
-        m_tessColors[i] = StructuredBuffer::MakeUnique();
-        N_RETURN(m_tessColors[i]->Create(m_device.get(), MMVerts, sizeof(XMFLOAT3), ResourceFlag::ALLOW_UNORDERED_ACCESS), false);
+    m_tessFactor = (min)(m_tessFactor, m_budgetTessFactor);
+    m_numInnerPoints = calcNumInnerPoints(m_tessFactor);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+        m_numTessVerts[i] = calcNumTessVerts(m_numWeldedVerts[i], m_numEdges[i], m_numIndices[i] / 3u, m_tessFactor);
 
-        m_tessDoms[i] = StructuredBuffer::MakeUnique();
-        N_RETURN(m_tessDoms[i]->Create(m_device.get(), MMVerts, sizeof(XMFLOAT2), ResourceFlag::ALLOW_UNORDERED_ACCESS), false);
+    // Create the tessellation buffers for the active factor
+    {
+        bool reallocated;
+        m_tessColors->Init(NUM_MESH, sizeof(PackedVector::XMFLOAT3PK), L"TessColors");
+        m_tessDoms->Init(NUM_MESH, sizeof(XMFLOAT2), L"TessDomains");
+        N_RETURN(reserveTessBuffers(0, reallocated), false);
     }
 
     m_cbGlobal = ConstantBuffer::MakeUnique();
@@ -183,15 +207,7 @@ bool TVRayTracer::Init(
             nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBGraphics"), false);
     }
 
-    // Load input image
-    {
-        DDS::Loader textureLoader;
-        DDS::AlphaMode alphaMode;
-
-        uploaders.emplace_back(Resource::MakeUnique());
-        N_RETURN(textureLoader.CreateTextureFromFile(m_device.get(), static_cast<XUSG::CommandList*>(pCommandList), envFileName,
-            8192, false, m_lightProbe, uploaders.back().get(), &alphaMode), false);
-    }
+    m_lightProbe = assets.LightProbe;
 
     const auto dsFormat = Format::D24_UNORM_S8_UINT;
     m_depth = DepthStencil::MakeUnique();
@@ -207,74 +223,21 @@ bool TVRayTracer::Init(
     N_RETURN(buildAccelerationStructures(pCommandList, pGeometries), false);
     N_RETURN(buildShaderTables(), false);
 
-    return true;
-}
+    // Create progressive accumulation
+    N_RETURN(m_accumulator->Init(width, height, m_outputView.get(), m_descriptorTableCache.get()), false);
 
-static const XMFLOAT2& IncrementalHalton()
-{
-    static auto haltonBase = XMUINT2(0, 0);
-    static auto halton = XMFLOAT2(0.0f, 0.0f);
-
-    // Base 2
-    {
-        // Bottom bit always changes, higher bits
-        // Change less frequently.
-        auto change = 0.5f;
-        auto oldBase = haltonBase.x++;
-        auto diff = haltonBase.x ^ oldBase;
-
-        // Diff will be of the form 0*1+, i.e. one bits up until the last carry.
-        // Expected iterations = 1 + 0.5 + 0.25 + ... = 2
-        do
-        {
-            halton.x += (oldBase & 1) ? -change : change;
-            change *= 0.5f;
-
-            diff = diff >> 1;
-            oldBase = oldBase >> 1;
-        } while (diff);
-    }
-
-    // Base 3
-    {
-        const auto oneThird = 1.0f / 3.0f;
-        auto mask = 0x3u;	// Also the max base 3 digit
-        auto add = 0x1u;	// Amount to add to force carry once digit == 3
-        auto change = oneThird;
-        ++haltonBase.y;
-
-        // Expected iterations: 1.5
-        while (true)
-        {
-            if ((haltonBase.y & mask) == mask)
-            {
-                haltonBase.y += add;	// Force carry into next 2-bit digit
-                halton.y -= 2 * change;
-
-                mask = mask << 2;
-                add = add << 2;
-
-                change *= oneThird;
-            }
-            else
-            {
-                halton.y += change;	// We know digit n has gone from a to a + 1
-                break;
-            }
-        };
-    }
-
-    return halton;
+    return true;
 }
 
 void TVRayTracer::UpdateFrame(
     uint8_t   frameIndex,
     CXMVECTOR eyePt,
     CXMMATRIX viewProj,
+    float     modelAngle,
     float     timeStep,
     uint32_t  tessFactor)
 {
-    const auto halton = IncrementalHalton();
+    const auto halton = Sampler(Sampler::HALTON).Get(++m_haltonIndex);
     XMFLOAT2 projBias =
     {
         (halton.x * 2.0f - 1.0f) / m_viewport.x,
@@ -299,9 +262,7 @@ void TVRayTracer::UpdateFrame(
     }
 
     {
-        static auto angle = 0.0f;
-        angle += 16.0f * timeStep * XM_PI / 180.0f;
-        const auto rot = XMMatrixRotationY(angle);
+        const auto rot = XMMatrixRotationY(modelAngle);
 
         XMMATRIX worlds[NUM_MESH] =
         {
@@ -331,15 +292,20 @@ void TVRayTracer::UpdateFrame(
         }
     }
 
+    tessFactor = (min)(tessFactor, m_budgetTessFactor);
     if (m_tessFactor != tessFactor)
     {
         m_tessFactor = tessFactor;
-        m_maxVertPerPatch = calcMaxVertPerPatch(m_tessFactor);
+        m_numInnerPoints = calcNumInnerPoints(m_tessFactor);
         for (auto i = 0u; i < NUM_MESH; ++i)
-        {
-            m_numMaxTessVerts[i] = m_numIndices[i] / 3u * m_maxVertPerPatch;
-        }
+            m_numTessVerts[i] = calcNumTessVerts(m_numWeldedVerts[i], m_numEdges[i], m_numIndices[i] / 3u, m_tessFactor);
     }
+
+    // Grow the tessellation buffers if needed, once the retired ones are no longer in flight
+    bool reallocated;
+    if (reserveTessBuffers(frameIndex, reallocated) && reallocated) createTessDescriptorTables();
+
+    m_accumulator->UpdateFrame(frameIndex, viewProj, timeStep, tessFactor);
 }
 
 void TVRayTracer::Render(
@@ -362,6 +328,7 @@ void TVRayTracer::Render(
     tessellate(pCommandList, frameIndex);
     raytrace(pCommandList, frameIndex);
     rasterize(pCommandList, frameIndex);
+    if (m_accumulator->IsEnabled()) m_accumulator->Accumulate(pCommandList, frameIndex);
     toneMap(pCommandList, rtv, numBarriers, pBarriers);
 }
 
@@ -384,6 +351,31 @@ void TVRayTracer::UpdateAccelerationStructures(
     m_topLevelAS->Build(pCommandList, m_scratch.get(), m_instances[frameIndex].get(), descriptorPool, true);
 }
 
+Accumulator* TVRayTracer::GetAccumulator() const
+{
+    return m_accumulator.get();
+}
+
+uint8_t TVRayTracer::GetMaxTessFactor() const
+{
+    return static_cast<uint8_t>(m_budgetTessFactor);
+}
+
+void TVRayTracer::SetTessBufferBudget(size_t budget)
+{
+    m_tessBufferBudget = budget;
+}
+
+size_t TVRayTracer::GetTessBufferSize() const
+{
+    return m_tessColors->GetSize() + m_tessDoms->GetSize();
+}
+
+size_t TVRayTracer::GetTessBufferBudget() const
+{
+    return m_tessBufferBudget;
+}
+
 bool TVRayTracer::createVB(
     RayTracing::CommandList* pCommandList,
     uint32_t                 numVert,
@@ -427,10 +419,12 @@ bool TVRayTracer::createGroundMesh(
     vector<Resource::uptr>& uploaders)
 {
     const uint32_t N = 64;
+
+    // Cube vertices positions and corresponding triangle normals.
+    static Vertex vertices[N * N * 6];
+
     // Vertex buffer
     {
-        // Cube vertices positions and corresponding triangle normals.
-        static Vertex vertices[N * N * 6];
         for (auto i = 0u; i < N; ++i)
             for (auto j = 0u; j < N; ++j)
                 vertices[N * i + j] = {
@@ -517,11 +511,103 @@ bool TVRayTracer::createGroundMesh(
         uploaders.push_back(Resource::MakeUnique());
         N_RETURN(indexBuffer->Upload(pCommandList, uploaders.back().get(), indices,
             sizeof(indices), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE), false);
+
+        N_RETURN(createTopology(pCommandList, GROUND, reinterpret_cast<const uint8_t*>(vertices),
+            sizeof(Vertex), &indices[0][0][0][0][0], uploaders), false);
     }
 
     return true;
 }
 
+bool TVRayTracer::createTopology(
+    RayTracing::CommandList* pCommandList,
+    uint32_t                 meshIdx,
+    const uint8_t*           pVertices,
+    uint32_t                 stride,
+    const uint32_t*          pIndices,
+    vector<Resource::uptr>&  uploaders)
+{
+    // Weld the vertices by position, so that the faces of the ground share their borders
+    struct PosHash
+    {
+        size_t operator()(const XMFLOAT3& p) const
+        {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+    struct PosEqual
+    {
+        bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const
+        {
+            return memcmp(&a, &b, sizeof(XMFLOAT3)) == 0;
+        }
+    };
+    unordered_map<XMFLOAT3, uint32_t, PosHash, PosEqual> vertMap;
+    unordered_map<uint64_t, uint32_t> edgeMap;
+    vector<uint32_t> weldedVerts;
+    vector<XMUINT2> edges;
+
+    const auto numPatches = m_numIndices[meshIdx] / 3;
+    vector<PatchTopology> patches(numPatches);
+    for (auto i = 0u; i < numPatches; ++i)
+    {
+        uint32_t verts[3];
+        for (auto j = 0u; j < 3; ++j)
+        {
+            const auto vertex = pIndices[3 * i + j];
+            const auto& pos = *reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * vertex]);
+            const auto result = vertMap.emplace(pos, static_cast<uint32_t>(weldedVerts.size()));
+            if (result.second) weldedVerts.push_back(vertex);
+            verts[j] = result.first->second;
+        }
+
+        // Edge j is opposite to corner j, with its endpoint of the smaller welded index first
+        uint32_t edgeIndices[3];
+        for (auto j = 0u; j < 3; ++j)
+        {
+            const auto v0 = (min)(verts[(j + 1) % 3], verts[(j + 2) % 3]);
+            const auto v1 = (max)(verts[(j + 1) % 3], verts[(j + 2) % 3]);
+            const auto result = edgeMap.emplace((static_cast<uint64_t>(v0) << 32) | v1, static_cast<uint32_t>(edges.size()));
+            if (result.second) edges.emplace_back(weldedVerts[v0], weldedVerts[v1]);
+            edgeIndices[j] = result.first->second;
+        }
+
+        patches[i].Verts = XMUINT3(verts);
+        patches[i].Edges = XMUINT3(edgeIndices);
+    }
+
+    m_numWeldedVerts[meshIdx] = static_cast<uint32_t>(weldedVerts.size());
+    m_numEdges[meshIdx] = static_cast<uint32_t>(edges.size());
+
+    auto& patchTopologies = m_patchTopologies[meshIdx];
+    patchTopologies = StructuredBuffer::MakeUnique();
+    N_RETURN(patchTopologies->Create(m_device.get(), numPatches, sizeof(PatchTopology),
+        ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"PatchTopologies"), false);
+    uploaders.emplace_back(Resource::MakeUnique());
+    N_RETURN(patchTopologies->Upload(pCommandList, uploaders.back().get(), patches.data(),
+        sizeof(PatchTopology) * numPatches, 0, ResourceState::NON_PIXEL_SHADER_RESOURCE), false);
+
+    auto& weldedVertBuffer = m_weldedVerts[meshIdx];
+    weldedVertBuffer = StructuredBuffer::MakeUnique();
+    N_RETURN(weldedVertBuffer->Create(m_device.get(), m_numWeldedVerts[meshIdx], sizeof(uint32_t),
+        ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"WeldedVerts"), false);
+    uploaders.emplace_back(Resource::MakeUnique());
+    N_RETURN(weldedVertBuffer->Upload(pCommandList, uploaders.back().get(), weldedVerts.data(),
+        sizeof(uint32_t) * weldedVerts.size(), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE), false);
+
+    auto& edgeBuffer = m_tessEdges[meshIdx];
+    edgeBuffer = StructuredBuffer::MakeUnique();
+    N_RETURN(edgeBuffer->Create(m_device.get(), m_numEdges[meshIdx], sizeof(XMUINT2),
+        ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"TessEdges"), false);
+    uploaders.emplace_back(Resource::MakeUnique());
+
+    return edgeBuffer->Upload(pCommandList, uploaders.back().get(), edges.data(),
+        sizeof(XMUINT2) * edges.size(), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+}
+
 bool TVRayTracer::createInputLayout()
 {
     // Define the vertex input layout.
@@ -581,6 +667,8 @@ bool TVRayTracer::createPipelineLayouts()
         pipelineLayout->SetConstants(TESS_CONSTS, SizeOfInUint32(CBTessellation), 3);
         pipelineLayout->SetRange(TESS_DOMS, DescriptorType::SRV, NUM_MESH, 2);
         pipelineLayout->SetRange(ENV_TEXTURE, DescriptorType::SRV, 1, 1);
+        pipelineLayout->SetRange(WELDED_VERTS, DescriptorType::SRV, NUM_MESH, 0, 3);
+        pipelineLayout->SetRange(TESS_EDGES, DescriptorType::SRV, NUM_MESH, 0, 4);
         X_RETURN(m_pipelineLayouts[RT_GLOBAL_LAYOUT], pipelineLayout->GetPipelineLayout(
             m_device.get(), m_pipelineLayoutCache.get(), PipelineLayoutFlag::NONE,
             L"RayTracerGlobalPipelineLayout"), false);
@@ -613,6 +701,7 @@ bool TVRayTracer::createPipelineLayouts()
         pipelineLayout->SetRootCBV(1, 1, 0, Shader::Stage::DS);
         pipelineLayout->SetRange(2, DescriptorType::SRV, NUM_MESH, 0);
         pipelineLayout->SetRange(3, DescriptorType::UAV, 1, 0);
+        pipelineLayout->SetRange(4, DescriptorType::SRV, NUM_MESH, 0, 1);
 
         X_RETURN(m_pipelineLayouts[GRAPHICS_LAYOUT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutCache.get(), PipelineLayoutFlag::ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT, L"GraphicsPipelineLayout"), false);
     }
@@ -737,23 +826,8 @@ bool TVRayTracer::createDescriptorTables()
         X_RETURN(m_uavTables[UAV_TABLE_OUTPUT], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
     }
 
-    // Tessellation domains UAV
-    {
-        Descriptor descriptors[NUM_MESH];
-        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_tessDoms[i]->GetUAV();
-        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-        X_RETURN(m_uavTables[UAV_TABLE_TESSDOMS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
-    }
-
-    // Tessellated vertex color UAV
-    {
-        Descriptor descriptors[NUM_MESH];
-        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_tessColors[i]->GetUAV();
-        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-        X_RETURN(m_uavTables[UAV_TABLE_RT], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
-    }
+    // Tessellation buffer UAVs and SRVs
+    N_RETURN(createTessDescriptorTables(), false);
 
     // Index buffer SRVs
     {
@@ -780,22 +854,31 @@ bool TVRayTracer::createDescriptorTables()
         X_RETURN(m_srvTables[SRV_TABLE_ENV], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
     }
 
-    // Tessellated vertex color SRV
+    // Patch topology SRVs
     {
         Descriptor descriptors[NUM_MESH];
-        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_tessColors[i]->GetSRV();
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_patchTopologies[i]->GetSRV();
         const auto descriptorTable = Util::DescriptorTable::MakeUnique();
         descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-        X_RETURN(m_srvTables[SRV_TABLE_VCOLOR], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false)
+        X_RETURN(m_srvTables[SRV_TABLE_TOPOLOGY], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
     }
 
-    // Tessellation domain SRV
+    // Welded vertex SRVs
     {
         Descriptor descriptors[NUM_MESH];
-        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_tessDoms[i]->GetSRV();
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_weldedVerts[i]->GetSRV();
         const auto descriptorTable = Util::DescriptorTable::MakeUnique();
         descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-        X_RETURN(m_srvTables[SRV_TABLE_TESSDOMS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false)
+        X_RETURN(m_srvTables[SRV_TABLE_WELDED_VERTS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Edge table SRVs
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_tessEdges[i]->GetSRV();
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_TESS_EDGES], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
     }
 
     // Output SRV for tone mapping
@@ -816,6 +899,84 @@ bool TVRayTracer::createDescriptorTables()
     return true;
 }
 
+bool TVRayTracer::createTessDescriptorTables()
+{
+    const auto pTessDoms = m_tessDoms->GetBuffer();
+    const auto pTessColors = m_tessColors->GetBuffer();
+
+    // Tessellation domains UAV
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = pTessDoms->GetUAV(i);
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_uavTables[UAV_TABLE_TESSDOMS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Tessellated vertex color UAV
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = pTessColors->GetUAV(i);
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_uavTables[UAV_TABLE_RT], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Tessellated vertex color SRV
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = pTessColors->GetSRV(i);
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_VCOLOR], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false)
+    }
+
+    // Tessellation domain SRV
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = pTessDoms->GetSRV(i);
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_TESSDOMS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false)
+    }
+
+    return true;
+}
+
+bool TVRayTracer::reserveTessBuffers(uint8_t frameIndex, bool& reallocated)
+{
+    uint32_t numVerts[NUM_MESH], maxVerts[NUM_MESH];
+    uint32_t numDoms[NUM_MESH], maxDoms[NUM_MESH];
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        const auto numPatches = m_numIndices[i] / 3u;
+        numVerts[i] = m_numTessVerts[i];
+        maxVerts[i] = calcNumTessVerts(m_numWeldedVerts[i], m_numEdges[i], numPatches, m_budgetTessFactor);
+        numDoms[i] = numPatches * m_numInnerPoints;
+        maxDoms[i] = numPatches * calcNumInnerPoints(m_budgetTessFactor);
+    }
+
+    bool colorsReallocated, domsReallocated;
+    N_RETURN(m_tessColors->Reserve(frameIndex, numVerts, maxVerts, colorsReallocated), false);
+    N_RETURN(m_tessDoms->Reserve(frameIndex, numDoms, maxDoms, domsReallocated), false);
+    reallocated = colorsReallocated || domsReallocated;
+
+    return true;
+}
+
+size_t TVRayTracer::calcTessBufferSize(uint32_t tessFactor) const
+{
+    size_t tessBufferSize = 0;
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        const auto numPatches = m_numIndices[i] / 3u;
+        tessBufferSize += sizeof(PackedVector::XMFLOAT3PK) * calcNumTessVerts(m_numWeldedVerts[i], m_numEdges[i], numPatches, tessFactor);
+        tessBufferSize += sizeof(XMFLOAT2) * numPatches * calcNumInnerPoints(tessFactor);
+    }
+
+    return tessBufferSize;
+}
+
 bool TVRayTracer::buildAccelerationStructures(
     const RayTracing::CommandList* pCommandList,
     GeometryBuffer* pGeometries)
@@ -994,7 +1155,7 @@ void TVRayTracer::tessellate(
 
     for (auto i = 0u; i < NUM_MESH; ++i)
     {
-        CBTessellation tessConsts = { i, m_tessFactor, m_maxVertPerPatch };
+        CBTessellation tessConsts = { i, m_tessFactor, m_numInnerPoints, m_numWeldedVerts[i], m_numEdges[i] };
         pCommandList->SetGraphics32BitConstants(0, SizeOfInUint32(tessConsts), &tessConsts);
         pCommandList->IASetVertexBuffers(0, 1, &m_vertexBuffers[i]->GetVBV());
         pCommandList->IASetIndexBuffer(m_indexBuffers[i]->GetIBV());
@@ -1006,13 +1167,9 @@ void TVRayTracer::raytrace(
     const RayTracing::CommandList* pCommandList,
     uint8_t                        frameIndex)
 {
-    ResourceBarrier barriers[2];
-    auto numBarriers = 0u;
-    for (auto i = 0u; i < NUM_MESH; ++i)
-    {
-        numBarriers = m_tessDoms[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
-    }
-    pCommandList->Barrier(numBarriers, barriers);
+    ResourceBarrier barrier;
+    const auto numBarriers = m_tessDoms->GetBuffer()->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
+    pCommandList->Barrier(numBarriers, &barrier);
 
     // Bind the acceleration structure and dispatch rays.
     pCommandList->SetComputePipelineLayout(m_pipelineLayouts[RT_GLOBAL_LAYOUT]);
@@ -1025,13 +1182,15 @@ void TVRayTracer::raytrace(
     pCommandList->SetComputeDescriptorTable(SAMPLER, m_samplerTable);
     pCommandList->SetComputeDescriptorTable(VERTEX_COLOR, m_uavTables[UAV_TABLE_RT]);
     pCommandList->SetComputeDescriptorTable(TESS_DOMS, m_srvTables[SRV_TABLE_TESSDOMS]);
+    pCommandList->SetComputeDescriptorTable(WELDED_VERTS, m_srvTables[SRV_TABLE_WELDED_VERTS]);
+    pCommandList->SetComputeDescriptorTable(TESS_EDGES, m_srvTables[SRV_TABLE_TESS_EDGES]);
 
     for (auto i = 0u; i < NUM_MESH; ++i)
     {
-        CBTessellation tessConsts = { i, m_tessFactor, m_maxVertPerPatch };
+        CBTessellation tessConsts = { i, m_tessFactor, m_numInnerPoints, m_numWeldedVerts[i], m_numEdges[i] };
         pCommandList->SetCompute32BitConstants(TESS_CONSTS, SizeOfInUint32(tessConsts), &tessConsts);
         // Fallback layer has no depth
-        pCommandList->DispatchRays(m_pipelines[RAY_TRACING], m_numMaxTessVerts[i], 1, 1,
+        pCommandList->DispatchRays(m_pipelines[RAY_TRACING], m_numTessVerts[i], 1, 1,
             m_hitGroupShaderTable.get(), m_missShaderTable.get(), m_rayGenShaderTables[frameIndex].get());
     }
 }
@@ -1052,6 +1211,7 @@ void TVRayTracer::rasterize(
 
     pCommandList->SetGraphicsDescriptorTable(2, m_srvTables[SRV_TABLE_VCOLOR]);
     pCommandList->SetGraphicsDescriptorTable(3, m_uavTables[UAV_TABLE_OUTPUT]);
+    pCommandList->SetGraphicsDescriptorTable(4, m_srvTables[SRV_TABLE_TOPOLOGY]);
 
     Viewport viewport(0.0f, 0.0f, static_cast<float>(m_viewport.x), static_cast<float>(m_viewport.y));
     RectRange scissorRect(0, 0, m_viewport.x, m_viewport.y);
@@ -1062,7 +1222,7 @@ void TVRayTracer::rasterize(
 
     for (auto i = 0u; i < NUM_MESH; ++i)
     {
-        CBTessellation tessConsts = { i, m_tessFactor, m_maxVertPerPatch };
+        CBTessellation tessConsts = { i, m_tessFactor, m_numInnerPoints, m_numWeldedVerts[i], m_numEdges[i] };
         pCommandList->SetGraphics32BitConstants(0, SizeOfInUint32(tessConsts), &tessConsts);
         pCommandList->SetGraphicsRootConstantBufferView(1, m_cbGraphics[i].get(), m_cbGraphics[i]->GetCBVOffset(frameIndex));
         pCommandList->IASetVertexBuffers(0, 1, &m_vertexBuffers[i]->GetVBV());
@@ -1086,7 +1246,8 @@ void TVRayTracer::toneMap(
     pCommandList->OMSetRenderTargets(1, &rtv);
 
     pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[TONEMAP_LAYOUT]);
-    pCommandList->SetGraphicsDescriptorTable(0, m_srvTables[SRV_TABLE_OUTPUT]);
+    pCommandList->SetGraphicsDescriptorTable(0, m_accumulator->IsEnabled() ?
+        m_accumulator->GetSRVTable() : m_srvTables[SRV_TABLE_OUTPUT]);
 
     pCommandList->SetPipelineState(m_pipelines[TONEMAP]);
 
@@ -4,33 +4,34 @@
 
 #pragma once
 
-#include "Core/XUSG.h"
-#include "RayTracing/XUSGRayTracing.h"
+#include "RayTracer.h"
+#include "TessBufferAllocator.h"
 
-class TVRayTracer
+class TVRayTracer :
+    public RayTracer
 {
 public:
-    enum MeshIndex : uint32_t
-    {
-        GROUND,
-        MODEL_OBJ,
-
-        NUM_MESH
-    };
-
     TVRayTracer(const XUSG::RayTracing::Device::sptr& device);
     virtual ~TVRayTracer();
 
     bool Init(XUSG::RayTracing::CommandList* pCommandList, uint32_t width, uint32_t height,
         std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometries,
-        const char* fileName, const wchar_t* envFileName, XUSG::Format rtFormat,
-        const DirectX::XMFLOAT4& posScale = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
-    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float timeStep, uint32_t tessFactor);
-    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers);
-    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex);
-
-    static const uint8_t FrameCount = 3;
-    static const uint8_t MinTessFactor = 1;
+        const SceneAssets& assets, XUSG::Format rtFormat) override;
+    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float modelAngle, float timeStep, uint32_t tessFactor) override;
+    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers) override;
+    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex) override;
+
+    Accumulator* GetAccumulator() const override;
+    uint8_t GetMaxTessFactor() const override;
+
+    // The tessellation buffers are sized for the active factor, and the factor is
+    // clamped so that they fit in the budget, which is set before Init; if not even
+    // the min factor fits, Init warns and keeps it. The size includes the buffers
+    // replaced on growth until the frames in flight are complete.
+    void SetTessBufferBudget(size_t budget) override;
+    size_t GetTessBufferSize() const override;
+    size_t GetTessBufferBudget() const override;
+
     static const uint8_t MaxTessFactor = 5;
 private:
     enum PipelineLayoutIndex : uint8_t
@@ -73,6 +74,8 @@ private:
         TESS_CONSTS,
         TESS_DOMS,
         ENV_TEXTURE,
+        WELDED_VERTS,
+        TESS_EDGES,
         OUTPUT_VIEW
     };
 
@@ -84,6 +87,9 @@ private:
         SRV_TABLE_VCOLOR,
         SRV_TABLE_OUTPUT,
         SRV_TABLE_TESSDOMS,
+        SRV_TABLE_TOPOLOGY,
+        SRV_TABLE_WELDED_VERTS,
+        SRV_TABLE_TESS_EDGES,
 
         NUM_SRV_TABLE
     };
@@ -126,10 +132,16 @@ private:
         const uint32_t* pData, std::vector<XUSG::Resource::uptr>& uploaders);
     bool createGroundMesh(XUSG::RayTracing::CommandList* pCommandList,
         std::vector<XUSG::Resource::uptr>& uploaders);
+    bool createTopology(XUSG::RayTracing::CommandList* pCommandList, uint32_t meshIdx,
+        const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+        std::vector<XUSG::Resource::uptr>& uploaders);
     bool createInputLayout();
     bool createPipelineLayouts();
     bool createPipelines(XUSG::Format rtFormat, XUSG::Format dsFormat);
     bool createDescriptorTables();
+    bool createTessDescriptorTables();
+    bool reserveTessBuffers(uint8_t frameIndex, bool& reallocated);
+    size_t calcTessBufferSize(uint32_t tessFactor) const;
     bool buildAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList,
         XUSG::RayTracing::GeometryBuffer* pGeometries);
     bool buildShaderTables();
@@ -145,11 +157,16 @@ private:
 
     uint32_t            m_numIndices[NUM_MESH];
     uint32_t            m_numVerts[NUM_MESH];
-    uint32_t            m_numMaxTessVerts[NUM_MESH];
+    uint32_t            m_numWeldedVerts[NUM_MESH];
+    uint32_t            m_numEdges[NUM_MESH];
+    uint32_t            m_numTessVerts[NUM_MESH];
     uint32_t            m_tessFactor;
-    uint32_t            m_maxVertPerPatch;
+    uint32_t            m_numInnerPoints;
+    uint32_t            m_budgetTessFactor;
+    size_t              m_tessBufferBudget;
 
     DirectX::XMUINT2    m_viewport;
+    uint32_t            m_haltonIndex;  // Of the jitter, one point per frame
     DirectX::XMFLOAT4   m_posScale;
     DirectX::XMFLOAT4X4 m_worlds[NUM_MESH];
 
@@ -169,8 +186,11 @@ private:
 
     XUSG::DepthStencil::uptr        m_depth;
     XUSG::Texture2D::uptr           m_outputView;
-    XUSG::StructuredBuffer::uptr    m_tessColors[NUM_MESH];
-    XUSG::StructuredBuffer::uptr    m_tessDoms[NUM_MESH];
+    std::unique_ptr<TessBufferAllocator> m_tessColors;
+    std::unique_ptr<TessBufferAllocator> m_tessDoms;
+    XUSG::StructuredBuffer::uptr    m_patchTopologies[NUM_MESH];
+    XUSG::StructuredBuffer::uptr    m_weldedVerts[NUM_MESH];
+    XUSG::StructuredBuffer::uptr    m_tessEdges[NUM_MESH];
 
     XUSG::ConstantBuffer::uptr      m_cbMaterials;
     XUSG::ConstantBuffer::uptr      m_cbGlobal;
@@ -181,6 +201,8 @@ private:
     XUSG::Resource::uptr            m_scratch;
     XUSG::Resource::uptr            m_instances[FrameCount];
 
+    std::unique_ptr<Accumulator>    m_accumulator;
+
     XUSG::ShaderResource::sptr      m_lightProbe;
 
     // Shader tables
@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "TessBufferAllocator.h"
+
+using namespace std;
+using namespace XUSG;
+
+TessBufferAllocator::TessBufferAllocator(const Device::sptr& device) :
+    m_device(device),
+    m_stride(0),
+    m_bufferSize(0),
+    m_retiredSizes()
+{
+}
+
+TessBufferAllocator::~TessBufferAllocator()
+{
+}
+
+void TessBufferAllocator::Init(uint32_t numMeshes, uint32_t stride, const wchar_t* name)
+{
+    m_stride = stride;
+    m_name = name ? name : L"";
+    m_capacities.assign(numMeshes, 0);
+    m_buffer.reset();
+    m_bufferSize = 0;
+}
+
+bool TessBufferAllocator::Reserve(uint8_t frameIndex, const uint32_t* numElements,
+    const uint32_t* maxElements, bool& reallocated)
+{
+    // The frames that could still read the buffers retired at this frame index are complete.
+    m_retiredBuffers[frameIndex].clear();
+    m_retiredSizes[frameIndex] = 0;
+
+    reallocated = false;
+    const auto numMeshes = static_cast<uint32_t>(m_capacities.size());
+    for (auto i = 0u; i < numMeshes; ++i)
+        reallocated = reallocated || numElements[i] > m_capacities[i];
+    if (m_buffer && !reallocated) return true;
+
+    vector<uint32_t> firstElements(numMeshes);
+    auto numTotalElements = 0u;
+    for (auto i = 0u; i < numMeshes; ++i)
+    {
+        auto& capacity = m_capacities[i];
+        if (numElements[i] > capacity)
+            capacity = (min)((max)(numElements[i], capacity + capacity / 2), maxElements[i]);
+        capacity = (max)(capacity, 1u);
+
+        firstElements[i] = numTotalElements;
+        numTotalElements += capacity;
+    }
+
+    if (m_buffer)
+    {
+        m_retiredBuffers[frameIndex].emplace_back(move(m_buffer));
+        m_retiredSizes[frameIndex] += m_bufferSize;
+    }
+    m_buffer = StructuredBuffer::MakeUnique();
+    N_RETURN(m_buffer->Create(m_device.get(), numTotalElements, m_stride, ResourceFlag::ALLOW_UNORDERED_ACCESS,
+        MemoryType::DEFAULT, numMeshes, firstElements.data(), numMeshes, firstElements.data(),
+        MemoryFlag::NONE, m_name.c_str()), false);
+    m_bufferSize = static_cast<size_t>(numTotalElements) * m_stride;
+    reallocated = true;
+
+    return true;
+}
+
+StructuredBuffer* TessBufferAllocator::GetBuffer() const
+{
+    return m_buffer.get();
+}
+
+uint32_t TessBufferAllocator::GetCapacity(uint32_t meshIdx) const
+{
+    return m_capacities[meshIdx];
+}
+
+size_t TessBufferAllocator::GetSize() const
+{
+    // The replaced buffers are still allocated until the frames in flight are complete
+    auto size = m_bufferSize;
+    for (const auto& retiredSize : m_retiredSizes) size += retiredSize;
+
+    return size;
+}
@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+// Sub-allocator of the per-mesh tessellation buffers. The meshes share a single buffer,
+// with a view per mesh, which is sized for the active tessellation factor instead of the
+// maximum, and grows geometrically when a larger factor needs more room. The buffers it
+// replaces are kept until the frames in flight can no longer reference them.
+class TessBufferAllocator
+{
+public:
+    TessBufferAllocator(const XUSG::Device::sptr& device);
+    virtual ~TessBufferAllocator();
+
+    void Init(uint32_t numMeshes, uint32_t stride, const wchar_t* name);
+
+    // Makes room for numElements[i] of each mesh i, growing by at least half the capacity
+    // but never beyond maxElements[i]. Must be called every frame to release the buffers
+    // replaced FrameCount frames ago; reallocated tells whether the views have changed.
+    bool Reserve(uint8_t frameIndex, const uint32_t* numElements, const uint32_t* maxElements, bool& reallocated);
+
+    XUSG::StructuredBuffer* GetBuffer() const;
+    uint32_t GetCapacity(uint32_t meshIdx) const;
+    size_t GetSize() const;     // Bytes of the buffer and of the replaced ones still in flight
+
+    static const uint8_t FrameCount = 3;
+private:
+    XUSG::Device::sptr m_device;
+
+    uint32_t            m_stride;
+    std::wstring        m_name;
+    std::vector<uint32_t> m_capacities;
+    size_t              m_bufferSize;
+    size_t              m_retiredSizes[FrameCount];
+
+    XUSG::StructuredBuffer::uptr m_buffer;
+    std::vector<XUSG::StructuredBuffer::uptr> m_retiredBuffers[FrameCount];
+};
@@ -4,10 +4,7 @@
 
 #include "stdafx.h"
 #include "VRayTracer.h"
-#include "XUSGObjLoader.h"
-#define _INDEPENDENT_DDS_LOADER_
-#include "Advanced/XUSGDDSLoader.h"
-#undef _INDEPENDENT_DDS_LOADER_
+#include "Sampler.h"
 #include "DirectXPackedVector.h"
 
 using namespace std;
@@ -53,6 +50,24 @@ struct CBEnv
     XMFLOAT2 Viewport;
 };
 
+struct CBVisibility
+{
+    XMFLOAT4X4 WorldViewProj;
+    XMFLOAT3   LocalEyePt;
+    uint32_t   NumTriangles;
+    uint32_t   NumVerts;
+    uint32_t   InstanceIdx;
+    uint32_t   FrameStamp;
+};
+
+struct Cluster
+{
+    XMFLOAT3 Center;
+    XMFLOAT3 Extents;
+    XMFLOAT3 ConeAxis;
+    float    ConeCutoff;
+};
+
 const wchar_t* VRayTracer::HitGroupNames[] = { L"hitGroupRadiance", L"hitGroupShadow" };
 const wchar_t* VRayTracer::RaygenShaderName = L"raygenMain";
 const wchar_t* VRayTracer::ClosestHitShaderNames[] = { L"closestHitRadiance", L"closestHitShadow" };
@@ -61,13 +76,19 @@ const wchar_t* VRayTracer::MissShaderNames[] = { L"missRadiance", L"missShadow"
 VRayTracer::VRayTracer(const RayTracing::Device::sptr& device) :
     m_device(device),
     m_instances(),
-    m_tessFactor(2)
+    m_tessFactor(2),
+    m_frameStamp(0),
+    m_numVisibleVerts(),
+    m_isReadbackPending(),
+    m_haltonIndex(0)
 {
     m_shaderPool = ShaderPool::MakeUnique();
     m_rayTracingPipelineCache = RayTracing::PipelineCache::MakeUnique(device.get());
     m_graphicsPipelineCache = Graphics::PipelineCache::MakeUnique(device.get());
+    m_computePipelineCache = Compute::PipelineCache::MakeUnique(device.get());
     m_pipelineLayoutCache = PipelineLayoutCache::MakeUnique(device.get());
     m_descriptorTableCache = DescriptorTableCache::MakeUnique(device.get(), L"RayTracerDescriptorTableCache");
+    m_accumulator = make_unique<Accumulator>(device);
 
     AccelerationStructure::SetUAVCount(NUM_MESH + NUM_HIT_GROUP + 1);
 }
@@ -82,21 +103,20 @@ bool VRayTracer::Init(
     uint32_t                 height,
     vector<Resource::uptr>&  uploaders,
     GeometryBuffer*          pGeometries,
-    const char*              fileName,
-    const wchar_t*           envFileName,
-    Format                   rtFormat,
-    const XMFLOAT4&          posScale)
+    const SceneAssets&       assets,
+    Format                   rtFormat)
 {
     m_viewport = XMUINT2(width, height);
-    m_posScale = posScale;
+    m_posScale = assets.PosScale;
 
-    // Load inputs
-    ObjLoader objLoader;
-    if (!objLoader.Import(fileName, true, true)) return false;
+    // Create the inputs from the shared model
+    const auto& objLoader = assets.Model;
     auto numVertices = objLoader.GetNumVertices();
     auto numIndices = objLoader.GetNumIndices();
     N_RETURN(createVB(pCommandList, numVertices, objLoader.GetVertexStride(), objLoader.GetVertices(), uploaders), false);
     N_RETURN(createIB(pCommandList, numIndices, objLoader.GetIndices(), uploaders), false);
+    N_RETURN(createClusters(pCommandList, MODEL_OBJ, objLoader.GetVertices(), objLoader.GetVertexStride(),
+        objLoader.GetIndices(), uploaders), false);
 
     N_RETURN(createGroundMesh(pCommandList, uploaders), false);
 
@@ -108,13 +128,41 @@ bool VRayTracer::Init(
             L"GraphicsOut"), false);
     }
     
-    // Create vertex color buffer
+    // Create vertex color buffer, packed as R11G11B10_FLOAT
     {
         for (auto i = 0u; i < NUM_MESH; ++i)
         {
             auto& vertexColor = m_vertexColors[i];
             vertexColor = StructuredBuffer::MakeUnique();
-            N_RETURN(vertexColor->Create(m_device.get(), m_numVerts[i], sizeof(XMFLOAT3), ResourceFlag::ALLOW_UNORDERED_ACCESS), false);
+            N_RETURN(vertexColor->Create(m_device.get(), m_numVerts[i], sizeof(PackedVector::XMFLOAT3PK), ResourceFlag::ALLOW_UNORDERED_ACCESS), false);
+        }
+    }
+
+    // Create the vertex stamps of the last frames seen, and the compacted visible vertices
+    {
+        for (auto i = 0u; i < NUM_MESH; ++i)
+        {
+            auto& vertexStamps = m_vertexStamps[i];
+            vertexStamps = StructuredBuffer::MakeUnique();
+            N_RETURN(vertexStamps->Create(m_device.get(), m_numVerts[i], sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+                MemoryType::DEFAULT, 0, nullptr, 1, nullptr, MemoryFlag::NONE, L"VertexStamps"), false);
+
+            auto& visibleVerts = m_visibleVerts[i];
+            visibleVerts = StructuredBuffer::MakeUnique();
+            N_RETURN(visibleVerts->Create(m_device.get(), m_numVerts[i], sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+                MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"VisibleVerts"), false);
+        }
+
+        m_visibleCounts = StructuredBuffer::MakeUnique();
+        N_RETURN(m_visibleCounts->Create(m_device.get(), NUM_MESH, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+            MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"VisibleCounts"), false);
+
+        for (uint8_t i = 0; i < FrameCount; ++i)
+        {
+            m_readbacks[i] = RawBuffer::MakeUnique();
+            N_RETURN(m_readbacks[i]->Create(m_device.get(), sizeof(uint32_t[NUM_MESH]), ResourceFlag::NONE,
+                MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE,
+                (L"VisibleCountReadback" + to_wstring(i)).c_str()), false);
         }
     }
 
@@ -126,6 +174,14 @@ bool VRayTracer::Init(
     N_RETURN(m_cbEnv->Create(m_device.get(), sizeof(CBEnv[FrameCount]), FrameCount,
         nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBEnv"), false);
 
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        auto& cbVisibility = m_cbVisibility[i];
+        cbVisibility = ConstantBuffer::MakeUnique();
+        N_RETURN(cbVisibility->Create(m_device.get(), sizeof(CBVisibility[FrameCount]), FrameCount,
+            nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBVisibility"), false);
+    }
+
     m_cbMaterials = ConstantBuffer::MakeUnique();
     N_RETURN(m_cbMaterials->Create(m_device.get(), sizeof(CBMaterial), 1,
         nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBMaterial"), false);
@@ -145,15 +201,7 @@ bool VRayTracer::Init(
             nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBGraphics"), false);
     }
 
-    // Load input image
-    {
-        DDS::Loader textureLoader;
-        DDS::AlphaMode alphaMode;
-
-        uploaders.emplace_back(Resource::MakeUnique());
-        N_RETURN(textureLoader.CreateTextureFromFile(m_device.get(), static_cast<XUSG::CommandList*>(pCommandList), envFileName,
-            8192, false, m_lightProbe, uploaders.back().get(), &alphaMode), false);
-    }
+    m_lightProbe = assets.LightProbe;
 
     const auto dsFormat = Format::D24_UNORM_S8_UINT;
     m_depth = DepthStencil::MakeUnique();
@@ -169,74 +217,24 @@ bool VRayTracer::Init(
     N_RETURN(buildAccelerationStructures(pCommandList, pGeometries), false);
     N_RETURN(buildShaderTables(), false);
 
-    return true;
-}
-
-static const XMFLOAT2& IncrementalHalton()
-{
-    static auto haltonBase = XMUINT2(0, 0);
-    static auto halton = XMFLOAT2(0.0f, 0.0f);
-
-    // Base 2
-    {
-        // Bottom bit always changes, higher bits
-        // Change less frequently.
-        auto change = 0.5f;
-        auto oldBase = haltonBase.x++;
-        auto diff = haltonBase.x ^ oldBase;
-
-        // Diff will be of the form 0*1+, i.e. one bits up until the last carry.
-        // Expected iterations = 1 + 0.5 + 0.25 + ... = 2
-        do
-        {
-            halton.x += (oldBase & 1) ? -change : change;
-            change *= 0.5f;
+    // Create progressive accumulation
+    N_RETURN(m_accumulator->Init(width, height, m_outputView.get(), m_descriptorTableCache.get()), false);
 
-            diff = diff >> 1;
-            oldBase = oldBase >> 1;
-        } while (diff);
-    }
-
-    // Base 3
-    {
-        const auto oneThird = 1.0f / 3.0f;
-        auto mask = 0x3u;	// Also the max base 3 digit
-        auto add = 0x1u;	// Amount to add to force carry once digit == 3
-        auto change = oneThird;
-        ++haltonBase.y;
-
-        // Expected iterations: 1.5
-        while (true)
-        {
-            if ((haltonBase.y & mask) == mask)
-            {
-                haltonBase.y += add;	// Force carry into next 2-bit digit
-                halton.y -= 2 * change;
-
-                mask = mask << 2;
-                add = add << 2;
-
-                change *= oneThird;
-            }
-            else
-            {
-                halton.y += change;	// We know digit n has gone from a to a + 1
-                break;
-            }
-        };
-    }
-
-    return halton;
+    return true;
 }
 
 void VRayTracer::UpdateFrame(
     uint8_t   frameIndex,
     CXMVECTOR eyePt,
     CXMMATRIX viewProj,
+    float     modelAngle,
     float     timeStep,
     uint32_t  tessFactor)
 {
-    const auto halton = IncrementalHalton();
+    // The visible vertices of the frame that previously used this slot are ready
+    readbackVisibleCounts(frameIndex);
+
+    const auto halton = Sampler(Sampler::HALTON).Get(++m_haltonIndex);
     XMFLOAT2 projBias =
     {
         (halton.x * 2.0f - 1.0f) / m_viewport.x,
@@ -261,9 +259,7 @@ void VRayTracer::UpdateFrame(
     }
 
     {
-        static auto angle = 0.0f;
-        angle += 16.0f * timeStep * XM_PI / 180.0f;
-        const auto rot = XMMatrixRotationY(angle);
+        const auto rot = XMMatrixRotationY(modelAngle);
 
         XMMATRIX worlds[NUM_MESH] =
         {
@@ -291,9 +287,24 @@ void VRayTracer::UpdateFrame(
             XMStoreFloat4x4(&pCbGraphics->WorldViewProj, XMMatrixTranspose(worlds[i] * viewProj));
             XMStoreFloat3x4(&pCbGraphics->WorldIT, i ? rot : XMMatrixIdentity());
         }
+
+        // Culling without the jitter, and with the eye in the object space for the exact facing
+        ++m_frameStamp;
+        for (auto i = 0u; i < NUM_MESH; ++i)
+        {
+            const auto pCbVisibility = reinterpret_cast<CBVisibility*>(m_cbVisibility[i]->Map(frameIndex));
+            XMStoreFloat4x4(&pCbVisibility->WorldViewProj, XMMatrixTranspose(worlds[i] * viewProj));
+            XMStoreFloat3(&pCbVisibility->LocalEyePt, XMVector3TransformCoord(eyePt, XMMatrixInverse(nullptr, worlds[i])));
+            pCbVisibility->NumTriangles = m_numIndices[i] / 3;
+            pCbVisibility->NumVerts = m_numVerts[i];
+            pCbVisibility->InstanceIdx = i;
+            pCbVisibility->FrameStamp = m_frameStamp;
+        }
     }
 
     m_tessFactor = tessFactor;
+
+    m_accumulator->UpdateFrame(frameIndex, viewProj, timeStep, tessFactor);
 }
 
 void VRayTracer::Render(
@@ -313,8 +324,10 @@ void VRayTracer::Render(
 
     zPrepass(pCommandList, frameIndex);
     envPrepass(pCommandList, frameIndex);
+    cull(pCommandList, frameIndex);
     raytrace(pCommandList, frameIndex);
     rasterize(pCommandList, frameIndex);
+    if (m_accumulator->IsEnabled()) m_accumulator->Accumulate(pCommandList, frameIndex);
     toneMap(pCommandList, rtv, numBarriers, pBarriers);
 }
 
@@ -337,6 +350,32 @@ void VRayTracer::UpdateAccelerationStructures(
     m_topLevelAS->Build(pCommandList, m_scratch.get(), m_instances[frameIndex].get(), descriptorPool, true);
 }
 
+Accumulator* VRayTracer::GetAccumulator() const
+{
+    return m_accumulator.get();
+}
+
+uint8_t VRayTracer::GetMaxTessFactor() const
+{
+    return MaxTessFactor;
+}
+
+uint32_t VRayTracer::GetNumVisibleVerts() const
+{
+    auto numVerts = 0u;
+    for (const auto& numVisibleVerts : m_numVisibleVerts) numVerts += numVisibleVerts;
+
+    return numVerts;
+}
+
+uint32_t VRayTracer::GetNumVerts() const
+{
+    auto numVerts = 0u;
+    for (const auto& numMeshVerts : m_numVerts) numVerts += numMeshVerts;
+
+    return numVerts;
+}
+
 bool VRayTracer::createVB(
     RayTracing::CommandList* pCommandList,
     uint32_t                 numVert,
@@ -380,10 +419,12 @@ bool VRayTracer::createGroundMesh(
     vector<Resource::uptr>&  uploaders)
 {
     const uint32_t N = 100;
+
+    // Cube vertices positions and corresponding triangle normals.
+    static Vertex vertices[N * N * 6];
+
     // Vertex buffer
     {
-        // Cube vertices positions and corresponding triangle normals.
-        static Vertex vertices[N * N * 6];
         for (auto i = 0u; i < N; ++i)
             for (auto j = 0u; j < N; ++j)
                 vertices[N * i + j] = { 
@@ -470,11 +511,82 @@ bool VRayTracer::createGroundMesh(
         uploaders.push_back(Resource::MakeUnique());
         N_RETURN(indexBuffer->Upload(pCommandList, uploaders.back().get(), indices,
             sizeof(indices), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE), false);
+
+        N_RETURN(createClusters(pCommandList, GROUND, reinterpret_cast<const uint8_t*>(vertices),
+            sizeof(Vertex), &indices[0][0][0][0][0], uploaders), false);
     }
 
     return true;
 }
 
+bool VRayTracer::createClusters(
+    RayTracing::CommandList* pCommandList,
+    uint32_t                 meshIdx,
+    const uint8_t*           pVertices,
+    uint32_t                 stride,
+    const uint32_t*          pIndices,
+    vector<Resource::uptr>&  uploaders)
+{
+    const auto getPos = [&](uint32_t i) { return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * pIndices[i]])); };
+
+    // Bounds and normal cones of runs of triangles, in the object space
+    const auto numTriangles = m_numIndices[meshIdx] / 3;
+    vector<Cluster> clusters(DIV_UP(numTriangles, TrianglesPerCluster));
+    for (auto c = 0u; c < clusters.size(); ++c)
+    {
+        const auto firstTriangle = c * TrianglesPerCluster;
+        const auto endTriangle = (min)(firstTriangle + TrianglesPerCluster, numTriangles);
+
+        auto minPt = XMVectorReplicate(FLT_MAX);
+        auto maxPt = XMVectorReplicate(-FLT_MAX);
+        auto normalSum = XMVectorZero();
+        for (auto t = firstTriangle; t < endTriangle; ++t)
+        {
+            const auto p0 = getPos(3 * t);
+            const auto p1 = getPos(3 * t + 1);
+            const auto p2 = getPos(3 * t + 2);
+            minPt = XMVectorMin(XMVectorMin(minPt, p0), XMVectorMin(p1, p2));
+            maxPt = XMVectorMax(XMVectorMax(maxPt, p0), XMVectorMax(p1, p2));
+
+            const auto normal = XMVector3Cross(p1 - p0, p2 - p0);
+            if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f) normalSum += XMVector3Normalize(normal);
+        }
+
+        // The cone around the mean normal, given up for spreads of 90 degrees and more
+        auto& cluster = clusters[c];
+        XMStoreFloat3(&cluster.Center, (minPt + maxPt) * 0.5f);
+        XMStoreFloat3(&cluster.Extents, (maxPt - minPt) * 0.5f);
+        cluster.ConeAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        cluster.ConeCutoff = 2.0f;
+        if (XMVectorGetX(XMVector3LengthSq(normalSum)) <= 0.0f) continue;
+
+        auto minDot = 1.0f;
+        const auto axis = XMVector3Normalize(normalSum);
+        for (auto t = firstTriangle; t < endTriangle; ++t)
+        {
+            const auto p0 = getPos(3 * t);
+            const auto normal = XMVector3Cross(getPos(3 * t + 1) - p0, getPos(3 * t + 2) - p0);
+            if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+                minDot = (min)(minDot, XMVectorGetX(XMVector3Dot(XMVector3Normalize(normal), axis)));
+        }
+
+        if (minDot > 0.0f)
+        {
+            XMStoreFloat3(&cluster.ConeAxis, axis);
+            cluster.ConeCutoff = sqrt(1.0f - minDot * minDot);
+        }
+    }
+
+    auto& clusterBuffer = m_clusters[meshIdx];
+    clusterBuffer = StructuredBuffer::MakeUnique();
+    N_RETURN(clusterBuffer->Create(m_device.get(), static_cast<uint32_t>(clusters.size()), sizeof(Cluster),
+        ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 0, nullptr, MemoryFlag::NONE, L"Clusters"), false);
+    uploaders.emplace_back(Resource::MakeUnique());
+
+    return clusterBuffer->Upload(pCommandList, uploaders.back().get(), clusters.data(),
+        sizeof(Cluster) * clusters.size(), 0, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+}
+
 bool VRayTracer::createInputLayout()
 {
     // Define the vertex input layout.
@@ -511,6 +623,20 @@ bool VRayTracer::createPipelineLayouts()
         pipelineLayout->SetShaderStage(0, Shader::Stage::PS);
         X_RETURN(m_pipelineLayouts[ENV_PRE_LAYOUT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutCache.get(), PipelineLayoutFlag::NONE, L"EnvPrepassPipelineLayout"), false);
     }
+
+    // Visibility and compaction pipeline layout
+    {
+        const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+        pipelineLayout->SetRootCBV(0, 0);
+        pipelineLayout->SetRange(1, DescriptorType::SRV, NUM_MESH, 0, 0);
+        pipelineLayout->SetRange(2, DescriptorType::SRV, NUM_MESH, 0, 1);
+        pipelineLayout->SetRange(3, DescriptorType::SRV, NUM_MESH, 0, 2);
+        pipelineLayout->SetRange(4, DescriptorType::UAV, NUM_MESH, 0, 0);
+        pipelineLayout->SetRange(5, DescriptorType::UAV, NUM_MESH, 0, 1);
+        pipelineLayout->SetRange(6, DescriptorType::UAV, 1, 0, 2);
+        X_RETURN(m_pipelineLayouts[VISIBILITY_LAYOUT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutCache.get(),
+            PipelineLayoutFlag::NONE, L"VisibilityPipelineLayout"), false);
+    }
     
     // Global pipeline layout
     // This is a pipeline layout that is shared across all raytracing shaders invoked during a DispatchRays() call.
@@ -525,6 +651,8 @@ bool VRayTracer::createPipelineLayouts()
         pipelineLayout->SetRootCBV(CONSTANTS, 1);
         pipelineLayout->SetConstants(INSTANCE_IDX, SizeOfInUint32(uint32_t), 3);
         pipelineLayout->SetRange(ENV_TEXTURE, DescriptorType::SRV, 1, 1);
+        pipelineLayout->SetRange(VISIBLE_VERTS, DescriptorType::SRV, NUM_MESH, 0, 3);
+        pipelineLayout->SetRange(VISIBLE_COUNTS, DescriptorType::SRV, 1, 2);
         X_RETURN(m_pipelineLayouts[RT_GLOBAL_LAYOUT], pipelineLayout->GetPipelineLayout(
             m_device.get(), m_pipelineLayoutCache.get(), PipelineLayoutFlag::NONE,
             L"RayTracerGlobalPipelineLayout"), false);
@@ -586,6 +714,8 @@ bool VRayTracer::createPipelines(Format rtFormat, Format dsFormat)
     N_RETURN(m_shaderPool->CreateShader(Shader::Stage::DS, ShaderIndex::DS_GRAPHICS, L"VDomainShader.cso"), false);
     N_RETURN(m_shaderPool->CreateShader(Shader::Stage::PS, ShaderIndex::PS_GRAPHICS, L"VPixelShader.cso"), false);
     N_RETURN(m_shaderPool->CreateShader(Shader::Stage::PS, ShaderIndex::PS_TONEMAP, L"PSToneMap.cso"), false);
+    N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, ShaderIndex::CS_VISIBILITY, L"CSVisibility.cso"), false);
+    N_RETURN(m_shaderPool->CreateShader(Shader::Stage::CS, ShaderIndex::CS_COMPACT_VERTS, L"CSCompactVerts.cso"), false);
 
     // Z prepass
     {
@@ -610,6 +740,22 @@ bool VRayTracer::createPipelines(Format rtFormat, Format dsFormat)
         state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
         X_RETURN(m_pipelines[ENV_PREPASS], state->GetPipeline(m_graphicsPipelineCache.get(), L"EnvPrepass"), false);
     }
+
+    // Visibility
+    {
+        const auto state = Compute::State::MakeUnique();
+        state->SetPipelineLayout(m_pipelineLayouts[VISIBILITY_LAYOUT]);
+        state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, ShaderIndex::CS_VISIBILITY));
+        X_RETURN(m_pipelines[VISIBILITY], state->GetPipeline(m_computePipelineCache.get(), L"Visibility"), false);
+    }
+
+    // Compaction of the visible vertices
+    {
+        const auto state = Compute::State::MakeUnique();
+        state->SetPipelineLayout(m_pipelineLayouts[VISIBILITY_LAYOUT]);
+        state->SetShader(m_shaderPool->GetShader(Shader::Stage::CS, ShaderIndex::CS_COMPACT_VERTS));
+        X_RETURN(m_pipelines[COMPACT_VERTS], state->GetPipeline(m_computePipelineCache.get(), L"CompactVerts"), false);
+    }
     
     // Ray tracing pass
     {
@@ -711,6 +857,54 @@ bool VRayTracer::createDescriptorTables()
         X_RETURN(m_srvTables[SRV_TABLE_VCOLOR], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false)
     }
 
+    // Cluster SRVs
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_clusters[i]->GetSRV();
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_CLUSTERS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Visible vertex SRVs and UAVs
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_visibleVerts[i]->GetSRV();
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_srvTables[SRV_TABLE_VISIBLE_VERTS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_visibleVerts[i]->GetUAV();
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_uavTables[UAV_TABLE_VISIBLE_VERTS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Vertex stamp UAVs
+    {
+        Descriptor descriptors[NUM_MESH];
+        for (auto i = 0u; i < NUM_MESH; ++i) descriptors[i] = m_vertexStamps[i]->GetUAV();
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+        X_RETURN(m_uavTables[UAV_TABLE_VERTEX_STAMPS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    // Visible count SRV and UAV
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_visibleCounts->GetSRV());
+        X_RETURN(m_srvTables[SRV_TABLE_VISIBLE_COUNTS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
+    {
+        const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+        descriptorTable->SetDescriptors(0, 1, &m_visibleCounts->GetUAV());
+        X_RETURN(m_uavTables[UAV_TABLE_VISIBLE_COUNTS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableCache.get()), false);
+    }
+
     // Output SRV for tone mapping
     {
         const auto descriptorTable = Util::DescriptorTable::MakeUnique();
@@ -888,6 +1082,54 @@ void VRayTracer::envPrepass(
     pCommandList->Draw(3, 1, 0, 0);
 }
 
+void VRayTracer::cull(
+    const XUSG::CommandList* pCommandList,
+    uint8_t                  frameIndex)
+{
+    ResourceBarrier barriers[2 * NUM_MESH + 1];
+    auto numBarriers = m_visibleCounts->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        numBarriers = m_vertexStamps[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+        numBarriers = m_visibleVerts[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+    }
+    pCommandList->Barrier(numBarriers, barriers);
+
+    pCommandList->SetComputePipelineLayout(m_pipelineLayouts[VISIBILITY_LAYOUT]);
+    pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_IB]);
+    pCommandList->SetComputeDescriptorTable(2, m_srvTables[SRV_TABLE_VB]);
+    pCommandList->SetComputeDescriptorTable(3, m_srvTables[SRV_TABLE_CLUSTERS]);
+    pCommandList->SetComputeDescriptorTable(4, m_uavTables[UAV_TABLE_VERTEX_STAMPS]);
+    pCommandList->SetComputeDescriptorTable(5, m_uavTables[UAV_TABLE_VISIBLE_VERTS]);
+    pCommandList->SetComputeDescriptorTable(6, m_uavTables[UAV_TABLE_VISIBLE_COUNTS]);
+
+    // Stamp the vertices of the visible triangles, one group per cluster
+    pCommandList->SetPipelineState(m_pipelines[VISIBILITY]);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        pCommandList->SetComputeRootConstantBufferView(0, m_cbVisibility[i].get(), m_cbVisibility[i]->GetCBVOffset(frameIndex));
+        pCommandList->Dispatch(DIV_UP(m_numIndices[i] / 3, TrianglesPerCluster), 1, 1);
+    }
+
+    numBarriers = m_visibleCounts->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+        numBarriers = m_vertexStamps[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+    pCommandList->Barrier(numBarriers, barriers);
+
+    // Compact the stamped vertices
+    pCommandList->SetPipelineState(m_pipelines[COMPACT_VERTS]);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+    {
+        pCommandList->SetComputeRootConstantBufferView(0, m_cbVisibility[i].get(), m_cbVisibility[i]->GetCBVOffset(frameIndex));
+        pCommandList->Dispatch(DIV_UP(m_numVerts[i], 64), 1, 1);
+    }
+
+    numBarriers = m_visibleCounts->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+    for (auto i = 0u; i < NUM_MESH; ++i)
+        numBarriers = m_visibleVerts[i]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+    pCommandList->Barrier(numBarriers, barriers);
+}
+
 void VRayTracer::raytrace(
     const RayTracing::CommandList* pCommandList,
     uint8_t                        frameIndex)
@@ -902,7 +1144,10 @@ void VRayTracer::raytrace(
     pCommandList->SetComputeRootConstantBufferView(MATERIALS, m_cbMaterials.get());
     pCommandList->SetComputeRootConstantBufferView(CONSTANTS, m_cbGlobal.get(), m_cbGlobal->GetCBVOffset(frameIndex));
     pCommandList->SetComputeDescriptorTable(ENV_TEXTURE, m_srvTables[SRV_TABLE_ENV]);
+    pCommandList->SetComputeDescriptorTable(VISIBLE_VERTS, m_srvTables[SRV_TABLE_VISIBLE_VERTS]);
+    pCommandList->SetComputeDescriptorTable(VISIBLE_COUNTS, m_srvTables[SRV_TABLE_VISIBLE_COUNTS]);
 
+    // Without indirect dispatch, the rays past the visible vertices exit in the ray generation
     for (auto i = 0u; i < NUM_MESH; ++i)
     {
         pCommandList->SetCompute32BitConstant(INSTANCE_IDX, i);
@@ -911,13 +1156,18 @@ void VRayTracer::raytrace(
             m_hitGroupShaderTable.get(), m_missShaderTable.get(), m_rayGenShaderTables[frameIndex].get());
     }
 
-    ResourceBarrier barriers[2];
+    ResourceBarrier barriers[NUM_MESH + 1];
     uint32_t numBarriers = 0;
     for (auto i = 0u; i < NUM_MESH; ++i)
     {
         numBarriers = m_vertexColors[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
     }
+    numBarriers = m_visibleCounts->SetBarrier(barriers, ResourceState::COPY_SOURCE, numBarriers);
     pCommandList->Barrier(numBarriers, barriers);
+
+    // Read the visible vertex counts back once this frame has completed
+    pCommandList->CopyBufferRegion(m_readbacks[frameIndex].get(), 0, m_visibleCounts.get(), 0, sizeof(uint32_t[NUM_MESH]));
+    m_isReadbackPending[frameIndex] = true;
 }
 
 void VRayTracer::rasterize(
@@ -965,7 +1215,8 @@ void VRayTracer::toneMap(
     pCommandList->OMSetRenderTargets(1, &rtv);
 
     pCommandList->SetGraphicsPipelineLayout(m_pipelineLayouts[TONEMAP_LAYOUT]);
-    pCommandList->SetGraphicsDescriptorTable(0, m_srvTables[SRV_TABLE_OUTPUT]);
+    pCommandList->SetGraphicsDescriptorTable(0, m_accumulator->IsEnabled() ?
+        m_accumulator->GetSRVTable() : m_srvTables[SRV_TABLE_OUTPUT]);
 
     pCommandList->SetPipelineState(m_pipelines[TONEMAP]);
 
@@ -977,3 +1228,17 @@ void VRayTracer::toneMap(
     pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLELIST);
     pCommandList->Draw(3, 1, 0, 0);
 }
+
+void VRayTracer::readbackVisibleCounts(uint8_t frameIndex)
+{
+    if (!m_isReadbackPending[frameIndex]) return;
+
+    const auto pCounts = reinterpret_cast<const uint32_t*>(m_readbacks[frameIndex]->Map(0, 0, sizeof(uint32_t[NUM_MESH])));
+    if (pCounts)
+    {
+        memcpy(m_numVisibleVerts, pCounts, sizeof(m_numVisibleVerts));
+        m_readbacks[frameIndex]->Unmap();
+    }
+
+    m_isReadbackPending[frameIndex] = false;
+}
@@ -4,39 +4,37 @@
 
 #pragma once
 
-#include "Core/XUSG.h"
-#include "RayTracing/XUSGRayTracing.h"
+#include "RayTracer.h"
 
-class VRayTracer
+class VRayTracer :
+    public RayTracer
 {
 public:
-    enum MeshIndex : uint32_t
-    {
-        GROUND,
-        MODEL_OBJ,
-
-        NUM_MESH
-    };
-
     VRayTracer(const XUSG::RayTracing::Device::sptr& device);
     virtual ~VRayTracer();
 
     bool Init(XUSG::RayTracing::CommandList* pCommandList, uint32_t width, uint32_t height,
         std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometries,
-        const char* fileName, const wchar_t* envFileName, XUSG::Format rtFormat,
-        const DirectX::XMFLOAT4& posScale = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
-    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float timeStep, uint32_t tessFactor);
-    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers);
-    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex);
-
-    static const uint8_t FrameCount = 3;
-    static const uint8_t MinTessFactor = 1;
+        const SceneAssets& assets, XUSG::Format rtFormat) override;
+    void UpdateFrame(uint8_t frameIndex, DirectX::CXMVECTOR eyePt, DirectX::CXMMATRIX viewProj, float modelAngle, float timeStep, uint32_t tessFactor) override;
+    void Render(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers) override;
+    void UpdateAccelerationStructures(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex) override;
+
+    Accumulator* GetAccumulator() const override;
+    uint8_t GetMaxTessFactor() const override;
+
+    // Vertices traced per frame, read back a few frames late, vs. all the vertices
+    uint32_t GetNumVisibleVerts() const override;
+    uint32_t GetNumVerts() const override;
+
     static const uint8_t MaxTessFactor = 9;
+    static const uint32_t TrianglesPerCluster = 64;
 private:
     enum PipelineLayoutIndex : uint8_t
     {
         Z_PRE_LAYOUT,
         ENV_PRE_LAYOUT,
+        VISIBILITY_LAYOUT,
         
         RT_GLOBAL_LAYOUT,
         RAY_GEN_LAYOUT,
@@ -52,6 +50,8 @@ private:
     {
         Z_PREPASS,
         ENV_PREPASS,
+        VISIBILITY,
+        COMPACT_VERTS,
         RAY_TRACING,
         GRAPHICS,
         TONEMAP,
@@ -70,6 +70,8 @@ private:
         CONSTANTS,
         INSTANCE_IDX,
         ENV_TEXTURE,
+        VISIBLE_VERTS,
+        VISIBLE_COUNTS,
         OUTPUT_VIEW
     };
 
@@ -80,6 +82,9 @@ private:
         SRV_TABLE_ENV,
         SRV_TABLE_VCOLOR,
         SRV_TABLE_OUTPUT,
+        SRV_TABLE_CLUSTERS,
+        SRV_TABLE_VISIBLE_VERTS,
+        SRV_TABLE_VISIBLE_COUNTS,
 
         NUM_SRV_TABLE
     };
@@ -88,6 +93,9 @@ private:
     {
         UAV_TABLE_RT,
         UAV_TABLE_OUTPUT,
+        UAV_TABLE_VERTEX_STAMPS,
+        UAV_TABLE_VISIBLE_VERTS,
+        UAV_TABLE_VISIBLE_COUNTS,
 
         NUM_UAV_TABLE
     };
@@ -112,7 +120,9 @@ private:
         HS_GRAPHICS,
         DS_GRAPHICS,
         PS_GRAPHICS,
-        PS_TONEMAP
+        PS_TONEMAP,
+        CS_VISIBILITY,
+        CS_COMPACT_VERTS
     };
 
     bool createVB(XUSG::RayTracing::CommandList* pCommandList, uint32_t numVert,
@@ -121,6 +131,9 @@ private:
         const uint32_t* pData, std::vector<XUSG::Resource::uptr>& uploaders);
     bool createGroundMesh(XUSG::RayTracing::CommandList* pCommandList,
         std::vector<XUSG::Resource::uptr>& uploaders);
+    bool createClusters(XUSG::RayTracing::CommandList* pCommandList, uint32_t meshIdx,
+        const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+        std::vector<XUSG::Resource::uptr>& uploaders);
     bool createInputLayout();
     bool createPipelineLayouts();
     bool createPipelines(XUSG::Format rtFormat, XUSG::Format dsFormat);
@@ -131,17 +144,23 @@ private:
 
     void zPrepass(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
     void envPrepass(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
+    void cull(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
     void raytrace(const XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex);
     void rasterize(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
     void toneMap(const XUSG::CommandList* pCommandList, const XUSG::Descriptor& rtv, uint32_t numBarriers, XUSG::ResourceBarrier* pBarriers);
+    void readbackVisibleCounts(uint8_t frameIndex);
 
     XUSG::RayTracing::Device::sptr m_device;
 
     uint32_t            m_numIndices[NUM_MESH];
     uint32_t            m_numVerts[NUM_MESH];
     uint32_t            m_tessFactor;
+    uint32_t            m_frameStamp;
+    uint32_t            m_numVisibleVerts[NUM_MESH];
+    bool                m_isReadbackPending[FrameCount];
 
     DirectX::XMUINT2    m_viewport;
+    uint32_t            m_haltonIndex;  // Of the jitter, one point per frame
     DirectX::XMFLOAT4   m_posScale;
     DirectX::XMFLOAT4X4 m_worlds[NUM_MESH];
 
@@ -163,14 +182,24 @@ private:
     XUSG::Texture2D::uptr           m_outputView;
     XUSG::StructuredBuffer::uptr    m_vertexColors[NUM_MESH];
 
+    // Cluster culling and compaction of the visible vertices
+    XUSG::StructuredBuffer::uptr    m_clusters[NUM_MESH];
+    XUSG::StructuredBuffer::uptr    m_vertexStamps[NUM_MESH];
+    XUSG::StructuredBuffer::uptr    m_visibleVerts[NUM_MESH];
+    XUSG::StructuredBuffer::uptr    m_visibleCounts;
+    XUSG::RawBuffer::uptr           m_readbacks[FrameCount];
+
     XUSG::ConstantBuffer::uptr      m_cbMaterials;
     XUSG::ConstantBuffer::uptr      m_cbGlobal;
     XUSG::ConstantBuffer::uptr      m_cbGraphics[NUM_MESH];
     XUSG::ConstantBuffer::uptr      m_cbEnv;
+    XUSG::ConstantBuffer::uptr      m_cbVisibility[NUM_MESH];
 
     XUSG::Resource::uptr            m_scratch;
     XUSG::Resource::uptr            m_instances[FrameCount];
 
+    std::unique_ptr<Accumulator>    m_accumulator;
+
     XUSG::ShaderResource::sptr      m_lightProbe;
 
     // Shader tables
@@ -186,6 +215,7 @@ private:
     XUSG::ShaderPool::uptr                  m_shaderPool;
     XUSG::RayTracing::PipelineCache::uptr   m_rayTracingPipelineCache;
     XUSG::Graphics::PipelineCache::uptr     m_graphicsPipelineCache;
+    XUSG::Compute::PipelineCache::uptr      m_computePipelineCache;
     XUSG::PipelineLayoutCache::uptr         m_pipelineLayoutCache;
     XUSG::DescriptorTableCache::uptr        m_descriptorTableCache;
 };
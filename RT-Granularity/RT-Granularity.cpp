@@ -32,7 +32,16 @@ RTGranularity::RTGranularity(uint32_t width, uint32_t height, std::wstring name)
     m_meshFileName("Assets/bunny.obj"),
     m_envFileName(L"Assets/galileo_cross.dds"),
     m_meshPosScale(0.0f, 0.0f, 0.0f, 1.0f),
-    m_tessFactor(2)
+    m_tessFactor(2),
+    m_modelAngle(0.0f),
+    m_mode(RayTracer::PER_PIXEL),
+    m_switchTime(0.0),
+    m_tessBufferBudget(256 << 20),
+    m_isProgressive(false),
+    m_numAutoRefSamples(0),
+    m_numLoggedSamples(0),
+    m_isReplaying(false),
+    m_numReplayFrames(0)
 {
 #if defined (_DEBUG)
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -55,6 +64,16 @@ void RTGranularity::OnInit()
 {
     LoadPipeline();
     LoadAssets();
+
+    // The replay steps by 1/60 s whatever the frame rate, so the timer does too
+    if (!m_replayFileName.empty())
+    {
+        if (!m_cameraPath.Load(m_replayFileName.c_str())) ThrowIfFailed(E_FAIL);
+        m_cameraReplay.Init(m_cameraPath, m_numReplayFrames, 1.0f / 60.0f);
+        m_timer.SetFixedTimeStep(true);
+        m_timer.SetTargetElapsedSeconds(1.0 / 60.0);
+        m_isReplaying = true;
+    }
 }
 
 // Load the rendering pipeline dependencies.
@@ -162,15 +181,10 @@ void RTGranularity::LoadAssets()
 
     vector<Resource::uptr> uploaders(0);
 
-    // Create ray tracer
-    {
-        m_rayTracer = make_unique<RayTracer>(m_device);
-        if (!m_rayTracer) ThrowIfFailed(E_FAIL);
-
-        GeometryBuffer geometries[RayTracer::NUM_MESH];
-        if (!m_rayTracer->Init(pCommandList, m_width, m_height, uploaders, geometries, m_meshFileName.c_str(),
-            m_envFileName.c_str(), Format::R8G8B8A8_UNORM, m_meshPosScale)) ThrowIfFailed(E_FAIL);
-    }
+    // Load the assets shared by the ray tracers, and create the selected one
+    N_RETURN(RayTracer::LoadSceneAssets(m_sceneAssets, m_device.get(), static_cast<XUSG::CommandList*>(pCommandList),
+        uploaders, m_meshFileName.c_str(), m_envFileName.c_str(), m_meshPosScale), ThrowIfFailed(E_FAIL));
+    CreateRayTracer(pCommandList, uploaders);
 
     // Close the command list and execute it to begin the initial GPU setup.
     N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
@@ -214,12 +228,61 @@ void RTGranularity::LoadAssets()
     XMStoreFloat4x4(&m_view, view);
 }
 
+void RTGranularity::CreateRayTracer(RayTracing::CommandList* pCommandList, vector<Resource::uptr>& uploaders)
+{
+    auto& rayTracer = m_rayTracers[m_mode];
+    rayTracer = RayTracer::Create(m_mode, m_device);
+    if (!rayTracer) ThrowIfFailed(E_FAIL);
+    rayTracer->SetTessBufferBudget(m_tessBufferBudget);
+
+    GeometryBuffer geometries[RayTracer::NUM_MESH];
+    if (!rayTracer->Init(pCommandList, m_width, m_height, uploaders, geometries,
+        m_sceneAssets, Format::R8G8B8A8_UNORM)) ThrowIfFailed(E_FAIL);
+    rayTracer->GetAccumulator()->SetEnabled(m_isProgressive);
+    rayTracer->GetAccumulator()->SetAutoReference(m_numAutoRefSamples);
+    m_tessFactor = (min)(m_tessFactor, static_cast<uint32_t>(rayTracer->GetMaxTessFactor()));
+}
+
+// Switch to another ray tracer, creating it on the first use.
+void RTGranularity::SwitchRayTracer(RayTracer::Mode mode)
+{
+    const auto startTime = chrono::high_resolution_clock::now();
+
+    m_mode = mode;
+    const auto& rayTracer = m_rayTracers[mode];
+    if (rayTracer)
+    {
+        rayTracer->GetAccumulator()->SetEnabled(m_isProgressive);
+        m_tessFactor = (min)(m_tessFactor, static_cast<uint32_t>(rayTracer->GetMaxTessFactor()));
+    }
+    else
+    {
+        // The geometry allocator is free again once the GPU is idle.
+        WaitForGpu();
+        const auto commandAllocator = m_commandAllocators[ALLOCATOR_GEOMETRY][m_frameIndex].get();
+        N_RETURN(commandAllocator->Reset(), ThrowIfFailed(E_FAIL));
+
+        const auto pCommandList = m_commandLists[UNIVERSAL].get();
+        N_RETURN(pCommandList->Reset(commandAllocator, nullptr), ThrowIfFailed(E_FAIL));
+
+        vector<Resource::uptr> uploaders(0);
+        CreateRayTracer(pCommandList, uploaders);
+
+        N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
+        m_commandQueues[UNIVERSAL]->ExecuteCommandList(pCommandList);
+        WaitForGpu();
+    }
+
+    m_switchTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count();
+}
+
 // Update frame-based values.
 void RTGranularity::OnUpdate()
 {
     // Timer
     static auto time = 0.0, pauseTime = 0.0;
 
+    m_frameRecorder.BeginFrame();
     m_timer.Tick();
     float timeStep;
     const auto totalTime = CalculateFrameStats(&timeStep);
@@ -227,37 +290,72 @@ void RTGranularity::OnUpdate()
     time = totalTime - pauseTime;
     timeStep = m_isPaused ? 0.0f : timeStep;
 
+    // The replay updates and renders each frame of the path, then quits
+    if (m_isReplaying)
+    {
+        if (!m_cameraReplay.Step(*this)) PostQuitMessage(0);
+
+        return;
+    }
+
+    const auto frame = GetCameraFrame();
+    if (!m_recordFileName.empty()) m_cameraPath.Append(frame);
+    UpdateFrame(frame, timeStep);
+}
+
+// Render the scene.
+void RTGranularity::OnRender()
+{
+    if (!m_isReplaying) RenderFrame();
+}
+
+void RTGranularity::OnDestroy()
+{
+    // Ensure that the GPU is no longer referencing resources that are about to be
+    // cleaned up by the destructor.
+    WaitForGpu();
+
+    CloseHandle(m_fenceEvent);
+
+    // Percentiles of the frame times by phase, and the camera path or the replay timings
+    m_frameRecorder.WriteCSV("FrameTimes.csv");
+    if (m_isReplaying) m_cameraReplay.WriteCSV("ReplayTimes.csv");
+    else if (!m_recordFileName.empty()) m_cameraPath.Save(m_recordFileName.c_str());
+}
+
+void RTGranularity::UpdateFrame(const CameraPath::Frame& frame, float timeStep)
+{
+    const auto maxTessFactor = static_cast<uint32_t>(m_rayTracers[m_mode]->GetMaxTessFactor());
+    m_eyePt = XMFLOAT3(frame.EyePt);
+    m_view = XMFLOAT4X4(frame.View);
+    m_tessFactor = (min)((max)(frame.TessFactor, static_cast<uint32_t>(MinTessFactor)), maxTessFactor);
+    m_isPaused = frame.IsPaused;
+    m_modelAngle += 16.0f * timeStep * XM_PI / 180.0f;
+
     // View
     const auto eyePt = XMLoadFloat3(&m_eyePt);
     const auto view = XMLoadFloat4x4(&m_view);
     const auto proj = XMLoadFloat4x4(&m_proj);
-    m_rayTracer->UpdateFrame(m_frameIndex, eyePt, view * proj, timeStep, m_tessFactor);
+    m_rayTracers[m_mode]->UpdateFrame(m_frameIndex, eyePt, view * proj, m_modelAngle, timeStep, m_tessFactor);
+    LogConvergence();
 }
 
-// Render the scene.
-void RTGranularity::OnRender()
+void RTGranularity::RenderFrame()
 {
     // Record all the commands we need to render the scene into the command list.
     PopulateCommandList();
 
     // Execute the command list.
     m_commandQueues[UNIVERSAL]->ExecuteCommandList(m_commandLists[UNIVERSAL].get());
+    m_frameRecorder.Lap(FrameRecorder::SUBMIT);
 
     // Present the frame.
     N_RETURN(m_swapChain->Present(0, 0), ThrowIfFailed(E_FAIL));
+    m_frameRecorder.Lap(FrameRecorder::PRESENT);
 
     MoveToNextFrame();
 }
 
-void RTGranularity::OnDestroy()
-{
-    // Ensure that the GPU is no longer referencing resources that are about to be
-    // cleaned up by the destructor.
-    WaitForGpu();
-
-    CloseHandle(m_fenceEvent);
-}
-
 // User hot-key interactions.
 void RTGranularity::OnKeyUp(uint8_t key)
 {
@@ -267,11 +365,24 @@ void RTGranularity::OnKeyUp(uint8_t key)
         m_isPaused = !m_isPaused;
         break;
     case VK_UP:
-        if (m_tessFactor < MaxTessFactor) m_tessFactor += 1;
+        if (m_tessFactor < m_rayTracers[m_mode]->GetMaxTessFactor()) m_tessFactor += 1;
         break;
     case VK_DOWN:
         if (m_tessFactor > MinTessFactor) m_tessFactor -= 1;
         break;
+    case 'P':
+        m_isProgressive = !m_isProgressive;
+        m_rayTracers[m_mode]->GetAccumulator()->SetEnabled(m_isProgressive);
+        break;
+    case 'R':
+        m_rayTracers[m_mode]->GetAccumulator()->CaptureReference();
+        break;
+    case 'C':
+        m_rayTracers[m_mode]->GetAccumulator()->Reset();
+        break;
+    case 'M':
+        SwitchRayTracer(static_cast<RayTracer::Mode>((m_mode + 1) % RayTracer::NUM_MODE));
+        break;
     }
 }
 
@@ -360,6 +471,56 @@ void RTGranularity::ParseCommandLineArgs(wchar_t* argv[], int argc)
         else if (_wcsnicmp(argv[i], L"-env", wcslen(argv[i])) == 0 ||
                  _wcsnicmp(argv[i], L"/env", wcslen(argv[i])) == 0)
             m_envFileName = i + 1 < argc ? argv[++i] : m_envFileName;
+        else if (_wcsnicmp(argv[i], L"-progressive", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/progressive", wcslen(argv[i])) == 0)
+            m_isProgressive = true;
+        else if (_wcsnicmp(argv[i], L"-refspp", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/refspp", wcslen(argv[i])) == 0)
+        {
+            if (i + 1 < argc && swscanf_s(argv[i + 1], L"%u", &m_numAutoRefSamples) == 1) ++i;
+        }
+        else if (_wcsnicmp(argv[i], L"-mode", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/mode", wcslen(argv[i])) == 0)
+        {
+            if (i + 1 < argc)
+            {
+                ++i;
+                if (_wcsicmp(argv[i], L"pixel") == 0) m_mode = RayTracer::PER_PIXEL;
+                else if (_wcsicmp(argv[i], L"vertex") == 0) m_mode = RayTracer::PER_VERTEX;
+                else if (_wcsicmp(argv[i], L"tessvertex") == 0) m_mode = RayTracer::PER_TESS_VERTEX;
+            }
+        }
+        else if (_wcsnicmp(argv[i], L"-record", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/record", wcslen(argv[i])) == 0)
+        {
+            if (i + 1 < argc)
+            {
+                m_recordFileName.resize(wcslen(argv[++i]));
+                for (size_t j = 0; j < m_recordFileName.size(); ++j)
+                    m_recordFileName[j] = static_cast<char>(argv[i][j]);
+            }
+        }
+        else if (_wcsnicmp(argv[i], L"-replay", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/replay", wcslen(argv[i])) == 0)
+        {
+            if (i + 1 < argc)
+            {
+                m_replayFileName.resize(wcslen(argv[++i]));
+                for (size_t j = 0; j < m_replayFileName.size(); ++j)
+                    m_replayFileName[j] = static_cast<char>(argv[i][j]);
+            }
+            if (i + 1 < argc && swscanf_s(argv[i + 1], L"%u", &m_numReplayFrames) == 1) ++i;
+        }
+        else if (_wcsnicmp(argv[i], L"-tessbudget", wcslen(argv[i])) == 0 ||
+                 _wcsnicmp(argv[i], L"/tessbudget", wcslen(argv[i])) == 0)
+        {
+            auto budgetMB = 0u;
+            if (i + 1 < argc && swscanf_s(argv[i + 1], L"%u", &budgetMB) == 1)
+            {
+                m_tessBufferBudget = static_cast<size_t>(budgetMB) << 20;
+                ++i;
+            }
+        }
     }
 }
 
@@ -383,8 +544,9 @@ void RTGranularity::PopulateCommandList()
     numBarriers = m_renderTargets[m_frameIndex]->SetBarrier(barriers, ResourceState::RENDER_TARGET);
 
     // Record commands.
-    m_rayTracer->UpdateAccelerationStructures(pCommandList, m_frameIndex);
-    m_rayTracer->Render(pCommandList, m_frameIndex, m_renderTargets[m_frameIndex]->GetRTV(), numBarriers, barriers);
+    const auto& rayTracer = m_rayTracers[m_mode];
+    rayTracer->UpdateAccelerationStructures(pCommandList, m_frameIndex);
+    rayTracer->Render(pCommandList, m_frameIndex, m_renderTargets[m_frameIndex]->GetRTV(), numBarriers, barriers);
 
     // Indicate that the back buffer will now be used to present.
     numBarriers = m_renderTargets[m_frameIndex]->SetBarrier(barriers, ResourceState::PRESENT);
@@ -398,10 +560,12 @@ void RTGranularity::WaitForGpu()
 {
     // Schedule a Signal command in the queue.
     N_RETURN(m_commandQueues[UNIVERSAL]->Signal(m_fence.get(), m_fenceValues[m_frameIndex]), ThrowIfFailed(E_FAIL));
+    m_frameRecorder.Lap(FrameRecorder::SUBMIT);
 
     // Wait until the fence has been processed, and increment the fence value for the current frame.
     N_RETURN(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex]++, m_fenceEvent), ThrowIfFailed(E_FAIL));
     WaitForSingleObject(m_fenceEvent, INFINITE);
+    m_frameRecorder.Lap(FrameRecorder::WAIT);
 }
 
 // Prepare to render the next frame.
@@ -410,6 +574,7 @@ void RTGranularity::MoveToNextFrame()
     // Schedule a Signal command in the queue.
     const auto currentFenceValue = m_fenceValues[m_frameIndex];
     N_RETURN(m_commandQueues[UNIVERSAL]->Signal(m_fence.get(), currentFenceValue), ThrowIfFailed(E_FAIL));
+    m_frameRecorder.Lap(FrameRecorder::SUBMIT);
 
     // Update the frame index.
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -420,11 +585,23 @@ void RTGranularity::MoveToNextFrame()
         N_RETURN(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent), ThrowIfFailed(E_FAIL));
         WaitForSingleObject(m_fenceEvent, INFINITE);
     }
+    m_frameRecorder.Lap(FrameRecorder::WAIT);
 
     // Set the fence value for the next frame.
     m_fenceValues[m_frameIndex] = currentFenceValue + 1;
 }
 
+CameraPath::Frame RTGranularity::GetCameraFrame() const
+{
+    CameraPath::Frame frame;
+    memcpy(frame.EyePt, &m_eyePt, sizeof(frame.EyePt));
+    memcpy(frame.View, &m_view, sizeof(frame.View));
+    frame.TessFactor = m_tessFactor;
+    frame.IsPaused = m_isPaused;
+
+    return frame;
+}
+
 double RTGranularity::CalculateFrameStats(float* pTimeStep)
 {
     static int frameCnt = 0;
@@ -444,9 +621,28 @@ double RTGranularity::CalculateFrameStats(float* pTimeStep)
         elapsedTime = totalTime;
 
         wstringstream windowText;
-        windowText << L"    type: "  << RayTracerTypeName;
+        const auto& rayTracer = m_rayTracers[m_mode];
+        windowText << L"    type: "  << RayTracer::GetModeName(m_mode);
         windowText << setprecision(2) << fixed << L"    fps: " << fps;
+        const auto& frameTimes = m_frameRecorder.GetHistogram(FrameRecorder::FRAME);
+        windowText << L"    frame p50/p99: " << frameTimes.GetPercentile(50.0) << L" / " <<
+            frameTimes.GetPercentile(99.0) << L" ms";
         windowText << L"    tessellation factor: " << m_tessFactor;
+        if (rayTracer->GetNumVerts() > 0)
+            windowText << L"    shaded vertices: " << 100.0f * rayTracer->GetNumVisibleVerts() / rayTracer->GetNumVerts() << L"%";
+        if (rayTracer->GetTessBufferBudget() > 0)
+            windowText << L"    tessellation buffers: " << rayTracer->GetTessBufferSize() / 1048576.0f << L" / "
+                << rayTracer->GetTessBufferBudget() / 1048576.0f << L" MB";
+        if (m_switchTime > 0.0) windowText << L"    last switch: " << m_switchTime << L" ms";
+
+        const auto pAccumulator = rayTracer->GetAccumulator();
+        if (pAccumulator->IsEnabled())
+        {
+            windowText << L"    spp: " << pAccumulator->GetNumSamples();
+            if (pAccumulator->HasReference())
+                windowText << setprecision(5) << L"    RMSE: " << pAccumulator->GetRMSE()
+                    << L" (ref. " << pAccumulator->GetNumReferenceSamples() << L" spp)";
+        }
         SetCustomWindowText(windowText.str().c_str());
     }
 
@@ -456,6 +652,32 @@ double RTGranularity::CalculateFrameStats(float* pTimeStep)
     return totalTime;
 }
 
+// Append each new error measurement of the progressive accumulation,
+// so that the convergence curve can be plotted afterwards.
+void RTGranularity::LogConvergence()
+{
+    const auto pAccumulator = m_rayTracers[m_mode]->GetAccumulator();
+    const auto numSamples = pAccumulator->GetNumMeasuredSamples();
+    if (numSamples == 0)
+    {
+        // No reference for the current image; the next measurement starts a new series.
+        m_numLoggedSamples = 0;
+        return;
+    }
+    if (numSamples == m_numLoggedSamples) return;
+
+    if (!m_convergenceLog.is_open())
+    {
+        m_convergenceLog.open("Convergence.csv");
+        m_convergenceLog << L"type,tessellation factor,reference spp,spp,rmse" << endl;
+    }
+
+    m_convergenceLog << RayTracer::GetModeName(m_mode) << L"," << m_tessFactor << L"," <<
+        pAccumulator->GetNumReferenceSamples() << L"," << numSamples << L"," <<
+        pAccumulator->GetRMSE() << endl;
+    m_numLoggedSamples = numSamples;
+}
+
 //--------------------------------------------------------------------------------------
 // Ray tracing
 //--------------------------------------------------------------------------------------
@@ -13,7 +13,8 @@
 
 #include "DXFramework.h"
 #include "StepTimer.h"
-#include "RayTracerSelection.h"
+#include "CameraPath.h"
+#include "RayTracer.h"
 
 using namespace DirectX;
 
@@ -23,7 +24,7 @@ using namespace DirectX;
 // referenced by the GPU.
 // An example of this can be found in the class method: OnDestroy().
 
-class RTGranularity : public DXFramework
+class RTGranularity : public DXFramework, public CameraReplay::Backend
 {
 public:
     RTGranularity(uint32_t width, uint32_t height, std::wstring name);
@@ -43,6 +44,10 @@ public:
 
     virtual void ParseCommandLineArgs(wchar_t* argv[], int argc);
 
+    // Applies a frame of the camera path, recorded or replayed, and renders it
+    virtual void UpdateFrame(const CameraPath::Frame& frame, float timeStep);
+    virtual void RenderFrame();
+
 private:
     enum CommandType : uint8_t
     {
@@ -63,7 +68,6 @@ private:
 
     static const auto FrameCount = RayTracer::FrameCount;
     static const auto MinTessFactor = RayTracer::MinTessFactor;
-    static const auto MaxTessFactor = RayTracer::MaxTessFactor;
 
     // Pipeline objects.
     XUSG::Viewport                  m_viewport;
@@ -80,12 +84,22 @@ private:
     XUSG::RayTracing::CommandList::uptr m_commandLists[COMMAND_TYPE_COUNT];
 
     // App resources.
-    std::unique_ptr<RayTracer>  m_rayTracer;
+    RayTracer::SceneAssets      m_sceneAssets;
+    std::unique_ptr<RayTracer>  m_rayTracers[RayTracer::NUM_MODE];  // Created on first use, then kept
+    RayTracer::Mode             m_mode;
+    double                      m_switchTime;   // Of the last switch, in ms, including the backend creation
     XMFLOAT4X4                  m_proj;
     XMFLOAT4X4                  m_view;
     XMFLOAT3                    m_focusPt;
     XMFLOAT3                    m_eyePt;
     uint32_t                    m_tessFactor;
+    float                       m_modelAngle;   // Rotation of the model about Y, in radians
+
+    // Progressive accumulation
+    bool                        m_isProgressive;
+    uint32_t                    m_numAutoRefSamples;    // 0 to capture the reference only with 'R'
+    uint32_t                    m_numLoggedSamples;
+    std::wofstream              m_convergenceLog;
 
     // Synchronization objects.
     uint8_t                     m_frameIndex;
@@ -96,8 +110,17 @@ private:
     XUSG::Semaphore             m_semaphore;
 
     // Application state
-    bool        m_isPaused;
-    StepTimer   m_timer;
+    bool            m_isPaused;
+    StepTimer       m_timer;
+    FrameRecorder   m_frameRecorder;
+
+    // Camera path, recorded each frame or replayed at a fixed time step
+    CameraPath      m_cameraPath;
+    CameraReplay    m_cameraReplay;
+    bool            m_isReplaying;
+    uint32_t        m_numReplayFrames;  // 0 to play the path once
+    std::string     m_recordFileName;
+    std::string     m_replayFileName;
 
     // User camera interactions
     bool        m_tracking;
@@ -107,13 +130,18 @@ private:
     std::wstring    m_envFileName;
     std::string     m_meshFileName;
     XMFLOAT4        m_meshPosScale;
+    size_t          m_tessBufferBudget;
 
     void LoadPipeline();
     void LoadAssets();
+    void CreateRayTracer(XUSG::RayTracing::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
+    void SwitchRayTracer(RayTracer::Mode mode);
     void PopulateCommandList();
     void WaitForGpu();
     void MoveToNextFrame();
     double CalculateFrameStats(float* fTimeStep = nullptr);
+    CameraPath::Frame GetCameraFrame() const;
+    void LogConvergence();
 
     // Ray tracing
     void EnableDirectXRaytracing(IDXGIAdapter1* adapter);;
@@ -42,6 +42,8 @@
 #include <unordered_map>
 #endif
 #include <functional>
+#include <chrono>
+#include <atomic>
 #include <wrl.h>
 #include <shellapi.h>
 